@@ -0,0 +1,90 @@
+/**
+ * codesift cold-start benchmarks
+ *
+ * Each sample is a fresh process, so every run pays module load, base64
+ * decode, WebAssembly compile and instantiate from scratch — what a CLI
+ * invocation or serverless cold start sees. Resident memory is sampled
+ * after the first call; the per-language rows compare the full engine with
+ * the JavaScript-only build from dist/.
+ *
+ * Run: bun bench/cold-start.ts
+ */
+
+import { spawnSync } from "node:child_process";
+import { existsSync, mkdtempSync, rmSync } from "node:fs";
+import { tmpdir } from "node:os";
+import { join } from "node:path";
+import { formatNs } from "./utils.js";
+
+const ENTRY = new URL("../src/js/index.ts", import.meta.url).pathname;
+const JS_ENGINE = new URL("../dist/engine-javascript.wasm", import.meta.url);
+const RUNS = 15;
+
+interface Sample {
+  importMs: number;
+  firstCallMs: number;
+  totalMs: number;
+  rssMb: number;
+}
+
+/** Child script: time the import, the optional init, and the first match. */
+function script(setup: string): string {
+  return `
+    const t0 = performance.now();
+    const m = await import(${JSON.stringify(ENTRY)});
+    const t1 = performance.now();
+    ${setup}
+    m.structMatch("eval($X)", "eval(input)", "javascript");
+    const t2 = performance.now();
+    const rssMb = process.memoryUsage().rss / 2 ** 20;
+    console.log(JSON.stringify({ importMs: t1 - t0, firstCallMs: t2 - t1, totalMs: t2, rssMb }));
+  `;
+}
+
+function sample(code: string): Sample {
+  const res = spawnSync(process.execPath, ["-e", code], { encoding: "utf8" });
+  if (res.status !== 0) throw new Error(res.stderr || `child exited with ${res.status}`);
+  return JSON.parse(res.stdout.trim().split("\n").pop()!);
+}
+
+function median(xs: number[]): number {
+  const s = [...xs].sort((a, b) => a - b);
+  return s[Math.floor(s.length / 2)];
+}
+
+function run(name: string, code: string, before?: () => void): void {
+  const samples: Sample[] = [];
+  for (let i = 0; i < RUNS; i++) {
+    before?.();
+    samples.push(sample(code));
+  }
+  const ms = (f: (s: Sample) => number) => formatNs(median(samples.map(f)) * 1e6).padStart(10);
+  const rss = median(samples.map(s => s.rssMb)).toFixed(1).padStart(6);
+  console.log(`  ${name.padEnd(34)} import ${ms(s => s.importMs)}  first call ${ms(s => s.firstCallMs)}  since start ${ms(s => s.totalMs)}  rss ${rss} MB`);
+}
+
+console.log("codesift cold start (median of", RUNS, "fresh processes)");
+console.log("=".repeat(92));
+
+const cacheDir = mkdtempSync(join(tmpdir(), "codesift-bench-"));
+try {
+  run("lazy (sync instantiate on 1st call)", script(""));
+  run("await init()", script("await m.init();"));
+  run("await init({ cache }) — cold cache", script(`await m.init({ cache: ${JSON.stringify(cacheDir)} });`),
+    () => rmSync(cacheDir, { recursive: true, force: true }));
+  run("await init({ cache }) — warm cache", script(`await m.init({ cache: ${JSON.stringify(cacheDir)} });`));
+  if (existsSync(JS_ENGINE)) {
+    run("await init() — full engine.wasm", script(`await m.init({ wasmUrl: ${JSON.stringify(JS_ENGINE.href.replace("engine-javascript", "engine"))} });`));
+    run("await init() — engine-javascript", script(`await m.init({ wasmUrl: ${JSON.stringify(JS_ENGINE.href)} });`));
+  } else {
+    console.log("  (dist/engine-javascript.wasm not built; skipping per-language rows)");
+  }
+  run("import only (no engine use)", `
+    const t0 = performance.now();
+    await import(${JSON.stringify(ENTRY)});
+    const t1 = performance.now();
+    console.log(JSON.stringify({ importMs: t1 - t0, firstCallMs: 0, totalMs: t1, rssMb: process.memoryUsage().rss / 2 ** 20 }));
+  `);
+} finally {
+  rmSync(cacheDir, { recursive: true, force: true });
+}
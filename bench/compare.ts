@@ -11,7 +11,7 @@
  * Run: bun bench/compare.ts
  */
 
-import * as codesift from "../src/js/ts/index.js";
+import * as codesift from "../src/js/index.js";
 import { encodeRules } from "../src/js/encoder.js";
 import { parse, Lang } from "@ast-grep/napi";
 import { bench, formatOps, formatNs, SMALL_SOURCE, MEDIUM_SOURCE, LARGE_SOURCE, type BenchResult } from "./utils.js";
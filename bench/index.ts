@@ -2,7 +2,8 @@
  * codesift benchmarks
  *
  * Measures throughput of core operations: pattern matching, scanner reuse,
- * compiled pattern reuse, tree traversal, rule engine, and slot operations.
+ * compiled pattern reuse, tree traversal, rule engine, slot operations, the
+ * tree-sitter query backend against the structural matcher, and batch apply.
  *
  * Run: bun bench/index.ts
  */
@@ -18,7 +19,7 @@ import {
   filterInside,
   freeMatches,
   SgNode,
-} from "../src/js/ts/index.js";
+} from "../src/js/index.js";
 import { encodeRules } from "../src/js/encoder.js";
 import type { RuleDefinition } from "../src/js/types.js";
 import { bench, formatOps, formatNs, SMALL_SOURCE, MEDIUM_SOURCE, LARGE_SOURCE, type BenchResult } from "./utils.js";
@@ -222,7 +223,57 @@ console.log("=".repeat(68));
   scanner.free();
 }
 
-// 9. Throughput summary
+// 9. Query backend vs structural matcher
+{
+  const scanner = createScanner(LARGE_SOURCE, "javascript");
+  const evalQuery = `((call_expression function: (identifier) @_f arguments: (arguments . (_) .)) @match (#eq? @_f "eval"))`;
+  const patterns = ["eval($X)", "setTimeout($F, $T)", "console.log($MSG)", "$OBJ.innerHTML = $V", "new Function($BODY)", "document.write($X)"];
+
+  const queryRules: RuleDefinition[] = patterns.map((pattern, i) => ({
+    id: `p${i}`,
+    language: "javascript",
+    severity: "warning",
+    message: pattern,
+    rule: { pattern },
+  }));
+  const ruleset = loadRules(encodeRules(queryRules));
+
+  const results = [
+    bench("eval($X), structural walk", () => { scanner.match("eval($X)"); }, 500),
+    bench("eval($X), raw query", () => { scanner.query(evalQuery); }, 500),
+    bench("kind call_expression, walk", () => { scanner.matchKind("call_expression"); }, 500),
+    bench("kind call_expression, query", () => { scanner.query("(call_expression) @match"); }, 500),
+    bench(`${patterns.length} patterns, one walk each`, () => { for (const p of patterns) scanner.match(p); }, 100),
+    bench(`${patterns.length} patterns, ruleset (one query pass)`, () => { ruleset.apply(scanner); }, 100),
+  ];
+  printResults("query backend vs structural matcher (5KB)", results);
+
+  ruleset.free();
+  scanner.free();
+}
+
+// 10. Batch apply vs one call per file
+{
+  const rules: RuleDefinition[] = ["eval($X)", "$OBJ.innerHTML = $V", "setTimeout($F, $T)"].map((pattern, i) => ({
+    id: `b${i}`,
+    language: "javascript",
+    severity: "warning",
+    message: pattern,
+    rule: { pattern },
+  }));
+  const ruleset = loadRules(encodeRules(rules));
+  const sources = Array.from({ length: 200 }, (_, i) => ({ source: `${SMALL_SOURCE}\n// file ${i}`, lang: "javascript" as const }));
+
+  const results = [
+    bench(`${sources.length} small files, applySource each`, () => { for (const s of sources) ruleset.applySource(s.source, s.lang); }, 20),
+    bench(`${sources.length} small files, applyMany`, () => { ruleset.applyMany(sources); }, 20),
+  ];
+  printResults("batch apply (small files)", results);
+
+  ruleset.free();
+}
+
+// 11. Throughput summary
 {
   console.log(`\n── Throughput summary ${"─".repeat(47)}`);
 
@@ -0,0 +1,63 @@
+/**
+ * codesift worker pool scaling
+ *
+ * Scans a real tree with createPool() at 1, 2, 4, … 32 workers and prints
+ * files/s and speedup over one worker. Worker startup (engine instantiate,
+ * ruleset load) is excluded: each size warms up with one scan first.
+ *
+ * Run: bun bench/pool.ts [dir]   (default: node_modules, else .)
+ */
+
+import * as fs from "node:fs";
+import * as path from "node:path";
+import { availableParallelism } from "node:os";
+import { encodeRules } from "../src/js/encoder.js";
+import { createPool } from "../src/js/pool.js";
+import type { RuleDefinition } from "../src/js/types.js";
+
+const EXTENSIONS = new Set([".js", ".mjs", ".cjs", ".ts", ".tsx"]);
+const SIZES = [1, 2, 4, 8, 16, 32];
+
+function walk(dir: string, out: string[]): string[] {
+  for (const entry of fs.readdirSync(dir, { withFileTypes: true })) {
+    if (entry.name === ".git") continue;
+    const full = path.join(dir, entry.name);
+    if (entry.isDirectory()) walk(full, out);
+    else if (entry.isFile() && EXTENSIONS.has(path.extname(entry.name))) out.push(full);
+  }
+  return out;
+}
+
+const root = process.argv[2] ?? (fs.existsSync("node_modules") ? "node_modules" : ".");
+const files = walk(root, []);
+const bytes = files.reduce((n, f) => n + fs.statSync(f).size, 0);
+
+const rules: RuleDefinition[] = ["eval($X)", "$OBJ.innerHTML = $V", "new Function($$$ARGS)", "setTimeout($F, $T)", "document.write($X)"].map((pattern, i) => ({
+  id: `r${i}`,
+  language: "javascript",
+  severity: "warning",
+  message: pattern,
+  rule: { pattern },
+}));
+const bytecode = encodeRules(rules);
+
+console.log(`codesift pool scaling: ${files.length} files, ${(bytes / 2 ** 20).toFixed(1)} MB under ${root}`);
+console.log(`available parallelism: ${availableParallelism()}\n`);
+console.log(`  ${"workers".padStart(7)}  ${"time".padStart(10)}  ${"files/s".padStart(10)}  ${"speedup".padStart(7)}`);
+
+let baseline = 0;
+for (const size of SIZES) {
+  const pool = createPool({ size, rules: bytecode });
+  try {
+    for await (const _ of pool.scan(files.slice(0, size * 4)));
+    const start = performance.now();
+    let findings = 0;
+    for await (const r of pool.scan(files)) findings += r.findings.length;
+    const ms = performance.now() - start;
+    baseline ||= ms;
+    const rate = (files.length / ms) * 1000;
+    console.log(`  ${String(size).padStart(7)}  ${`${ms.toFixed(0)} ms`.padStart(10)}  ${rate.toFixed(0).padStart(10)}  ${`${(baseline / ms).toFixed(2)}x`.padStart(7)}   (${findings} findings)`);
+  } finally {
+    await pool.close();
+  }
+}
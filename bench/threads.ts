@@ -0,0 +1,72 @@
+/**
+ * codesift threaded engine scaling
+ *
+ * Applies a ruleset to one large generated bundle with createThreadedRuleset()
+ * at 1, 2, 4, 8 and 16 threads, and prints the apply time and speedup over
+ * one thread. The parse runs once per apply on the calling thread and is
+ * included; thread startup is not.
+ *
+ * Run: bun bench/threads.ts   (needs dist/engine-threads.wasm: bun run build:zig)
+ */
+
+import { availableParallelism } from "node:os";
+import { encodeRules } from "../src/js/encoder.js";
+import { createThreadedRuleset } from "../src/js/threads.js";
+import type { RuleDefinition } from "../src/js/types.js";
+
+const SIZES = [1, 2, 4, 8, 16];
+const ROUNDS = 5;
+const wasmUrl = new URL("../dist/engine-threads.wasm", import.meta.url);
+
+const patterns = [
+  "eval($X)", "$OBJ.innerHTML = $V", "new Function($$$ARGS)", "setTimeout($F, $T)", "document.write($X)",
+  "console.log($$$ARGS)", "$A == $B", "JSON.parse($X)", "fetch($URL)", "$X.then($F)",
+  "require($M)", "Object.assign($$$ARGS)", "$ARR.forEach($F)", "localStorage.setItem($K, $V)", "new Promise($F)",
+  "parseInt($X)",
+];
+const rules: RuleDefinition[] = patterns.map((pattern, i) => ({
+  id: `r${i}`,
+  language: "javascript",
+  severity: "warning",
+  message: pattern,
+  rule: { pattern },
+}));
+
+// A bundle-like file: many small modules concatenated.
+const chunk = `
+function module_@(exports, require) {
+  const dep = require("./dep_@");
+  const data = JSON.parse(localStorage.getItem("k_@") || "{}");
+  if (data.count == null) data.count = parseInt("0");
+  [1, 2, 3].forEach(x => console.log("item", x, dep));
+  fetch("/api/@").then(r => r.json()).then(j => Object.assign(data, j));
+  setTimeout(() => document.write("<p>" + data.count + "</p>"), 10);
+  el.innerHTML = data.html;
+  return new Promise(resolve => resolve(eval(data.expr)));
+}
+`;
+const source = Array.from({ length: 4000 }, (_, i) => chunk.replaceAll("@", String(i))).join("");
+
+console.log(`codesift threaded engine: ${rules.length} rules over one ${(source.length / 2 ** 20).toFixed(1)} MB file`);
+console.log(`available parallelism: ${availableParallelism()}\n`);
+console.log(`  ${"threads".padStart(7)}  ${"apply".padStart(10)}  ${"speedup".padStart(7)}`);
+
+const bytecode = encodeRules(rules);
+let baseline = 0;
+for (const threads of SIZES) {
+  const threaded = await createThreadedRuleset({ rules: bytecode, threads, wasmUrl });
+  try {
+    await threaded.apply(source, "javascript");
+    let best = Infinity;
+    let findings = 0;
+    for (let r = 0; r < ROUNDS; r++) {
+      const start = performance.now();
+      findings = (await threaded.apply(source, "javascript")).length;
+      best = Math.min(best, performance.now() - start);
+    }
+    baseline ||= best;
+    console.log(`  ${String(threads).padStart(7)}  ${`${best.toFixed(1)} ms`.padStart(10)}  ${`${(baseline / best).toFixed(2)}x`.padStart(7)}   (${findings} findings)`);
+  } finally {
+    await threaded.close();
+  }
+}
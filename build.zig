@@ -1,5 +1,110 @@
 const std = @import("std");
 
+/// Grammars linked into an engine build. Each grammar's parse tables are a
+/// large share of the binary (TypeScript by far the largest), so JS-only
+/// deployments can ship an engine without the TypeScript grammar.
+const Grammars = struct {
+    javascript: bool = true,
+    typescript: bool = true,
+};
+
+/// Symbols exported from every engine build.
+const engine_exports: []const []const u8 = &.{
+    "alloc",
+    "dealloc",
+    "context_create",
+    "context_free",
+    "struct_match",
+    "struct_count",
+    "get_result_ptr",
+    "get_result_len",
+    "compile_pattern",
+    "pattern_prefilter",
+    "pattern_literals",
+    "match_pattern",
+    "free_pattern",
+    "pattern_cache_stats",
+    "compile_source",
+    "compile_source_owned",
+    "get_source_ptr",
+    "get_source_len",
+    "match_compiled",
+    "count_compiled",
+    "free_source",
+    "get_parse_status",
+    // Match slot system
+    "store_matches",
+    "filter_inside",
+    "filter_not_inside",
+    "filter_not",
+    "intersect_matches",
+    "free_matches",
+    // Kind matching
+    "kind_match",
+    // Range-constrained matching
+    "match_in_range",
+    "match_node",
+    // Sibling matching
+    "match_preceding",
+    "match_following",
+    // Tree traversal
+    "node_root",
+    "node_info",
+    "node_at",
+    "node_child",
+    "node_kind_table",
+    "node_children",
+    "node_parent",
+    "node_field_child",
+    "node_next",
+    "node_prev",
+    "node_dump",
+    // Query backend
+    "query_source",
+    "get_query_error_offset",
+    "pattern_query",
+    // Rule engine
+    "load_ruleset",
+    "apply_ruleset",
+    "count_ruleset",
+    "ruleset_prefilter",
+    "apply_ruleset_prefiltered",
+    "apply_ruleset_partition",
+    "prepare_partitions",
+    "apply_ruleset_many",
+    "free_ruleset",
+    "get_ruleset_result_ptr",
+    "get_ruleset_result_len",
+    // Incremental re-evaluation
+    "edit_source",
+    "apply_ruleset_incremental",
+    // Resumable evaluation
+    "apply_ruleset_step",
+    // Grammar registry
+    "has_language",
+    // Flattened tree snapshots
+    "snapshot_source",
+    "get_batch_snapshots",
+    // Content hashing
+    "hash_bytes",
+};
+
+/// Extra symbols the threaded engine exports so the host can give each
+/// worker thread its own stack (__stack_pointer) and thread-local block
+/// (__wasm_init_tls with __tls_size bytes at __tls_align).
+const thread_exports: []const []const u8 = &.{
+    "__stack_pointer",
+    "__tls_size",
+    "__tls_align",
+    "__wasm_init_tls",
+};
+
+/// Linear memory of the threaded engine, imported as env.memory. A shared
+/// memory cannot be resized past its declared maximum, so both are fixed
+/// here; src/js/threads.ts creates the memory with the same limits.
+const threads_initial_memory = 64 << 20;
+const threads_max_memory = 1 << 30;
+
 pub fn build(b: *std.Build) void {
     const optimize = b.standardOptimizeOption(.{});
 
@@ -14,18 +119,137 @@ pub fn build(b: *std.Build) void {
         }),
     });
 
-    // --- Main WASM engine library ---
+    // Threaded builds need atomics for the shared memory and its locks.
+    const wasm_threads_target = b.resolveTargetQuery(.{
+        .cpu_arch = .wasm32,
+        .os_tag = .freestanding,
+        .cpu_features_add = std.Target.wasm.featureSet(&.{
+            .simd128,
+            .bulk_memory,
+            .sign_ext,
+            .mutable_globals,
+            .atomics,
+        }),
+    });
+
+    // --- Main WASM engine (all grammars) ---
+    const engine = addEngine(b, "engine", wasm_target, optimize, .{}, false);
+
+    // Install to zig-out/bin/engine.wasm
+    b.installArtifact(engine);
+
+    // --- Copy to dist/ for convenience ---
+    const install_dist = b.addInstallFile(engine.getEmittedBin(), "../dist/engine.wasm");
+    b.getInstallStep().dependOn(&install_dist.step);
+
+    // --- JavaScript-only engine (no TypeScript parse tables) ---
+    const engine_js = addEngine(b, "engine-javascript", wasm_target, optimize, .{ .typescript = false }, false);
+    b.installArtifact(engine_js);
+    const install_dist_js = b.addInstallFile(engine_js.getEmittedBin(), "../dist/engine-javascript.wasm");
+    b.getInstallStep().dependOn(&install_dist_js.step);
+
+    // --- Threaded engine (shared memory; rules split across worker threads) ---
+    const engine_threads = addEngine(b, "engine-threads", wasm_threads_target, optimize, .{}, true);
+    b.installArtifact(engine_threads);
+    const install_dist_threads = b.addInstallFile(engine_threads.getEmittedBin(), "../dist/engine-threads.wasm");
+    b.getInstallStep().dependOn(&install_dist_threads.step);
+
+    // --- Tests (native target for unit testing) ---
+    const test_target = b.standardTargetOptions(.{});
+    const unit_tests = b.addTest(.{
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/zig/main.zig"),
+            .target = test_target,
+            .optimize = optimize,
+        }),
+    });
+
+    // Tests link every grammar so all languages are exercised.
+    unit_tests.root_module.addOptions("build_options", grammarOptions(b, .{}));
+
+    // Vendored regex module for tests (native target)
+    unit_tests.root_module.addImport("regex", b.createModule(.{
+        .root_source_file = b.path("vendor/regex/regex.zig"),
+        .target = test_target,
+        .optimize = optimize,
+    }));
+
+    // Link libc for tree-sitter @cImport on native targets
+    unit_tests.linkLibC();
+
+    // tree-sitter C sources for native test builds
+    const test_c_flags: []const []const u8 = &.{
+        "-std=c11",
+        "-D_GNU_SOURCE",
+        "-UTREE_SITTER_FEATURE_WASM",
+        "-DNDEBUG",
+    };
+
+    unit_tests.addCSourceFile(.{
+        .file = b.path("vendor/tree-sitter/runtime/lib/src/lib.c"),
+        .flags = test_c_flags,
+    });
+    unit_tests.addCSourceFile(.{
+        .file = b.path("vendor/tree-sitter/javascript/src/parser.c"),
+        .flags = test_c_flags,
+    });
+    unit_tests.addCSourceFile(.{
+        .file = b.path("vendor/tree-sitter/javascript/src/scanner.c"),
+        .flags = test_c_flags,
+    });
+    unit_tests.addCSourceFile(.{
+        .file = b.path("vendor/tree-sitter/typescript/typescript/src/parser.c"),
+        .flags = test_c_flags,
+    });
+    unit_tests.addCSourceFile(.{
+        .file = b.path("vendor/tree-sitter/typescript/typescript/src/scanner.c"),
+        .flags = test_c_flags,
+    });
+
+    // C include paths for tree-sitter headers
+    unit_tests.addIncludePath(b.path("vendor/tree-sitter/runtime/lib/include"));
+    unit_tests.addIncludePath(b.path("vendor/tree-sitter/runtime/lib/src"));
+    // TypeScript scanner includes ../../common/scanner.h relative to its source;
+    // common/scanner.h then includes "tree_sitter/parser.h" which lives under
+    // typescript/typescript/src/tree_sitter/.
+    unit_tests.addIncludePath(b.path("vendor/tree-sitter/typescript"));
+    unit_tests.addIncludePath(b.path("vendor/tree-sitter/typescript/typescript/src"));
+
+    const run_tests = b.addRunArtifact(unit_tests);
+    const test_step = b.step("test", "Run unit tests");
+    test_step.dependOn(&run_tests.step);
+}
+
+/// `build_options` module telling grammars.zig which grammars are linked.
+fn grammarOptions(b: *std.Build, grammars: Grammars) *std.Build.Step.Options {
+    const options = b.addOptions();
+    options.addOption(bool, "javascript", grammars.javascript);
+    options.addOption(bool, "typescript", grammars.typescript);
+    return options;
+}
+
+fn addEngine(
+    b: *std.Build,
+    name: []const u8,
+    wasm_target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+    grammars: Grammars,
+    threads: bool,
+) *std.Build.Step.Compile {
     const engine = b.addExecutable(.{
-        .name = "engine",
+        .name = name,
         .root_module = b.createModule(.{
             .root_source_file = b.path("src/zig/main.zig"),
             .target = wasm_target,
             .optimize = optimize,
             .strip = true,
             .unwind_tables = .none,
+            .single_threaded = !threads,
         }),
     });
 
+    engine.root_module.addOptions("build_options", grammarOptions(b, grammars));
+
     // Vendored regex module (from metal0/packages/regex)
     engine.root_module.addImport("regex", b.createModule(.{
         .root_source_file = b.path("vendor/regex/regex.zig"),
@@ -36,48 +260,18 @@ pub fn build(b: *std.Build) void {
     // WASM-specific settings
     engine.entry = .disabled;
     engine.rdynamic = true;
-    engine.root_module.export_symbol_names = &.{
-        "alloc",
-        "dealloc",
-        "struct_match",
-        "get_result_ptr",
-        "get_result_len",
-        "compile_pattern",
-        "match_pattern",
-        "free_pattern",
-        "compile_source",
-        "match_compiled",
-        "free_source",
-        // Match slot system
-        "store_matches",
-        "filter_inside",
-        "filter_not_inside",
-        "filter_not",
-        "intersect_matches",
-        "free_matches",
-        // Kind matching
-        "kind_match",
-        // Range-constrained matching
-        "match_in_range",
-        // Sibling matching
-        "match_preceding",
-        "match_following",
-        // Tree traversal
-        "node_root",
-        "node_info",
-        "node_children",
-        "node_named_children",
-        "node_parent",
-        "node_field_child",
-        "node_next",
-        "node_prev",
-        // Rule engine
-        "load_ruleset",
-        "apply_ruleset",
-        "free_ruleset",
-        "get_ruleset_result_ptr",
-        "get_ruleset_result_len",
-    };
+    engine.root_module.export_symbol_names = engine_exports;
+
+    // Every thread instantiates the module against one shared memory; the
+    // linker initializes data segments once, and threadlocal scratch state
+    // lives in per-thread TLS blocks.
+    if (threads) {
+        engine.import_memory = true;
+        engine.shared_memory = true;
+        engine.initial_memory = threads_initial_memory;
+        engine.max_memory = threads_max_memory;
+        engine.root_module.export_symbol_names = engine_exports ++ thread_exports;
+    }
 
     // --- C source compilation (tree-sitter + dlmalloc) ---
     //
@@ -113,24 +307,28 @@ pub fn build(b: *std.Build) void {
     });
 
     // JavaScript grammar (ES2024 + JSX)
-    engine.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/javascript/src/parser.c"),
-        .flags = c_flags,
-    });
-    engine.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/javascript/src/scanner.c"),
-        .flags = c_flags,
-    });
+    if (grammars.javascript) {
+        engine.addCSourceFile(.{
+            .file = b.path("vendor/tree-sitter/javascript/src/parser.c"),
+            .flags = c_flags,
+        });
+        engine.addCSourceFile(.{
+            .file = b.path("vendor/tree-sitter/javascript/src/scanner.c"),
+            .flags = c_flags,
+        });
+    }
 
     // TypeScript grammar (full TS + TSX)
-    engine.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/typescript/typescript/src/parser.c"),
-        .flags = c_flags,
-    });
-    engine.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/typescript/typescript/src/scanner.c"),
-        .flags = c_flags,
-    });
+    if (grammars.typescript) {
+        engine.addCSourceFile(.{
+            .file = b.path("vendor/tree-sitter/typescript/typescript/src/parser.c"),
+            .flags = c_flags,
+        });
+        engine.addCSourceFile(.{
+            .file = b.path("vendor/tree-sitter/typescript/typescript/src/scanner.c"),
+            .flags = c_flags,
+        });
+    }
 
     // dlmalloc for wasm32-freestanding (provides malloc/free/calloc/realloc)
     engine.addCSourceFile(.{
@@ -148,72 +346,5 @@ pub fn build(b: *std.Build) void {
     engine.addIncludePath(b.path("vendor/tree-sitter/typescript"));
     engine.addIncludePath(b.path("vendor/tree-sitter/typescript/typescript/src"));
 
-    // Install to zig-out/bin/engine.wasm
-    b.installArtifact(engine);
-
-    // --- Copy to dist/ for convenience ---
-    const install_dist = b.addInstallFile(engine.getEmittedBin(), "../dist/engine.wasm");
-    b.getInstallStep().dependOn(&install_dist.step);
-
-    // --- Tests (native target for unit testing) ---
-    const test_target = b.standardTargetOptions(.{});
-    const unit_tests = b.addTest(.{
-        .root_module = b.createModule(.{
-            .root_source_file = b.path("src/zig/main.zig"),
-            .target = test_target,
-            .optimize = optimize,
-        }),
-    });
-
-    // Vendored regex module for tests (native target)
-    unit_tests.root_module.addImport("regex", b.createModule(.{
-        .root_source_file = b.path("vendor/regex/regex.zig"),
-        .target = test_target,
-        .optimize = optimize,
-    }));
-
-    // Link libc for tree-sitter @cImport on native targets
-    unit_tests.linkLibC();
-
-    // tree-sitter C sources for native test builds
-    const test_c_flags: []const []const u8 = &.{
-        "-std=c11",
-        "-D_GNU_SOURCE",
-        "-UTREE_SITTER_FEATURE_WASM",
-        "-DNDEBUG",
-    };
-
-    unit_tests.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/runtime/lib/src/lib.c"),
-        .flags = test_c_flags,
-    });
-    unit_tests.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/javascript/src/parser.c"),
-        .flags = test_c_flags,
-    });
-    unit_tests.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/javascript/src/scanner.c"),
-        .flags = test_c_flags,
-    });
-    unit_tests.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/typescript/typescript/src/parser.c"),
-        .flags = test_c_flags,
-    });
-    unit_tests.addCSourceFile(.{
-        .file = b.path("vendor/tree-sitter/typescript/typescript/src/scanner.c"),
-        .flags = test_c_flags,
-    });
-
-    // C include paths for tree-sitter headers
-    unit_tests.addIncludePath(b.path("vendor/tree-sitter/runtime/lib/include"));
-    unit_tests.addIncludePath(b.path("vendor/tree-sitter/runtime/lib/src"));
-    // TypeScript scanner includes ../../common/scanner.h relative to its source;
-    // common/scanner.h then includes "tree_sitter/parser.h" which lives under
-    // typescript/typescript/src/tree_sitter/.
-    unit_tests.addIncludePath(b.path("vendor/tree-sitter/typescript"));
-    unit_tests.addIncludePath(b.path("vendor/tree-sitter/typescript/typescript/src"));
-
-    const run_tests = b.addRunArtifact(unit_tests);
-    const test_step = b.step("test", "Run unit tests");
-    test_step.dependOn(&run_tests.step);
+    return engine;
 }
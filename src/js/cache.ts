@@ -0,0 +1,134 @@
+import * as fs from "node:fs";
+import * as path from "node:path";
+import { engineVersion, hashBytes } from "./index.js";
+import { detectLanguage, type Finding, type Language } from "./types.js";
+
+// ── Scan cache ───────────────────────────────────────────
+//
+// `codesift scan --cache <dir>` keeps each file's findings between runs,
+// keyed by the XXH3 of its content, the language it is parsed as, the
+// ruleset bytecode and the engine build. Keys are content hashes, so
+// identical files anywhere in the tree (or in another checkout) share one
+// entry, unless their extensions differ: the same bytes can parse
+// differently as .ts and .tsx. The directory holds:
+//
+//   files.json                  path → [size, mtimeMs, ino, content hash]
+//   <engine>-<ruleset>/index.json   <hash>.<lang> → number of findings
+//   <engine>-<ruleset>/<hash>.<lang>.json  the findings, for keys that have any
+//   trees/<hash>.<lang>         the file's tree snapshot (applyMany onSnapshot)
+//
+// A file whose stat matches files.json is not read at all: a warm scan of
+// an unchanged tree is stat calls plus the findings it prints. A fresh
+// checkout (new mtimes) reads and hashes each file once, then hits.
+//
+// Tree snapshots outlive rulesets: after a rule change every file misses,
+// but its saved tree is applied without parsing. They take about 4-5x the
+// size of the source. A snapshot from another build of the grammar is
+// refused by the engine, the file is parsed, and its new snapshot replaces
+// the stale one.
+
+/** What the cache knows about a file: its findings, or the bytes to scan. */
+export type CacheLookup =
+  | { hash: string; findings: Finding[] }
+  | { hash: string; bytes: Uint8Array; snapshot?: Uint8Array };
+
+export interface ScanCache {
+  /** Findings cached for `file`'s content, else its bytes, read and hashed. Throws if it cannot be read. */
+  lookup(file: string): Promise<CacheLookup>;
+  /** Record the findings for content `hash` parsed as `lang`. */
+  store(hash: string, lang: Language, findings: Finding[]): Promise<void>;
+  /** Record the tree snapshot of content `hash` parsed as `lang`. */
+  storeSnapshot(hash: string, lang: Language, snapshot: Uint8Array): Promise<void>;
+  /** Write the stat and findings indexes back. */
+  save(): Promise<void>;
+}
+
+type StatEntry = [size: number, mtimeMs: number, ino: number, hash: string];
+
+/**
+ * Stats of files modified this recently are not recorded: a second write
+ * within the filesystem's mtime granularity would leave them unchanged.
+ */
+export const RACY_MS = 2000;
+
+/** Open (creating if needed) the cache under `dir` for the ruleset `bytecode`. */
+export async function openScanCache(dir: string, bytecode: Uint8Array): Promise<ScanCache> {
+  const scope = path.join(dir, `${engineVersion()}-${hashBytes(bytecode)}`);
+  const trees = path.join(dir, "trees");
+  await fs.promises.mkdir(scope, { recursive: true });
+  await fs.promises.mkdir(trees, { recursive: true });
+  const statsFile = path.join(dir, "files.json");
+  const indexFile = path.join(scope, "index.json");
+  const stats: Record<string, StatEntry> = (await readJson(statsFile)) ?? {};
+  const counts = new Map(Object.entries((await readJson<Record<string, number>>(indexFile)) ?? {}));
+  let statsDirty = false;
+  let countsDirty = false;
+
+  return {
+    async lookup(file: string): Promise<CacheLookup> {
+      const key = path.resolve(file);
+      const st = await fs.promises.stat(file);
+      const known = stats[key];
+      let bytes: Uint8Array | undefined;
+      let hash: string;
+      if (known && known[0] === st.size && known[1] === st.mtimeMs && known[2] === st.ino) {
+        hash = known[3];
+      } else {
+        bytes = await fs.promises.readFile(file);
+        hash = hashBytes(bytes);
+        if (st.mtimeMs + RACY_MS < Date.now()) stats[key] = [st.size, st.mtimeMs, st.ino, hash];
+        else delete stats[key];
+        statsDirty = true;
+      }
+
+      const key = `${hash}.${detectLanguage(file)}`;
+      const count = counts.get(key);
+      if (count === 0) return { hash, findings: [] };
+      if (count !== undefined) {
+        const findings = await readJson<Finding[]>(path.join(scope, `${key}.json`));
+        if (findings) return { hash, findings };
+      }
+      bytes ??= await fs.promises.readFile(file);
+      const snapshot = await fs.promises.readFile(path.join(trees, key)).catch(() => undefined);
+      return { hash, bytes, snapshot };
+    },
+
+    async store(hash: string, lang: Language, findings: Finding[]): Promise<void> {
+      const key = `${hash}.${lang}`;
+      if (findings.length > 0 && !(await writeAtomic(path.join(scope, `${key}.json`), JSON.stringify(findings)))) return;
+      counts.set(key, findings.length);
+      countsDirty = true;
+    },
+
+    async storeSnapshot(hash: string, lang: Language, snapshot: Uint8Array): Promise<void> {
+      await writeAtomic(path.join(trees, `${hash}.${lang}`), snapshot);
+    },
+
+    async save(): Promise<void> {
+      if (statsDirty) await writeAtomic(statsFile, JSON.stringify(stats));
+      if (countsDirty) await writeAtomic(indexFile, JSON.stringify(Object.fromEntries(counts)));
+      statsDirty = countsDirty = false;
+    },
+  };
+}
+
+async function readJson<T>(file: string): Promise<T | null> {
+  try {
+    return JSON.parse(await fs.promises.readFile(file, "utf-8")) as T;
+  } catch {
+    return null;
+  }
+}
+
+/** Write-then-rename, so a concurrent scan never reads a partial file. False if it could not be written. */
+async function writeAtomic(file: string, data: string | Uint8Array): Promise<boolean> {
+  const tmp = `${file}.${process.pid}.tmp`;
+  try {
+    await fs.promises.writeFile(tmp, data);
+    await fs.promises.rename(tmp, file);
+    return true;
+  } catch {
+    // A cache that cannot be written is just a miss next time.
+    return false;
+  }
+}
@@ -3,14 +3,22 @@ import * as fs from "node:fs";
 import * as path from "node:path";
 import {
   structMatch,
+  structCount,
   createScanner,
   loadRules,
   detectLanguage,
   isWasmLanguage,
+  patternLiterals,
+  init,
   type Match,
-  type Finding,
-} from "./ts/index.js";
+} from "./index.js";
 import { encodeRules } from "./encoder.js";
+import { createPool, type FileFindings } from "./pool.js";
+import { discoverFiles, SOURCE_EXTENSIONS, type DiscoverOptions } from "./discover.js";
+import { scanStream, batches, readCached, SCAN_BATCH } from "./pipeline.js";
+import { openScanCache } from "./cache.js";
+import { updateTrigramIndex, openTrigramIndex, indexedCandidates } from "./trigrams.js";
+import { createFindingWriter, REPORT_FORMATS, type ReportFormat } from "./report.js";
 import { traceFile } from "./trace.js";
 import type { RuleDefinition, Language, Confidence } from "./types.js";
 
@@ -22,6 +30,9 @@ interface ParsedArgs {
   flags: Record<string, string | boolean>;
 }
 
+/** Flags that never take a value, so a following path stays positional. */
+const BOOLEAN_FLAGS = new Set(["exists", "count", "no-ignore", "git-index"]);
+
 function parseArgs(argv: string[]): ParsedArgs {
   const args = argv.slice(2);
   const command = args[0] ?? "help";
@@ -35,7 +46,7 @@ function parseArgs(argv: string[]): ParsedArgs {
     if (isLong || isShort) {
       const key = arg.slice(isLong ? 2 : 1);
       const next = args[i + 1];
-      if (next && !next.startsWith("-")) {
+      if (next && !next.startsWith("-") && !BOOLEAN_FLAGS.has(key)) {
         flags[key] = next;
         i++;
       } else {
@@ -51,26 +62,10 @@ function parseArgs(argv: string[]): ParsedArgs {
 
 // ── File discovery ───────────────────────────────────────
 
-const EXTENSIONS = new Set([".js", ".jsx", ".ts", ".tsx", ".mjs", ".cjs", ".mts", ".cts"]);
-
-function discoverFiles(paths: string[]): string[] {
-  const files: string[] = [];
-  for (const p of paths) {
-    if (!fs.existsSync(p)) continue;
-    const stat = fs.statSync(p);
-    if (stat.isFile() && EXTENSIONS.has(path.extname(p))) {
-      files.push(p);
-    } else if (stat.isDirectory()) {
-      const entries = fs.readdirSync(p, { recursive: true }) as string[];
-      for (const entry of entries) {
-        const fullPath = path.join(p, entry);
-        if (fs.statSync(fullPath).isFile() && EXTENSIONS.has(path.extname(fullPath))) {
-          files.push(fullPath);
-        }
-      }
-    }
-  }
-  return files;
+/** Discovery options from --exclude, --no-ignore and --git-index. */
+function discoverOptions(flags: Record<string, string | boolean>): DiscoverOptions {
+  const exclude = typeof flags.exclude === "string" ? flags.exclude.split(",").filter(Boolean) : [];
+  return { exclude, gitignore: flags["no-ignore"] !== true, gitIndex: flags["git-index"] === true };
 }
 
 // ── JSON rule loading ────────────────────────────────────
@@ -107,94 +102,8 @@ function loadRuleFiles(rulesPath: string): RuleDefinition[] {
   return rules;
 }
 
-// ── SARIF output ─────────────────────────────────────────
-
-interface SarifResult {
-  ruleId: string;
-  level: string;
-  message: { text: string };
-  locations: Array<{
-    physicalLocation: {
-      artifactLocation: { uri: string };
-      region: {
-        startLine: number;
-        startColumn: number;
-        endLine: number;
-        endColumn: number;
-      };
-    };
-  }>;
-}
-
-function toSarif(
-  allFindings: Array<{ file: string; findings: Finding[] }>,
-  rules: RuleDefinition[],
-): object {
-  const results: SarifResult[] = [];
-
-  for (const { file, findings } of allFindings) {
-    for (const f of findings) {
-      for (const m of f.matches) {
-        results.push({
-          ruleId: f.ruleId,
-          level: f.severity === "error" ? "error" : f.severity === "warning" ? "warning" : "note",
-          message: { text: f.message },
-          locations: [
-            {
-              physicalLocation: {
-                artifactLocation: { uri: file },
-                region: {
-                  startLine: m.start_row + 1,
-                  startColumn: m.start_col + 1,
-                  endLine: m.end_row + 1,
-                  endColumn: m.end_col + 1,
-                },
-              },
-            },
-          ],
-        });
-      }
-    }
-  }
-
-  return {
-    $schema: "https://raw.githubusercontent.com/oasis-tcs/sarif-spec/main/sarif-2.1/schema/sarif-schema-2.1.0.json",
-    version: "2.1.0",
-    runs: [
-      {
-        tool: {
-          driver: {
-            name: "codesift",
-            version: "0.1.0",
-            rules: rules.map((r) => ({
-              id: r.id,
-              shortDescription: { text: r.message },
-              defaultConfiguration: { level: r.severity ?? "error" },
-            })),
-          },
-        },
-        results,
-      },
-    ],
-  };
-}
-
 // ── Formatters ───────────────────────────────────────────
 
-function formatTextFindings(file: string, findings: Finding[], source: string): string {
-  const sourceLines = source.split("\n");
-  const lines: string[] = [];
-  for (const f of findings) {
-    for (const m of f.matches) {
-      const line = sourceLines[m.start_row] ?? "";
-      lines.push(`${file}:${m.start_row + 1}:${m.start_col + 1}: ${f.severity} [${f.ruleId}] ${f.message}`);
-      lines.push(`  ${line.trimEnd()}`);
-      lines.push(`  ${" ".repeat(m.start_col)}${"^".repeat(Math.max(1, m.end_col - m.start_col))}`);
-    }
-  }
-  return lines.join("\n");
-}
-
 function formatTextMatch(file: string, matches: Match[], source: string, pattern: string): string {
   const sourceLines = source.split("\n");
   const lines: string[] = [];
@@ -212,14 +121,34 @@ function formatTextMatch(file: string, matches: Match[], source: string, pattern
 
 // ── Commands ─────────────────────────────────────────────
 
-function cmdScan(positionals: string[], flags: Record<string, string | boolean>): void {
+/** Integer flag `name` of at least `min`, else `fallback`. */
+function intFlag(flags: Record<string, string | boolean>, name: string, fallback: number, min: number): number {
+  const n = Number(flags[name] ?? fallback);
+  return Number.isFinite(n) && n >= min ? Math.floor(n) : fallback;
+}
+
+/** --jobs N: worker threads for scan and run (default 1: this thread). */
+function jobsFlag(flags: Record<string, string | boolean>): number {
+  return intFlag(flags, "jobs", 1, 1);
+}
+
+const utf8 = new TextDecoder();
+
+/** Where `codesift index` keeps the trigram index unless given --index. */
+const DEFAULT_INDEX_DIR = ".codesift-index";
+
+async function cmdScan(positionals: string[], flags: Record<string, string | boolean>): Promise<void> {
   const rulesPath = flags.rules as string;
   if (!rulesPath) {
     console.error("Error: --rules <path> is required for scan command");
     process.exit(1);
   }
 
-  const format = (flags.format as string) ?? "text";
+  const format = ((flags.format as string) ?? "text") as ReportFormat;
+  if (!REPORT_FORMATS.includes(format)) {
+    console.error(`Error: --format must be one of ${REPORT_FORMATS.join(", ")}`);
+    process.exit(1);
+  }
 
   const rules = loadRuleFiles(rulesPath);
   if (rules.length === 0) {
@@ -228,45 +157,82 @@ function cmdScan(positionals: string[], flags: Record<string, string | boolean>)
   }
 
   const bytecode = encodeRules(rules);
-  const ruleset = loadRules(bytecode);
+  const jobs = jobsFlag(flags);
 
-  const files = discoverFiles(positionals.length > 0 ? positionals : ["."]);
-  const allFindings: Array<{ file: string; findings: Finding[] }> = [];
-  let totalFindings = 0;
-
-  for (const file of files) {
-    const source = fs.readFileSync(file, "utf-8");
-    const lang = detectLanguage(file);
-    if (!isWasmLanguage(lang)) continue;
-
-    const scanner = createScanner(source, lang);
-    const findings = ruleset.apply(scanner);
-    scanner.free();
-
-    if (findings.length > 0) {
-      allFindings.push({ file, findings });
-      totalFindings += findings.length;
+  const batchSize = intFlag(flags, "batch", SCAN_BATCH, 1);
+  const readDepth = intFlag(flags, "read-ahead", 2 * batchSize, 0);
+  const cacheDir = flags.cache;
+  if (cacheDir === true) {
+    console.error("Error: --cache requires a directory");
+    process.exit(1);
+  }
+  const cache = cacheDir ? await openScanCache(cacheDir, bytecode) : undefined;
 
-      if (format === "text") {
-        console.log(formatTextFindings(file, findings, source));
-      }
+  let fileCount = 0;
+  async function* discovered(): AsyncGenerator<string> {
+    for await (const file of discoverFiles(positionals.length > 0 ? positionals : ["."], discoverOptions(flags))) {
+      fileCount++;
+      yield file;
     }
   }
 
-  ruleset.free();
-
-  if (format === "json") {
-    console.log(JSON.stringify(allFindings, null, 2));
-  } else if (format === "sarif") {
-    console.log(JSON.stringify(toSarif(allFindings, rules), null, 2));
-  } else if (format === "text") {
-    console.log(`\n${totalFindings} finding(s) in ${files.length} file(s)`);
+  // Output stage: findings are written as each file completes, and a slow
+  // stdout holds up the stages feeding it.
+  const writer = createFindingWriter(format, process.stdout, rules);
+
+  if (jobs > 1) {
+    // Workers read the files themselves; only files with findings are
+    // read again here, for the text snippets. Each batch goes out as soon
+    // as discovery has filled it.
+    const pool = createPool({ size: jobs, rules: bytecode });
+    try {
+      for await (const batch of batches(discovered(), batchSize * jobs)) {
+        if (!cache) {
+          for await (const { file, findings, error } of pool.scan(batch)) {
+            if (error) console.error(`${file}: ${error}`);
+            await writer.file(file, findings, () => fs.readFileSync(file, "utf-8"));
+          }
+          continue;
+        }
+        // Cache hits skip the workers; the misses are scanned and stored,
+        // and the batch is written in order once they are back. A worker
+        // reads each miss again, so its findings are stored under the hash
+        // of the bytes it scanned, not of the bytes read here.
+        const looked = await Promise.all(batch.map(readCached(cache)));
+        const misses = looked.filter(r => r.bytes !== undefined);
+        const scanned = new Map<string, FileFindings>();
+        for await (const result of pool.scan(misses.map(r => r.file), { hash: true })) scanned.set(result.file, result);
+        await Promise.all(misses.map(({ file, hash }) => {
+          const { findings, error, hash: scannedHash } = scanned.get(file)!;
+          return error ? undefined : cache.store(scannedHash ?? hash!, detectLanguage(file), findings);
+        }));
+        for (const r of looked) {
+          const { file, findings, error } = scanned.get(r.file) ?? { file: r.file, findings: r.findings ?? [], error: r.error };
+          if (error) console.error(`${file}: ${error}`);
+          await writer.file(file, findings, () => (r.bytes ? utf8.decode(r.bytes) : fs.readFileSync(file, "utf-8")));
+        }
+      }
+    } finally {
+      await pool.close();
+    }
+  } else {
+    // Reads run ahead on libuv's pool while the engine applies the rules to
+    // the batch before them (or, with --read-ahead 0, each batch is read
+    // straight into engine memory). Snippets come from the bytes scanned.
+    const ruleset = loadRules(bytecode);
+    for await (const { file, findings, bytes, error } of scanStream(discovered(), ruleset, { batch: batchSize, readAhead: readDepth, cache })) {
+      if (error) console.error(`${file}: ${error}`);
+      await writer.file(file, findings, () => (bytes ? utf8.decode(bytes) : fs.readFileSync(file, "utf-8")));
+    }
+    ruleset.free();
   }
 
-  process.exit(totalFindings > 0 ? 1 : 0);
+  await cache?.save();
+  await writer.end(fileCount);
+  process.exit(writer.count > 0 ? 1 : 0);
 }
 
-function cmdRun(positionals: string[], flags: Record<string, string | boolean>): void {
+async function cmdRun(positionals: string[], flags: Record<string, string | boolean>): Promise<void> {
   const pattern = positionals[0];
   if (!pattern) {
     console.error("Error: pattern argument is required");
@@ -276,35 +242,129 @@ function cmdRun(positionals: string[], flags: Record<string, string | boolean>):
 
   const format = (flags.format as string) ?? "text";
   const langFlag = flags.lang as string | undefined;
+  // --exists only needs one match per file, so the engine stops there.
+  const exists = flags.exists === true;
+  const limit = exists ? 1 : flags.limit ? Number(flags.limit) : undefined;
   const filePaths = positionals.slice(1);
-  const files = discoverFiles(filePaths.length > 0 ? filePaths : ["."]);
+  let files: AsyncIterable<string> = discoverFiles(filePaths.length > 0 ? filePaths : ["."], discoverOptions(flags));
 
-  let totalMatches = 0;
+  // --index: parse only the files whose trigrams hold the pattern's literals.
+  const indexDir = flags.index;
+  if (indexDir === true) {
+    console.error("Error: --index requires a directory");
+    process.exit(1);
+  }
+  const index = indexDir ? await openTrigramIndex(indexDir) : null;
+  if (indexDir && !index) console.error(`No index in ${indexDir}; run \`codesift index --index ${indexDir}\` first. Scanning every file.`);
+  if (index) {
+    const literals = new Map<Language, string[]>();
+    files = indexedCandidates(files, index, file => {
+      const lang = (langFlag ?? detectLanguage(file)) as Language;
+      if (!literals.has(lang)) literals.set(lang, patternLiterals(pattern, lang) ?? []);
+      return literals.get(lang)!;
+    });
+  }
 
-  for (const file of files) {
-    const source = fs.readFileSync(file, "utf-8");
-    const lang = (langFlag ?? detectLanguage(file)) as Language;
-    if (!isWasmLanguage(lang)) continue;
+  const groupBy = flags["group-by"] as string | undefined;
+  if (flags.count === true || groupBy) {
+    await countMatches(pattern, files, langFlag, format, groupBy);
+    return;
+  }
 
-    const matches = structMatch(pattern, source, lang);
+  let totalMatches = 0;
+  let fileCount = 0;
+
+  function report(file: string, matches: Match[], source: () => string): void {
     totalMatches += matches.length;
+    if (matches.length === 0) return;
+    if (exists) {
+      console.log(file);
+    } else if (format === "json") {
+      console.log(JSON.stringify({ file, matches }, null, 2));
+    } else {
+      console.log(formatTextMatch(file, matches, source(), pattern));
+    }
+  }
 
-    if (matches.length > 0) {
-      if (format === "json") {
-        console.log(JSON.stringify({ file, matches }, null, 2));
-      } else {
-        console.log(formatTextMatch(file, matches, source, pattern));
+  const jobs = jobsFlag(flags);
+  if (jobs > 1) {
+    const pool = createPool({ size: jobs });
+    try {
+      for await (const batch of batches(files, SCAN_BATCH * jobs)) {
+        fileCount += batch.length;
+        for await (const { file, matches, error } of pool.run(pattern, batch, { lang: langFlag as Language | undefined, limit })) {
+          if (error) console.error(`${file}: ${error}`);
+          report(file, matches, () => fs.readFileSync(file, "utf-8"));
+        }
       }
+    } finally {
+      await pool.close();
+    }
+  } else {
+    for await (const file of files) {
+      fileCount++;
+      const lang = (langFlag ?? detectLanguage(file)) as Language;
+      if (!isWasmLanguage(lang)) continue;
+      const source = fs.readFileSync(file, "utf-8");
+      report(file, structMatch(pattern, source, lang, { limit }), () => source);
     }
   }
 
-  if (format === "text") {
-    console.log(`\n${totalMatches} match(es) in ${files.length} file(s)`);
+  if (format === "text" && !exists) {
+    console.log(`\n${totalMatches} match(es) in ${fileCount} file(s)`);
   }
 
   process.exit(totalMatches > 0 ? 1 : 0);
 }
 
+async function cmdIndex(positionals: string[], flags: Record<string, string | boolean>): Promise<void> {
+  if (flags.index === true) {
+    console.error("Error: --index requires a directory");
+    process.exit(1);
+  }
+  const dir = (flags.index as string | undefined) ?? DEFAULT_INDEX_DIR;
+  const files = discoverFiles(positionals.length > 0 ? positionals : ["."], discoverOptions(flags));
+  const { files: count, indexed } = await updateTrigramIndex(dir, files);
+  console.log(`Indexed ${count} file(s) in ${dir} (${indexed} new or changed)`);
+}
+
+/** `run --count` / `--group-by`: totals tallied by the engine, no match records. */
+async function countMatches(pattern: string, files: AsyncIterable<string>, langFlag: string | undefined, format: string, groupBy: string | undefined): Promise<void> {
+  let total = 0;
+  let fileCount = 0;
+  const perFile: { file: string; count: number }[] = [];
+  const groups = new Map<string, number>();
+
+  for await (const file of files) {
+    fileCount++;
+    const lang = (langFlag ?? detectLanguage(file)) as Language;
+    if (!isWasmLanguage(lang)) continue;
+
+    const counts = structCount(pattern, fs.readFileSync(file, "utf-8"), lang, { groupBy });
+    if (counts.total === 0) continue;
+    total += counts.total;
+    perFile.push({ file, count: counts.total });
+    for (const g of counts.groups) groups.set(g.text, (groups.get(g.text) ?? 0) + g.count);
+  }
+
+  // Most frequent first, ties by text, as the engine ranks each file's groups.
+  const ranked = [...groups].sort((a, b) => b[1] - a[1] || (a[0] < b[0] ? -1 : a[0] > b[0] ? 1 : 0));
+  if (format === "json") {
+    // An array, not an object: integer-like texts would be reordered as keys.
+    const grouped = ranked.map(([text, count]) => ({ text, count }));
+    console.log(JSON.stringify({ total, files: perFile, ...(groupBy ? { groups: grouped } : {}) }, null, 2));
+  } else {
+    if (groupBy) {
+      for (const [text, count] of ranked) console.log(`${String(count).padStart(8)}  ${text.replace(/\s+/g, " ")}`);
+    } else {
+      for (const { file, count } of perFile) console.log(`${file}: ${count}`);
+    }
+    console.log(`\n${total} match(es) in ${fileCount} file(s)`);
+  }
+
+  process.exit(total > 0 ? 1 : 0);
+}
+
 function cmdCompile(positionals: string[], flags: Record<string, string | boolean>): void {
   const input = positionals[0];
   if (!input) {
@@ -352,7 +412,7 @@ function cmdTest(flags: Record<string, string | boolean>): void {
     }
 
     const testFiles = fs.readdirSync(testDir).filter((f) =>
-      f.startsWith(rule.id) && EXTENSIONS.has(path.extname(f)),
+      f.startsWith(rule.id) && SOURCE_EXTENSIONS.has(path.extname(f)),
     );
 
     for (const testFile of testFiles) {
@@ -449,11 +509,33 @@ function showHelp(): void {
 
 Commands:
   scan [files...] --rules <path>     Scan files with JSON rules
-    --format text|json|sarif         Output format (default: text)
+    --format text|json|ndjson|sarif  Output format (default: text)
+    --jobs <n>                       Worker threads (default: 1)
+    --batch <n>                      Files per engine call (default: 256)
+    --read-ahead <n>                 Files read ahead of the engine (default: 2 x batch; 0: read in place)
+    --cache <dir>                    Reuse findings for files unchanged since the last scan
+    --exclude <glob,...>             Skip paths matching gitignore-style globs
+    --no-ignore                      Do not read .gitignore files
+    --git-index                      List tracked files from .git/index
 
   run "<pattern>" [files...]         One-shot pattern match
     --lang js|ts|tsx                 Language (default: auto-detect)
     --format text|json               Output format (default: text)
+    --limit <n>                      Stop after n matches per file
+    --exists                         List matching files only (first match)
+    --count                          Print match counts per file
+    --group-by <METAVAR>             Print match counts per text bound to METAVAR
+    --jobs <n>                       Worker threads (default: 1)
+    --index <dir>                    Parse only files the trigram index lists as candidates
+    --exclude <glob,...>             Skip paths matching gitignore-style globs
+    --no-ignore                      Do not read .gitignore files
+    --git-index                      List tracked files from .git/index
+
+  index [files...]                   Build or update a trigram index for run --index
+    --index <dir>                    Index directory (default: .codesift-index)
+    --exclude <glob,...>             Skip paths matching gitignore-style globs
+    --no-ignore                      Do not read .gitignore files
+    --git-index                      List tracked files from .git/index
 
   trace <file>                       Behavioral trace via proxy execution
     --timeout <ms>                   Execution timeout (default: 5000)
@@ -466,8 +548,12 @@ Commands:
 
   test --rules <dir>                 Test rules against fixtures
 
+Environment:
+  CODESIFT_WASM_CACHE=<dir>|1        Cache the engine module between runs
+
 Examples:
   codesift run "eval(\\$X)" src/
+  codesift index src/ && codesift run "eval(\\$X)" src/ --index .codesift-index
   codesift scan --rules rules/ src/
   codesift trace suspicious.js
   codesift trace script.js --confidence low --timeout 10000
@@ -475,15 +561,18 @@ Examples:
 `);
 }
 
-function main(): void {
+async function main(): Promise<void> {
   const { command, positionals, flags } = parseArgs(process.argv);
 
   switch (command) {
     case "scan":
-      cmdScan(positionals, flags);
+      await cmdScan(positionals, flags);
       break;
     case "run":
-      cmdRun(positionals, flags);
+      await cmdRun(positionals, flags);
+      break;
+    case "index":
+      await cmdIndex(positionals, flags);
       break;
     case "trace":
       cmdTrace(positionals, flags);
@@ -506,4 +595,8 @@ function main(): void {
   }
 }
 
-main();
+// Opt-in engine cache: skips decoding the embedded engine on later runs.
+const wasmCache = process.env.CODESIFT_WASM_CACHE;
+if (wasmCache) await init({ cache: wasmCache === "1" ? true : wasmCache });
+
+await main();
@@ -0,0 +1,366 @@
+import * as fs from "node:fs";
+import * as path from "node:path";
+
+// ── File discovery ───────────────────────────────────────
+//
+// discoverFiles walks the given paths with fs.promises.opendir and yields
+// source files one directory at a time, so a scan starts on the first files
+// while the rest of the tree is still being read and the full listing is
+// never held in memory. Directory entries carry their type, so only
+// symlinks cost a stat. .git is never entered and node_modules is skipped
+// by default; .gitignore files, the repository's .git/info/exclude and
+// --exclude globs prune the walk before an ignored directory is opened.
+// With `gitIndex`, a path inside a git work tree is listed from .git/index
+// instead — the tracked files, no walk.
+
+/** Extensions discoverFiles yields by default. */
+export const SOURCE_EXTENSIONS: ReadonlySet<string> = new Set([
+  ".js", ".jsx", ".ts", ".tsx", ".mjs", ".cjs", ".mts", ".cts",
+]);
+
+export interface DiscoverOptions {
+  /** Gitignore-style globs to leave out, relative to each given path. */
+  exclude?: string[];
+  /** Honor .gitignore files and .git/info/exclude (default: true). */
+  gitignore?: boolean;
+  /** List tracked files from .git/index instead of walking, when there is one (default: false). */
+  gitIndex?: boolean;
+  /** File extensions to yield (default: SOURCE_EXTENSIONS). */
+  extensions?: ReadonlySet<string>;
+}
+
+interface IgnoreRule {
+  re: RegExp;
+  negate: boolean;
+  dirOnly: boolean;
+}
+
+/** Rules from one ignore file, matched against paths relative to `base`. */
+interface IgnoreList {
+  base: string;
+  rules: IgnoreRule[];
+}
+
+/**
+ * Skipped in every walk. Checked before any ignore file, so a .gitignore
+ * negation can bring a directory back.
+ */
+const DEFAULT_IGNORES: IgnoreRule[] = [compileIgnore("node_modules/")!];
+
+interface Walk {
+  extensions: ReadonlySet<string>;
+  gitignore: boolean;
+  /** --exclude globs for the current root; checked after every ignore file. */
+  excludes: IgnoreList;
+}
+
+/**
+ * Yield the source files under `paths` as they are found. Files named
+ * directly are yielded as-is; directories are walked (or, with `gitIndex`,
+ * listed from the git index). Paths that do not exist are skipped.
+ */
+export async function* discoverFiles(paths: string[], opts: DiscoverOptions = {}): AsyncGenerator<string> {
+  const extensions = opts.extensions ?? SOURCE_EXTENSIONS;
+  const gitignore = opts.gitignore ?? true;
+  const excludeRules = (opts.exclude ?? []).map(compileIgnore).filter((r): r is IgnoreRule => r !== null);
+
+  for (const p of paths) {
+    let stat: fs.Stats;
+    try {
+      stat = await fs.promises.stat(p);
+    } catch {
+      continue;
+    }
+    if (stat.isFile()) {
+      if (extensions.has(path.extname(p))) yield p;
+      continue;
+    }
+    if (!stat.isDirectory()) continue;
+
+    const abs = path.resolve(p);
+    const walk: Walk = { extensions, gitignore, excludes: { base: abs, rules: excludeRules } };
+    const repo = await findWorkTree(abs);
+
+    if (opts.gitIndex && repo) {
+      const tracked = await readIndexFile(path.join(repo.gitDir, "index"));
+      if (tracked) {
+        yield* listTracked(p, abs, repo.root, tracked, walk);
+        continue;
+      }
+    }
+
+    // Ignore files above the walk still apply to it, as they would for git.
+    // The root itself is never tested: a path given explicitly is scanned.
+    const lists: IgnoreList[] = [{ base: abs, rules: DEFAULT_IGNORES }];
+    if (gitignore && repo) {
+      const info = await readIgnoreFile(path.join(repo.gitDir, "info", "exclude"));
+      if (info.length > 0) lists.push({ base: repo.root, rules: info });
+      for (let dir = repo.root; dir !== abs; ) {
+        const rules = await readIgnoreFile(path.join(dir, ".gitignore"));
+        if (rules.length > 0) lists.push({ base: dir, rules });
+        dir = path.join(dir, relPosix(dir, abs).split("/")[0]);
+      }
+    }
+    yield* walkDir(p, abs, lists, walk);
+  }
+}
+
+async function* walkDir(dir: string, abs: string, lists: IgnoreList[], walk: Walk): AsyncGenerator<string> {
+  if (walk.gitignore) {
+    const rules = await readIgnoreFile(path.join(abs, ".gitignore"));
+    if (rules.length > 0) lists = [...lists, { base: abs, rules }];
+  }
+
+  let handle: fs.Dir;
+  try {
+    handle = await fs.promises.opendir(abs);
+  } catch {
+    return;
+  }
+
+  // One directory is read whole and sorted, so output order does not
+  // depend on the filesystem.
+  const files: string[] = [];
+  const subdirs: string[] = [];
+  for await (const entry of handle) {
+    if (entry.name === ".git") continue;
+    const childAbs = path.join(abs, entry.name);
+    const isDir = entry.isDirectory();
+    let isFile = entry.isFile();
+    if (entry.isSymbolicLink()) {
+      // Links are followed to files only: a linked directory can lead back up the tree.
+      try {
+        isFile = (await fs.promises.stat(childAbs)).isFile();
+      } catch {
+        continue;
+      }
+    }
+    if (!isDir && !(isFile && walk.extensions.has(path.extname(entry.name)))) continue;
+    if (isIgnored(lists, walk.excludes, childAbs, isDir)) continue;
+    (isDir ? subdirs : files).push(entry.name);
+  }
+
+  for (const name of files.sort()) yield path.join(dir, name);
+  for (const name of subdirs.sort()) {
+    yield* walkDir(path.join(dir, name), path.join(abs, name), lists, walk);
+  }
+}
+
+/** Tracked files under `abs`, filtered like a walk, skipping any missing from the work tree. */
+async function* listTracked(dir: string, abs: string, root: string, tracked: string[], walk: Walk): AsyncGenerator<string> {
+  const prefix = abs === root ? "" : relPosix(root, abs) + "/";
+  for (const entry of tracked) {
+    if (!entry.startsWith(prefix) || !walk.extensions.has(path.posix.extname(entry))) continue;
+    const rel = entry.slice(prefix.length);
+    const childAbs = path.join(abs, rel);
+    if (isIgnored([], walk.excludes, childAbs, false) || excludedDir(walk.excludes, abs, rel)) continue;
+    try {
+      await fs.promises.access(childAbs);
+    } catch {
+      continue;
+    }
+    yield path.join(dir, rel);
+  }
+}
+
+/** Whether an --exclude glob names a directory on the way to `rel`, as it would prune a walk. */
+function excludedDir(excludes: IgnoreList, abs: string, rel: string): boolean {
+  if (excludes.rules.length === 0) return false;
+  const parts = rel.split("/");
+  let dir = abs;
+  for (let i = 0; i < parts.length - 1; i++) {
+    dir = path.join(dir, parts[i]);
+    if (isIgnored([], excludes, dir, true)) return true;
+  }
+  return false;
+}
+
+// ── Ignore rules ─────────────────────────────────────────
+
+/**
+ * Whether `abs` is ignored: the last matching rule wins, deeper ignore
+ * files over shallower ones, and --exclude globs over all of them.
+ */
+function isIgnored(lists: IgnoreList[], excludes: IgnoreList, abs: string, isDir: boolean): boolean {
+  let ignored = false;
+  for (const list of lists) ignored = applyRules(list, abs, isDir, ignored);
+  return applyRules(excludes, abs, isDir, ignored);
+}
+
+function applyRules(list: IgnoreList, abs: string, isDir: boolean, ignored: boolean): boolean {
+  if (list.rules.length === 0) return ignored;
+  const rel = relPosix(list.base, abs);
+  for (const rule of list.rules) {
+    if (rule.dirOnly && !isDir) continue;
+    if (rule.re.test(rel)) ignored = !rule.negate;
+  }
+  return ignored;
+}
+
+async function readIgnoreFile(file: string): Promise<IgnoreRule[]> {
+  let text: string;
+  try {
+    text = await fs.promises.readFile(file, "utf-8");
+  } catch {
+    return [];
+  }
+  return text.split("\n").map(compileIgnore).filter((r): r is IgnoreRule => r !== null);
+}
+
+/** @internal Compile one gitignore line; null for blank lines and comments. */
+export function compileIgnore(line: string): IgnoreRule | null {
+  let p = line.replace(/\r$/, "").replace(/(?<!\\) +$/, "");
+  if (p === "" || p.startsWith("#")) return null;
+
+  let negate = false;
+  if (p.startsWith("!")) {
+    negate = true;
+    p = p.slice(1);
+  } else if (p.startsWith("\\!") || p.startsWith("\\#")) {
+    p = p.slice(1);
+  }
+
+  let dirOnly = false;
+  if (p.endsWith("/")) {
+    dirOnly = true;
+    p = p.slice(0, -1);
+  }
+  if (p === "") return null;
+
+  // A slash anywhere but the end anchors the pattern to the ignore file's
+  // directory; otherwise it matches a name at any depth.
+  const anchored = p.includes("/");
+  if (p.startsWith("/")) p = p.slice(1);
+  return { re: new RegExp(`${anchored ? "^" : "(?:^|/)"}${globToRegex(p)}$`), negate, dirOnly };
+}
+
+function globToRegex(glob: string): string {
+  let re = "";
+  for (let i = 0; i < glob.length; i++) {
+    const c = glob[i];
+    if (c === "*") {
+      const segmentStart = i === 0 || glob[i - 1] === "/";
+      if (glob[i + 1] === "*" && segmentStart && glob[i + 2] === "/") {
+        re += "(?:.*/)?"; // "**/": any number of leading directories
+        i += 2;
+      } else if (glob[i + 1] === "*" && segmentStart && i + 2 === glob.length) {
+        re += ".*"; // trailing "/**": everything inside
+        i += 1;
+      } else {
+        re += "[^/]*";
+        while (glob[i + 1] === "*") i++;
+      }
+    } else if (c === "?") {
+      re += "[^/]";
+    } else if (c === "[") {
+      // "]" right after "[" or "[!" is a literal member of the class.
+      const first = glob[i + 1] === "!" ? i + 2 : i + 1;
+      const end = glob.indexOf("]", first + 1);
+      if (end < 0) {
+        re += "\\[";
+        continue;
+      }
+      const body = glob.slice(first, end).replace(/[\\\]^]/g, "\\$&");
+      re += `[${first === i + 2 ? "^" : ""}${body}]`;
+      i = end;
+    } else if (c === "\\" && i + 1 < glob.length) {
+      re += escapeRegex(glob[++i]);
+    } else {
+      re += escapeRegex(c);
+    }
+  }
+  return re;
+}
+
+function escapeRegex(s: string): string {
+  return s.replace(/[.*+?^${}()|[\]\\/]/g, "\\$&");
+}
+
+/** `abs` relative to its ancestor `base`, "/"-separated. */
+function relPosix(base: string, abs: string): string {
+  const rel = path.relative(base, abs);
+  return path.sep === "/" ? rel : rel.split(path.sep).join("/");
+}
+
+// ── Git work tree and index ──────────────────────────────
+
+/** The work tree holding `dir` (absolute) and its git directory, if any. */
+async function findWorkTree(dir: string): Promise<{ root: string; gitDir: string } | null> {
+  for (let d = dir; ; d = path.dirname(d)) {
+    const dotGit = path.join(d, ".git");
+    try {
+      const stat = await fs.promises.stat(dotGit);
+      if (stat.isDirectory()) return { root: d, gitDir: dotGit };
+      // Worktrees and submodules have a .git file pointing at the real one.
+      const m = /^gitdir:\s*(.+?)\s*$/m.exec(await fs.promises.readFile(dotGit, "utf-8"));
+      if (m) return { root: d, gitDir: path.resolve(d, m[1]) };
+    } catch {
+      // no .git here
+    }
+    if (path.dirname(d) === d) return null;
+  }
+}
+
+async function readIndexFile(file: string): Promise<string[] | null> {
+  try {
+    return parseGitIndex(await fs.promises.readFile(file));
+  } catch {
+    return null;
+  }
+}
+
+/** Mode bits of a gitlink (submodule) entry; there is no file to scan. */
+const GITLINK = 0o160000;
+
+/**
+ * @internal Paths recorded in a git index file ("DIRC", versions 2-4),
+ * "/"-separated and relative to the work tree, in index order. Submodules
+ * are left out and a conflicted path is listed once. Throws on anything
+ * that is not an index.
+ */
+export function parseGitIndex(buf: Buffer): string[] {
+  if (buf.length < 12 || buf.toString("latin1", 0, 4) !== "DIRC") throw new Error("not a git index");
+  const version = buf.readUInt32BE(4);
+  if (version < 2 || version > 4) throw new Error(`unsupported git index version ${version}`);
+
+  const count = buf.readUInt32BE(8);
+  const paths: string[] = [];
+  let prev = Buffer.alloc(0);
+  let pos = 12;
+  for (let i = 0; i < count; i++) {
+    const start = pos;
+    const mode = buf.readUInt32BE(start + 24);
+    const flags = buf.readUInt16BE(start + 60);
+    pos = start + 62;
+    if (version >= 3 && flags & 0x4000) pos += 2; // extended flags
+
+    let name: Buffer;
+    if (version === 4) {
+      // The path is the previous one minus `strip` trailing bytes, plus a
+      // NUL-terminated suffix, with no padding. `strip` is git's offset
+      // varint: each continuation adds one before shifting.
+      let byte = buf[pos++];
+      let strip = byte & 0x7f;
+      while (byte & 0x80) {
+        byte = buf[pos++];
+        strip = ((strip + 1) << 7) | (byte & 0x7f);
+      }
+      const end = buf.indexOf(0, pos);
+      if (end < 0 || strip > prev.length) throw new Error("truncated git index");
+      name = Buffer.concat([prev.subarray(0, prev.length - strip), buf.subarray(pos, end)]);
+      pos = end + 1;
+    } else {
+      // NUL-padded (one to eight bytes) to a multiple of eight.
+      const end = buf.indexOf(0, pos);
+      if (end < 0) throw new Error("truncated git index");
+      name = buf.subarray(pos, end);
+      pos = start + ((end - start + 8) & ~7);
+    }
+
+    const isRepeat = name.equals(prev);
+    prev = name;
+    if ((mode & 0o170000) === GITLINK || isRepeat) continue;
+    paths.push(name.toString("utf-8"));
+  }
+  return paths;
+}
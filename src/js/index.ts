@@ -1 +1,6 @@
+import { wasmBase64, wasmHash } from "./ts/engine-wasm.generated.js";
+import { embedEngine } from "./ts/embedded.js";
+
+embedEngine({ base64: wasmBase64, hash: wasmHash });
+
 export * from "./ts/index.js";
@@ -0,0 +1,33 @@
+import * as fs from "node:fs";
+import type { BatchReader, Language } from "./types.js";
+
+// ── File ingestion ───────────────────────────────────────
+//
+// Scanned files reach the engine as bytes. fileReader gives applyMany a
+// reader that fs.readSync's the file straight into the batch buffer in WASM
+// memory, so there is no JS string and no TextEncoder pass; the engine
+// rejects binary and non-UTF-8 bytes before parsing. Text is decoded only
+// where output needs it: the snippets of files with findings.
+
+/** A BatchReader for `file`, sized by a stat now and read when its batch is packed. */
+export function fileReader(file: string, lang: Language): BatchReader {
+  return {
+    lang,
+    size: fs.statSync(file).size,
+    read(dest: Uint8Array): number {
+      const fd = fs.openSync(file, "r");
+      try {
+        // A file that shrank since the stat comes back short; one that grew is cut at `size`.
+        let n = 0;
+        while (n < dest.length) {
+          const got = fs.readSync(fd, dest, n, dest.length - n, null);
+          if (got === 0) break;
+          n += got;
+        }
+        return n;
+      } finally {
+        fs.closeSync(fd);
+      }
+    },
+  };
+}
@@ -0,0 +1,8 @@
+// JavaScript-only entry: the same API as index.ts, embedding
+// engine-javascript.wasm, which leaves out the TypeScript grammars.
+import { wasmBase64, wasmHash } from "./ts/engine-javascript-wasm.generated.js";
+import { embedEngine } from "./ts/embedded.js";
+
+embedEngine({ base64: wasmBase64, hash: wasmHash });
+
+export * from "./ts/index.js";
@@ -0,0 +1,179 @@
+import * as fs from "node:fs";
+import { once } from "node:events";
+import type { CompiledRuleset } from "./index.js";
+import type { ScanCache } from "./cache.js";
+import { detectLanguage, type BatchReader, type Finding, type ParseOptions } from "./types.js";
+import { fileReader } from "./ingest.js";
+
+// ── Scan pipeline stages ─────────────────────────────────
+//
+// `codesift scan` runs as three overlapped stages: reads, engine calls and
+// output. readAhead keeps up to `depth` async reads in flight on libuv's
+// thread pool while the engine works through the current batch on the main
+// thread, so on a cold cache or a network filesystem the scan takes about
+// as long as the slower of I/O and compute rather than their sum. batches
+// groups the read files for applyMany, and write stops the engine when
+// stdout is not keeping up. Every stage is bounded, so memory does not grow
+// with the size of the tree. scanStream joins the first two for library
+// callers, whose pace on the iterator is the backpressure.
+
+/** Files per applyMany call in scanStream (and `codesift scan --batch`). */
+export const SCAN_BATCH = 256;
+
+export interface ScanStreamOptions extends ParseOptions {
+  /** Files per engine call (default: SCAN_BATCH). */
+  batch?: number;
+  /**
+   * Files read ahead of the engine (default: twice `batch`). 0 reads each
+   * batch synchronously, straight into engine memory.
+   */
+  readAhead?: number;
+  /** Take findings from, and store them in, this cache (see openScanCache). Implies a read-ahead of at least 1. */
+  cache?: ScanCache;
+}
+
+export interface ScannedFile {
+  file: string;
+  findings: Finding[];
+  /** The bytes scanned, when read ahead: decode them for snippets instead of reading the file again. */
+  bytes?: Uint8Array;
+  /** Set when the file could not be read. */
+  error?: string;
+}
+
+/** A file read by readAhead: its bytes, its cached findings, or why it could not be read. */
+export interface ReadFile {
+  file: string;
+  bytes?: Uint8Array;
+  /** Set when the findings came from a cache instead of the bytes. */
+  findings?: Finding[];
+  /** Content hash, when read through a cache. */
+  hash?: string;
+  /** The cache's tree snapshot of the bytes, if it has one. */
+  snapshot?: Uint8Array;
+  error?: string;
+}
+
+/**
+ * Read `files` ahead of the consumer, yielding them in order. At most
+ * `depth` files are being read or waiting to be taken at any time. `read`
+ * must capture its own errors, as readOne does.
+ */
+export async function* readAhead(
+  files: AsyncIterable<string>,
+  depth: number,
+  read: (file: string) => Promise<ReadFile> = readOne,
+): AsyncGenerator<ReadFile> {
+  const it = files[Symbol.asyncIterator]();
+  const queue: Promise<ReadFile>[] = [];
+  let exhausted = false;
+  try {
+    for (;;) {
+      while (!exhausted && queue.length < depth) {
+        const next = await it.next();
+        if (next.done) exhausted = true;
+        else queue.push(read(next.value));
+      }
+      const head = queue.shift();
+      if (!head) return;
+      yield await head;
+    }
+  } finally {
+    await it.return?.();
+  }
+}
+
+async function readOne(file: string): Promise<ReadFile> {
+  try {
+    return { file, bytes: await fs.promises.readFile(file) };
+  } catch (e) {
+    return { file, error: e instanceof Error ? e.message : String(e) };
+  }
+}
+
+/** readOne through `cache`: a hit carries findings and no bytes. */
+export function readCached(cache: ScanCache): (file: string) => Promise<ReadFile> {
+  return async (file) => {
+    try {
+      return { file, ...(await cache.lookup(file)) };
+    } catch (e) {
+      return { file, error: e instanceof Error ? e.message : String(e) };
+    }
+  };
+}
+
+/**
+ * Apply `ruleset` to `files`, yielding every file in order as its batch
+ * completes. The next batch is read and applied only as the consumer pulls,
+ * so a slow consumer holds the scan to its pace with at most one batch (and
+ * the read-ahead) in memory. Throws ParseBudgetExceededError as applyMany does.
+ */
+export async function* scanStream(
+  files: Iterable<string> | AsyncIterable<string>,
+  ruleset: CompiledRuleset,
+  opts: ScanStreamOptions = {},
+): AsyncGenerator<ScannedFile> {
+  const size = Math.max(1, Math.floor(opts.batch ?? SCAN_BATCH));
+  const { cache } = opts;
+  const depth = Math.max(cache ? 1 : 0, Math.floor(opts.readAhead ?? 2 * size));
+
+  if (depth === 0) {
+    for await (const batch of batches(each(files), size)) {
+      const read: ReadFile[] = [];
+      const readers: BatchReader[] = [];
+      for (const file of batch) {
+        try {
+          readers.push(fileReader(file, detectLanguage(file)));
+          read.push({ file });
+        } catch (e) {
+          read.push({ file, error: e instanceof Error ? e.message : String(e) });
+        }
+      }
+      const results = ruleset.applyMany(readers, opts);
+      let k = 0;
+      for (const { file, error } of read) yield error ? { file, findings: [], error } : { file, findings: results[k++] };
+    }
+    return;
+  }
+
+  const read = cache ? readCached(cache) : readOne;
+  for await (const batch of batches(readAhead(each(files), depth, read), size)) {
+    const ready = batch.filter(r => r.bytes !== undefined);
+    const sources = ready.map(({ file, bytes, snapshot }) => ({ source: bytes!, lang: detectLanguage(file), snapshot }));
+    // Trees parsed for a cache are saved with it, for the next ruleset.
+    const saving: Promise<void>[] = [];
+    const onSnapshot = (i: number, snapshot: Uint8Array) => saving.push(cache!.storeSnapshot(ready[i].hash!, sources[i].lang, snapshot));
+    const results = ruleset.applyMany(sources, cache ? { ...opts, onSnapshot } : opts);
+    if (cache) await Promise.all([...saving, ...ready.map((r, i) => cache.store(r.hash!, sources[i].lang, results[i]))]);
+    let k = 0;
+    for (const { file, bytes, findings, error } of batch) {
+      if (bytes) yield { file, findings: results[k++], bytes };
+      else yield findings ? { file, findings } : { file, findings: [], error };
+    }
+  }
+}
+
+async function* each<T>(items: Iterable<T> | AsyncIterable<T>): AsyncGenerator<T> {
+  yield* items;
+}
+
+/** Group a stream into arrays of up to `size`, each yielded as soon as it fills. */
+export async function* batches<T>(items: AsyncIterable<T> | Iterable<T>, size: number): AsyncGenerator<T[]> {
+  let batch: T[] = [];
+  for await (const item of items) {
+    batch.push(item);
+    if (batch.length >= size) {
+      yield batch;
+      batch = [];
+    }
+  }
+  if (batch.length > 0) yield batch;
+}
+
+/**
+ * Write `text` to `stream`, waiting for it to drain when its buffer is past
+ * the high-water mark: the backpressure that pauses the stages upstream.
+ */
+export async function write(stream: NodeJS.WritableStream, text: string): Promise<void> {
+  if (!stream.write(text)) await once(stream, "drain");
+}
@@ -0,0 +1,175 @@
+import { Worker } from "node:worker_threads";
+import { availableParallelism } from "node:os";
+import type { Finding, Language, Match } from "./types.js";
+
+// ── Worker pool ──────────────────────────────────────────
+//
+// Each worker thread instantiates its own engine and loads the ruleset once
+// at startup. A job posts the whole file list to every worker together with
+// a SharedArrayBuffer cursor; workers claim the next file with Atomics.add
+// until the list runs out, so a worker stuck on a large file never holds up
+// the rest. Results come back tagged with their file index and are yielded
+// in file order.
+
+export interface PoolOptions {
+  /** Worker threads (default: os.availableParallelism()). */
+  size?: number;
+  /** Compiled rules (encodeRules output) each worker loads, for scan(). */
+  rules?: Uint8Array;
+}
+
+export interface PoolRunOptions {
+  /** Language for every file (default: detected from the extension). */
+  lang?: Language;
+  /** Stop after this many matches per file. */
+  limit?: number;
+}
+
+export interface PoolScanOptions {
+  /**
+   * Also return the content hash (hashBytes) of the bytes each file was
+   * scanned as, read in the same worker read as the findings.
+   */
+  hash?: boolean;
+}
+
+export interface FileFindings {
+  file: string;
+  findings: Finding[];
+  /** With PoolScanOptions.hash, the hash of the bytes scanned. */
+  hash?: string;
+  /** Set when the file could not be read or parsed. */
+  error?: string;
+}
+
+export interface FileMatches {
+  file: string;
+  matches: Match[];
+  /** Set when the file could not be read or parsed. */
+  error?: string;
+}
+
+export interface Pool {
+  readonly size: number;
+  /** Apply the pool's rules to `files`, yielding one result per file in order. */
+  scan(files: string[], opts?: PoolScanOptions): AsyncIterableIterator<FileFindings>;
+  /** Match `pattern` against `files`, yielding one result per file in order. */
+  run(pattern: string, files: string[], opts?: PoolRunOptions): AsyncIterableIterator<FileMatches>;
+  /** Terminate the workers. Unfinished iterators throw. */
+  close(): Promise<void>;
+}
+
+/** @internal Job posted to every worker. */
+export interface JobMessage {
+  job: number;
+  files: string[];
+  /** Int32 cursor: index of the next unclaimed file. */
+  next: SharedArrayBuffer;
+  pattern?: string;
+  lang?: Language;
+  limit?: number;
+  hash?: boolean;
+}
+
+/** @internal One file's result from a worker. */
+export interface ResultMessage {
+  job: number;
+  index: number;
+  items: Finding[] | Match[];
+  hash?: string;
+  error?: string;
+}
+
+interface PendingJob {
+  deliver(msg: ResultMessage): void;
+  fail(err: Error): void;
+}
+
+/** The worker entry next to this module: worker.ts from source, worker.js from dist/. */
+function workerUrl(): URL {
+  return new URL(import.meta.url.endsWith(".ts") ? "./worker.ts" : "./worker.js", import.meta.url);
+}
+
+export function createPool(opts: PoolOptions = {}): Pool {
+  const size = Math.max(1, Math.floor(opts.size ?? availableParallelism()));
+  const jobs = new Map<number, PendingJob>();
+  let nextJob = 1;
+  let closed = false;
+
+  const failAll = (err: Error) => {
+    for (const job of jobs.values()) job.fail(err);
+  };
+
+  const workers = Array.from({ length: size }, () => {
+    const worker = new Worker(workerUrl(), { workerData: { rules: opts.rules ?? null } });
+    worker.on("message", (msg: ResultMessage) => jobs.get(msg.job)?.deliver(msg));
+    worker.on("error", err => failAll(err));
+    worker.on("exit", code => {
+      if (!closed) failAll(new Error(`codesift: pool worker exited with code ${code}`));
+    });
+    return worker;
+  });
+
+  function submit<T>(files: string[], job: Omit<JobMessage, "job" | "files" | "next">, wrap: (file: string, msg: ResultMessage) => T): AsyncIterableIterator<T> {
+    if (closed) throw new Error("codesift: pool is closed");
+    const id = nextJob++;
+    const next = new SharedArrayBuffer(4);
+    const results = new Map<number, ResultMessage>();
+    let failure: Error | null = null;
+    let wake: (() => void) | null = null;
+
+    jobs.set(id, {
+      deliver(msg) {
+        results.set(msg.index, msg);
+        wake?.();
+      },
+      fail(err) {
+        failure = err;
+        wake?.();
+      },
+    });
+    for (const worker of workers) worker.postMessage({ ...job, job: id, files, next } satisfies JobMessage);
+
+    async function* ordered(): AsyncGenerator<T> {
+      try {
+        for (let i = 0; i < files.length; i++) {
+          let msg = results.get(i);
+          while (!msg) {
+            if (failure) throw failure;
+            await new Promise<void>(resolve => (wake = resolve));
+            msg = results.get(i);
+          }
+          results.delete(i);
+          yield wrap(files[i], msg);
+        }
+      } finally {
+        // Abandoned early: let the workers skip the remaining files.
+        Atomics.store(new Int32Array(next), 0, files.length);
+        jobs.delete(id);
+      }
+    }
+    return ordered();
+  }
+
+  return {
+    size,
+    scan(files: string[], scanOpts: PoolScanOptions = {}): AsyncIterableIterator<FileFindings> {
+      if (!opts.rules) throw new Error("codesift: createPool() needs `rules` to scan");
+      return submit(files, { hash: scanOpts.hash }, (file, msg) => ({
+        file,
+        findings: msg.items as Finding[],
+        ...(msg.hash ? { hash: msg.hash } : {}),
+        ...(msg.error ? { error: msg.error } : {}),
+      }));
+    },
+    run(pattern: string, files: string[], runOpts: PoolRunOptions = {}): AsyncIterableIterator<FileMatches> {
+      return submit(files, { pattern, lang: runOpts.lang, limit: runOpts.limit }, (file, msg) => ({ file, matches: msg.items as Match[], ...(msg.error ? { error: msg.error } : {}) }));
+    },
+    async close(): Promise<void> {
+      if (closed) return;
+      closed = true;
+      failAll(new Error("codesift: pool closed"));
+      await Promise.all(workers.map(w => w.terminate()));
+    },
+  };
+}
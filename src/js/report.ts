@@ -0,0 +1,177 @@
+import { write } from "./pipeline.js";
+import type { Finding, RuleDefinition } from "./types.js";
+
+// ── Finding writers ──────────────────────────────────────
+//
+// Scan output is written as each file completes, never collected first.
+// json and sarif open their document up front and write one array element
+// per record; the bytes match what JSON.stringify(doc, null, 2) gives for
+// the whole document, so consumers see no difference but the timing. ndjson
+// writes one finding per line, for tools that read results as they arrive.
+
+export type ReportFormat = "text" | "json" | "ndjson" | "sarif";
+
+export const REPORT_FORMATS: readonly ReportFormat[] = ["text", "json", "ndjson", "sarif"];
+
+export interface FindingWriter {
+  /** Write one file's findings. `source` is only called for text snippets. */
+  file(file: string, findings: Finding[], source: () => string): Promise<void>;
+  /** Close the document; `files` is how many files were scanned. */
+  end(files: number): Promise<void>;
+  /** Findings written so far. */
+  readonly count: number;
+}
+
+export function createFindingWriter(format: ReportFormat, out: NodeJS.WritableStream, rules: RuleDefinition[]): FindingWriter {
+  let count = 0;
+  // An array document is opened by its first element and closed by end().
+  const doc = format === "sarif" ? sarifFrame(rules) : format === "json" ? arrayFrame("[]", 0) : null;
+  let elements = 0;
+
+  function element(json: string): string {
+    if (!doc) return json;
+    const sep = elements++ === 0 ? doc.head : ",";
+    return `${sep}\n${indent(json, doc.depth)}`;
+  }
+
+  return {
+    get count() {
+      return count;
+    },
+    async file(file: string, findings: Finding[], source: () => string): Promise<void> {
+      if (findings.length === 0) return;
+      count += findings.length;
+      switch (format) {
+        case "text":
+          await write(out, formatTextFindings(file, findings, source()) + "\n");
+          break;
+        case "ndjson":
+          await write(out, findings.map(f => JSON.stringify({ file, ...f }) + "\n").join(""));
+          break;
+        case "json":
+          await write(out, element(JSON.stringify({ file, findings }, null, 2)));
+          break;
+        case "sarif":
+          await write(out, sarifResults(file, findings).map(r => element(JSON.stringify(r, null, 2))).join(""));
+          break;
+      }
+    },
+    async end(files: number): Promise<void> {
+      if (format === "text") await write(out, `\n${count} finding(s) in ${files} file(s)\n`);
+      else if (doc) await write(out, (elements === 0 ? doc.empty : `\n${" ".repeat(doc.depth - 2)}${doc.tail}`) + "\n");
+    },
+  };
+}
+
+/** How to stream the elements of the one empty array in a document. */
+interface ArrayFrame {
+  /** Everything up to and including the array's "[". */
+  head: string;
+  /** From the array's "]" to the end. */
+  tail: string;
+  /** The whole document with the array empty. */
+  empty: string;
+  /** Indentation of the array's elements. */
+  depth: number;
+}
+
+/** Split `doc` (pretty-printed, with one `[]`) around its array. */
+function arrayFrame(doc: string, depth: number): ArrayFrame {
+  const at = doc.indexOf("[]");
+  return { head: doc.slice(0, at + 1), tail: doc.slice(at + 1), empty: doc, depth: depth + 2 };
+}
+
+function indent(json: string, depth: number): string {
+  const pad = " ".repeat(depth);
+  return pad + json.replace(/\n/g, "\n" + pad);
+}
+
+// ── SARIF ────────────────────────────────────────────────
+
+interface SarifResult {
+  ruleId: string;
+  level: string;
+  message: { text: string };
+  locations: Array<{
+    physicalLocation: {
+      artifactLocation: { uri: string };
+      region: {
+        startLine: number;
+        startColumn: number;
+        endLine: number;
+        endColumn: number;
+      };
+    };
+  }>;
+}
+
+function sarifFrame(rules: RuleDefinition[]): ArrayFrame {
+  const doc = JSON.stringify({
+    $schema: "https://raw.githubusercontent.com/oasis-tcs/sarif-spec/main/sarif-2.1/schema/sarif-schema-2.1.0.json",
+    version: "2.1.0",
+    runs: [
+      {
+        tool: {
+          driver: {
+            name: "codesift",
+            version: "0.1.0",
+            rules: rules.map((r) => ({
+              id: r.id,
+              shortDescription: { text: r.message },
+              defaultConfiguration: { level: r.severity ?? "error" },
+            })),
+          },
+        },
+        results: [],
+      },
+    ],
+  }, null, 2);
+  // `results` is the last key written, so its "[]" is the last one in the document.
+  const at = doc.lastIndexOf('"results": []');
+  const lineStart = doc.lastIndexOf("\n", at) + 1;
+  const frame = arrayFrame(doc.slice(lineStart), at - lineStart);
+  return { ...frame, head: doc.slice(0, lineStart) + frame.head, empty: doc };
+}
+
+function sarifResults(file: string, findings: Finding[]): SarifResult[] {
+  const results: SarifResult[] = [];
+  for (const f of findings) {
+    for (const m of f.matches) {
+      results.push({
+        ruleId: f.ruleId,
+        level: f.severity === "error" ? "error" : f.severity === "warning" ? "warning" : "note",
+        message: { text: f.message },
+        locations: [
+          {
+            physicalLocation: {
+              artifactLocation: { uri: file },
+              region: {
+                startLine: m.start_row + 1,
+                startColumn: m.start_col + 1,
+                endLine: m.end_row + 1,
+                endColumn: m.end_col + 1,
+              },
+            },
+          },
+        ],
+      });
+    }
+  }
+  return results;
+}
+
+// ── Text ─────────────────────────────────────────────────
+
+export function formatTextFindings(file: string, findings: Finding[], source: string): string {
+  const sourceLines = source.split("\n");
+  const lines: string[] = [];
+  for (const f of findings) {
+    for (const m of f.matches) {
+      const line = sourceLines[m.start_row] ?? "";
+      lines.push(`${file}:${m.start_row + 1}:${m.start_col + 1}: ${f.severity} [${f.ruleId}] ${f.message}`);
+      lines.push(`  ${line.trimEnd()}`);
+      lines.push(`  ${" ".repeat(m.start_col)}${"^".repeat(Math.max(1, m.end_col - m.start_col))}`);
+    }
+  }
+  return lines.join("\n");
+}
@@ -0,0 +1,25 @@
+import { parentPort, workerData } from "node:worker_threads";
+import { readPart, threadImports, type PartJob, type PartResult, type ThreadExports, type ThreadWorkerData } from "./threads.js";
+
+// Threaded engine worker (see threads.ts): one more instance of
+// engine-threads.wasm on the shared memory, evaluating the part of each
+// apply it is sent in the engine context it was given.
+
+const { module, memory, stackTop, tlsBlock, ctx } = workerData as ThreadWorkerData;
+const ex = new WebAssembly.Instance(module, threadImports(memory)).exports as unknown as ThreadExports;
+
+// Before any other call: this thread's own stack and thread-local block,
+// which the calling thread allocated from the shared heap.
+ex.__stack_pointer.value = stackTop;
+ex.__wasm_init_tls(tlsBlock);
+
+parentPort?.on("message", (job: PartJob) => {
+  let msg: PartResult;
+  try {
+    ex.apply_ruleset_partition(ctx, job.ruleset, job.source, job.part, job.parts);
+    msg = { job: job.job, findings: readPart(ex, memory, ctx) };
+  } catch (e) {
+    msg = { job: job.job, findings: [], error: e instanceof Error ? e.message : String(e) };
+  }
+  parentPort!.postMessage(msg);
+});
@@ -0,0 +1,268 @@
+import { Worker } from "node:worker_threads";
+import { availableParallelism } from "node:os";
+import * as fs from "node:fs/promises";
+import { langToInt, isWasmLanguage } from "./types.js";
+import { ParseBudgetExceededError } from "./index.js";
+import type { Finding, Language, ParseOptions } from "./types.js";
+
+// ── Threaded engine ──────────────────────────────────────
+//
+// engine-threads.wasm is the engine built with atomics and an imported
+// shared memory. The calling thread and every worker instantiate it against
+// one WebAssembly.Memory. The calling thread loads the rules and parses each
+// source once; then every thread evaluates its share of the rules
+// (apply_ruleset_partition) against that same tree, on its own stack and in
+// its own engine context, so results and scratch lists never overlap. This
+// parallelizes one large file, where the worker pool (pool.ts) parallelizes
+// across files.
+
+/** Shared memory limits in 64 KiB pages; must match build.zig. */
+const INITIAL_PAGES = (64 << 20) >> 16;
+const MAXIMUM_PAGES = (1 << 30) >> 16;
+/** Stack per worker thread, as large as the calling thread's. */
+const WORKER_STACK = 1 << 20;
+const PARSE_BUDGET_EXCEEDED = 2;
+
+export interface ThreadedRulesetOptions {
+  /** Compiled rules (encodeRules output). */
+  rules: Uint8Array;
+  /** Threads evaluating rules, the calling thread included (default: os.availableParallelism()). */
+  threads?: number;
+  /** Location of engine-threads.wasm (default: next to this module). */
+  wasmUrl?: string | URL;
+}
+
+export interface ThreadedRuleset {
+  readonly threads: number;
+  /**
+   * Parse `source` once and evaluate the rules on every thread, each taking
+   * a contiguous share. Findings are the same, in the same order, as
+   * CompiledRuleset.applySource. Calls run one at a time.
+   */
+  apply(source: string, lang: Language, opts?: ParseOptions): Promise<Finding[]>;
+  /** Terminate the workers and free the rules. Pending applies reject. */
+  close(): Promise<void>;
+}
+
+/** @internal Exports of engine-threads.wasm used here and in thread-worker.ts. */
+export interface ThreadExports {
+  alloc(size: number): number;
+  dealloc(ptr: number, size: number): void;
+  context_create(): number;
+  context_free(ctx: number): void;
+  load_ruleset(bytecode_ptr: number, bytecode_len: number): number;
+  free_ruleset(handle: number): void;
+  ruleset_prefilter(ctx: number, ruleset_handle: number, src_ptr: number, src_len: number): number;
+  compile_source_owned(ctx: number, src_ptr: number, src_len: number, lang: number, budget_us: number): number;
+  get_parse_status(ctx: number): number;
+  free_source(handle: number): void;
+  apply_ruleset_partition(ctx: number, ruleset_handle: number, src_handle: number, part: number, parts: number): void;
+  prepare_partitions(ctx: number, ruleset_handle: number, src_handle: number): number;
+  get_ruleset_result_ptr(ctx: number): number;
+  get_ruleset_result_len(ctx: number): number;
+  __stack_pointer: WebAssembly.Global;
+  __tls_size: WebAssembly.Global;
+  __tls_align: WebAssembly.Global;
+  __wasm_init_tls(tls_block: number): void;
+}
+
+/** @internal Data each worker starts with. */
+export interface ThreadWorkerData {
+  module: WebAssembly.Module;
+  memory: WebAssembly.Memory;
+  /** Top of the worker's stack, allocated by the calling thread. */
+  stackTop: number;
+  /** The worker's thread-local block, __tls_size bytes. */
+  tlsBlock: number;
+  /** The worker's engine context, created by the calling thread. */
+  ctx: number;
+}
+
+/** @internal One part of an apply, posted to one worker. */
+export interface PartJob {
+  job: number;
+  ruleset: number;
+  source: number;
+  part: number;
+  parts: number;
+}
+
+/** @internal A worker's findings for its part. */
+export interface PartResult {
+  job: number;
+  findings: Finding[];
+  error?: string;
+}
+
+/** @internal Imports for one thread's instance of engine-threads.wasm. */
+export function threadImports(memory: WebAssembly.Memory): WebAssembly.Imports {
+  // Host clock for parse budgets (wasm32-freestanding has none).
+  return { env: { memory, now_us: () => performance.now() * 1000 } };
+}
+
+/** @internal Findings the last apply_ruleset_partition in `ctx` wrote. */
+export function readPart(exports: ThreadExports, memory: WebAssembly.Memory, ctx: number): Finding[] {
+  const len = exports.get_ruleset_result_len(ctx);
+  if (len === 0) return [];
+  // TextDecoder rejects views of shared memory, so copy the JSON out first.
+  const bytes = new Uint8Array(memory.buffer, exports.get_ruleset_result_ptr(ctx), len).slice();
+  return JSON.parse(new TextDecoder().decode(bytes));
+}
+
+/** The worker entry next to this module: thread-worker.ts from source, thread-worker.js from dist/. */
+function workerUrl(): URL {
+  return new URL(import.meta.url.endsWith(".ts") ? "./thread-worker.ts" : "./thread-worker.js", import.meta.url);
+}
+
+async function compileThreadedEngine(url: string | URL): Promise<WebAssembly.Module> {
+  const href = url.toString();
+  let bytes: Uint8Array;
+  try {
+    if (href.startsWith("file:")) {
+      bytes = new Uint8Array(await fs.readFile(new URL(href)));
+    } else {
+      const res = await fetch(url);
+      if (!res.ok) throw new Error(`${res.status}`);
+      bytes = new Uint8Array(await res.arrayBuffer());
+    }
+  } catch (e) {
+    throw new Error(`codesift: cannot load the threaded engine from ${href} (${e instanceof Error ? e.message : e}); build it with \`bun run build:zig\` or pass wasmUrl`);
+  }
+  return WebAssembly.compile(bytes as BufferSource);
+}
+
+/** An aligned block of `size` bytes from the engine heap: [ptr to free, aligned start]. */
+function allocAligned(ex: ThreadExports, size: number, align: number): [number, number] {
+  const ptr = ex.alloc(size + align);
+  if (!ptr) throw new Error("codesift: out of memory starting threads");
+  return [ptr, (ptr + align - 1) & ~(align - 1)];
+}
+
+/**
+ * Load `rules` into a threaded engine and start `threads - 1` workers that
+ * share its memory. Node only, like codesift/pool.
+ */
+export async function createThreadedRuleset(opts: ThreadedRulesetOptions): Promise<ThreadedRuleset> {
+  const threads = Math.max(1, Math.floor(opts.threads ?? availableParallelism()));
+  const module = await compileThreadedEngine(opts.wasmUrl ?? new URL("./engine-threads.wasm", import.meta.url));
+  const memory = new WebAssembly.Memory({ initial: INITIAL_PAGES, maximum: MAXIMUM_PAGES, shared: true });
+  const instance = await WebAssembly.instantiate(module, threadImports(memory));
+  const ex = instance.exports as unknown as ThreadExports;
+
+  // One engine context per thread, all created here: the context table is
+  // shared and only this thread writes it.
+  const contexts = Array.from({ length: threads }, () => ex.context_create());
+  if (contexts.includes(0)) throw new Error("codesift: out of memory starting threads");
+  const ctx = contexts[0];
+
+  // The engine keeps pointers into the bytecode, so it stays allocated until close().
+  const bytecode = ex.alloc(opts.rules.length);
+  if (!bytecode) throw new Error("codesift: out of memory loading rules");
+  new Uint8Array(memory.buffer, bytecode, opts.rules.length).set(opts.rules);
+  const ruleset = ex.load_ruleset(bytecode, opts.rules.length);
+  if (ruleset === 0) {
+    ex.dealloc(bytecode, opts.rules.length);
+    throw new Error("codesift: failed to load rules");
+  }
+
+  const tlsSize = ex.__tls_size.value as number;
+  const tlsAlign = Math.max(ex.__tls_align.value as number, 1);
+  const blocks: [number, number][] = [];
+  const pending = new Map<number, { resolve(findings: Finding[]): void; reject(err: Error): void }>();
+  let nextJob = 1;
+  let closed = false;
+
+  const failAll = (err: Error) => {
+    for (const job of pending.values()) job.reject(err);
+    pending.clear();
+  };
+
+  const workers = Array.from({ length: threads - 1 }, (_, i) => {
+    const [stack, stackBase] = allocAligned(ex, WORKER_STACK, 16);
+    const [tls, tlsBlock] = allocAligned(ex, tlsSize, tlsAlign);
+    blocks.push([stack, WORKER_STACK + 16], [tls, tlsSize + tlsAlign]);
+    const workerData: ThreadWorkerData = { module, memory, stackTop: stackBase + WORKER_STACK, tlsBlock, ctx: contexts[i + 1] };
+    const worker = new Worker(workerUrl(), { workerData });
+    worker.on("message", (msg: PartResult) => {
+      const job = pending.get(msg.job);
+      if (!job) return;
+      pending.delete(msg.job);
+      if (msg.error) job.reject(new Error(msg.error));
+      else job.resolve(msg.findings);
+    });
+    worker.on("error", err => failAll(err));
+    worker.on("exit", code => {
+      if (!closed) failAll(new Error(`codesift: engine thread exited with code ${code}`));
+    });
+    return worker;
+  });
+
+  function runPart(worker: Worker, job: Omit<PartJob, "job">): Promise<Finding[]> {
+    const id = nextJob++;
+    return new Promise((resolve, reject) => {
+      pending.set(id, { resolve, reject });
+      worker.postMessage({ ...job, job: id } satisfies PartJob);
+    });
+  }
+
+  async function applyNow(source: string, lang: Language, applyOpts?: ParseOptions): Promise<Finding[]> {
+    if (closed) throw new Error("codesift: threaded ruleset is closed");
+    if (!isWasmLanguage(lang)) return [];
+    const bytes = new TextEncoder().encode(source);
+    if (bytes.length === 0) return [];
+    const ptr = ex.alloc(bytes.length);
+    if (!ptr) return [];
+    new Uint8Array(memory.buffer, ptr, bytes.length).set(bytes);
+    if (ex.ruleset_prefilter(ctx, ruleset, ptr, bytes.length) === 0) {
+      ex.dealloc(ptr, bytes.length);
+      return [];
+    }
+
+    const us = applyOpts?.budgetUs;
+    const budget = us && us > 0 ? Math.min(Math.ceil(us), 0xFFFFFFFF) : 0;
+    // The engine takes ownership of the bytes, as in applySource.
+    const src = ex.compile_source_owned(ctx, ptr, bytes.length, langToInt(lang), budget);
+    if (src === 0) {
+      if (ex.get_parse_status(ctx) === PARSE_BUDGET_EXCEEDED) throw new ParseBudgetExceededError(us ?? 0);
+      return [];
+    }
+    let others: Promise<Finding[]>[] = [];
+    try {
+      const parts = threads;
+      // Query the tree once and hand every part the rules the prefilter kept.
+      ex.prepare_partitions(ctx, ruleset, src);
+      others = workers.map((worker, i) => runPart(worker, { ruleset, source: src, part: i + 1, parts }));
+      // The calling thread takes part 0 while the workers run theirs.
+      ex.apply_ruleset_partition(ctx, ruleset, src, 0, parts);
+      const first = readPart(ex, memory, ctx);
+      return first.concat(...await Promise.all(others));
+    } finally {
+      // Workers read the tree until their parts settle, even after one fails.
+      await Promise.allSettled(others);
+      ex.free_source(src);
+    }
+  }
+
+  let queue: Promise<unknown> = Promise.resolve();
+
+  return {
+    threads,
+    apply(source: string, lang: Language, applyOpts?: ParseOptions): Promise<Finding[]> {
+      // One apply at a time: each uses the calling thread's context and every worker.
+      const result = queue.then(() => applyNow(source, lang, applyOpts));
+      queue = result.catch(() => {});
+      return result;
+    },
+    async close(): Promise<void> {
+      if (closed) return;
+      closed = true;
+      failAll(new Error("codesift: threaded ruleset closed"));
+      await Promise.all(workers.map(w => w.terminate()));
+      await queue;
+      ex.free_ruleset(ruleset);
+      ex.dealloc(bytecode, opts.rules.length);
+      for (const [ptr, size] of blocks) ex.dealloc(ptr, size);
+      for (const c of contexts) ex.context_free(c);
+    },
+  };
+}
@@ -0,0 +1,376 @@
+import * as fs from "node:fs";
+import * as path from "node:path";
+import { hashBytes } from "./index.js";
+import { batches } from "./pipeline.js";
+import { RACY_MS } from "./cache.js";
+
+// ── Trigram index ────────────────────────────────────────
+//
+// `codesift index` records which byte trigrams each discovered file
+// contains. A pattern can only match a file holding all its literals
+// (patternLiterals: `eval` in `eval($X)`), and so every trigram of them.
+// Intersecting those trigrams' posting lists leaves the few files worth
+// parsing, and `codesift run --index` parses only those, plus any file the
+// index does not cover (not indexed, or changed since).
+//
+// The index is one file, <dir>/trigrams.bin, rewritten whole on update:
+//
+//   header     magic, FORMAT_VERSION, file list byte length, trigram count
+//   file list  JSON [path, size, mtimeMs, ino, content hash] by file id,
+//              padded to 4 bytes
+//   table      [trigram, offset, count] u32 triples, sorted by trigram
+//   postings   each trigram's file ids, ascending, as LEB128 gaps
+//
+// An update reads only files whose size, mtime or inode changed, and
+// re-indexes only those whose content hash changed too. The other files'
+// postings are carried over, with ids renumbered densely.
+
+/** [path, size, mtimeMs, ino, content hash]; mtimeMs is -1 when too recent to trust. */
+type IndexEntry = [path: string, size: number, mtimeMs: number, ino: number, hash: string];
+
+const INDEX_FILE = "trigrams.bin";
+const MAGIC = 0x47545343; // "CSTG"
+const FORMAT_VERSION = 1;
+const HEADER_LEN = 16;
+/** Files stat'ed (and read) at once. */
+const IO_BATCH = 256;
+
+export interface TrigramIndexStats {
+  /** Files in the index. */
+  files: number;
+  /** Files whose trigrams were (re)computed. */
+  indexed: number;
+}
+
+export interface TrigramIndex {
+  /** Whether the index holds `file` as it is now: same size, mtime and inode. */
+  covers(file: string, st: fs.Stats): boolean;
+  /**
+   * Indexed files (absolute paths) holding every trigram of `literals`,
+   * or null when the literals have none and rule nothing out.
+   */
+  candidates(literals: string[]): Promise<Set<string> | null>;
+  close(): Promise<void>;
+}
+
+const enc = new TextEncoder();
+const dec = new TextDecoder();
+
+/** One bit per 24-bit trigram, cleared again after each trigramsOf call. */
+const seen = new Uint8Array(1 << 21);
+
+/** The distinct trigrams of `bytes`, each packed big-endian into 24 bits. */
+export function trigramsOf(bytes: Uint8Array): Uint32Array {
+  const found: number[] = [];
+  let t = 0;
+  for (let i = 0; i < bytes.length; i++) {
+    t = ((t << 8) | bytes[i]) & 0xffffff;
+    if (i < 2 || seen[t >>> 3] & (1 << (t & 7))) continue;
+    seen[t >>> 3] |= 1 << (t & 7);
+    found.push(t);
+  }
+  for (const f of found) seen[f >>> 3] = 0;
+  return Uint32Array.from(found);
+}
+
+function sameStat(entry: IndexEntry, st: fs.Stats): boolean {
+  return entry[1] === st.size && entry[2] === st.mtimeMs && entry[3] === st.ino;
+}
+
+/**
+ * Bring the index under `dir` up to date with `files`, creating it if
+ * needed. Files no longer listed are dropped.
+ */
+export async function updateTrigramIndex(dir: string, files: Iterable<string> | AsyncIterable<string>): Promise<TrigramIndexStats> {
+  const indexFile = path.join(dir, INDEX_FILE);
+  const bytes = await fs.promises.readFile(indexFile).catch(() => null);
+  const old = bytes ? parseHead(bytes) : null;
+  const oldFiles = old?.files ?? [];
+  const oldIds = new Map(oldFiles.map((entry, id) => [entry[0], id]));
+
+  // Files whose old postings still hold, by old id, and files to index.
+  const kept: Array<{ id: number; entry: IndexEntry }> = [];
+  const fresh: Array<{ entry: IndexEntry; trigrams: Uint32Array }> = [];
+  const listed = new Set<string>();
+  for await (const batch of batches(files, IO_BATCH)) {
+    await Promise.all(batch.map(async name => {
+      const file = path.resolve(name);
+      if (listed.has(file)) return;
+      listed.add(file);
+      const st = await fs.promises.stat(file).catch(() => null);
+      if (!st) return;
+      const id = oldIds.get(file);
+      const known = id === undefined ? undefined : oldFiles[id];
+      if (known && sameStat(known, st)) {
+        kept.push({ id: id!, entry: known });
+        return;
+      }
+      const content = await fs.promises.readFile(file).catch(() => null);
+      if (!content) return;
+      const entry: IndexEntry = [file, st.size, st.mtimeMs + RACY_MS < Date.now() ? st.mtimeMs : -1, st.ino, hashBytes(content)];
+      if (known && known[4] === entry[4]) kept.push({ id: id!, entry });
+      else fresh.push({ entry, trigrams: trigramsOf(content) });
+    }));
+  }
+
+  // Kept files take the first ids in their old order, so remapped lists
+  // stay sorted; indexed files follow.
+  kept.sort((a, b) => a.id - b.id);
+  fresh.sort((a, b) => (a.entry[0] < b.entry[0] ? -1 : 1));
+  const remap = new Int32Array(oldFiles.length).fill(-1);
+  kept.forEach(({ id }, k) => (remap[id] = k));
+
+  // The indexed files' postings, grouped by trigram: keys[j]'s ids are
+  // ids[starts[j]..starts[j + 1]].
+  const slot = new Map<number, number>();
+  for (const { trigrams } of fresh) for (const t of trigrams) slot.set(t, (slot.get(t) ?? 0) + 1);
+  const keys = Uint32Array.from(slot.keys()).sort();
+  const starts = new Uint32Array(keys.length + 1);
+  keys.forEach((t, j) => {
+    starts[j + 1] = starts[j] + slot.get(t)!;
+    slot.set(t, j);
+  });
+  const ids = new Uint32Array(starts[keys.length]);
+  const fill = starts.slice(0, keys.length);
+  fresh.forEach(({ trigrams }, k) => {
+    for (const t of trigrams) ids[fill[slot.get(t)!]++] = kept.length + k;
+  });
+
+  // Merge the old table with the new keys, both sorted by trigram.
+  const out = new PostingWriter();
+  const table: number[] = [];
+  const oldTable = old?.table ?? new Uint32Array(0);
+  const oldCount = oldTable.length / 3;
+  const oldData = old ? bytes!.subarray(old.dataAt) : new Uint8Array(0);
+  let i = 0;
+  let j = 0;
+  while (i < oldCount || j < keys.length) {
+    const oldKey = i < oldCount ? oldTable[i * 3] : Infinity;
+    const newKey = j < keys.length ? keys[j] : Infinity;
+    const t = Math.min(oldKey, newKey);
+    const offset = out.begin();
+    if (oldKey === t) {
+      for (const id of readPostings(oldData, oldTable[i * 3 + 1], oldTable[i * 3 + 2])) {
+        if (remap[id] >= 0) out.add(remap[id]);
+      }
+      i++;
+    }
+    if (newKey === t) {
+      for (let k = starts[j]; k < starts[j + 1]; k++) out.add(ids[k]);
+      j++;
+    }
+    if (out.count > 0) table.push(t, offset, out.count);
+  }
+
+  const entries = [...kept.map(k => k.entry), ...fresh.map(f => f.entry)];
+  const list = enc.encode(JSON.stringify(entries));
+  const tableAt = HEADER_LEN + ((list.length + 3) & ~3);
+  const postings = out.bytes();
+  const index = new Uint8Array(tableAt + table.length * 4 + postings.length);
+  new Uint32Array(index.buffer, 0, 4).set([MAGIC, FORMAT_VERSION, list.length, table.length / 3]);
+  index.set(list, HEADER_LEN);
+  new Uint32Array(index.buffer, tableAt, table.length).set(table);
+  index.set(postings, tableAt + table.length * 4);
+
+  // Write-then-rename, so a concurrent run never reads a partial index.
+  await fs.promises.mkdir(dir, { recursive: true });
+  const tmp = `${indexFile}.${process.pid}.tmp`;
+  await fs.promises.writeFile(tmp, index);
+  await fs.promises.rename(tmp, indexFile);
+  return { files: entries.length, indexed: fresh.length };
+}
+
+/** Open the index under `dir` for lookups, or null if there is none (or it is from another version). */
+export async function openTrigramIndex(dir: string): Promise<TrigramIndex | null> {
+  const fh = await fs.promises.open(path.join(dir, INDEX_FILE)).catch(() => null);
+  if (!fh) return null;
+  // Only the file list and table are read up front; posting lists as queried.
+  const header = new Uint8Array(HEADER_LEN);
+  const size = (await fh.stat()).size;
+  await fh.read(header, 0, HEADER_LEN, 0);
+  const len = headLength(header);
+  const head = len !== null && len <= size ? new Uint8Array(len) : null;
+  if (head) await fh.read(head, 0, head.length, 0);
+  const parsed = head ? parseHead(head) : null;
+  if (!parsed) {
+    await fh.close();
+    return null;
+  }
+  const { files, table, dataAt } = parsed;
+  const ids = new Map(files.map((entry, id) => [entry[0], id]));
+  const count = table.length / 3;
+
+  async function postings(k: number): Promise<Uint32Array> {
+    const from = table[k * 3 + 1];
+    const to = k + 1 < count ? table[(k + 1) * 3 + 1] : size - dataAt;
+    const data = new Uint8Array(to - from);
+    await fh.read(data, 0, data.length, dataAt + from);
+    return readPostings(data, 0, table[k * 3 + 2]);
+  }
+
+  return {
+    covers(file: string, st: fs.Stats): boolean {
+      const id = ids.get(path.resolve(file));
+      return id !== undefined && sameStat(files[id], st);
+    },
+
+    async candidates(literals: string[]): Promise<Set<string> | null> {
+      const wanted = new Set<number>();
+      for (const lit of literals) for (const t of trigramsOf(enc.encode(lit))) wanted.add(t);
+      if (wanted.size === 0) return null;
+      const rows: number[] = [];
+      for (const t of wanted) {
+        const k = findTrigram(table, t);
+        if (k < 0) return new Set();
+        rows.push(k);
+      }
+      // Shortest lists first: the running intersection only shrinks.
+      rows.sort((a, b) => table[a * 3 + 2] - table[b * 3 + 2]);
+      let hits = await postings(rows[0]);
+      for (const k of rows.slice(1)) {
+        if (hits.length === 0) break;
+        hits = intersect(hits, await postings(k));
+      }
+      return new Set(Array.from(hits, id => files[id][0]));
+    },
+
+    async close(): Promise<void> {
+      await fh.close();
+    },
+  };
+}
+
+/**
+ * The files of `files` that can match: the candidates `index` gives for
+ * the literals `literalsFor(file)` requires, plus every file it does not
+ * cover. Order is kept.
+ */
+export async function* indexedCandidates(
+  files: AsyncIterable<string> | Iterable<string>,
+  index: TrigramIndex,
+  literalsFor: (file: string) => string[],
+): AsyncGenerator<string> {
+  const found = new Map<string, Promise<Set<string> | null>>();
+  for await (const batch of batches(files, IO_BATCH)) {
+    const keep = await Promise.all(batch.map(async file => {
+      const st = await fs.promises.stat(file).catch(() => null);
+      if (!st || !index.covers(file, st)) return true;
+      const literals = literalsFor(file);
+      const key = literals.join("\0");
+      let candidates = found.get(key);
+      if (!candidates) found.set(key, (candidates = index.candidates(literals)));
+      const set = await candidates;
+      return set === null || set.has(path.resolve(file));
+    }));
+    for (let k = 0; k < batch.length; k++) if (keep[k]) yield batch[k];
+  }
+}
+
+// ── Encoding ─────────────────────────────────────────────
+
+/** Bytes from the start of an index to the end of its table, or null if `header` is not an index header. */
+function headLength(header: Uint8Array): number | null {
+  if (header.length < HEADER_LEN) return null;
+  const view = new DataView(header.buffer, header.byteOffset, HEADER_LEN);
+  if (view.getUint32(0, true) !== MAGIC || view.getUint32(4, true) !== FORMAT_VERSION) return null;
+  return HEADER_LEN + ((view.getUint32(8, true) + 3) & ~3) + view.getUint32(12, true) * 12;
+}
+
+function parseHead(bytes: Uint8Array): { files: IndexEntry[]; table: Uint32Array; dataAt: number } | null {
+  const dataAt = headLength(bytes);
+  if (dataAt === null || dataAt > bytes.length) return null;
+  const view = new DataView(bytes.buffer, bytes.byteOffset, HEADER_LEN);
+  const listLen = view.getUint32(8, true);
+  const tableAt = HEADER_LEN + ((listLen + 3) & ~3);
+  try {
+    const files = JSON.parse(dec.decode(bytes.subarray(HEADER_LEN, HEADER_LEN + listLen))) as IndexEntry[];
+    // Copied (Buffer's slice() would not copy), as the table need not be
+    // 4-byte aligned within `bytes`.
+    return { files, table: new Uint32Array(new Uint8Array(bytes.subarray(tableAt, dataAt)).buffer), dataAt };
+  } catch {
+    return null;
+  }
+}
+
+/** Posting lists as LEB128 gaps between ascending ids, one list at a time. */
+class PostingWriter {
+  private buf = new Uint8Array(1 << 16);
+  private len = 0;
+  private last = -1;
+  count = 0;
+
+  /** Start a list; returns its offset. */
+  begin(): number {
+    this.last = -1;
+    this.count = 0;
+    return this.len;
+  }
+
+  add(id: number): void {
+    if (this.len + 5 > this.buf.length) {
+      const grown = new Uint8Array(this.buf.length * 2);
+      grown.set(this.buf);
+      this.buf = grown;
+    }
+    let gap = id - this.last;
+    this.last = id;
+    this.count++;
+    while (gap >= 0x80) {
+      this.buf[this.len++] = (gap & 0x7f) | 0x80;
+      gap >>>= 7;
+    }
+    this.buf[this.len++] = gap;
+  }
+
+  bytes(): Uint8Array {
+    return this.buf.subarray(0, this.len);
+  }
+}
+
+/** Decode `count` ids written by PostingWriter at `offset`. */
+function readPostings(data: Uint8Array, offset: number, count: number): Uint32Array {
+  const ids = new Uint32Array(count);
+  let at = offset;
+  let id = -1;
+  for (let k = 0; k < count; k++) {
+    let gap = 0;
+    let shift = 0;
+    let byte: number;
+    do {
+      byte = data[at++];
+      gap |= (byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    id += gap;
+    ids[k] = id;
+  }
+  return ids;
+}
+
+/** Row of trigram `t` in the sorted table, or -1. */
+function findTrigram(table: Uint32Array, t: number): number {
+  let lo = 0;
+  let hi = table.length / 3;
+  while (lo < hi) {
+    const mid = (lo + hi) >>> 1;
+    if (table[mid * 3] < t) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo < table.length / 3 && table[lo * 3] === t ? lo : -1;
+}
+
+/** Ids in both ascending lists. */
+function intersect(a: Uint32Array, b: Uint32Array): Uint32Array {
+  const both = new Uint32Array(Math.min(a.length, b.length));
+  let n = 0;
+  for (let i = 0, j = 0; i < a.length && j < b.length; ) {
+    if (a[i] < b[j]) i++;
+    else if (a[i] > b[j]) j++;
+    else {
+      both[n++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return both.subarray(0, n);
+}
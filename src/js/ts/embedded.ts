@@ -0,0 +1,27 @@
+/**
+ * The engine build an entry point embeds.
+ *
+ * The API module (ts/index.ts) imports no base64 itself. Each entry point
+ * registers its generated module on import: index.ts the full engine,
+ * javascript.ts the JavaScript-only build. A bundle therefore carries only
+ * the build its entry chose.
+ */
+
+export interface EmbeddedEngine {
+  /** The engine's WebAssembly bytes, base64-encoded. */
+  base64: string;
+  /** Identifies the build (scripts/embed-wasm.mjs). */
+  hash: string;
+}
+
+let embedded: EmbeddedEngine | null = null;
+
+/** Register the entry point's engine. The first registration wins. */
+export function embedEngine(build: EmbeddedEngine): void {
+  embedded ??= build;
+}
+
+export function embeddedEngine(): EmbeddedEngine {
+  if (!embedded) throw new Error("codesift: no embedded engine; import \"codesift\" or \"codesift/javascript\"");
+  return embedded;
+}
@@ -1,8 +1,9 @@
-import { wasmBase64 } from "./engine-wasm.generated.js";
+import { embeddedEngine } from "./embedded.js";
+import { openModuleCache } from "./module-cache.js";
 import { langToInt, isWasmLanguage } from "../types.js";
-import type { Language, Finding, Match, RichMatch, NodeInfo } from "../types.js";
+import type { Language, Finding, Match, RichMatch, MatchCounts, RuleCount, CountOptions, BatchSource, BatchReader, ApplyManyOptions, NodeInfo, SourceEdit, ParseOptions, MatchOptions, MatchesOptions, ScannerOptions, DumpTreeOptions, TreeDump, ApplyAsyncOptions, EngineInitOptions } from "../types.js";
 
-export type { Language, RuleDefinition, RuleNode, StopBy, MetavarConstraint, TransformOp, Finding, Match, RichMatch, NodeInfo, TraceOptions, TraceEvent, TraceFinding, TraceResult, Confidence } from "../types.js";
+export type { Language, RuleDefinition, RuleNode, StopBy, MetavarConstraint, TransformOp, Finding, Match, RichMatch, MatchCounts, RuleCount, CountOptions, BatchSource, BatchReader, ApplyManyOptions, NodeInfo, SourceEdit, ParseOptions, MatchOptions, MatchesOptions, ScannerOptions, DumpTreeOptions, TreeDump, ApplyAsyncOptions, EngineInitOptions, TraceOptions, TraceEvent, TraceFinding, TraceResult, Confidence } from "../types.js";
 export { langToInt, detectLanguage, isWasmLanguage } from "../types.js";
 export { encodeRules } from "../encoder.js";
 export { rewriteSource, trace, traceFile } from "../trace.js";
@@ -20,70 +21,270 @@ interface WasmExports {
   memory: WebAssembly.Memory;
   alloc(size: number): number;
   dealloc(ptr: number, size: number): void;
-  struct_match(pat_ptr: number, pat_len: number, src_ptr: number, src_len: number, lang: number): void;
-  get_result_ptr(): number;
-  get_result_len(): number;
+  context_create(): number;
+  context_free(ctx: number): void;
+  struct_match(ctx: number, pat_ptr: number, pat_len: number, src_ptr: number, src_len: number, lang: number, budget_us: number, limit: number): void;
+  struct_count(ctx: number, pat_ptr: number, pat_len: number, src_ptr: number, src_len: number, lang: number, budget_us: number, group_ptr: number, group_len: number): void;
+  get_result_ptr(ctx: number): number;
+  get_result_len(ctx: number): number;
+  pattern_prefilter(pat_handle: number, src_ptr: number, src_len: number): number;
+  pattern_literals(ctx: number, pat_handle: number): number;
   compile_pattern(pat_ptr: number, pat_len: number, lang: number): number;
-  match_pattern(handle: number, src_ptr: number, src_len: number): void;
+  match_pattern(ctx: number, handle: number, src_ptr: number, src_len: number, budget_us: number): void;
   free_pattern(handle: number): void;
-  compile_source(src_ptr: number, src_len: number, lang: number): number;
-  match_compiled(pat_handle: number, src_handle: number): void;
+  pattern_cache_stats(ctx: number): void;
+  compile_source(ctx: number, src_ptr: number, src_len: number, lang: number, budget_us: number): number;
+  compile_source_owned(ctx: number, src_ptr: number, src_len: number, lang: number, budget_us: number): number;
+  get_source_ptr(handle: number): number;
+  get_source_len(handle: number): number;
+  get_parse_status(ctx: number): number;
+  match_compiled(ctx: number, pat_handle: number, src_handle: number, limit: number): void;
+  count_compiled(ctx: number, pat_handle: number, src_handle: number, group_ptr: number, group_len: number): void;
   free_source(handle: number): void;
-  store_matches(): number;
-  filter_inside(matches_h: number, ctx_h: number): void;
-  filter_not_inside(matches_h: number, ctx_h: number): void;
-  filter_not(matches_h: number, excl_h: number): void;
-  intersect_matches(a_h: number, b_h: number): void;
-  free_matches(handle: number): void;
-  kind_match(src_handle: number, kind_ptr: number, kind_len: number): void;
-  match_in_range(pat_handle: number, src_handle: number, start_byte: number, end_byte: number): void;
-  match_preceding(pat_handle: number, src_handle: number, node_start: number, node_end: number): void;
-  match_following(pat_handle: number, src_handle: number, node_start: number, node_end: number): void;
+  edit_source(ctx: number, src_handle: number, src_ptr: number, src_len: number, start_byte: number, old_end_byte: number, new_end_byte: number): number;
+  store_matches(ctx: number): number;
+  filter_inside(ctx: number, matches_h: number, scope_h: number): void;
+  filter_not_inside(ctx: number, matches_h: number, scope_h: number): void;
+  filter_not(ctx: number, matches_h: number, excl_h: number): void;
+  intersect_matches(ctx: number, a_h: number, b_h: number): void;
+  free_matches(ctx: number, handle: number): void;
+  kind_match(ctx: number, src_handle: number, kind_ptr: number, kind_len: number): void;
+  match_in_range(ctx: number, pat_handle: number, src_handle: number, start_byte: number, end_byte: number, limit: number): void;
+  match_node(pat_handle: number, src_handle: number, id: number): number;
+  match_preceding(ctx: number, pat_handle: number, src_handle: number, node_start: number, node_end: number): void;
+  match_following(ctx: number, pat_handle: number, src_handle: number, node_start: number, node_end: number): void;
   load_ruleset(bytecode_ptr: number, bytecode_len: number): number;
-  apply_ruleset(ruleset_handle: number, src_handle: number): void;
+  apply_ruleset(ctx: number, ruleset_handle: number, src_handle: number): void;
+  count_ruleset(ctx: number, ruleset_handle: number, src_handle: number): void;
+  ruleset_prefilter(ctx: number, ruleset_handle: number, src_ptr: number, src_len: number): number;
+  apply_ruleset_prefiltered(ctx: number, ruleset_handle: number, src_handle: number): void;
+  apply_ruleset_many(ctx: number, ruleset_handle: number, sources_ptr: number, sources_len: number, table_ptr: number, count: number, budget_us: number): number;
+  get_batch_snapshots(ctx: number): number;
+  apply_ruleset_incremental(ctx: number, ruleset_handle: number, src_handle: number): void;
+  apply_ruleset_step(ctx: number, ruleset_handle: number, src_handle: number, fuel: number, restart: number): number;
   free_ruleset(handle: number): void;
-  get_ruleset_result_ptr(): number;
-  get_ruleset_result_len(): number;
-  // Tree traversal
-  node_root(src_handle: number): void;
-  node_info(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-  node_children(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-  node_named_children(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-  node_parent(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-  node_field_child(src_handle: number, start_byte: number, end_byte: number, is_root: number, name_ptr: number, name_len: number): void;
-  node_next(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-  node_prev(src_handle: number, start_byte: number, end_byte: number, is_root: number): void;
-}
-
-const { instance } = await WebAssembly.instantiate(
-  decodeBase64(wasmBase64) as BufferSource, { env: {} },
-) as WebAssembly.WebAssemblyInstantiatedSource;
-const wasm = instance.exports as unknown as WasmExports;
+  get_ruleset_result_ptr(ctx: number): number;
+  get_ruleset_result_len(ctx: number): number;
+  // Tree traversal (node ids; NO_NODE = none, returned as -1 by i32 exports)
+  node_root(ctx: number, src_handle: number): number;
+  node_info(ctx: number, src_handle: number, id: number): number;
+  node_at(ctx: number, src_handle: number, start_byte: number, end_byte: number): number;
+  node_child(ctx: number, src_handle: number, id: number, index: number, named_only: number): number;
+  node_children(ctx: number, src_handle: number, id: number, named_only: number, from: number): number;
+  node_parent(ctx: number, src_handle: number, id: number): number;
+  node_field_child(ctx: number, src_handle: number, id: number, name_ptr: number, name_len: number): number;
+  node_next(ctx: number, src_handle: number, id: number): number;
+  node_prev(ctx: number, src_handle: number, id: number): number;
+  node_kind_table(ctx: number, src_handle: number): void;
+  node_dump(src_handle: number, id: number, named_only: number, max_depth: number): number;
+  // Query backend
+  query_source(ctx: number, src_handle: number, query_ptr: number, query_len: number, limit: number): number;
+  get_query_error_offset(ctx: number): number;
+  pattern_query(ctx: number, pat_handle: number): number;
+  // Grammar registry
+  has_language(lang: number): number;
+  snapshot_source(src_handle: number): number;
+  hash_bytes(ptr: number, len: number): bigint;
+}
+
+// ── Engine instantiation ─────────────────────────────────
+//
+// Importing this module decodes and compiles nothing. The engine is
+// instantiated on first use, synchronously from the base64 copy the entry
+// point embedded (see embedded.ts), unless init() ran first: init() compiles asynchronously (with
+// compileStreaming when given a URL) and can reuse bytes from an opt-in
+// cache, keeping cold starts off the synchronous path.
+
+const imports = {
+  // Host clock for parse budgets (wasm32-freestanding has none).
+  env: { now_us: () => performance.now() * 1000 },
+};
+
+let wasm: WasmExports | null = null;
+/**
+ * The engine context (result buffer, parsers, match slots, scratch) every
+ * call from this module passes; created with the instance.
+ */
+let ctx = 0;
+
+function instantiate(module: WebAssembly.Module): WasmExports {
+  return withContext(new WebAssembly.Instance(module, imports).exports as unknown as WasmExports);
+}
+
+function withContext(exports: WasmExports): WasmExports {
+  ctx = exports.context_create();
+  if (ctx === 0) throw new Error("codesift: cannot create an engine context");
+  return exports;
+}
+
+/** The engine's exports, instantiating it on first use. */
+function engine(): WasmExports {
+  return wasm ??= instantiate(new WebAssembly.Module(decodeBase64(embeddedEngine().base64) as BufferSource));
+}
+
+async function fetchBytes(url: string | URL): Promise<Uint8Array> {
+  const href = url.toString();
+  // Node's fetch() has no file: support.
+  if (href.startsWith("file:") && typeof process !== "undefined" && process.versions?.node) {
+    const fs = await import("node:fs/promises");
+    return new Uint8Array(await fs.readFile(new URL(href)));
+  }
+  const res = await fetch(url);
+  if (!res.ok) throw new Error(`Failed to fetch ${href}: ${res.status}`);
+  return new Uint8Array(await res.arrayBuffer());
+}
+
+/** Per-language engine builds shipped next to this module (dist/). */
+const LANGUAGE_ENGINES: Partial<Record<Language, string>> = {
+  javascript: "./engine-javascript.wasm",
+};
+
+/** The smallest engine build covering `languages`, if one ships alongside this module. */
+function languageEngineUrl(languages: Language[] | undefined): URL | null {
+  if (!languages || languages.length === 0) return null;
+  const files = new Set(languages.map(l => LANGUAGE_ENGINES[l]));
+  if (files.size !== 1) return null;
+  const [file] = files;
+  return file ? new URL(file, import.meta.url) : null;
+}
+
+async function compileEngine(opts: EngineInitOptions): Promise<WebAssembly.Module> {
+  const languageUrl = opts.wasmUrl === undefined ? languageEngineUrl(opts.languages) : null;
+  if (languageUrl) {
+    try {
+      return await WebAssembly.compile(await fetchBytes(languageUrl) as BufferSource);
+    } catch {
+      // Not shipped here (e.g. running from source): use the full engine.
+    }
+  }
+
+  if (opts.wasmUrl !== undefined) {
+    if (typeof WebAssembly.compileStreaming === "function" && !opts.wasmUrl.toString().startsWith("file:")) {
+      try {
+        return await WebAssembly.compileStreaming(fetch(opts.wasmUrl));
+      } catch {
+        // Usually a server not sending application/wasm; compile from bytes.
+      }
+    }
+    return WebAssembly.compile(await fetchBytes(opts.wasmUrl) as BufferSource);
+  }
+
+  const cache = opts.cache ? await openModuleCache(opts.cache, embeddedEngine().hash) : null;
+  let bytes = await cache?.get() ?? null;
+  if (!bytes) {
+    bytes = decodeBase64(embeddedEngine().base64);
+    await cache?.put(bytes);
+  }
+  return WebAssembly.compile(bytes as BufferSource);
+}
+
+/**
+ * Compile and instantiate the engine ahead of first use. Optional — every
+ * API instantiates the engine on demand — but asynchronous compilation
+ * keeps the work off the caller's first synchronous call, and `cache`
+ * skips the base64 decode on later cold starts. `languages` selects a
+ * smaller per-language engine build when one covers them. No-op once
+ * instantiated.
+ */
+export async function init(opts: EngineInitOptions = {}): Promise<void> {
+  if (wasm) return;
+  const module = await compileEngine(opts);
+  const instance = await WebAssembly.instantiate(module, imports);
+  wasm ??= withContext(instance.exports as unknown as WasmExports);
+}
+
+/** Whether the loaded engine links the grammar for `lang`. */
+export function hasLanguage(lang: Language): boolean {
+  return isWasmLanguage(lang) && engine().has_language(langToInt(lang)) !== 0;
+}
+
+/**
+ * Identifies the embedded engine build. Anything cached from engine output
+ * (codesift scan --cache) is keyed by it, so a new build starts fresh.
+ */
+export function engineVersion(): string {
+  return embeddedEngine().hash;
+}
+
+/** 64-bit XXH3 of `bytes`, computed by the engine, as 16 hex digits. */
+export function hashBytes(bytes: Uint8Array): string {
+  const size = Math.max(bytes.length, 1);
+  const ptr = engine().alloc(size);
+  if (!ptr) throw new Error("WASM alloc failed for hash");
+  try {
+    new Uint8Array(engine().memory.buffer, ptr, bytes.length).set(bytes);
+    return BigInt.asUintN(64, engine().hash_bytes(ptr, bytes.length)).toString(16).padStart(16, "0");
+  } finally {
+    engine().dealloc(ptr, size);
+  }
+}
+
+/** Throw when `lang` is a WASM language whose grammar this engine build omits. */
+function requireGrammar(lang: Language): void {
+  if (!hasLanguage(lang)) {
+    throw new Error(`codesift: the ${lang} grammar is not linked into this engine build; call init() with a matching \`languages\` list`);
+  }
+}
 
 const enc = new TextEncoder();
 const dec = new TextDecoder();
 
 // ── WASM helpers ─────────────────────────────────────────
 
-/** Encode string into WASM linear memory. Caller must dealloc. Returns [ptr, len] or null. */
+/** UTF-8 byte length of `s` (lone surrogates count as U+FFFD, as TextEncoder writes them). */
+function utf8Length(s: string): number {
+  let n = 0;
+  for (let i = 0; i < s.length; i++) {
+    const c = s.charCodeAt(i);
+    if (c < 0x80) n += 1;
+    else if (c < 0x800) n += 2;
+    else if (c >= 0xD800 && c <= 0xDBFF && (s.charCodeAt(i + 1) & 0xFC00) === 0xDC00) { n += 4; i++; }
+    else n += 3;
+  }
+  return n;
+}
+
+/**
+ * Encode string straight into WASM linear memory with encodeInto — no
+ * intermediate JS byte array. Caller must dealloc (or hand ownership to an
+ * *_owned export). Returns [ptr, len] or null.
+ */
 function writeStr(s: string): [number, number] | null {
-  const bytes = enc.encode(s);
-  if (bytes.length === 0) return null;
-  const ptr = wasm.alloc(bytes.length);
+  if (s.length === 0) return null;
+  // One byte per UTF-16 unit is exact for ASCII, the common case for code.
+  let size = s.length;
+  let ptr = engine().alloc(size);
   if (!ptr) return null;
-  new Uint8Array(wasm.memory.buffer, ptr, bytes.length).set(bytes);
-  return [ptr, bytes.length];
+  const { read } = enc.encodeInto(s, new Uint8Array(engine().memory.buffer, ptr, size));
+  if (read < s.length) {
+    engine().dealloc(ptr, size);
+    size = utf8Length(s);
+    ptr = engine().alloc(size);
+    if (!ptr) return null;
+    enc.encodeInto(s, new Uint8Array(engine().memory.buffer, ptr, size));
+  }
+  return [ptr, size];
+}
+
+/**
+ * Bytes of a compiled source, viewed in place in WASM memory. Views are
+ * invalidated when memory grows, so take a fresh one for every read.
+ */
+function sourceView(srcHandle: number): Uint8Array {
+  const len = engine().get_source_len(srcHandle);
+  if (len === 0) return new Uint8Array(0);
+  return new Uint8Array(engine().memory.buffer, engine().get_source_ptr(srcHandle), len);
 }
 
 function readResult(): Match[] {
-  const ptr = wasm.get_result_ptr();
-  const len = wasm.get_result_len();
+  const ptr = engine().get_result_ptr(ctx);
+  const len = engine().get_result_len(ctx);
   if (len < 4) return [];
 
   // Binary protocol: [4B count] then per match:
   //   [4B sb][4B eb][4B sr][4B sc][4B er][4B ec][4B binding_count]
   //   per binding: [4B name_len][name_bytes][4B text_len][text_bytes]
-  const view = new DataView(wasm.memory.buffer, ptr, len);
+  const view = new DataView(engine().memory.buffer, ptr, len);
   const count = view.getUint32(0, true);
   if (count === 0) return [];
 
@@ -102,9 +303,9 @@ function readResult(): Match[] {
     const bindings: Record<string, string> = {};
     for (let b = 0; b < bindingCount; b++) {
       const nameLen = view.getUint32(offset, true); offset += 4;
-      const name = dec.decode(new Uint8Array(wasm.memory.buffer, ptr + offset, nameLen)); offset += nameLen;
+      const name = dec.decode(new Uint8Array(engine().memory.buffer, ptr + offset, nameLen)); offset += nameLen;
       const textLen = view.getUint32(offset, true); offset += 4;
-      const text = dec.decode(new Uint8Array(wasm.memory.buffer, ptr + offset, textLen)); offset += textLen;
+      const text = dec.decode(new Uint8Array(engine().memory.buffer, ptr + offset, textLen)); offset += textLen;
       bindings[name] = text;
     }
 
@@ -114,30 +315,161 @@ function readResult(): Match[] {
   return matches;
 }
 
-function readRulesetResult(): Finding[] {
-  const ptr = wasm.get_ruleset_result_ptr();
-  const len = wasm.get_ruleset_result_len();
+function readRulesetResult<T = Finding>(): T[] {
+  const ptr = engine().get_ruleset_result_ptr(ctx);
+  const len = engine().get_ruleset_result_len(ctx);
   if (len === 0) return [];
-  return JSON.parse(dec.decode(new Uint8Array(wasm.memory.buffer, ptr, len)));
+  return JSON.parse(dec.decode(new Uint8Array(engine().memory.buffer, ptr, len)));
+}
+
+function resultView(): DataView {
+  return new DataView(engine().memory.buffer, engine().get_result_ptr(ctx), engine().get_result_len(ctx));
+}
+
+function emptyCounts(): MatchCounts {
+  return { total: 0, ungrouped: 0, other: 0, groups: [] };
+}
+
+function readCounts(): MatchCounts {
+  // Tally protocol: [4B total][4B ungrouped][4B other][4B group_count]
+  // then per group: [4B count][4B text_len][text_bytes].
+  const view = resultView();
+  if (view.byteLength < 16) return emptyCounts();
+  const bytes = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+  const groups: { text: string; count: number }[] = [];
+  let pos = 16;
+  for (let i = view.getUint32(12, true); i > 0; i--) {
+    const count = view.getUint32(pos, true);
+    const len = view.getUint32(pos + 4, true);
+    groups.push({ text: dec.decode(bytes.subarray(pos + 8, pos + 8 + len)), count });
+    pos += 8 + len;
+  }
+  return { total: view.getUint32(0, true), ungrouped: view.getUint32(4, true), other: view.getUint32(8, true), groups };
+}
+
+/** A groupBy metavariable as the engine names it: without the `$`. */
+function writeGroupName(metavar: string | undefined): [number, number] | null {
+  return metavar ? writeStr(metavar.replace(/^\$/, "")) : null;
+}
+
+// ── Node records ─────────────────────────────────────────
+//
+// Traversal exports identify nodes by integer id and write fixed-width
+// records: [id][kind | named << 16][sb][eb][sr][sc][er][ec][parent][cc][ncc],
+// little-endian u32s. Kind ids index a per-grammar name table fetched once.
+
+const NO_NODE = 0xFFFFFFFF;
+const NODE_RECORD_BYTES = 11 * 4;
+const ERROR_KIND = 0xFFFF;
+
+const kindTables = new Map<Language, string[]>();
+
+function kindTable(srcHandle: number, lang: Language): string[] {
+  const cached = kindTables.get(lang);
+  if (cached) return cached;
+  engine().node_kind_table(ctx, srcHandle);
+  const view = resultView();
+  if (view.byteLength < 4) return [];
+  const bytes = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+  const count = view.getUint32(0, true);
+  const table: string[] = [];
+  let pos = 4;
+  for (let i = 0; i < count; i++) {
+    const len = view.getUint32(pos, true);
+    table.push(dec.decode(bytes.subarray(pos + 4, pos + 4 + len)));
+    pos += 4 + len;
+  }
+  if (count > 0) kindTables.set(lang, table);
+  return table;
+}
+
+function decodeNodeInfo(view: DataView, offset: number, kinds: string[]): NodeInfo {
+  const word = (k: number) => view.getUint32(offset + k * 4, true);
+  const kindWord = word(1);
+  const kind = kindWord & 0xFFFF;
+  return {
+    kind: kind === ERROR_KIND ? "ERROR" : kinds[kind] ?? "",
+    sb: word(2),
+    eb: word(3),
+    sr: word(4),
+    sc: word(5),
+    er: word(6),
+    ec: word(7),
+    named: ((kindWord >>> 16) & 1) === 1,
+    cc: word(9),
+    ncc: word(10),
+  };
 }
 
-function readResultJson(): string | null {
-  const ptr = wasm.get_result_ptr();
-  const len = wasm.get_result_len();
-  if (len === 0) return null;
-  return dec.decode(new Uint8Array(wasm.memory.buffer, ptr, len));
+// ── Tree dumps ───────────────────────────────────────────
+//
+// node_dump returns a buffer the caller frees:
+// [byte_len][n], ten u32 columns (sb eb sr sc er ec parent first_child
+// next_sibling id), then a u16 kind column and a u8 named column.
+
+const DUMP_U32_COLUMNS = 10;
+
+/** Copy a node_dump buffer into typed arrays and release it. ptr 0 = empty dump. */
+function readTreeDump(ptr: number, kinds: string[]): TreeDump {
+  let n = 0;
+  let u32 = new Uint32Array(0);
+  let kind = new Uint16Array(0);
+  let named = new Uint8Array(0);
+  if (ptr !== 0) {
+    const mem = engine().memory.buffer;
+    const [byteLen, count] = new Uint32Array(mem, ptr, 2);
+    n = count;
+    const base = ptr + 8;
+    u32 = new Uint32Array(mem, base, n * DUMP_U32_COLUMNS).slice();
+    kind = new Uint16Array(mem, base + n * DUMP_U32_COLUMNS * 4, n).slice();
+    named = new Uint8Array(mem, base + n * (DUMP_U32_COLUMNS * 4 + 2), n).slice();
+    engine().dealloc(ptr, byteLen);
+  }
+  const column = (c: number) => u32.subarray(c * n, (c + 1) * n);
+  // Link columns use NO_NODE, which reads back as -1 through Int32Array.
+  const links = (c: number) => new Int32Array(u32.buffer, c * n * 4, n);
+  return {
+    length: n,
+    kind,
+    named,
+    startByte: column(0),
+    endByte: column(1),
+    startRow: column(2),
+    startCol: column(3),
+    endRow: column(4),
+    endCol: column(5),
+    parent: links(6),
+    firstChild: links(7),
+    nextSibling: links(8),
+    id: column(9),
+    kindName: (k: number) => (k === ERROR_KIND ? "ERROR" : kinds[k] ?? ""),
+  };
 }
 
-function readNodeResult(): NodeInfo | null {
-  const str = readResultJson();
-  if (!str || str === "null") return null;
-  return JSON.parse(str);
+// ── Parse budgets ────────────────────────────────────────
+
+const PARSE_BUDGET_EXCEEDED = 2;
+
+/** Thrown when a parse runs past ParseOptions.budgetUs. */
+export class ParseBudgetExceededError extends Error {
+  readonly budgetUs: number;
+
+  constructor(budgetUs: number) {
+    super(`Parse exceeded budget of ${budgetUs}µs`);
+    this.budgetUs = budgetUs;
+    this.name = "ParseBudgetExceededError";
+  }
 }
 
-function readNodeArrayResult(): NodeInfo[] {
-  const str = readResultJson();
-  if (!str) return [];
-  return JSON.parse(str);
+/** Budget in whole microseconds as the u32 WASM expects (0 = unlimited). */
+function budgetArg(opts?: ParseOptions): number {
+  const us = opts?.budgetUs;
+  if (!us || us <= 0) return 0;
+  return Math.min(Math.ceil(us), 0xFFFFFFFF);
+}
+
+function checkParseStatus(opts?: ParseOptions): void {
+  if (engine().get_parse_status(ctx) === PARSE_BUDGET_EXCEEDED) throw new ParseBudgetExceededError(opts?.budgetUs ?? 0);
 }
 
 // ── Pattern matching ─────────────────────────────────────
@@ -147,23 +479,49 @@ export function extractMatchText(source: string, m: Match): string {
 }
 
 /** One-shot pattern match against source code. */
-export function structMatch(pattern: string, source: string, lang: Language): Match[] {
+export function structMatch(pattern: string, source: string, lang: Language, opts?: MatchOptions): Match[] {
   if (!isWasmLanguage(lang)) return [];
+  requireGrammar(lang);
 
   const pat = writeStr(pattern);
   const src = writeStr(source);
   if (!pat || !src) {
-    if (pat) wasm.dealloc(pat[0], pat[1]);
-    if (src) wasm.dealloc(src[0], src[1]);
+    if (pat) engine().dealloc(pat[0], pat[1]);
+    if (src) engine().dealloc(src[0], src[1]);
     return [];
   }
 
   try {
-    wasm.struct_match(pat[0], pat[1], src[0], src[1], langToInt(lang));
+    engine().struct_match(ctx, pat[0], pat[1], src[0], src[1], langToInt(lang), budgetArg(opts), opts?.limit ?? 0);
+    checkParseStatus(opts);
     return readResult();
   } finally {
-    wasm.dealloc(pat[0], pat[1]);
-    wasm.dealloc(src[0], src[1]);
+    engine().dealloc(pat[0], pat[1]);
+    engine().dealloc(src[0], src[1]);
+  }
+}
+
+/**
+ * Count the matches of `pattern` in `source` without collecting them, so
+ * there is no 64-match cap. With `groupBy`, also returns how often each
+ * text bound to that metavariable occurs.
+ */
+export function structCount(pattern: string, source: string, lang: Language, opts?: CountOptions): MatchCounts {
+  if (!isWasmLanguage(lang)) return emptyCounts();
+  requireGrammar(lang);
+
+  const pat = writeStr(pattern);
+  const src = writeStr(source);
+  const group = writeGroupName(opts?.groupBy);
+  try {
+    if (!pat || !src) return emptyCounts();
+    engine().struct_count(ctx, pat[0], pat[1], src[0], src[1], langToInt(lang), budgetArg(opts), group?.[0] ?? 0, group?.[1] ?? 0);
+    checkParseStatus(opts);
+    return readCounts();
+  } finally {
+    if (pat) engine().dealloc(pat[0], pat[1]);
+    if (src) engine().dealloc(src[0], src[1]);
+    if (group) engine().dealloc(group[0], group[1]);
   }
 }
 
@@ -172,37 +530,138 @@ export function structMatch(pattern: string, source: string, lang: Language): Ma
 /** Compile a pattern for repeated matching. Returns handle (0 = error). */
 export function compilePattern(pattern: string, lang: Language): number {
   if (!isWasmLanguage(lang)) return 0;
+  requireGrammar(lang);
   const buf = writeStr(pattern);
   if (!buf) return 0;
-  const handle = wasm.compile_pattern(buf[0], buf[1], langToInt(lang));
-  wasm.dealloc(buf[0], buf[1]);
+  const handle = engine().compile_pattern(buf[0], buf[1], langToInt(lang));
+  engine().dealloc(buf[0], buf[1]);
   return handle;
 }
 
 /** Match a compiled pattern against source. */
-export function matchPattern(handle: number, source: string): Match[] {
+export function matchPattern(handle: number, source: string, opts?: ParseOptions): Match[] {
   if (handle === 0) return [];
   const buf = writeStr(source);
   if (!buf) return [];
   try {
-    wasm.match_pattern(handle, buf[0], buf[1]);
+    engine().match_pattern(ctx, handle, buf[0], buf[1], budgetArg(opts));
+    checkParseStatus(opts);
     return readResult();
   } finally {
-    wasm.dealloc(buf[0], buf[1]);
+    engine().dealloc(buf[0], buf[1]);
   }
 }
 
+/** Release a compiled pattern handle. The parse stays in the engine's cache. */
 export function freePattern(handle: number): void {
-  if (handle > 0) wasm.free_pattern(handle);
+  if (handle > 0) engine().free_pattern(handle);
+}
+
+/**
+ * Engine pattern cache counters: slots holding a parsed pattern, slots with
+ * live handles, and patterns parsed since the engine loaded. Every entry
+ * point (structMatch, compilePattern, scanners, rulesets) shares the cache,
+ * keyed by language and pattern text.
+ */
+export function patternCacheStats(): { cached: number; referenced: number; parses: number } {
+  engine().pattern_cache_stats(ctx);
+  const view = resultView();
+  return { cached: view.getUint32(0, true), referenced: view.getUint32(4, true), parses: view.getUint32(8, true) };
+}
+
+/**
+ * Literals every match of `pattern` contains in the source bytes, such as
+ * `eval` in `eval($X)`: the prefilter compiled patterns and rules run before
+ * parsing. Empty when nothing is required; null if the pattern does not compile.
+ */
+export function patternLiterals(pattern: string, lang: Language): string[] | null {
+  const handle = compilePattern(pattern, lang);
+  if (handle === 0) return null;
+  try {
+    const len = engine().pattern_literals(ctx, handle);
+    if (len === 0) return [];
+    return dec.decode(new Uint8Array(engine().memory.buffer, engine().get_result_ptr(ctx), len)).split("\0").slice(0, -1);
+  } finally {
+    freePattern(handle);
+  }
+}
+
+// ── Tree-sitter queries ──────────────────────────────────
+
+const QUERY_ERROR_KINDS = ["syntax", "node type", "field", "capture", "structure", "language"] as const;
+
+/** Thrown when a tree-sitter query does not compile. */
+export class QueryError extends Error {
+  readonly kind: (typeof QUERY_ERROR_KINDS)[number];
+  /** Byte offset in the query where compilation failed. */
+  readonly offset: number;
+
+  constructor(kind: (typeof QUERY_ERROR_KINDS)[number], offset: number) {
+    super(`Invalid query: ${kind} error at offset ${offset}`);
+    this.kind = kind;
+    this.offset = offset;
+    this.name = "QueryError";
+  }
+}
+
+/**
+ * The tree-sitter query the rule engine uses to find candidates for
+ * `pattern`, or null when it has none (a bare metavariable, a parse error).
+ * The query may accept more nodes than the pattern matches.
+ */
+export function patternToQuery(pattern: string, lang: Language): string | null {
+  const handle = compilePattern(pattern, lang);
+  if (handle === 0) return null;
+  try {
+    const len = engine().pattern_query(ctx, handle);
+    if (len === 0) return null;
+    return dec.decode(new Uint8Array(engine().memory.buffer, engine().get_result_ptr(ctx), len));
+  } finally {
+    freePattern(handle);
+  }
 }
 
 // ── Scanner ──────────────────────────────────────────────
 
+/** Smallest single edit turning `a` into `b`: common prefix and suffix trimmed. */
+function diffBytes(a: Uint8Array, b: Uint8Array): SourceEdit {
+  const max = Math.min(a.length, b.length);
+  let start = 0;
+  while (start < max && a[start] === b[start]) start++;
+  let suffix = 0;
+  while (suffix < max - start && a[a.length - 1 - suffix] === b[b.length - 1 - suffix]) suffix++;
+  return { startByte: start, oldEndByte: a.length - suffix, newEndByte: b.length - suffix };
+}
+
 export interface Scanner {
-  match(pattern: string): Match[];
+  /** Matches of `pattern`, stopping after `limit` when given. */
+  match(pattern: string, limit?: number): Match[];
+  /** Whether `pattern` matches anywhere; stops at the first match. */
+  exists(pattern: string): boolean;
+  /** Number of matches of `pattern`, counted in the engine without a cap. */
+  count(pattern: string): number;
+  /** Matches of `pattern` counted per text bound to `metavar` (e.g. "$FN"). */
+  groupBy(pattern: string, metavar: string): MatchCounts;
   matchKind(kind: string): Match[];
+  /**
+   * Matches of a tree-sitter S-expression query. Each match spans its
+   * `@match` capture (else its first); other captures not starting with
+   * `_` become bindings. Throws QueryError if the query does not compile.
+   */
+  query(query: string, limit?: number): Match[];
   scanAll(patterns: string[]): RichMatch[];
   root(): SgNode;
+  /**
+   * Flatten the subtree under `node` (default: the root) into typed arrays
+   * in one engine call — far cheaper than walking it node by node.
+   */
+  dumpTree(node?: SgNode, opts?: DumpTreeOptions): TreeDump;
+  /**
+   * Replace the source with an edited version and re-parse incrementally.
+   * When `edit` is omitted it is derived from the common prefix/suffix.
+   * Returns false (leaving the scanner unchanged) if the edit was rejected.
+   */
+  edit(newSource: string, edit?: SourceEdit): boolean;
   readonly source: string;
   readonly language: Language;
   readonly _srcHandle: number;
@@ -212,13 +671,19 @@ export interface Scanner {
 export function createScanner(
   source: string,
   lang: Language,
+  opts?: ScannerOptions,
 ): Scanner {
-  const sourceBytes = enc.encode(source);
   const noopScanner: Scanner = {
     match: () => [],
+    exists: () => false,
+    count: () => 0,
+    groupBy: emptyCounts,
     matchKind: () => [],
+    query: () => [],
     scanAll: () => [],
-    root: () => new SgNode(0, lang, source, sourceBytes, { kind: "program", sb: 0, eb: sourceBytes.length, sr: 0, sc: 0, er: 0, ec: 0, named: true, cc: 0, ncc: 0 }),
+    root: () => new SgNode(0, lang, source, [], 0, { kind: "program", sb: 0, eb: utf8Length(source), sr: 0, sc: 0, er: 0, ec: 0, named: true, cc: 0, ncc: 0 }),
+    dumpTree: () => readTreeDump(0, []),
+    edit: () => false,
     source,
     language: lang,
     _srcHandle: 0,
@@ -226,15 +691,22 @@ export function createScanner(
   };
 
   if (!isWasmLanguage(lang)) return noopScanner;
+  requireGrammar(lang);
 
   const buf = writeStr(source);
   if (!buf) return noopScanner;
 
-  let srcHandle = wasm.compile_source(buf[0], buf[1], langToInt(lang));
-  wasm.dealloc(buf[0], buf[1]);
-  if (srcHandle === 0) return noopScanner;
+  // The engine takes ownership of buf: it becomes the tree's source in place.
+  let srcHandle = engine().compile_source_owned(ctx, buf[0], buf[1], langToInt(lang), budgetArg(opts));
+  if (srcHandle === 0) {
+    checkParseStatus(opts);
+    return noopScanner;
+  }
+  // A failed snapshot only means the engine keeps walking the tree.
+  if (opts?.snapshot) engine().snapshot_source(srcHandle);
 
-  // Pattern cache: avoid recompiling the same pattern string on every match call
+  // Handles this scanner holds, so repeat matches skip the string copy into
+  // WASM; the parses themselves live in the engine's shared pattern cache.
   const patternCache = new Map<string, number>();
 
   function cachedCompile(pattern: string): number {
@@ -245,48 +717,99 @@ export function createScanner(
     return h;
   }
 
-  function rawMatch(pattern: string): Match[] {
+  function rawMatch(pattern: string, limit = 0): Match[] {
     if (srcHandle === 0) return [];
     const patHandle = cachedCompile(pattern);
     if (patHandle === 0) return [];
-    wasm.match_compiled(patHandle, srcHandle);
+    engine().match_compiled(ctx, patHandle, srcHandle, limit);
     return readResult();
   }
 
+  function rawCount(pattern: string, metavar?: string): MatchCounts {
+    if (srcHandle === 0) return emptyCounts();
+    const patHandle = cachedCompile(pattern);
+    const group = writeGroupName(metavar);
+    try {
+      engine().count_compiled(ctx, patHandle, srcHandle, group?.[0] ?? 0, group?.[1] ?? 0);
+      return readCounts();
+    } finally {
+      if (group) engine().dealloc(group[0], group[1]);
+    }
+  }
+
   function rawKindMatch(kind: string): Match[] {
     if (srcHandle === 0) return [];
     const buf = writeStr(kind);
     if (!buf) return [];
     try {
-      wasm.kind_match(srcHandle, buf[0], buf[1]);
+      engine().kind_match(ctx, srcHandle, buf[0], buf[1]);
       return readResult();
     } finally {
-      wasm.dealloc(buf[0], buf[1]);
+      engine().dealloc(buf[0], buf[1]);
+    }
+  }
+
+  function rawQuery(query: string, limit = 0): Match[] {
+    if (srcHandle === 0) return [];
+    const buf = writeStr(query);
+    if (!buf) return [];
+    try {
+      const status = engine().query_source(ctx, srcHandle, buf[0], buf[1], limit);
+      if (status !== 0) throw new QueryError(QUERY_ERROR_KINDS[status - 1] ?? "syntax", engine().get_query_error_offset(ctx));
+      return readResult();
+    } finally {
+      engine().dealloc(buf[0], buf[1]);
     }
   }
 
   return {
     match: rawMatch,
+    exists: (pattern: string) => rawMatch(pattern, 1).length > 0,
+    count: (pattern: string) => rawCount(pattern).total,
+    groupBy: rawCount,
     matchKind: rawKindMatch,
+    query: rawQuery,
 
     scanAll(patterns: string[]): RichMatch[] {
       const results: RichMatch[] = [];
       for (const pat of patterns) {
-        for (const m of rawMatch(pat)) {
-          results.push({ ...m, pattern: pat, text: dec.decode(sourceBytes.slice(m.start_byte, m.end_byte)) });
+        const matches = rawMatch(pat);
+        const bytes = sourceView(srcHandle);
+        for (const m of matches) {
+          results.push({ ...m, pattern: pat, text: dec.decode(bytes.subarray(m.start_byte, m.end_byte)) });
         }
       }
       return results;
     },
 
     root(): SgNode {
-      wasm.node_root(srcHandle);
-      const info = readNodeResult();
-      if (!info) return new SgNode(srcHandle, lang, source, sourceBytes, { kind: "program", sb: 0, eb: sourceBytes.length, sr: 0, sc: 0, er: 0, ec: 0, named: true, cc: 0, ncc: 0 }, true, cachedCompile);
-      return new SgNode(srcHandle, lang, source, sourceBytes, info, true, cachedCompile);
+      // Fetch the kind table first: it shares result_buf with node records.
+      const kinds = kindTable(srcHandle, lang);
+      const id = engine().node_root(ctx, srcHandle) >>> 0;
+      if (id === NO_NODE) return new SgNode(srcHandle, lang, source, kinds, 0, { kind: "program", sb: 0, eb: engine().get_source_len(srcHandle), sr: 0, sc: 0, er: 0, ec: 0, named: true, cc: 0, ncc: 0 }, cachedCompile);
+      return new SgNode(srcHandle, lang, source, kinds, id, decodeNodeInfo(resultView(), 0, kinds), cachedCompile);
     },
 
-    source,
+    dumpTree(node?: SgNode, opts?: DumpTreeOptions): TreeDump {
+      const kinds = kindTable(srcHandle, lang);
+      const maxDepth = opts?.maxDepth ?? NO_NODE;
+      const ptr = srcHandle === 0 ? 0 : engine().node_dump(srcHandle, node?.id() ?? 0, opts?.namedOnly ? 1 : 0, Math.min(maxDepth, NO_NODE)) >>> 0;
+      return readTreeDump(ptr, kinds);
+    },
+
+    edit(newSource: string, edit?: SourceEdit): boolean {
+      if (srcHandle === 0) return false;
+      // Like createScanner, an empty source cannot be compiled.
+      const buf = writeStr(newSource);
+      if (!buf) return false;
+      const e = edit ?? diffBytes(sourceView(srcHandle), new Uint8Array(engine().memory.buffer, buf[0], buf[1]));
+      // edit_source takes ownership of buf, even when it rejects the edit.
+      if (!engine().edit_source(ctx, srcHandle, buf[0], buf[1], e.startByte, e.oldEndByte, e.newEndByte)) return false;
+      source = newSource;
+      return true;
+    },
+
+    get source() { return source; },
     language: lang,
     get _srcHandle() { return srcHandle; },
 
@@ -294,7 +817,7 @@ export function createScanner(
       for (const h of patternCache.values()) freePattern(h);
       patternCache.clear();
       if (srcHandle > 0) {
-        wasm.free_source(srcHandle);
+        engine().free_source(srcHandle);
         srcHandle = 0;
       }
     },
@@ -303,85 +826,95 @@ export function createScanner(
 
 // ── Match slot operations ────────────────────────────────
 
-export function storeMatches(): number { return wasm.store_matches(); }
+export function storeMatches(): number { return engine().store_matches(ctx); }
 
-export function filterInside(matchesH: number, ctxH: number): Match[] {
-  wasm.filter_inside(matchesH, ctxH);
+export function filterInside(matchesH: number, scopeH: number): Match[] {
+  engine().filter_inside(ctx, matchesH, scopeH);
   return readResult();
 }
 
-export function filterNotInside(matchesH: number, ctxH: number): Match[] {
-  wasm.filter_not_inside(matchesH, ctxH);
+export function filterNotInside(matchesH: number, scopeH: number): Match[] {
+  engine().filter_not_inside(ctx, matchesH, scopeH);
   return readResult();
 }
 
 export function filterNot(matchesH: number, exclH: number): Match[] {
-  wasm.filter_not(matchesH, exclH);
+  engine().filter_not(ctx, matchesH, exclH);
   return readResult();
 }
 
 export function intersectMatches(aH: number, bH: number): Match[] {
-  wasm.intersect_matches(aH, bH);
+  engine().intersect_matches(ctx, aH, bH);
   return readResult();
 }
 
 export function freeMatches(handle: number): void {
-  if (handle > 0) wasm.free_matches(handle);
+  if (handle > 0) engine().free_matches(ctx, handle);
 }
 
-export function matchInRange(patH: number, srcH: number, start: number, end: number): Match[] {
-  wasm.match_in_range(patH, srcH, start, end);
+export function matchInRange(patH: number, srcH: number, start: number, end: number, limit = 0): Match[] {
+  engine().match_in_range(ctx, patH, srcH, start, end, limit);
   return readResult();
 }
 
 export function matchPreceding(patH: number, srcH: number, start: number, end: number): Match[] {
-  wasm.match_preceding(patH, srcH, start, end);
+  engine().match_preceding(ctx, patH, srcH, start, end);
   return readResult();
 }
 
 export function matchFollowing(patH: number, srcH: number, start: number, end: number): Match[] {
-  wasm.match_following(patH, srcH, start, end);
+  engine().match_following(ctx, patH, srcH, start, end);
   return readResult();
 }
 
 // ── Tree traversal (SgNode) ──────────────────────────────
 
-/** ast-grep style tree node. Navigate the CST and match patterns at any subtree. */
+/**
+ * ast-grep style tree node. Navigate the CST and match patterns at any subtree.
+ * Nodes are engine node ids plus a decoded record; they are valid until the
+ * scanner's next edit() or free().
+ */
 export class SgNode {
   private _srcHandle: number;
   private _lang: Language;
   private _source: string;
-  private _sourceBytes: Uint8Array;
+  private _kinds: string[];
+  private _id: number;
   private _info: NodeInfo;
-  private _isRoot: boolean;
   private _compile: ((pattern: string) => number) | null;
-  private _rootInfo: NodeInfo | null;
 
   /** @internal — use scanner.root() to create */
-  constructor(srcHandle: number, lang: Language, source: string, sourceBytes: Uint8Array, info: NodeInfo, isRoot = false, compileFn: ((pattern: string) => number) | null = null, rootInfo: NodeInfo | null = null) {
+  constructor(srcHandle: number, lang: Language, source: string, kinds: string[], id: number, info: NodeInfo, compileFn: ((pattern: string) => number) | null = null) {
     this._srcHandle = srcHandle;
     this._lang = lang;
     this._source = source;
-    this._sourceBytes = sourceBytes;
+    this._kinds = kinds;
+    this._id = id;
     this._info = info;
-    this._isRoot = isRoot;
     this._compile = compileFn;
-    this._rootInfo = isRoot ? info : rootInfo;
   }
 
-  private _ir(): number { return this._isRoot ? 1 : 0; }
+  /** Wrap the record the engine just wrote for `id` (as returned by a node_* export). */
+  private _wrap(id: number): SgNode | null {
+    id >>>= 0;
+    if (id === NO_NODE) return null;
+    return this._fromRecord(resultView(), 0);
+  }
 
-  private _makeNode(info: NodeInfo | null): SgNode | null {
-    if (!info) return null;
-    return new SgNode(this._srcHandle, this._lang, this._source, this._sourceBytes, info, false, this._compile, this._rootInfo);
+  private _fromRecord(view: DataView, offset: number): SgNode {
+    const id = view.getUint32(offset, true);
+    return new SgNode(this._srcHandle, this._lang, this._source, this._kinds, id, decodeNodeInfo(view, offset, this._kinds), this._compile);
   }
 
+  /** Stable id of this node within its source (until the next edit). */
+  id(): number { return this._id; }
+
   /** Node type string (e.g. "call_expression", "identifier"). */
   kind(): string { return this._info.kind; }
 
-  /** Source text spanned by this node. */
+  /** Source text spanned by this node, decoded straight from WASM memory. */
   text(): string {
-    return dec.decode(this._sourceBytes.slice(this._info.sb, this._info.eb));
+    return dec.decode(sourceView(this._srcHandle).subarray(this._info.sb, this._info.eb));
   }
 
   /** Whether this is a named node (vs anonymous punctuation). */
@@ -405,22 +938,33 @@ export class SgNode {
   /** Named child count. */
   namedChildCount(): number { return this._info.ncc; }
 
+  private _childList(namedOnly: boolean): SgNode[] {
+    const total = namedOnly ? this._info.ncc : this._info.cc;
+    const out: SgNode[] = [];
+    // node_children fills result_buf a page at a time.
+    while (out.length < total) {
+      const n = engine().node_children(ctx, this._srcHandle, this._id, namedOnly ? 1 : 0, out.length);
+      if (n <= 0) break;
+      const view = resultView();
+      for (let k = 0; k < n; k++) out.push(this._fromRecord(view, k * NODE_RECORD_BYTES));
+    }
+    return out;
+  }
+
   /** Get all children (named + anonymous). */
   children(): SgNode[] {
-    wasm.node_children(this._srcHandle, this._info.sb, this._info.eb, this._ir());
-    return readNodeArrayResult().map(info => this._makeNode(info)!);
+    return this._childList(false);
   }
 
   /** Get named children only. */
   namedChildren(): SgNode[] {
-    wasm.node_named_children(this._srcHandle, this._info.sb, this._info.eb, this._ir());
-    return readNodeArrayResult().map(info => this._makeNode(info)!);
+    return this._childList(true);
   }
 
   /** Get child by index (all children). */
   child(index: number): SgNode | null {
-    const kids = this.children();
-    return kids[index] ?? null;
+    if (index < 0 || index >= this._info.cc) return null;
+    return this._wrap(engine().node_child(ctx, this._srcHandle, this._id, index, 0));
   }
 
   /** Get child by field name (e.g. "function", "arguments"). */
@@ -428,35 +972,26 @@ export class SgNode {
     const buf = writeStr(name);
     if (!buf) return null;
     try {
-      wasm.node_field_child(this._srcHandle, this._info.sb, this._info.eb, this._ir(), buf[0], buf[1]);
-      return this._makeNode(readNodeResult());
+      return this._wrap(engine().node_field_child(ctx, this._srcHandle, this._id, buf[0], buf[1]));
     } finally {
-      wasm.dealloc(buf[0], buf[1]);
+      engine().dealloc(buf[0], buf[1]);
     }
   }
 
   /** Parent node, or null if root. */
   parent(): SgNode | null {
-    if (this._isRoot) return null;
-    wasm.node_parent(this._srcHandle, this._info.sb, this._info.eb, 0);
-    const info = readNodeResult();
-    if (!info) return null;
-    // Check if parent is root using cached root info (avoids second WASM call)
-    const ri = this._rootInfo;
-    const parentIsRoot = ri !== null && info.sb === ri.sb && info.eb === ri.eb;
-    return new SgNode(this._srcHandle, this._lang, this._source, this._sourceBytes, info, parentIsRoot, this._compile, this._rootInfo);
+    if (this._id === 0) return null;
+    return this._wrap(engine().node_parent(ctx, this._srcHandle, this._id));
   }
 
   /** Next named sibling. */
   next(): SgNode | null {
-    wasm.node_next(this._srcHandle, this._info.sb, this._info.eb, this._ir());
-    return this._makeNode(readNodeResult());
+    return this._wrap(engine().node_next(ctx, this._srcHandle, this._id));
   }
 
   /** Previous named sibling. */
   prev(): SgNode | null {
-    wasm.node_prev(this._srcHandle, this._info.sb, this._info.eb, this._ir());
-    return this._makeNode(readNodeResult());
+    return this._wrap(engine().node_prev(ctx, this._srcHandle, this._id));
   }
 
   private _compilePattern(pattern: string): number {
@@ -473,13 +1008,11 @@ export class SgNode {
     const patHandle = this._compilePattern(pattern);
     if (patHandle === 0) return null;
     try {
-      wasm.match_in_range(patHandle, this._srcHandle, this._info.sb, this._info.eb);
+      engine().match_in_range(ctx, patHandle, this._srcHandle, this._info.sb, this._info.eb, 1);
       const matches = readResult();
       if (matches.length === 0) return null;
       const m = matches[0];
-      wasm.node_info(this._srcHandle, m.start_byte, m.end_byte, 0);
-      const info = readNodeResult();
-      return this._makeNode(info);
+      return this._wrap(engine().node_at(ctx, this._srcHandle, m.start_byte, m.end_byte));
     } finally {
       this._freePatternIfUncached(patHandle);
     }
@@ -490,7 +1023,7 @@ export class SgNode {
     const patHandle = this._compilePattern(pattern);
     if (patHandle === 0) return [];
     try {
-      wasm.match_in_range(patHandle, this._srcHandle, this._info.sb, this._info.eb);
+      engine().match_in_range(ctx, patHandle, this._srcHandle, this._info.sb, this._info.eb, 0);
       const matches = readResult();
       // Deduplicate by byte range (same pattern can match at different AST levels)
       const seen = new Set<string>();
@@ -499,9 +1032,7 @@ export class SgNode {
         const key = `${m.start_byte}:${m.end_byte}`;
         if (seen.has(key)) continue;
         seen.add(key);
-        wasm.node_info(this._srcHandle, m.start_byte, m.end_byte, 0);
-        const info = readNodeResult();
-        const node = this._makeNode(info);
+        const node = this._wrap(engine().node_at(ctx, this._srcHandle, m.start_byte, m.end_byte));
         if (node) nodes.push(node);
       }
       return nodes;
@@ -510,12 +1041,19 @@ export class SgNode {
     }
   }
 
-  /** Check if this node matches a structural pattern. */
-  matches(pattern: string): boolean {
+  /**
+   * Check if this node matches a structural pattern. By default a match of
+   * the same range further down (the call inside an expression statement)
+   * counts; `exact` tests this node alone.
+   */
+  matches(pattern: string, opts?: MatchesOptions): boolean {
     const patHandle = this._compilePattern(pattern);
     if (patHandle === 0) return false;
     try {
-      wasm.match_in_range(patHandle, this._srcHandle, this._info.sb, this._info.eb);
+      if (opts?.exact) return engine().match_node(patHandle, this._srcHandle, this._id) === 1;
+      // Same-range nodes are nested, so if one matches it is the first
+      // match in preorder: a limit of 1 is enough.
+      engine().match_in_range(ctx, patHandle, this._srcHandle, this._info.sb, this._info.eb, 1);
       const results = readResult();
       return results.some(m => m.start_byte === this._info.sb && m.end_byte === this._info.eb);
     } finally {
@@ -528,17 +1066,137 @@ export class SgNode {
 
 export interface CompiledRuleset {
   apply(scanner: Scanner): Finding[];
+  /**
+   * Like apply(), but reuses the findings cached on the scanner by the
+   * previous call and only re-searches what scanner.edit() touched since.
+   */
+  applyIncremental(scanner: Scanner): Finding[];
+  /**
+   * Like apply(), but evaluates in fuel-metered steps and yields to the
+   * event loop between them, for hosts with per-task CPU limits.
+   */
+  applyAsync(scanner: Scanner, opts?: ApplyAsyncOptions): Promise<Finding[]>;
+  /**
+   * Parse `source` and apply the rules in one call. The raw bytes are first
+   * checked for each rule's required literals (`eval` in `eval($X)`): rules
+   * whose literals are absent are skipped, and so is the parse when none remain.
+   */
+  applySource(source: string, lang: Language, opts?: ParseOptions): Finding[];
+  /**
+   * applySource() for many sources in one engine call per batch: the
+   * sources are packed into one buffer and the findings come back in one
+   * buffer, indexed like `sources`. Byte sources and readers skip the
+   * string encoding; sources with a NUL byte or malformed UTF-8 are not
+   * parsed and have no findings. Sources given a `snapshot` are not parsed
+   * either, and `onSnapshot` collects snapshots of the ones that are.
+   * Throws ParseBudgetExceededError if any source exceeds the budget.
+   */
+  applyMany(sources: Array<BatchSource | BatchReader>, opts?: ApplyManyOptions): Finding[][];
+  /**
+   * Every rule's match count, zeros included, without building findings.
+   * Rules that are a single pattern, kind, regex or nthChild without
+   * constraints are counted in full; see RuleCount.capped for the rest.
+   */
+  count(scanner: Scanner): RuleCount[];
   free(): void;
 }
 
+const STEP_DONE = 1;
+const STEP_PARTIAL = 2;
+const DEFAULT_STEP_FUEL = 20_000;
+
+function yieldToHost(): Promise<void> {
+  return new Promise(resolve => setTimeout(resolve, 0));
+}
+
+/** Packed source bytes per apply_ruleset_many call. */
+const BATCH_BYTES = 4 << 20;
+
+/** UTF-8 bytes of a batch source. */
+function batchSize(s: BatchSource | BatchReader): number {
+  if ("read" in s) return s.size;
+  return typeof s.source === "string" ? utf8Length(s.source) : s.source.length;
+}
+
+/** Bytes applyMany reserves for a source of `size` bytes: its snapshot goes after it, 4-byte aligned. */
+function batchReserve(s: BatchSource | BatchReader, size: number): number {
+  return "snapshot" in s && s.snapshot ? ((size + 3) & ~3) + s.snapshot.length : size;
+}
+
+// Flags in a batch entry's lang word (see apply_ruleset_many).
+const BATCH_HAS_SNAPSHOT = 0x100;
+const BATCH_SAVE_SNAPSHOT = 0x200;
+
+/**
+ * Run one apply_ruleset_many call over `sources[batch[k]]`, whose UTF-8
+ * sizes are `sizes[k]`, storing findings into `results` by source index.
+ */
+function applyBatch(handle: number, sources: Array<BatchSource | BatchReader>, batch: number[], sizes: number[], results: Finding[][], opts?: ApplyManyOptions): void {
+  const reserved = batch.map((index, k) => batchReserve(sources[index], sizes[k]));
+  const total = reserved.reduce((a, b) => a + b, 0);
+  const srcPtr = engine().alloc(Math.max(total, 1));
+  const tablePtr = engine().alloc(batch.length * 12);
+  const snapshots: Array<[number, Uint8Array]> = [];
+  try {
+    if (!srcPtr || !tablePtr) throw new Error("WASM alloc failed for batch");
+    const mem = new Uint8Array(engine().memory.buffer);
+    const table = new Uint32Array(engine().memory.buffer, tablePtr, batch.length * 3);
+    const save = opts?.onSnapshot ? BATCH_SAVE_SNAPSHOT : 0;
+    let at = 0;
+    batch.forEach((index, k) => {
+      const s = sources[index];
+      const dest = mem.subarray(srcPtr + at, srcPtr + at + sizes[k]);
+      let len = sizes[k];
+      let flags = save;
+      // Readers write in place: nothing here allocates in WASM, so `dest` stays valid.
+      if ("read" in s) len = Math.min(s.read(dest), sizes[k]);
+      else if (typeof s.source === "string") enc.encodeInto(s.source, dest);
+      else dest.set(s.source);
+      if ("snapshot" in s && s.snapshot) {
+        mem.set(s.snapshot, srcPtr + ((at + len + 3) & ~3));
+        flags |= BATCH_HAS_SNAPSHOT;
+      }
+      table.set([at, len, langToInt(s.lang) | flags], k * 3);
+      at += reserved[k];
+    });
+
+    const out = engine().apply_ruleset_many(ctx, handle, srcPtr, total, tablePtr, batch.length, budgetArg(opts)) >>> 0;
+    if (!out) throw new Error("Batch apply failed");
+    // [byte_len][n][n+1 offsets][n statuses], then the JSON slices.
+    const words = new Uint32Array(engine().memory.buffer, out, 3 + 2 * batch.length);
+    const data = out + words.byteLength;
+    for (let k = 0; k < batch.length; k++) {
+      if (words[3 + batch.length + k] === PARSE_BUDGET_EXCEEDED) throw new ParseBudgetExceededError(opts?.budgetUs ?? 0);
+      const from = words[2 + k];
+      const to = words[3 + k];
+      if (to > from) results[batch[k]] = JSON.parse(dec.decode(new Uint8Array(engine().memory.buffer, data + from, to - from)));
+    }
+    if (save) {
+      // [byte_len][n][n+1 offsets], then the snapshots; copied out, as the engine reuses the buffer.
+      const snaps = engine().get_batch_snapshots(ctx) >>> 0;
+      const offsets = new Uint32Array(engine().memory.buffer, snaps, 3 + batch.length);
+      const base = snaps + offsets.byteLength;
+      for (let k = 0; k < batch.length; k++) {
+        const from = offsets[2 + k];
+        const to = offsets[3 + k];
+        if (to > from) snapshots.push([batch[k], new Uint8Array(engine().memory.buffer, base + from, to - from).slice()]);
+      }
+    }
+  } finally {
+    if (srcPtr) engine().dealloc(srcPtr, Math.max(total, 1));
+    if (tablePtr) engine().dealloc(tablePtr, batch.length * 12);
+  }
+  for (const [index, snapshot] of snapshots) opts!.onSnapshot!(index, snapshot);
+}
+
 export function loadRules(bytecode: Uint8Array): CompiledRuleset {
-  const ptr = wasm.alloc(bytecode.length);
+  const ptr = engine().alloc(bytecode.length);
   if (!ptr) throw new Error("WASM alloc failed for bytecode");
-  new Uint8Array(wasm.memory.buffer, ptr, bytecode.length).set(bytecode);
+  new Uint8Array(engine().memory.buffer, ptr, bytecode.length).set(bytecode);
 
-  const handle = wasm.load_ruleset(ptr, bytecode.length);
+  const handle = engine().load_ruleset(ptr, bytecode.length);
   if (handle === 0) {
-    wasm.dealloc(ptr, bytecode.length);
+    engine().dealloc(ptr, bytecode.length);
     throw new Error("Failed to load ruleset");
   }
 
@@ -546,12 +1204,81 @@ export function loadRules(bytecode: Uint8Array): CompiledRuleset {
   return {
     apply(scanner: Scanner): Finding[] {
       if (scanner._srcHandle === 0) return [];
-      wasm.apply_ruleset(handle, scanner._srcHandle);
+      engine().apply_ruleset(ctx, handle, scanner._srcHandle);
       return readRulesetResult();
     },
+    applyIncremental(scanner: Scanner): Finding[] {
+      if (scanner._srcHandle === 0) return [];
+      engine().apply_ruleset_incremental(ctx, handle, scanner._srcHandle);
+      return readRulesetResult();
+    },
+    async applyAsync(scanner: Scanner, opts: ApplyAsyncOptions = {}): Promise<Finding[]> {
+      const fuel = Math.max(1, Math.min(Math.floor(opts.fuel ?? DEFAULT_STEP_FUEL), 0xFFFFFFFF));
+      const pause = opts.yield ?? yieldToHost;
+      // The first step drops whatever an earlier, abandoned call left on the scanner.
+      for (let restart = 1; ; restart = 0) {
+        opts.signal?.throwIfAborted();
+        // Re-read the handle every step: the scanner may be freed while we yield.
+        if (scanner._srcHandle === 0) return [];
+        const status = engine().apply_ruleset_step(ctx, handle, scanner._srcHandle, fuel, restart);
+        if (status === STEP_DONE) return readRulesetResult();
+        if (status !== STEP_PARTIAL) return [];
+        await pause();
+      }
+    },
+    applySource(source: string, lang: Language, opts?: ParseOptions): Finding[] {
+      if (!isWasmLanguage(lang)) return [];
+      requireGrammar(lang);
+      const buf = writeStr(source);
+      if (!buf) return [];
+      if (engine().ruleset_prefilter(ctx, handle, buf[0], buf[1]) === 0) {
+        engine().dealloc(buf[0], buf[1]);
+        return [];
+      }
+      // The engine takes ownership of buf, as in createScanner.
+      const srcHandle = engine().compile_source_owned(ctx, buf[0], buf[1], langToInt(lang), budgetArg(opts));
+      if (srcHandle === 0) {
+        checkParseStatus(opts);
+        return [];
+      }
+      try {
+        engine().apply_ruleset_prefiltered(ctx, handle, srcHandle);
+        return readRulesetResult();
+      } finally {
+        engine().free_source(srcHandle);
+      }
+    },
+    applyMany(sources: Array<BatchSource | BatchReader>, opts?: ApplyManyOptions): Finding[][] {
+      const results: Finding[][] = sources.map(() => []);
+      let batch: number[] = [];
+      let sizes: number[] = [];
+      let bytes = 0;
+      sources.forEach((s, i) => {
+        if (!isWasmLanguage(s.lang)) return;
+        requireGrammar(s.lang);
+        const size = batchSize(s);
+        const reserve = batchReserve(s, size);
+        if (batch.length > 0 && bytes + reserve > BATCH_BYTES) {
+          applyBatch(handle, sources, batch, sizes, results, opts);
+          batch = [];
+          sizes = [];
+          bytes = 0;
+        }
+        batch.push(i);
+        sizes.push(size);
+        bytes += reserve;
+      });
+      if (batch.length > 0) applyBatch(handle, sources, batch, sizes, results, opts);
+      return results;
+    },
+    count(scanner: Scanner): RuleCount[] {
+      if (scanner._srcHandle === 0) return [];
+      engine().count_ruleset(ctx, handle, scanner._srcHandle);
+      return readRulesetResult<RuleCount>();
+    },
     free(): void {
-      wasm.free_ruleset(handle);
-      wasm.dealloc(ptr, bytecode.length);
+      engine().free_ruleset(handle);
+      engine().dealloc(ptr, bytecode.length);
     },
   };
 }
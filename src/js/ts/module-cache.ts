@@ -0,0 +1,100 @@
+/**
+ * Opt-in cache for the engine's WebAssembly bytes between runs.
+ *
+ * Neither Node nor browsers can persist a compiled WebAssembly.Module
+ * (v8.serialize rejects it and IndexedDB no longer stores it), so the cache
+ * keeps the raw module bytes instead. That skips decoding the embedded base64
+ * copy on every cold start, and the bytes go to WebAssembly.compile(), which
+ * compiles off the main thread in browsers.
+ *
+ * Node/Bun: one file per engine build under a cache directory.
+ * Browsers: one IndexedDB record per engine build.
+ */
+
+export interface ModuleCache {
+  get(): Promise<Uint8Array | null>;
+  put(bytes: Uint8Array): Promise<void>;
+}
+
+const DB_NAME = "codesift";
+const STORE_NAME = "engine-wasm";
+
+/**
+ * Open the cache for the engine build identified by `key`.
+ * `location` is a directory in Node/Bun (`true` = a per-user temp directory)
+ * and is ignored in browsers. Returns null when no backing store exists.
+ */
+export async function openModuleCache(location: true | string, key: string): Promise<ModuleCache | null> {
+  if (typeof indexedDB !== "undefined") return idbCache(key);
+  if (typeof process !== "undefined" && process.versions?.node) return fsCache(location, key);
+  return null;
+}
+
+async function fsCache(location: true | string, key: string): Promise<ModuleCache> {
+  const fs = await import("node:fs/promises");
+  const path = await import("node:path");
+  const os = await import("node:os");
+  const dir = location === true ? path.join(os.tmpdir(), "codesift-cache") : location;
+  const file = path.join(dir, `engine-${key}.wasm`);
+
+  return {
+    async get() {
+      try {
+        return new Uint8Array(await fs.readFile(file));
+      } catch {
+        return null;
+      }
+    },
+    async put(bytes) {
+      try {
+        await fs.mkdir(dir, { recursive: true });
+        // Write-then-rename so a concurrent reader never sees a partial file.
+        const tmp = `${file}.${process.pid}.tmp`;
+        await fs.writeFile(tmp, bytes);
+        await fs.rename(tmp, file);
+      } catch {
+        // A cache that cannot be written is just a cache miss next time.
+      }
+    },
+  };
+}
+
+function idbRequest<T>(req: IDBRequest<T>): Promise<T> {
+  return new Promise((resolve, reject) => {
+    req.onsuccess = () => resolve(req.result);
+    req.onerror = () => reject(req.error);
+  });
+}
+
+async function idbCache(key: string): Promise<ModuleCache | null> {
+  let db: IDBDatabase;
+  try {
+    const open = indexedDB.open(DB_NAME, 1);
+    open.onupgradeneeded = () => open.result.createObjectStore(STORE_NAME);
+    db = await idbRequest(open);
+  } catch {
+    return null;
+  }
+
+  return {
+    async get() {
+      try {
+        const store = db.transaction(STORE_NAME, "readonly").objectStore(STORE_NAME);
+        const value = await idbRequest(store.get(key));
+        return value instanceof Uint8Array ? value : null;
+      } catch {
+        return null;
+      }
+    },
+    async put(bytes) {
+      try {
+        const store = db.transaction(STORE_NAME, "readwrite").objectStore(STORE_NAME);
+        // Older engine builds are dead weight once a new one is cached.
+        await idbRequest(store.clear());
+        await idbRequest(store.put(bytes, key));
+      } catch {
+        // Quota exceeded or private mode: run uncached.
+      }
+    },
+  };
+}
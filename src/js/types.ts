@@ -82,6 +82,184 @@ export interface Finding {
   matches: Match[];
 }
 
+/**
+ * Match totals computed inside the engine by count()/groupBy(). An
+ * expression statement and the expression it wraps count as one match.
+ */
+export interface MatchCounts {
+  total: number;
+  /** Matches that did not bind the groupBy metavariable. */
+  ungrouped: number;
+  /** Matches whose bound text fell outside the groups returned. */
+  other: number;
+  /** Bound texts of the groupBy metavariable, most frequent first. */
+  groups: { text: string; count: number }[];
+}
+
+/** One rule's entry from CompiledRuleset.count(). */
+export interface RuleCount {
+  ruleId: string;
+  count: number;
+  /**
+   * The rule combines several matchers and was evaluated like apply(), so
+   * `count` stopped at the engine's 64 matches and is a lower bound.
+   */
+  capped: boolean;
+}
+
+/** Options for structCount(). */
+export interface CountOptions extends ParseOptions {
+  /** Metavariable (with or without $) whose bound text groups the matches. */
+  groupBy?: string;
+}
+
+/** One source for CompiledRuleset.applyMany(): text, or its UTF-8 bytes. */
+export interface BatchSource {
+  source: string | Uint8Array;
+  lang: Language;
+  /**
+   * A tree snapshot of exactly this source, as given to `onSnapshot`. The
+   * rules are applied to it without parsing, unless it was saved by
+   * another build of the grammar (then the source is parsed as usual).
+   */
+  snapshot?: Uint8Array;
+}
+
+/** Options for CompiledRuleset.applyMany(). */
+export interface ApplyManyOptions extends ParseOptions {
+  /**
+   * Called with a tree snapshot of every source the call parsed, by its
+   * index in `sources`, for passing back as BatchSource.snapshot when the
+   * same source is applied again (with any rules). Sources the prefilter
+   * skips are not parsed and get none.
+   */
+  onSnapshot?: (index: number, snapshot: Uint8Array) => void;
+}
+
+/**
+ * A source for CompiledRuleset.applyMany() that writes its own UTF-8 bytes
+ * into the batch buffer in engine memory, so a file can be read there with
+ * fs.readSync and never become a JS string.
+ */
+export interface BatchReader {
+  /** Bytes to reserve: the file size. */
+  size: number;
+  /** Fill `dest` (`size` bytes long) and return how many bytes were written. */
+  read(dest: Uint8Array): number;
+  lang: Language;
+}
+
+/** Options for init(). */
+export interface EngineInitOptions {
+  /**
+   * Load engine.wasm from this URL instead of the embedded copy, compiled
+   * with WebAssembly.compileStreaming where available.
+   */
+  wasmUrl?: string | URL;
+  /**
+   * Cache the engine between runs (default: off). In Node/Bun, `true` uses a
+   * temp directory and a string names the directory; browsers use IndexedDB.
+   */
+  cache?: boolean | string;
+  /**
+   * Languages this process will parse. When a smaller per-language engine
+   * build covers all of them (engine-javascript.wasm for `["javascript"]`),
+   * it is loaded instead of the full engine. Ignored with `wasmUrl`.
+   */
+  languages?: Language[];
+}
+
+/** Options for calls that parse source code. */
+export interface ParseOptions {
+  /**
+   * Wall-clock budget for parsing, in microseconds (default: unlimited).
+   * When exceeded the call throws ParseBudgetExceededError instead of
+   * blocking on tree-sitter's error recovery.
+   */
+  budgetUs?: number;
+}
+
+/** Options for structMatch(). */
+export interface MatchOptions extends ParseOptions {
+  /** Stop after this many matches (default: all, up to the engine's 64). */
+  limit?: number;
+}
+
+/** Options for SgNode.matches(). */
+export interface MatchesOptions {
+  /**
+   * Test only the node itself instead of searching its subtree for a match
+   * spanning the same range (e.g. a call inside its expression statement).
+   */
+  exact?: boolean;
+}
+
+/** Options for createScanner. */
+export interface ScannerOptions extends ParseOptions {
+  /**
+   * Flatten the parsed tree into a struct-of-arrays snapshot (about 100
+   * bytes per node). Matching and node navigation then scan arrays instead
+   * of walking the tree, which pays off for scanners queried many times.
+   * Kept up to date across edit(). Default: off.
+   */
+  snapshot?: boolean;
+}
+
+/** Options for Scanner.dumpTree(). */
+export interface DumpTreeOptions {
+  /** Leave out anonymous nodes; their named descendants attach to the nearest kept ancestor. */
+  namedOnly?: boolean;
+  /** Deepest level to include below the dumped node (0 = just the node). Default: unlimited. */
+  maxDepth?: number;
+}
+
+/**
+ * A subtree flattened into parallel typed arrays, one row per node in
+ * preorder. Row 0 is the dumped node. Link columns hold row indices, -1 for
+ * none; `id` holds the engine node id of each row.
+ */
+export interface TreeDump {
+  length: number;
+  kind: Uint16Array;
+  named: Uint8Array;
+  startByte: Uint32Array;
+  endByte: Uint32Array;
+  startRow: Uint32Array;
+  startCol: Uint32Array;
+  endRow: Uint32Array;
+  endCol: Uint32Array;
+  parent: Int32Array;
+  firstChild: Int32Array;
+  nextSibling: Int32Array;
+  id: Uint32Array;
+  /** Kind name for a `kind` value. */
+  kindName(kind: number): string;
+}
+
+/** Options for CompiledRuleset.applyAsync(). */
+export interface ApplyAsyncOptions {
+  /**
+   * Work done between yields: one unit per rule plus one per AST node
+   * visited (default: 20000). A pattern, kind or regex rule stops mid-walk
+   * when the fuel runs out; other rules finish once started.
+   */
+  fuel?: number;
+  /** Awaited between steps (default: a setTimeout(0) macrotask yield). */
+  yield?: () => Promise<void>;
+  /** Stops evaluation between steps, rejecting with the abort reason. */
+  signal?: AbortSignal;
+}
+
+/**
+ * A single source edit in UTF-8 byte offsets: old bytes [startByte, oldEndByte)
+ * were replaced by new bytes [startByte, newEndByte).
+ */
+export interface SourceEdit {
+  startByte: number;
+  oldEndByte: number;
+  newEndByte: number;
+}
+
 // ── Trace types ──────────────────────────────────────────
 
 export type Confidence = "high" | "medium" | "low";
@@ -0,0 +1,39 @@
+import { parentPort, workerData } from "node:worker_threads";
+import * as fs from "node:fs";
+import { loadRules, structMatch, detectLanguage, isWasmLanguage, hashBytes } from "./index.js";
+import { fileReader } from "./ingest.js";
+import type { JobMessage, ResultMessage } from "./pool.js";
+
+// Pool worker (see pool.ts): one engine instance per thread, with the
+// pool's ruleset loaded once for every scan job.
+
+const ruleset = workerData?.rules ? loadRules(workerData.rules as Uint8Array) : null;
+
+function processFile(job: JobMessage, file: string): Pick<ResultMessage, "items" | "hash"> {
+  const lang = job.lang ?? detectLanguage(file);
+  if (!isWasmLanguage(lang)) return { items: [] };
+  if (job.pattern !== undefined) return { items: structMatch(job.pattern, fs.readFileSync(file, "utf-8"), lang, { limit: job.limit }) };
+  if (!ruleset) return { items: [] };
+  if (job.hash) {
+    // The hash is of the bytes scanned, so a cache never files findings
+    // under the content of an earlier or later read.
+    const bytes = fs.readFileSync(file);
+    return { items: ruleset.applyMany([{ source: bytes, lang }])[0], hash: hashBytes(bytes) };
+  }
+  // Read straight into engine memory; files without any rule's required
+  // literals are never parsed.
+  return { items: ruleset.applyMany([fileReader(file, lang)])[0] };
+}
+
+parentPort?.on("message", (job: JobMessage) => {
+  const next = new Int32Array(job.next);
+  for (let i = Atomics.add(next, 0, 1); i < job.files.length; i = Atomics.add(next, 0, 1)) {
+    let msg: ResultMessage;
+    try {
+      msg = { job: job.job, index: i, ...processFile(job, job.files[i]) };
+    } catch (e) {
+      msg = { job: job.job, index: i, items: [], error: e instanceof Error ? e.message : String(e) };
+    }
+    parentPort!.postMessage(msg);
+  }
+});
@@ -38,6 +38,12 @@ fn dlmallocFree(_: *anyopaque, memory: []u8, _: std.mem.Alignment, _: usize) voi
     free(memory.ptr);
 }
 
+/// Release a buffer that tree-sitter allocated with malloc on our behalf
+/// (e.g. the array returned by ts_tree_get_changed_ranges).
+pub fn freeC(ptr: ?*anyopaque) void {
+    free(@ptrCast(ptr));
+}
+
 pub const gpa: std.mem.Allocator = if (builtin.target.cpu.arch == .wasm32)
     .{ .ptr = undefined, .vtable = &dlmalloc_vtable }
 else
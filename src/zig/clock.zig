@@ -0,0 +1,21 @@
+///! clock.zig — Microsecond clock for parse budgets.
+///!
+///! wasm32-freestanding has no clock of its own, so on WASM the host
+///! provides one as the `env.now_us` import (the JS wrapper backs it with
+///! performance.now()). Native test builds use the OS clock.
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+const host = struct {
+    extern "env" fn now_us() f64;
+};
+
+/// Current time in microseconds. Only differences are meaningful.
+pub fn nowMicros() u64 {
+    if (builtin.target.cpu.arch == .wasm32) {
+        const t = host.now_us();
+        return if (t > 0) @intFromFloat(t) else 0;
+    }
+    return @intCast(@max(std.time.microTimestamp(), 0));
+}
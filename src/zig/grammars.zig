@@ -0,0 +1,31 @@
+///! grammars.zig — Registry of the tree-sitter grammars linked into this build.
+///!
+///! Each engine variant links a subset of grammars (see `Grammars` in
+///! build.zig), so grammar symbols are only referenced behind comptime
+///! `build_options` checks; an unlinked grammar leaves no undefined import.
+
+const build_options = @import("build_options");
+const rules = @import("rules.zig");
+const c = @import("ts_bridge.zig").c;
+
+// External symbols provided by the compiled grammar C objects.
+// Both return `const TSLanguage *`. TSX reuses the TypeScript grammar
+// (the TS grammar already includes JSX/TSX syntax).
+extern fn tree_sitter_javascript() ?*const c.TSLanguage;
+extern fn tree_sitter_typescript() ?*const c.TSLanguage;
+
+/// The grammar for `lang`, or null when it is not linked into this build.
+pub fn get(lang: rules.Language) ?*const c.TSLanguage {
+    return switch (lang) {
+        .javascript => if (build_options.javascript) tree_sitter_javascript() else null,
+        .typescript, .tsx => if (build_options.typescript) tree_sitter_typescript() else null,
+    };
+}
+
+/// Whether `lang` can be parsed by this build.
+pub fn has(lang: rules.Language) bool {
+    return switch (lang) {
+        .javascript => build_options.javascript,
+        .typescript, .tsx => build_options.typescript,
+    };
+}
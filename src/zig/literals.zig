@@ -0,0 +1,162 @@
+///! literals.zig — Required-literal prefilter.
+///!
+///! A structural pattern can only match source that contains its literal
+///! leaves: `eval` in `eval($X)`, `innerHTML` in `$OBJ.innerHTML = $V`.
+///! Looking for those bytes is far cheaper than parsing, so callers check a
+///! file's raw bytes first and skip the parse when nothing can match.
+///!
+///! A Set is a conjunction: every literal in it must occur. An empty set
+///! requires nothing (kind and regex rules, metavariable-only patterns).
+
+const std = @import("std");
+const ts = @import("ts_bridge.zig");
+
+/// Literals kept per set. Longer literals are rarer, so they are preferred.
+pub const MAX_LITERALS = 4;
+
+/// Shorter leaves (`a`, `if`) occur almost everywhere and filter nothing.
+pub const MIN_LITERAL_LEN = 3;
+
+const LANES = 16;
+const ByteVec = @Vector(LANES, u8);
+
+pub const Set = struct {
+    items: [MAX_LITERALS][]const u8 = undefined,
+    count: u8 = 0,
+
+    pub fn slice(self: *const Set) []const []const u8 {
+        return self.items[0..self.count];
+    }
+
+    fn has(self: *const Set, lit: []const u8) bool {
+        for (self.slice()) |item| {
+            if (std.mem.eql(u8, item, lit)) return true;
+        }
+        return false;
+    }
+
+    /// Add a required literal, evicting the shortest when full.
+    pub fn add(self: *Set, lit: []const u8) void {
+        if (lit.len < MIN_LITERAL_LEN or self.has(lit)) return;
+        if (self.count < MAX_LITERALS) {
+            self.items[self.count] = lit;
+            self.count += 1;
+            return;
+        }
+        var shortest: u8 = 0;
+        for (self.slice(), 0..) |item, k| {
+            if (item.len < self.items[shortest].len) shortest = @intCast(k);
+        }
+        if (lit.len > self.items[shortest].len) self.items[shortest] = lit;
+    }
+
+    /// Both sets required: keep the literals of both.
+    pub fn merge(self: *Set, other: *const Set) void {
+        for (other.slice()) |lit| self.add(lit);
+    }
+
+    /// Either set suffices: only literals common to both are required.
+    pub fn intersect(self: *Set, other: *const Set) void {
+        var kept = Set{};
+        for (self.slice()) |lit| {
+            if (other.has(lit)) kept.add(lit);
+        }
+        self.* = kept;
+    }
+
+    /// Whether `haystack` contains every literal.
+    pub fn allIn(self: *const Set, haystack: []const u8) bool {
+        for (self.slice()) |lit| {
+            if (!contains(haystack, lit)) return false;
+        }
+        return true;
+    }
+};
+
+/// Required literals of a parsed pattern: its named leaves other than
+/// metavariables and ellipses, which matchNode compares by text. A pattern
+/// that did not parse cleanly requires nothing.
+pub fn fromPattern(pattern_root: ts.Node) Set {
+    var set = Set{};
+    if (pattern_root.hasError()) return set;
+    collect(pattern_root, &set, 0);
+    return set;
+}
+
+fn collect(node: ts.Node, set: *Set, depth: u32) void {
+    if (depth > 100) return;
+    const count = node.childCount();
+    if (count == 0) {
+        const text = node.text();
+        if (node.isNamed() and text.len > 0 and text[0] != '$' and !std.mem.eql(u8, text, "...")) set.add(text);
+        return;
+    }
+    var i: u32 = 0;
+    while (i < count) : (i += 1) {
+        if (node.child(i)) |ch| collect(ch, set, depth + 1);
+    }
+}
+
+/// Whether `needle` occurs in `haystack`. Compares the needle's first and
+/// last bytes at LANES start positions per step and checks the bytes in
+/// between only where both agree.
+pub fn contains(haystack: []const u8, needle: []const u8) bool {
+    if (needle.len == 0) return true;
+    if (needle.len > haystack.len) return false;
+    if (needle.len == 1) return std.mem.indexOfScalar(u8, haystack, needle[0]) != null;
+
+    const first: ByteVec = @splat(needle[0]);
+    const last: ByteVec = @splat(needle[needle.len - 1]);
+    const middle = needle[1 .. needle.len - 1];
+    const starts = haystack.len - needle.len + 1;
+
+    var i: usize = 0;
+    while (i + LANES <= starts) : (i += LANES) {
+        const heads: ByteVec = haystack[i..][0..LANES].*;
+        const tails: ByteVec = haystack[i + needle.len - 1 ..][0..LANES].*;
+        var hits: u16 = @bitCast((heads == first) & (tails == last));
+        while (hits != 0) : (hits &= hits - 1) {
+            const at = i + @ctz(hits);
+            if (std.mem.eql(u8, haystack[at + 1 ..][0..middle.len], middle)) return true;
+        }
+    }
+    while (i < starts) : (i += 1) {
+        if (std.mem.eql(u8, haystack[i..][0..needle.len], needle)) return true;
+    }
+    return false;
+}
+
+// ── Tests ──────────────────────────────────────────────────
+
+test "contains agrees with indexOf" {
+    const hay = "const x = document.body.innerHTML; eval(input); // trailing text";
+    const needles = [_][]const u8{ "innerHTML", "eval", "trailing text", "const", "xt", "t", "evil", "innerHTMLx", "" };
+    for (needles) |n| {
+        try std.testing.expectEqual(std.mem.indexOf(u8, hay, n) != null, contains(hay, n));
+    }
+    try std.testing.expect(!contains("ab", "abc"));
+}
+
+test "fromPattern keeps identifier leaves, not metavariables" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    var tree = parser.parse("$OBJ.innerHTML = $VALUE") orelse return;
+    defer tree.deinit();
+
+    const set = fromPattern(tree.rootNode());
+    try std.testing.expectEqual(@as(u8, 1), set.count);
+    try std.testing.expectEqualStrings("innerHTML", set.items[0]);
+    try std.testing.expect(set.allIn("el.innerHTML = html;"));
+    try std.testing.expect(!set.allIn("el.textContent = html;"));
+}
+
+test "intersect keeps common literals" {
+    var a = Set{};
+    a.add("eval");
+    a.add("window");
+    var b = Set{};
+    b.add("eval");
+    a.intersect(&b);
+    try std.testing.expectEqual(@as(u8, 1), a.count);
+    try std.testing.expectEqualStrings("eval", a.items[0]);
+}
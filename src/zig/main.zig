@@ -4,22 +4,56 @@
 ///! the JavaScript host calls to run structural AST pattern matching
 ///! against JS/TS source code via tree-sitter.
 ///!
-///! Exported functions:
+///! Exported functions (those that write a result, read one back or keep
+///! per-caller state take a leading engine context handle, left out here):
 ///!   alloc(size)                     -> ptr    Allocate WASM memory
 ///!   dealloc(ptr, size)              ->        Free WASM memory
-///!   struct_match(pat, plen, src, slen, lang) -> Run pattern match
+///!   context_create()                -> handle New engine context (0 = error)
+///!   context_free(ctx)               ->        Release an engine context
+///!   struct_match(pat, plen, src, slen, lang, budget_us, limit) -> Run pattern match
 ///!   get_result_ptr()        -> ptr    Pointer to match JSON
 ///!   get_result_len()        -> u32    Length of match JSON
 ///!   compile_pattern(pat, len, lang) -> handle Compile & cache pattern
-///!   match_pattern(handle, src, len) ->        Match compiled pattern
-///!   free_pattern(handle)            ->        Free cached pattern
-///!   compile_source(src, len, lang)  -> handle Compile & cache source
-///!   match_compiled(pat_h, src_h)    ->        Match compiled pair
+///!   match_pattern(handle, src, len, budget_us) -> Match compiled pattern
+///!   free_pattern(handle)            ->        Release a pattern handle
+///!   pattern_cache_stats()           ->        Slots used/referenced, parse count
+///!   compile_source(src, len, lang, budget_us) -> handle Compile & cache source
+///!   compile_source_owned(src, len, lang, budget_us) -> handle Same, taking ownership of src
+///!   get_source_ptr(h) / get_source_len(h) -> Compiled source bytes in linear memory
+///!   get_parse_status()              -> u32    0 ok, 1 parse failed, 2 budget exceeded
+///!   match_compiled(pat_h, src_h, limit) ->    Match compiled pair
+///!   match_in_range(pat_h, src_h, s, e, limit) -> Match within a byte range
+///!   match_node(pat_h, src_h, id)    -> bool   Match at exactly one node
 ///!   free_source(handle)             ->        Free cached source
+///!   edit_source(h, src, len, s, oe, ne) -> ok  Incrementally re-parse an edit
+///!   apply_ruleset_incremental(rs, src) ->      Re-evaluate only what an edit touched
+///!   apply_ruleset_step(rs, src, fuel, restart) -> status Resumable apply (1 done, 2 partial)
+///!   has_language(lang)              -> bool   Whether this build links lang's grammar
+///!   pattern_prefilter(pat_h, src, len) -> bool Whether src has the pattern's literals
+///!   pattern_literals(pat_h)         -> u32    The pattern's literals, NUL-terminated
+///!   ruleset_prefilter(rs, src, len) -> count  Rules whose literals src contains
+///!   apply_ruleset_prefiltered(rs, src_h) ->    Apply only those rules
+///!   apply_ruleset_partition(rs, src_h, part, parts) -> One thread's share of those rules
+///!   prepare_partitions(rs, src_h)   -> ok     Query once and share the kept rules with the parts
+///!   snapshot_source(h)              -> ok     Flatten a source's tree for array scans
+///!   get_batch_snapshots()           -> ptr    Snapshots saved by the last apply_ruleset_many
+///!   node_root/node_info/node_at/node_parent/node_child/node_children/
+///!   node_field_child/node_next/node_prev -> id  Binary node records by node id
+///!   node_kind_table(h)              ->        Kind id → name table
+///!   node_dump(h, id, named_only, max_depth) -> ptr  Subtree as columnar arrays
+///!   query_source(src_h, q, qlen, limit) -> status  Run a tree-sitter query (0 ok)
+///!   get_query_error_offset()        -> u32    Where the last query failed to compile
+///!   pattern_query(pat_h)            -> u32    A pattern's query translation (0 = none)
 
 const std = @import("std");
 const rules = @import("rules.zig");
 const gpa = @import("alloc.zig").gpa;
+const clock = @import("clock.zig");
+const grammars = @import("grammars.zig");
+const snapshot = @import("snapshot.zig");
+const literals = @import("literals.zig");
+const utf8 = @import("utf8.zig");
+const query = @import("query.zig");
 
 // ── Output buffer ────────────────────────────────────────
 
@@ -38,19 +72,20 @@ export fn dealloc(ptr: [*]u8, size: u32) void {
 
 // ── Structural pattern matching exports ──────────────────
 //
-// struct_match(pattern_ptr, pattern_len, source_ptr, source_len, lang)
-//   → writes match result JSON to result_buf.
+// struct_match(pattern_ptr, pattern_len, source_ptr, source_len, lang, budget_us, limit)
+//   → writes match result JSON to the context's result buffer.
 //
 // The JS host passes a single pattern string + the source code. The
 // engine parses both with tree-sitter, runs structural matching, and
 // returns a JSON array of match objects with bindings.
+//
+// The matching exports take a trailing match limit (0 = MAX_MATCHES): the
+// search stops as soon as that many matches are found, so first-match and
+// existence checks do not walk the rest of the tree.
 
 const matcher = @import("matcher.zig");
 const ts = @import("ts_bridge.zig");
 
-var result_buf: [MAX_OUTPUT]u8 = undefined;
-var result_len: u32 = 0;
-
 fn toTsLang(lang: u32) ts.Language {
     const language: rules.Language = @enumFromInt(@as(u8, @truncate(lang)));
     return switch (language) {
@@ -60,91 +95,264 @@ fn toTsLang(lang: u32) ts.Language {
     };
 }
 
-// Static parser pool — avoids repeated alloc/free of tree-sitter parsers
-// which exhaust dlmalloc's WASM heap after multiple calls.
-var static_js_parser: ?ts.Parser = null;
-var static_ts_parser: ?ts.Parser = null;
+/// 1 when this engine build links the grammar for `lang`. Per-language
+/// builds (engine-javascript.wasm) omit the other grammars entirely.
+export fn has_language(lang: u32) u32 {
+    const language = std.meta.intToEnum(rules.Language, lang) catch return 0;
+    return @intFromBool(grammars.has(language));
+}
 
-fn getOrInitParser(ts_lang: ts.Language) ?*ts.Parser {
-    const slot: *?ts.Parser = switch (ts_lang) {
-        .javascript => &static_js_parser,
-        .typescript, .tsx => &static_ts_parser,
-    };
-    if (slot.* == null) {
-        slot.* = ts.Parser.init(ts_lang);
+/// 64-bit XXH3 of `len` bytes at `ptr`: the content key of the scan cache.
+/// XXH3 works on wide stripes the compiler maps to SIMD, so hashing keeps
+/// pace with reading.
+export fn hash_bytes(ptr: [*]const u8, len: u32) u64 {
+    return std.hash.XxHash3.hash(0, ptr[0..len]);
+}
+
+// Parser pool — avoids repeated alloc/free of tree-sitter parsers which
+// exhaust dlmalloc's WASM heap after multiple calls. Each engine context
+// has one, and the shared pattern cache has its own.
+const Parsers = struct {
+    javascript: ?ts.Parser = null,
+    typescript: ?ts.Parser = null,
+
+    fn get(self: *Parsers, ts_lang: ts.Language) ?*ts.Parser {
+        const slot: *?ts.Parser = switch (ts_lang) {
+            .javascript => &self.javascript,
+            .typescript, .tsx => &self.typescript,
+        };
+        if (slot.* == null) {
+            slot.* = ts.Parser.init(ts_lang);
+        }
+        return if (slot.*) |*p| p else null;
     }
-    return if (slot.*) |*p| p else null;
+
+    fn deinit(self: *Parsers) void {
+        if (self.javascript) |*p| p.deinit();
+        if (self.typescript) |*p| p.deinit();
+        self.* = .{};
+    }
+};
+
+var pattern_parsers: Parsers = .{};
+
+// ── Engine contexts ──────────────────────────────────────
+//
+// context_create() → handle (1-based, 0 = error)
+// context_free(ctx_handle)
+//
+// An engine context holds everything a call writes: the result buffer, the
+// parse status, its parsers, the match slots and the rule evaluator's
+// scratch lists. Every export that produces or reads back a result takes a
+// context first, so callers holding separate contexts (interleaved async
+// callers, or the threads of the threaded engine build) can share one
+// instance without clobbering each other's results. Compiled patterns,
+// sources and rulesets stay engine-wide and are named by handle from any
+// context; creating and freeing them is the caller's to serialize.
+
+const MAX_CONTEXTS = 64;
+
+const EngineContext = struct {
+    result_buf: [MAX_OUTPUT]u8 = undefined,
+    result_len: u32 = 0,
+    parse_status: ParseStatus = .ok,
+    parsers: Parsers = .{},
+    /// Raw matches of the last match operation (see store_matches).
+    last_match_list: matcher.MatchList = .{},
+    match_slots: [MAX_MATCH_SLOTS]?matcher.MatchList = .{null} ** MAX_MATCH_SLOTS,
+    /// Scratch for the counting exports; too large for the stack.
+    match_tally: matcher.Tally = .{ .source = "" },
+    query_error_offset: u32 = 0,
+    /// apply_ruleset_many output, reused across calls.
+    batch_out: std.ArrayListUnmanaged(u8) = .empty,
+    /// Tree snapshots saved by the last apply_ruleset_many (BATCH_SAVE_SNAPSHOT).
+    snap_out: std.ArrayListUnmanaged(u8) = .empty,
+    scratch: rule_engine.Scratch = .{},
+    /// Rules the last ruleset_prefilter in this context ruled out, and the
+    /// ruleset handle it ran for (0 = none).
+    skip: rule_engine.SkipSet = [_]bool{false} ** rule_engine.MAX_RULES,
+    skip_ruleset: u32 = 0,
+
+    fn writeEmptyArray(self: *EngineContext) void {
+        // Binary protocol: 4-byte count = 0
+        self.result_len = 4;
+        @memset(self.result_buf[0..4], 0);
+    }
+
+    fn writeMatches(self: *EngineContext, matches: *const matcher.MatchList) void {
+        self.last_match_list = matches.*;
+        self.result_len = serializeMatches(matches, &self.result_buf);
+    }
+};
+
+var context_slots: [MAX_CONTEXTS]?*EngineContext = .{null} ** MAX_CONTEXTS;
+
+/// Allocate a fresh context. Returns a 1-based handle (0 = error).
+export fn context_create() u32 {
+    const idx = findFree(*EngineContext, MAX_CONTEXTS, &context_slots) orelse return 0;
+    const ctx = gpa.create(EngineContext) catch return 0;
+    ctx.* = .{};
+    context_slots[idx] = ctx;
+    return idx + 1;
+}
+
+/// Release a context with its parsers and scratch space.
+export fn context_free(ctx_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    ctx.parsers.deinit();
+    ctx.batch_out.deinit(gpa);
+    ctx.snap_out.deinit(gpa);
+    ctx.scratch.deinit();
+    gpa.destroy(ctx);
+    context_slots[ctx_handle - 1] = null;
+}
+
+fn context(ctx_handle: u32) ?*EngineContext {
+    if (ctx_handle == 0 or ctx_handle > MAX_CONTEXTS) return null;
+    return context_slots[ctx_handle - 1];
+}
+
+// ── Parse budgets ────────────────────────────────────────
+//
+// struct_match, match_pattern and compile_source take a trailing budget_us
+// (0 = unlimited). Garbage or deeply ambiguous input can keep tree-sitter's
+// error recovery busy for seconds; a budget cancels the parse instead, and
+// the call reports it through get_parse_status().
+
+/// not_text marks a batch source skipped by utf8.isText, never parsed.
+const ParseStatus = enum(u32) { ok = 0, failed = 1, budget_exceeded = 2, not_text = 3 };
+
+export fn get_parse_status(ctx_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return @intFromEnum(ParseStatus.failed);
+    return @intFromEnum(ctx.parse_status);
+}
+
+/// Parse under a budget, recording in `status` why a failed parse failed.
+/// The parser is reset on failure so a cancelled parse is not resumed by
+/// the next call.
+fn parseBudgeted(parser: *ts.Parser, source: []const u8, budget_us: u32, status: *ParseStatus) ?ts.Tree {
+    return parser.parseWithBudget(source, budget_us) catch |err| {
+        status.* = switch (err) {
+            error.BudgetExceeded => .budget_exceeded,
+            error.ParseFailed => .failed,
+        };
+        parser.reset();
+        return null;
+    };
+}
+
+/// What is left of `budget_us` since `started`. 0 stays "no limit"; a spent
+/// budget still yields 1µs so the next parse is cancelled, not unlimited.
+fn remainingBudget(budget_us: u32, started: u64) u32 {
+    if (budget_us == 0) return 0;
+    const elapsed = clock.nowMicros() -| started;
+    return if (elapsed >= budget_us) 1 else budget_us - @as(u32, @intCast(elapsed));
 }
 
 export fn struct_match(
+    ctx_handle: u32,
     pattern_ptr: [*]const u8,
     pattern_len: u32,
     source_ptr: [*]const u8,
     source_len: u32,
     lang: u32,
+    budget_us: u32,
+    limit: u32,
 ) void {
-    const pattern_source = pattern_ptr[0..pattern_len];
+    const ctx = context(ctx_handle) orelse return;
+    var matches = matcher.MatchList.withLimit(limit);
+    if (!structSearch(ctx, pattern_ptr[0..pattern_len], source_ptr[0..source_len], lang, budget_us, &matches)) {
+        ctx.writeEmptyArray();
+        return;
+    }
+    ctx.writeMatches(&matches);
+}
+
+/// struct_match, counting instead of collecting: writes the tally of all
+/// matches (see serializeTally), grouped by the text bound to the
+/// metavariable `group` (name without $) unless group_len is 0.
+export fn struct_count(
+    ctx_handle: u32,
+    pattern_ptr: [*]const u8,
+    pattern_len: u32,
+    source_ptr: [*]const u8,
+    source_len: u32,
+    lang: u32,
+    budget_us: u32,
+    group_ptr: ?[*]const u8,
+    group_len: u32,
+) void {
+    const ctx = context(ctx_handle) orelse return;
     const source = source_ptr[0..source_len];
-    const ts_lang = toTsLang(lang);
+    ctx.match_tally = .{ .source = source, .group_by = groupName(group_ptr, group_len) };
+    var matches = matcher.MatchList{ .tally = &ctx.match_tally };
+    _ = structSearch(ctx, pattern_ptr[0..pattern_len], source, lang, budget_us, &matches);
+    ctx.result_len = serializeTally(&ctx.match_tally, &ctx.result_buf);
+}
 
-    // Reuse static parsers to avoid dlmalloc heap exhaustion in WASM.
-    const parser = getOrInitParser(ts_lang) orelse {
-        writeEmptyArray();
-        return;
-    };
+/// Parse `source` and search it for `pattern`, shared by struct_match and
+/// struct_count. False when nothing was searched: the pattern did not
+/// compile, the source lacks one of its literals, or the parse failed.
+fn structSearch(
+    ctx: *EngineContext,
+    pattern: []const u8,
+    source: []const u8,
+    lang: u32,
+    budget_us: u32,
+    matches: *matcher.MatchList,
+) bool {
+    const started = clock.nowMicros();
+    ctx.parse_status = .ok;
+    const ts_lang = toTsLang(lang);
 
-    // Parse source
-    var source_tree = parser.parse(source) orelse {
-        writeEmptyArray();
-        return;
-    };
+    // The pattern comes from the shared cache, parsed at most once. When
+    // the source lacks one of its literals there can be no match, and the
+    // source parse is skipped.
+    const pat_handle = acquirePattern(pattern, ts_lang, budget_us, &ctx.parse_status);
+    if (pat_handle == 0) return false;
+    defer releasePattern(pat_handle);
+    const pat_slot = compiled_slots[pat_handle - 1].?;
+    if (!pat_slot.required.allIn(source)) return false;
 
-    // Parse pattern with the same parser (tree-sitter supports sequential parses)
-    var pattern_tree = parser.parse(pattern_source) orelse {
-        source_tree.deinit();
-        parser.reset();
-        writeEmptyArray();
-        return;
-    };
+    // Reuse the context's parsers to avoid dlmalloc heap exhaustion in WASM.
+    const parser = ctx.parsers.get(ts_lang) orelse return false;
+    var source_tree = parseBudgeted(parser, source, remainingBudget(budget_us, started), &ctx.parse_status) orelse return false;
 
     // Run structural matching
-    var matches = matcher.MatchList{};
-    matcher.searchMatches(pattern_tree.rootNode(), source_tree.rootNode(), &matches, 0);
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    matcher.searchMatches(pat_slot.tree.rootNode(), source_tree.rootNode(), matches, 0);
 
-    // Free trees then reset parser to release all internal caches.
+    // Free the tree then reset parser to release all internal caches.
     // Critical for WASM where dlmalloc can't return freed pages to the OS.
-    pattern_tree.deinit();
     source_tree.deinit();
     parser.reset();
+    return true;
 }
 
-fn writeEmptyArray() void {
-    // Binary protocol: 4-byte count = 0
-    result_len = 4;
-    result_buf[0] = 0;
-    result_buf[1] = 0;
-    result_buf[2] = 0;
-    result_buf[3] = 0;
-}
-
-export fn get_result_ptr() [*]const u8 {
-    return &result_buf;
+export fn get_result_ptr(ctx_handle: u32) ?[*]const u8 {
+    const ctx = context(ctx_handle) orelse return null;
+    return &ctx.result_buf;
 }
 
-export fn get_result_len() u32 {
-    return result_len;
+export fn get_result_len(ctx_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    return ctx.result_len;
 }
 
 // ── AOT compiled pattern cache ──────────────────────────
 //
 // compile_pattern(pat_ptr, pat_len, lang) → handle (1-based slot index, 0 = error)
-// match_pattern(handle, src_ptr, src_len) → writes result JSON
-// free_pattern(handle)                    → releases the cached tree
+// match_pattern(handle, src_ptr, src_len, budget_us) → writes result JSON
+// free_pattern(handle)                    → drops one reference
 //
 // Patterns are parsed once by tree-sitter and stored. Subsequent
 // match_pattern calls skip the JS→WASM string copy and re-parse.
+//
+// The cache is content-addressed and shared by every entry point:
+// compile_pattern, struct_match and rulesets all acquire the slot already
+// holding the same (language, pattern text) and bump its reference count.
+// A slot whose last reference is dropped stays parsed until another
+// pattern needs it, least recently used first, so one pattern matched
+// against 10k files is parsed once.
 
 const MAX_COMPILED = 64;
 
@@ -152,44 +360,53 @@ const CompiledPattern = struct {
     tree: ts.Tree,
     lang: ts.Language,
     active: bool,
+    /// Literals any match needs in the source (slices of tree.source).
+    required: literals.Set = .{},
+    /// patternHash of (lang, tree.source), checked before the bytes.
+    hash: u64 = 0,
+    /// Live handles; at 0 the slot is only cached and may be evicted.
+    refs: u32 = 0,
+    /// pattern_clock at the last acquire.
+    last_used: u64 = 0,
 };
 
 var compiled_slots: [MAX_COMPILED]?CompiledPattern = .{null} ** MAX_COMPILED;
+var pattern_clock: u64 = 0;
+var pattern_parses: u32 = 0;
 
-/// Generic slot finder — replaces 4 identical findFreeXxxSlot functions.
-fn findFree(comptime T: type, comptime N: usize, slots: *const [N]?T) ?u32 {
-    for (0..N) |i| {
-        if (slots[i] == null) return @intCast(i);
-    }
-    return null;
+fn patternHash(ts_lang: ts.Language, text: []const u8) u64 {
+    return std.hash.Wyhash.hash(@intFromEnum(ts_lang), text);
 }
 
-/// Compile a pattern string and cache the parsed AST. Returns a 1-based
-/// handle (0 = error). The pattern string memory can be freed after this call.
-export fn compile_pattern(
-    pattern_ptr: [*]const u8,
-    pattern_len: u32,
-    lang: u32,
-) u32 {
-    const slot_idx = findFree(CompiledPattern, MAX_COMPILED, &compiled_slots) orelse return 0;
-    const pattern_source = pattern_ptr[0..pattern_len];
-    const ts_lang = toTsLang(lang);
-
-    const parser = getOrInitParser(ts_lang) orelse return 0;
+/// 1-based handle for `text` parsed as `ts_lang`, taking a reference. Parses
+/// only on a cache miss. Returns 0 if the parse fails (see `status`) or
+/// every slot is referenced.
+fn acquirePattern(text: []const u8, ts_lang: ts.Language, budget_us: u32, status: *ParseStatus) u32 {
+    const hash = patternHash(ts_lang, text);
+    pattern_clock += 1;
+    for (&compiled_slots, 0..) |*entry, i| {
+        if (entry.*) |*slot| {
+            if (slot.hash == hash and slot.lang == ts_lang and std.mem.eql(u8, slot.tree.source, text)) {
+                slot.refs += 1;
+                slot.last_used = pattern_clock;
+                return @intCast(i + 1);
+            }
+        }
+    }
 
-    var tree = parser.parse(pattern_source) orelse {
-        parser.reset();
-        return 0;
-    };
+    const slot_idx = findFree(CompiledPattern, MAX_COMPILED, &compiled_slots) orelse evictPattern() orelse return 0;
+    const parser = pattern_parsers.get(ts_lang) orelse return 0;
+    var tree = parseBudgeted(parser, text, budget_us, status) orelse return 0;
+    pattern_parses += 1;
 
     // Copy the pattern source into WASM-owned memory so the tree's
     // source slice stays valid after the caller frees the input buffer.
-    const owned = gpa.alloc(u8, pattern_len) catch {
+    const owned = gpa.alloc(u8, text.len) catch {
         tree.deinit();
         parser.reset();
         return 0;
     };
-    @memcpy(owned, pattern_source);
+    @memcpy(owned, text);
     tree.source = owned;
 
     parser.reset();
@@ -198,65 +415,167 @@ export fn compile_pattern(
         .tree = tree,
         .lang = ts_lang,
         .active = true,
+        .required = literals.fromPattern(tree.rootNode()),
+        .hash = hash,
+        .refs = 1,
+        .last_used = pattern_clock,
     };
+    return slot_idx + 1;
+}
 
-    return slot_idx + 1; // 1-based handle
+/// Drop one reference. The pattern stays cached until evicted.
+fn releasePattern(handle: u32) void {
+    if (handle == 0 or handle > MAX_COMPILED) return;
+    if (compiled_slots[handle - 1]) |*slot| {
+        slot.refs -|= 1;
+    }
+}
+
+/// Free the least recently used unreferenced slot and return its index.
+fn evictPattern() ?u32 {
+    var victim: ?u32 = null;
+    var oldest: u64 = std.math.maxInt(u64);
+    for (compiled_slots, 0..) |entry, i| {
+        const slot = entry orelse continue;
+        if (slot.refs == 0 and slot.last_used < oldest) {
+            oldest = slot.last_used;
+            victim = @intCast(i);
+        }
+    }
+    const idx = victim orelse return null;
+    if (compiled_slots[idx]) |*slot| {
+        gpa.free(slot.tree.source);
+        slot.tree.deinit();
+    }
+    compiled_slots[idx] = null;
+    return idx;
+}
+
+/// rule_engine.compilePatterns hook: rule patterns share the cache.
+fn acquireRulePattern(text: []const u8, ts_lang: ts.Language) u32 {
+    var status: ParseStatus = .ok;
+    return acquirePattern(text, ts_lang, 0, &status);
+}
+
+/// Cache counters, written to the result buffer as little-endian u32s:
+/// [slots in use][slots referenced][patterns parsed since load].
+export fn pattern_cache_stats(ctx_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    var used: u32 = 0;
+    var live: u32 = 0;
+    for (compiled_slots) |entry| {
+        const slot = entry orelse continue;
+        used += 1;
+        if (slot.refs > 0) live += 1;
+    }
+    writeU32LE(&ctx.result_buf, 0, used);
+    writeU32LE(&ctx.result_buf, 4, live);
+    writeU32LE(&ctx.result_buf, 8, pattern_parses);
+    ctx.result_len = 12;
+}
+
+/// Generic slot finder — replaces 4 identical findFreeXxxSlot functions.
+fn findFree(comptime T: type, comptime N: usize, slots: *const [N]?T) ?u32 {
+    for (0..N) |i| {
+        if (slots[i] == null) return @intCast(i);
+    }
+    return null;
+}
+
+/// Compile a pattern string (or reuse the cached parse) and return a
+/// 1-based handle holding a reference (0 = error). Release it with
+/// free_pattern. The pattern string memory can be freed after this call.
+export fn compile_pattern(
+    pattern_ptr: [*]const u8,
+    pattern_len: u32,
+    lang: u32,
+) u32 {
+    var status: ParseStatus = .ok;
+    return acquirePattern(pattern_ptr[0..pattern_len], toTsLang(lang), 0, &status);
+}
+
+/// 0 if the source bytes lack a literal the compiled pattern needs, so no
+/// match is possible and the source need not be parsed; 1 otherwise.
+export fn pattern_prefilter(pat_handle: u32, src_ptr: [*]const u8, src_len: u32) u32 {
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) return 1;
+    const slot = compiled_slots[pat_handle - 1] orelse return 1;
+    return @intFromBool(slot.required.allIn(src_ptr[0..src_len]));
+}
+
+/// Write a compiled pattern's required literals to the result buffer, each
+/// followed by a NUL byte, and return their byte length (0: none required).
+export fn pattern_literals(ctx_handle: u32, pat_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.result_len = 0;
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) return 0;
+    const slot = compiled_slots[pat_handle - 1] orelse return 0;
+    var len: usize = 0;
+    for (slot.required.slice()) |lit| {
+        // Dropping a literal only weakens the filter.
+        if (len + lit.len + 1 > MAX_OUTPUT) break;
+        @memcpy(ctx.result_buf[len..][0..lit.len], lit);
+        ctx.result_buf[len + lit.len] = 0;
+        len += lit.len + 1;
+    }
+    ctx.result_len = @intCast(len);
+    return ctx.result_len;
 }
 
 /// Match a pre-compiled pattern against source code. Writes result JSON
 /// to the result buffer (read via get_result_ptr/len).
 export fn match_pattern(
+    ctx_handle: u32,
     handle: u32,
     source_ptr: [*]const u8,
     source_len: u32,
+    budget_us: u32,
 ) void {
+    const ctx = context(ctx_handle) orelse return;
+    ctx.parse_status = .ok;
     if (handle == 0 or handle > MAX_COMPILED) {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     }
 
     const slot = compiled_slots[handle - 1] orelse {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     };
 
     const source = source_ptr[0..source_len];
-    const parser = getOrInitParser(slot.lang) orelse {
-        writeEmptyArray();
+    // No parse when the source lacks one of the pattern's literals.
+    if (!slot.required.allIn(source)) {
+        ctx.writeEmptyArray();
+        return;
+    }
+    const parser = ctx.parsers.get(slot.lang) orelse {
+        ctx.writeEmptyArray();
         return;
     };
 
-    var source_tree = parser.parse(source) orelse {
-        parser.reset();
-        writeEmptyArray();
+    var source_tree = parseBudgeted(parser, source, budget_us, &ctx.parse_status) orelse {
+        ctx.writeEmptyArray();
         return;
     };
 
     var matches = matcher.MatchList{};
     matcher.searchMatches(slot.tree.rootNode(), source_tree.rootNode(), &matches, 0);
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    ctx.writeMatches(&matches);
 
     source_tree.deinit();
     parser.reset();
 }
 
-/// Free a compiled pattern, releasing its cached AST.
+/// Drop a compile_pattern reference. The parsed AST stays cached for the
+/// next compile of the same pattern until its slot is evicted.
 export fn free_pattern(handle: u32) void {
-    if (handle == 0 or handle > MAX_COMPILED) return;
-    const idx = handle - 1;
-    if (compiled_slots[idx]) |*slot| {
-        // Free the owned source copy
-        gpa.free(slot.tree.source);
-        slot.tree.deinit();
-        compiled_slots[idx] = null;
-    }
+    releasePattern(handle);
 }
 
 // ── AOT compiled source cache ───────────────────────────
 //
-// compile_source(src_ptr, src_len, lang) → handle (1-based, 0 = error)
-// match_compiled(pat_handle, src_handle) → writes result JSON
+// compile_source(src_ptr, src_len, lang, budget_us) → handle (1-based, 0 = error)
+// match_compiled(pat_handle, src_handle, limit) → writes result JSON
 // free_source(handle)                    → releases the cached source tree
 
 const MAX_SOURCES = 16;
@@ -264,36 +583,74 @@ const MAX_SOURCES = 16;
 const CompiledSource = struct {
     tree: ts.Tree,
     lang: ts.Language,
+    /// Bytes touched by edit_source since the last incremental apply.
+    dirty: ?matcher.Range = null,
+    /// Cached per-rule findings for apply_ruleset_incremental.
+    incr: ?*rule_engine.IncrementalState = null,
+    /// In-progress apply_ruleset_step evaluation.
+    step: ?*rule_engine.StepState = null,
+    /// Flattened tree from snapshot_source, rebuilt after each edit.
+    snap: ?*snapshot.Snapshot = null,
+    /// Query pass from prepare_partitions, read by apply_ruleset_partition.
+    pass: ?*rule_engine.SharedPass = null,
+    /// Ruleset handle the pass ran for.
+    pass_ruleset: u32 = 0,
 };
 
 var source_slots: [MAX_SOURCES]?CompiledSource = .{null} ** MAX_SOURCES;
 
-/// Compile source code and cache the parsed AST. Returns a 1-based handle.
+/// Compile source code and cache the parsed AST. Returns a 1-based handle
+/// (0 = error; get_parse_status() tells a spent budget from a failed parse).
+/// The source is copied; the caller still owns `source_ptr`.
 export fn compile_source(
+    ctx_handle: u32,
     source_ptr: [*]const u8,
     source_len: u32,
     lang: u32,
+    budget_us: u32,
 ) u32 {
-    const slot_idx = findFree(CompiledSource, MAX_SOURCES, &source_slots) orelse return 0;
-    const source = source_ptr[0..source_len];
-    const ts_lang = toTsLang(lang);
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.parse_status = .ok;
+    const owned = gpa.alloc(u8, source_len) catch return 0;
+    @memcpy(owned, source_ptr[0..source_len]);
+    return compileOwned(ctx, owned, lang, budget_us);
+}
 
-    const parser = getOrInitParser(ts_lang) orelse return 0;
+/// Zero-copy compile_source: takes ownership of `source_ptr`, which must come
+/// from alloc(source_len). The buffer becomes the tree's source as is and is
+/// released by free_source, or right away if compilation fails.
+export fn compile_source_owned(
+    ctx_handle: u32,
+    source_ptr: [*]u8,
+    source_len: u32,
+    lang: u32,
+    budget_us: u32,
+) u32 {
+    const owned = source_ptr[0..source_len];
+    const ctx = context(ctx_handle) orelse {
+        gpa.free(owned);
+        return 0;
+    };
+    return compileOwned(ctx, owned, lang, budget_us);
+}
 
-    var tree = parser.parse(source) orelse {
-        parser.reset();
+fn compileOwned(ctx: *EngineContext, owned: []u8, lang: u32, budget_us: u32) u32 {
+    ctx.parse_status = .ok;
+    const slot_idx = findFree(CompiledSource, MAX_SOURCES, &source_slots) orelse {
+        gpa.free(owned);
         return 0;
     };
+    const ts_lang = toTsLang(lang);
 
-    // Copy source into WASM-owned memory
-    const owned = gpa.alloc(u8, source_len) catch {
-        tree.deinit();
-        parser.reset();
+    const parser = ctx.parsers.get(ts_lang) orelse {
+        gpa.free(owned);
         return 0;
     };
-    @memcpy(owned, source);
-    tree.source = owned;
 
+    const tree = parseBudgeted(parser, owned, budget_us, &ctx.parse_status) orelse {
+        gpa.free(owned);
+        return 0;
+    };
     parser.reset();
 
     source_slots[slot_idx] = .{
@@ -304,31 +661,100 @@ export fn compile_source(
     return slot_idx + 1;
 }
 
+/// Location of a compiled source's bytes in linear memory, so the host can
+/// read node text without keeping its own copy. null/0 for a bad handle.
+export fn get_source_ptr(handle: u32) ?[*]const u8 {
+    if (handle == 0 or handle > MAX_SOURCES) return null;
+    const slot = source_slots[handle - 1] orelse return null;
+    return slot.tree.source.ptr;
+}
+
+export fn get_source_len(handle: u32) u32 {
+    if (handle == 0 or handle > MAX_SOURCES) return 0;
+    const slot = source_slots[handle - 1] orelse return 0;
+    return @intCast(slot.tree.source.len);
+}
+
+/// Build a struct-of-arrays snapshot of a compiled source's tree. Matching,
+/// kind/regex collection and sibling lookups then scan its arrays instead
+/// of walking the tree through the C API (the node_* exports build one on
+/// first use regardless). Costs about
+/// 100 bytes per node; edit_source rebuilds it and free_source releases it.
+/// Returns 1 on success, 0 on error.
+export fn snapshot_source(handle: u32) u32 {
+    if (handle == 0 or handle > MAX_SOURCES) return 0;
+    const slot = if (source_slots[handle - 1]) |*s| s else return 0;
+    if (slot.snap != null) return 1;
+    return @intFromBool(attachSnapshot(slot));
+}
+
+fn attachSnapshot(slot: *CompiledSource) bool {
+    const snap = snapshot.Snapshot.build(&slot.tree) orelse return false;
+    if (!snapshot.register(snap)) {
+        snap.deinit();
+        return false;
+    }
+    slot.snap = snap;
+    return true;
+}
+
+fn dropSharedPass(slot: *CompiledSource) void {
+    if (slot.pass) |pass| {
+        rule_engine.freeSharedPass(pass);
+        slot.pass = null;
+        slot.pass_ruleset = 0;
+    }
+}
+
+fn dropSnapshot(slot: *CompiledSource) void {
+    if (slot.snap) |snap| {
+        snapshot.unregister(snap);
+        snap.deinit();
+        slot.snap = null;
+    }
+}
+
 /// Match a compiled pattern against a compiled source. Both ASTs are
 /// already parsed — this is a pure tree walk, no parsing overhead.
-export fn match_compiled(pat_handle: u32, src_handle: u32) void {
+export fn match_compiled(ctx_handle: u32, pat_handle: u32, src_handle: u32, limit: u32) void {
+    const ctx = context(ctx_handle) orelse return;
     if (pat_handle == 0 or pat_handle > MAX_COMPILED) {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     }
     if (src_handle == 0 or src_handle > MAX_SOURCES) {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     }
 
     const pat_slot = compiled_slots[pat_handle - 1] orelse {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     };
     const src_slot = source_slots[src_handle - 1] orelse {
-        writeEmptyArray();
+        ctx.writeEmptyArray();
         return;
     };
 
-    var matches = matcher.MatchList{};
+    var matches = matcher.MatchList.withLimit(limit);
     matcher.searchMatches(pat_slot.tree.rootNode(), src_slot.tree.rootNode(), &matches, 0);
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    ctx.writeMatches(&matches);
+}
+
+/// match_compiled, counting instead of collecting (see struct_count).
+export fn count_compiled(ctx_handle: u32, pat_handle: u32, src_handle: u32, group_ptr: ?[*]const u8, group_len: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    ctx.match_tally = .{ .source = "", .group_by = groupName(group_ptr, group_len) };
+    defer ctx.result_len = serializeTally(&ctx.match_tally, &ctx.result_buf);
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) return;
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return;
+    const pat_slot = compiled_slots[pat_handle - 1] orelse return;
+    const src_slot = source_slots[src_handle - 1] orelse return;
+
+    const root = src_slot.tree.rootNode();
+    ctx.match_tally.source = root.source;
+    var matches = matcher.MatchList{ .tally = &ctx.match_tally };
+    matcher.searchMatches(pat_slot.tree.rootNode(), root, &matches, 0);
 }
 
 /// Free a compiled source, releasing its cached AST.
@@ -336,109 +762,298 @@ export fn free_source(handle: u32) void {
     if (handle == 0 or handle > MAX_SOURCES) return;
     const idx = handle - 1;
     if (source_slots[idx]) |*slot| {
+        if (slot.incr) |state| rule_engine.freeIncremental(state);
+        if (slot.step) |state| rule_engine.freeStep(state);
+        dropSnapshot(slot);
+        dropSharedPass(slot);
         gpa.free(slot.tree.source);
         slot.tree.deinit();
         source_slots[idx] = null;
     }
 }
 
+// ── Incremental re-parse ─────────────────────────────────
+//
+// edit_source(src_h, new_ptr, new_len, start, old_end, new_end) → 1 ok / 0 error
+//
+// The edit replaces old bytes [start, old_end) with new bytes [start, new_end).
+// Like compile_source_owned, the engine takes ownership of `new_ptr` (from
+// alloc(new_len)) whether or not the edit succeeds.
+// The cached tree is edited and handed back to tree-sitter so unchanged
+// subtrees are reused, and the slot's dirty range grows by the edit plus
+// every range tree-sitter reports as structurally changed.
+
+/// Row/column after advancing `p` over `bytes` (columns count bytes, as
+/// tree-sitter does).
+fn advancePoint(p: ts.c.TSPoint, bytes: []const u8) ts.c.TSPoint {
+    const newlines = std.mem.count(u8, bytes, "\n");
+    if (newlines == 0) return .{ .row = p.row, .column = p.column + @as(u32, @intCast(bytes.len)) };
+    const last_nl = std.mem.lastIndexOfScalar(u8, bytes, '\n').?;
+    return .{ .row = p.row + @as(u32, @intCast(newlines)), .column = @intCast(bytes.len - last_nl - 1) };
+}
+
+/// Union of byte ranges, fed by edit_source and forEachChangedRange.
+const DirtyRange = struct {
+    range: ?matcher.Range = null,
+
+    fn add(self: *DirtyRange, start: u32, end: u32) void {
+        if (self.range) |r| {
+            self.range = .{ .start_byte = @min(r.start_byte, start), .end_byte = @max(r.end_byte, end) };
+        } else {
+            self.range = .{ .start_byte = start, .end_byte = end };
+        }
+    }
+};
+
+export fn edit_source(
+    ctx_handle: u32,
+    src_handle: u32,
+    new_ptr: [*]u8,
+    new_len: u32,
+    start_byte: u32,
+    old_end_byte: u32,
+    new_end_byte: u32,
+) u32 {
+    const owned = new_ptr[0..new_len];
+    const ctx = context(ctx_handle) orelse {
+        gpa.free(owned);
+        return 0;
+    };
+    if (!editSource(ctx, src_handle, owned, start_byte, old_end_byte, new_end_byte)) {
+        gpa.free(owned);
+        return 0;
+    }
+    return 1;
+}
+
+/// edit_source body; on false the caller still owns `owned`.
+fn editSource(ctx: *EngineContext, src_handle: u32, owned: []u8, start_byte: u32, old_end_byte: u32, new_end_byte: u32) bool {
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return false;
+    const slot = if (source_slots[src_handle - 1]) |*s| s else return false;
+    const old_source = slot.tree.source;
+
+    if (start_byte > old_end_byte or old_end_byte > old_source.len) return false;
+    if (start_byte > new_end_byte or new_end_byte > owned.len) return false;
+    if (old_source.len - old_end_byte != owned.len - new_end_byte) return false;
+
+    const parser = ctx.parsers.get(slot.lang) orelse return false;
+
+    const start_point = advancePoint(.{ .row = 0, .column = 0 }, old_source[0..start_byte]);
+    const input_edit = ts.c.TSInputEdit{
+        .start_byte = start_byte,
+        .old_end_byte = old_end_byte,
+        .new_end_byte = new_end_byte,
+        .start_point = start_point,
+        .old_end_point = advancePoint(start_point, old_source[start_byte..old_end_byte]),
+        .new_end_point = advancePoint(start_point, owned[start_byte..new_end_byte]),
+    };
+
+    // Edit a shallow copy so the slot stays intact if re-parsing fails.
+    var edited = slot.tree.copy() orelse return false;
+    edited.edit(&input_edit);
+    const new_tree = parser.reparse(&edited, owned) orelse {
+        edited.deinit();
+        parser.reset();
+        return false;
+    };
+    parser.reset();
+
+    const e = matcher.Edit{
+        .start_byte = start_byte,
+        .old_end_byte = old_end_byte,
+        .new_end_byte = new_end_byte,
+        .old_end_row = input_edit.old_end_point.row,
+        .old_end_col = input_edit.old_end_point.column,
+        .new_end_row = input_edit.new_end_point.row,
+        .new_end_col = input_edit.new_end_point.column,
+    };
+
+    var dirty = DirtyRange{ .range = if (slot.dirty) |d| matcher.shiftRange(d, e) else null };
+    dirty.add(start_byte, new_end_byte);
+    ts.Tree.forEachChangedRange(&edited, &new_tree, &dirty, DirtyRange.add);
+    edited.deinit();
+
+    if (slot.incr) |state| rule_engine.shiftIncremental(state, e);
+    // A resumable evaluation cannot be carried across an edit; restart it.
+    if (slot.step) |state| {
+        rule_engine.freeStep(state);
+        slot.step = null;
+    }
+
+    const had_snapshot = slot.snap != null;
+    dropSnapshot(slot);
+    dropSharedPass(slot);
+
+    gpa.free(old_source);
+    slot.tree.deinit();
+    slot.tree = new_tree;
+    slot.dirty = dirty.range;
+    // Without a fresh snapshot the walks fall back to the tree.
+    if (had_snapshot) _ = attachSnapshot(slot);
+    return true;
+}
+
 // ── Match slot system ────────────────────────────────────
 //
-// After any match operation, the raw MatchList is saved to last_match_list.
-// store_matches() moves it into a slot for later filtering/composition.
-// Slots are 1-based handles (0 = error).
+// After any match operation, the raw MatchList is saved to the context's
+// last_match_list. store_matches() moves it into one of the context's slots
+// for later filtering/composition. Slots are 1-based handles (0 = error).
 
 const MAX_MATCH_SLOTS = 4;
 
-var last_match_list: matcher.MatchList = .{};
-var match_slots: [MAX_MATCH_SLOTS]?matcher.MatchList = .{null} ** MAX_MATCH_SLOTS;
-
 /// Move last_match_list into a slot. Returns 1-based handle (0 = error).
-export fn store_matches() u32 {
-    const idx = findFree(matcher.MatchList, MAX_MATCH_SLOTS, &match_slots) orelse return 0;
-    match_slots[idx] = last_match_list;
+export fn store_matches(ctx_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    const idx = findFree(matcher.MatchList, MAX_MATCH_SLOTS, &ctx.match_slots) orelse return 0;
+    ctx.match_slots[idx] = ctx.last_match_list;
     return idx + 1;
 }
 
 /// Shared filter dispatch — validates handles, copies first slot, applies filter, serializes.
-fn runFilter(matches_h: u32, ctx_h: u32, comptime filterFn: fn (*matcher.MatchList, *const matcher.MatchList) matcher.MatchList) void {
-    if (matches_h == 0 or matches_h > MAX_MATCH_SLOTS) { writeEmptyArray(); return; }
-    if (ctx_h == 0 or ctx_h > MAX_MATCH_SLOTS) { writeEmptyArray(); return; }
-    const m_slot = match_slots[matches_h - 1] orelse { writeEmptyArray(); return; };
-    const c_slot = match_slots[ctx_h - 1] orelse { writeEmptyArray(); return; };
+fn runFilter(ctx_handle: u32, matches_h: u32, ref_h: u32, comptime filterFn: fn (*matcher.MatchList, *const matcher.MatchList) matcher.MatchList) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (matches_h == 0 or matches_h > MAX_MATCH_SLOTS) { ctx.writeEmptyArray(); return; }
+    if (ref_h == 0 or ref_h > MAX_MATCH_SLOTS) { ctx.writeEmptyArray(); return; }
+    const m_slot = ctx.match_slots[matches_h - 1] orelse { ctx.writeEmptyArray(); return; };
+    const r_slot = ctx.match_slots[ref_h - 1] orelse { ctx.writeEmptyArray(); return; };
     var m_copy = m_slot;
-    const result = filterFn(&m_copy, &c_slot);
-    last_match_list = result;
-    result_len = serializeMatches(&result, &result_buf);
+    const result = filterFn(&m_copy, &r_slot);
+    ctx.writeMatches(&result);
 }
 
-export fn filter_inside(matches_h: u32, ctx_h: u32) void { runFilter(matches_h, ctx_h, matcher.filterInside); }
-export fn filter_not_inside(matches_h: u32, ctx_h: u32) void { runFilter(matches_h, ctx_h, matcher.filterNotInside); }
-export fn filter_not(matches_h: u32, excl_h: u32) void { runFilter(matches_h, excl_h, matcher.filterNot); }
+export fn filter_inside(ctx_handle: u32, matches_h: u32, scope_h: u32) void { runFilter(ctx_handle, matches_h, scope_h, matcher.filterInside); }
+export fn filter_not_inside(ctx_handle: u32, matches_h: u32, scope_h: u32) void { runFilter(ctx_handle, matches_h, scope_h, matcher.filterNotInside); }
+export fn filter_not(ctx_handle: u32, matches_h: u32, excl_h: u32) void { runFilter(ctx_handle, matches_h, excl_h, matcher.filterNot); }
 
 /// Intersect two match lists.
-export fn intersect_matches(a_h: u32, b_h: u32) void {
-    if (a_h == 0 or a_h > MAX_MATCH_SLOTS) { writeEmptyArray(); return; }
-    if (b_h == 0 or b_h > MAX_MATCH_SLOTS) { writeEmptyArray(); return; }
-    const a_slot = match_slots[a_h - 1] orelse { writeEmptyArray(); return; };
-    const b_slot = match_slots[b_h - 1] orelse { writeEmptyArray(); return; };
+export fn intersect_matches(ctx_handle: u32, a_h: u32, b_h: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (a_h == 0 or a_h > MAX_MATCH_SLOTS) { ctx.writeEmptyArray(); return; }
+    if (b_h == 0 or b_h > MAX_MATCH_SLOTS) { ctx.writeEmptyArray(); return; }
+    const a_slot = ctx.match_slots[a_h - 1] orelse { ctx.writeEmptyArray(); return; };
+    const b_slot = ctx.match_slots[b_h - 1] orelse { ctx.writeEmptyArray(); return; };
     const result = matcher.intersect(&a_slot, &b_slot);
-    last_match_list = result;
-    result_len = serializeMatches(&result, &result_buf);
+    ctx.writeMatches(&result);
 }
 
 /// Free a match slot.
-export fn free_matches(handle: u32) void {
+export fn free_matches(ctx_handle: u32, handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
     if (handle == 0 or handle > MAX_MATCH_SLOTS) return;
-    match_slots[handle - 1] = null;
+    ctx.match_slots[handle - 1] = null;
 }
 
 // ── Kind matching export ─────────────────────────────────
 
 /// Collect all nodes matching a kind string from a compiled source.
-export fn kind_match(src_handle: u32, kind_ptr: [*]const u8, kind_len: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeEmptyArray(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeEmptyArray(); return; };
+export fn kind_match(ctx_handle: u32, src_handle: u32, kind_ptr: [*]const u8, kind_len: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
     const kind = kind_ptr[0..kind_len];
 
     var matches = matcher.MatchList{};
     matcher.collectByKind(src_slot.tree.rootNode(), kind, &matches, 0);
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    ctx.writeMatches(&matches);
+}
+
+// ── Query exports ────────────────────────────────────────
+
+/// Run a tree-sitter S-expression query over a compiled source and write
+/// its matches (see query.search) to the result buffer. Returns 0, or
+/// 1 + the compile error (1 syntax, 2 node type, 3 field, 4 capture,
+/// 5 structure, 6 language), with the byte offset in get_query_error_offset.
+export fn query_source(ctx_handle: u32, src_handle: u32, query_ptr: [*]const u8, query_len: u32, limit: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.writeEmptyArray();
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return 0;
+    const src_slot = source_slots[src_handle - 1] orelse return 0;
+
+    ctx.query_error_offset = 0;
+    var q = ts.Query.init(src_slot.lang, query_ptr[0..query_len], &ctx.query_error_offset) catch |err| {
+        return switch (err) {
+            error.Syntax => 1,
+            error.NodeType => 2,
+            error.Field => 3,
+            error.Capture => 4,
+            error.Structure => 5,
+            error.Language => 6,
+        };
+    };
+    defer q.deinit();
+
+    var matches = matcher.MatchList.withLimit(limit);
+    query.search(&q, src_slot.tree.rootNode(), &matches);
+    ctx.writeMatches(&matches);
+    return 0;
+}
+
+export fn get_query_error_offset(ctx_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    return ctx.query_error_offset;
+}
+
+/// Write a compiled pattern's query translation (query.translate) to the
+/// result buffer and return its length; 0 if the pattern has none.
+export fn pattern_query(ctx_handle: u32, pat_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.result_len = 0;
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) return 0;
+    const slot = compiled_slots[pat_handle - 1] orelse return 0;
+    var text: std.ArrayList(u8) = .empty;
+    defer text.deinit(gpa);
+    if (!query.translate(gpa, slot.tree.rootNode(), &text) or text.items.len > MAX_OUTPUT) return 0;
+    @memcpy(ctx.result_buf[0..text.items.len], text.items);
+    ctx.result_len = @intCast(text.items.len);
+    return ctx.result_len;
 }
 
 // ── Range-constrained matching export ────────────────────
 
 /// Match a compiled pattern against a compiled source within a byte range.
-export fn match_in_range(pat_handle: u32, src_handle: u32, start_byte: u32, end_byte: u32) void {
-    if (pat_handle == 0 or pat_handle > MAX_COMPILED) { writeEmptyArray(); return; }
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeEmptyArray(); return; }
-    const pat_slot = compiled_slots[pat_handle - 1] orelse { writeEmptyArray(); return; };
-    const src_slot = source_slots[src_handle - 1] orelse { writeEmptyArray(); return; };
-
-    var matches = matcher.MatchList{};
+export fn match_in_range(ctx_handle: u32, pat_handle: u32, src_handle: u32, start_byte: u32, end_byte: u32, limit: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const pat_slot = compiled_slots[pat_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+
+    var matches = matcher.MatchList.withLimit(limit);
     matcher.searchMatchesInRange(pat_slot.tree.rootNode(), src_slot.tree.rootNode(), &matches, 0, start_byte, end_byte);
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    ctx.writeMatches(&matches);
+}
+
+/// 1 if the pattern matches node `id` itself (no search below it), else 0.
+export fn match_node(pat_handle: u32, src_handle: u32, id: u32) u32 {
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) return 0;
+    const pat_slot = compiled_slots[pat_handle - 1] orelse return 0;
+    const snap = traversalSnapshot(src_handle) orelse return 0;
+    if (id >= snap.len) return 0;
+    const source = source_slots[src_handle - 1].?.tree.source;
+    var matches = matcher.MatchList.withLimit(1);
+    matcher.matchAt(pat_slot.tree.rootNode(), snap.tsNode(id, source), &matches);
+    return @intFromBool(matches.count > 0);
 }
 
 // ── Sibling matching exports ─────────────────────────────
 
 /// Match a pattern against preceding siblings of a node.
-export fn match_preceding(pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32) void {
-    matchSiblings(pat_handle, src_handle, node_start, node_end, true);
+export fn match_preceding(ctx_handle: u32, pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    matchSiblings(ctx, pat_handle, src_handle, node_start, node_end, true);
 }
 
 /// Match a pattern against following siblings of a node.
-export fn match_following(pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32) void {
-    matchSiblings(pat_handle, src_handle, node_start, node_end, false);
+export fn match_following(ctx_handle: u32, pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    matchSiblings(ctx, pat_handle, src_handle, node_start, node_end, false);
 }
 
-fn matchSiblings(pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32, preceding: bool) void {
-    if (pat_handle == 0 or pat_handle > MAX_COMPILED) { writeEmptyArray(); return; }
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeEmptyArray(); return; }
-    const pat_slot = compiled_slots[pat_handle - 1] orelse { writeEmptyArray(); return; };
-    const src_slot = source_slots[src_handle - 1] orelse { writeEmptyArray(); return; };
+fn matchSiblings(ctx: *EngineContext, pat_handle: u32, src_handle: u32, node_start: u32, node_end: u32, preceding: bool) void {
+    if (pat_handle == 0 or pat_handle > MAX_COMPILED) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const pat_slot = compiled_slots[pat_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
 
     var sibling_matches = matcher.MatchList{};
     if (preceding) {
@@ -451,156 +1066,274 @@ fn matchSiblings(pat_handle: u32, src_handle: u32, node_start: u32, node_end: u3
     for (sibling_matches.slice()) |sib| {
         matcher.searchMatchesInRange(pat_slot.tree.rootNode(), src_slot.tree.rootNode(), &matches, 0, sib.start_byte, sib.end_byte);
     }
-    last_match_list = matches;
-    result_len = serializeMatches(&matches, &result_buf);
+    ctx.writeMatches(&matches);
 }
 
 // ── Tree traversal exports ───────────────────────────────
 //
-// ast-grep style node navigation. Nodes are identified by (src_handle,
-// start_byte, end_byte). The WASM engine locates the node via
-// ts_node_descendant_for_byte_range, then navigates from there.
-// Results are serialized as JSON to result_buf.
-
-/// Find the deepest node exactly matching the given byte range.
-/// Uses descendantForByteRange for O(log n) lookup.
-/// When is_root=1, returns root directly (handles case where root and first
-/// child share the same byte range in single-statement programs).
-fn findNode(src_slot: *const CompiledSource, start_byte: u32, end_byte: u32, is_root: u32) ?ts.Node {
-    const root = src_slot.tree.rootNode();
-    if (is_root == 1) return root;
-    const node = root.descendantForByteRange(start_byte, end_byte) orelse return null;
-    // Verify exact match — descendantForByteRange may return a parent
-    if (node.startByte() == start_byte and node.endByte() == end_byte) return node;
-    return null;
+// ast-grep style node navigation. Nodes are identified by a per-source
+// integer id: their index in the source's snapshot, which the first
+// traversal call builds if snapshot_source has not. Ids stay valid until
+// edit_source or free_source. Navigation reads the snapshot's link and
+// child-index arrays, so parent/next/prev/child(i) are constant time.
+//
+// Each call returns a node id (NO_NODE if there is none) and writes that
+// node's record to the context's result buffer; node_children writes a page
+// of records.
+// A record is NODE_RECORD_WORDS little-endian u32s:
+//   [id][kind | named << 16][sb][eb][sr][sc][er][ec][parent][cc][ncc]
+// Kind ids index the name table written by node_kind_table.
+
+const NO_NODE: u32 = snapshot.NONE;
+const NODE_RECORD_WORDS = 11;
+const NODE_RECORD_BYTES = NODE_RECORD_WORDS * 4;
+
+/// Snapshot of a source for traversal, built on first use.
+fn traversalSnapshot(src_handle: u32) ?*snapshot.Snapshot {
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return null;
+    const slot = if (source_slots[src_handle - 1]) |*s| s else return null;
+    if (slot.snap == null and !attachSnapshot(slot)) return null;
+    return slot.snap;
 }
 
-fn serializeNodeInfo(node: ts.Node, w: anytype) !void {
-    try w.writeAll("{\"kind\":\"");
-    try w.writeAll(node.nodeType());
-    try w.writeAll("\",\"sb\":");
-    try w.print("{d}", .{node.startByte()});
-    try w.writeAll(",\"eb\":");
-    try w.print("{d}", .{node.endByte()});
-    try w.writeAll(",\"sr\":");
-    try w.print("{d}", .{node.startPoint().row});
-    try w.writeAll(",\"sc\":");
-    try w.print("{d}", .{node.startPoint().col});
-    try w.writeAll(",\"er\":");
-    try w.print("{d}", .{node.endPoint().row});
-    try w.writeAll(",\"ec\":");
-    try w.print("{d}", .{node.endPoint().col});
-    try w.writeAll(",\"named\":");
-    try w.writeAll(if (node.isNamed()) "true" else "false");
-    try w.writeAll(",\"cc\":");
-    try w.print("{d}", .{node.childCount()});
-    try w.writeAll(",\"ncc\":");
-    try w.print("{d}", .{node.namedChildCount()});
-    try w.writeByte('}');
+fn writeNodeRecord(ctx: *EngineContext, snap: *const snapshot.Snapshot, i: u32, pos: usize) void {
+    const words = [NODE_RECORD_WORDS]u32{
+        i,
+        @as(u32, snap.kind[i]) | (@as(u32, @intFromBool(snap.named[i])) << 16),
+        snap.start_byte[i],
+        snap.end_byte[i],
+        snap.start_row[i],
+        snap.start_col[i],
+        snap.end_row[i],
+        snap.end_col[i],
+        snap.parent[i],
+        @intCast(snap.children(i, false).len),
+        @intCast(snap.children(i, true).len),
+    };
+    for (words, 0..) |word, k| writeU32LE(&ctx.result_buf, pos + k * 4, word);
 }
 
-fn serializeNodeOrNull(maybe_node: ?ts.Node, buf: *[MAX_OUTPUT]u8) u32 {
-    if (maybe_node) |node| {
-        var stream = std.io.fixedBufferStream(buf);
-        serializeNodeInfo(node, stream.writer()) catch return 0;
-        return @intCast(stream.pos);
+/// Write the record for `i` and return it, or return NO_NODE.
+fn emitNode(ctx: *EngineContext, snap: *const snapshot.Snapshot, i: u32) u32 {
+    if (i >= snap.len) {
+        ctx.result_len = 0;
+        return NO_NODE;
     }
-    return writeNullTo(buf);
+    writeNodeRecord(ctx, snap, i, 0);
+    ctx.result_len = NODE_RECORD_BYTES;
+    return i;
 }
 
-/// Get root node info. Returns JSON object.
-export fn node_root(src_handle: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    result_len = serializeNodeOrNull(src_slot.tree.rootNode(), &result_buf);
+/// Kind names, indexed by kind id: [count] then count × [len][bytes].
+/// The ERROR kind (0xFFFF) is outside the table.
+export fn node_kind_table(ctx_handle: u32, src_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    const snap = traversalSnapshot(src_handle) orelse { ctx.writeEmptyArray(); return; };
+    const count = ts.c.ts_language_symbol_count(snap.language);
+    var pos: usize = 4;
+    var id: u32 = 0;
+    while (id < count) : (id += 1) {
+        const name_ptr = ts.c.ts_language_symbol_name(snap.language, @intCast(id));
+        const name: []const u8 = if (name_ptr == null) "" else std.mem.span(name_ptr);
+        if (pos + 4 + name.len > MAX_OUTPUT) break;
+        writeU32LE(&ctx.result_buf, pos, @intCast(name.len));
+        @memcpy(ctx.result_buf[pos + 4 ..][0..name.len], name);
+        pos += 4 + name.len;
+    }
+    writeU32LE(&ctx.result_buf, 0, id);
+    ctx.result_len = @intCast(pos);
 }
 
-/// Get info about a node. Returns JSON object or "null".
-export fn node_info(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeNull(); return; };
-    result_len = serializeNodeOrNull(node, &result_buf);
+/// Root node (id 0).
+export fn node_root(ctx_handle: u32, src_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    return emitNode(ctx, snap, 0);
 }
 
-/// Get all children of a node. Returns JSON array.
-export fn node_children(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    serializeChildren(src_handle, start_byte, end_byte, is_root, false);
+export fn node_info(ctx_handle: u32, src_handle: u32, id: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    return emitNode(ctx, snap, id);
 }
 
-/// Get named children of a node. Returns JSON array.
-export fn node_named_children(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    serializeChildren(src_handle, start_byte, end_byte, is_root, true);
+/// Innermost node spanning exactly [start_byte, end_byte), e.g. a match.
+export fn node_at(ctx_handle: u32, src_handle: u32, start_byte: u32, end_byte: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    return emitNode(ctx, snap, snap.innermostAt(start_byte, end_byte) orelse NO_NODE);
 }
 
-fn serializeChildren(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32, named_only: bool) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeEmptyArray(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeEmptyArray(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeEmptyArray(); return; };
-
-    var stream = std.io.fixedBufferStream(&result_buf);
-    var w = stream.writer();
-    w.writeByte('[') catch { result_len = 0; return; };
-
-    const count = if (named_only) node.namedChildCount() else node.childCount();
-    var first = true;
-    var i: u32 = 0;
-    while (i < count) : (i += 1) {
-        const ch = if (named_only) node.namedChild(i) else node.child(i);
-        if (ch) |child| {
-            if (!first) w.writeByte(',') catch { result_len = 0; return; };
-            first = false;
-            serializeNodeInfo(child, w) catch { result_len = 0; return; };
-        }
-    }
-
-    w.writeByte(']') catch { result_len = 0; return; };
-    result_len = @intCast(stream.pos);
+export fn node_parent(ctx_handle: u32, src_handle: u32, id: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    if (id >= snap.len) return emitNode(ctx, snap, NO_NODE);
+    return emitNode(ctx, snap, snap.parent[id]);
 }
 
-/// Get parent of a node. Returns JSON object or "null".
-export fn node_parent(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeNull(); return; };
-    result_len = serializeNodeOrNull(node.parent(), &result_buf);
+/// The index-th child (all children, or named only).
+export fn node_child(ctx_handle: u32, src_handle: u32, id: u32, index: u32, named_only: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    if (id >= snap.len) return emitNode(ctx, snap, NO_NODE);
+    return emitNode(ctx, snap, snap.child(id, index, named_only != 0));
 }
 
-/// Get child by field name. Returns JSON object or "null".
-export fn node_field_child(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32, name_ptr: [*]const u8, name_len: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeNull(); return; };
-    const name = name_ptr[0..name_len];
-    result_len = serializeNodeOrNull(node.childByFieldName(name), &result_buf);
+/// Records for children [from, ...) of `id`, as many as fit in the result buffer.
+/// Returns the number written; the host asks again from `from + n` until
+/// it has childCount/namedChildCount of them.
+export fn node_children(ctx_handle: u32, src_handle: u32, id: u32, named_only: u32, from: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.result_len = 0;
+    const snap = traversalSnapshot(src_handle) orelse return 0;
+    if (id >= snap.len) return 0;
+    const kids = snap.children(id, named_only != 0);
+    if (from >= kids.len) return 0;
+    const n: u32 = @intCast(@min(kids.len - from, MAX_OUTPUT / NODE_RECORD_BYTES));
+    for (kids[from..][0..n], 0..) |ch, k| writeNodeRecord(ctx, snap, ch, k * NODE_RECORD_BYTES);
+    ctx.result_len = n * NODE_RECORD_BYTES;
+    return n;
 }
 
-/// Get next named sibling. Returns JSON object or "null".
-export fn node_next(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeNull(); return; };
-    result_len = serializeNodeOrNull(node.nextNamedSibling(), &result_buf);
+/// Child by grammar field name (e.g. "function", "arguments").
+export fn node_field_child(ctx_handle: u32, src_handle: u32, id: u32, name_ptr: [*]const u8, name_len: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    if (id >= snap.len) return emitNode(ctx, snap, NO_NODE);
+    const source = source_slots[src_handle - 1].?.tree.source;
+    const field = snap.tsNode(id, source).childByFieldName(name_ptr[0..name_len]) orelse return emitNode(ctx, snap, NO_NODE);
+    return emitNode(ctx, snap, snap.indexOf(field) orelse NO_NODE);
 }
 
-/// Get previous named sibling. Returns JSON object or "null".
-export fn node_prev(src_handle: u32, start_byte: u32, end_byte: u32, is_root: u32) void {
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeNull(); return; }
-    const src_slot = source_slots[src_handle - 1] orelse { writeNull(); return; };
-    const node = findNode(&src_slot, start_byte, end_byte, is_root) orelse { writeNull(); return; };
-    result_len = serializeNodeOrNull(node.prevNamedSibling(), &result_buf);
+/// Next named sibling.
+export fn node_next(ctx_handle: u32, src_handle: u32, id: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    if (id >= snap.len) return emitNode(ctx, snap, NO_NODE);
+    return emitNode(ctx, snap, snap.namedSibling(id, true));
 }
 
-fn writeNullTo(buf: *[MAX_OUTPUT]u8) u32 {
-    buf[0] = 'n';
-    buf[1] = 'u';
-    buf[2] = 'l';
-    buf[3] = 'l';
-    return 4;
+/// Previous named sibling.
+export fn node_prev(ctx_handle: u32, src_handle: u32, id: u32) u32 {
+    const ctx = context(ctx_handle) orelse return NO_NODE;
+    const snap = traversalSnapshot(src_handle) orelse return NO_NODE;
+    if (id >= snap.len) return emitNode(ctx, snap, NO_NODE);
+    return emitNode(ctx, snap, snap.namedSibling(id, false));
 }
 
-fn writeNull() void {
-    result_len = writeNullTo(&result_buf);
+// ── Bulk subtree export ──────────────────────────────────
+//
+// node_dump(src_h, id, named_only, max_depth) -> ptr
+//
+// Writes the subtree under `id` in one pass to a 4-byte aligned buffer the
+// host copies into typed arrays and releases with dealloc(ptr, byte_len)
+// (gpa frees by pointer, whatever the alignment):
+//   [byte_len][n]
+//   u32 columns × n: sb, eb, sr, sc, er, ec, parent, first_child,
+//                    next_sibling, id
+//   u16 column × n:  kind
+//   u8 column × n:   named
+// Rows are in preorder; parent/first_child/next_sibling are row indices
+// (NO_NODE for none). With named_only, anonymous nodes are left out and
+// their named descendants attach to the nearest kept ancestor. Nodes deeper
+// than max_depth below `id` are left out. null on a bad handle or OOM.
+
+const DUMP_U32_COLUMNS = 10;
+
+export fn node_dump(src_handle: u32, id: u32, named_only: u32, max_depth: u32) ?[*]u8 {
+    const snap = traversalSnapshot(src_handle) orelse return null;
+    if (id >= snap.len) return null;
+    const lo = id;
+    const hi = snap.subtree_end[id];
+    const span = hi - lo;
+
+    // Per snapshot node in [lo, hi): depth below `id`, and the row of the
+    // nearest kept node at or above it (NO_NODE if skipped by depth).
+    const depth = gpa.alloc(u32, span) catch return null;
+    defer gpa.free(depth);
+    const row_of = gpa.alloc(u32, span) catch return null;
+    defer gpa.free(row_of);
+
+    // Pass 1: choose rows.
+    var n: u32 = 0;
+    var j = lo;
+    while (j < hi) {
+        const k = j - lo;
+        depth[k] = if (j == lo) 0 else depth[snap.parent[j] - lo] + 1;
+        if (depth[k] > max_depth) {
+            // Everything below is deeper still.
+            const end = snap.subtree_end[j];
+            while (j < end) : (j += 1) row_of[j - lo] = NO_NODE;
+            continue;
+        }
+        const kept = j == lo or named_only == 0 or snap.named[j];
+        if (kept) {
+            row_of[k] = n;
+            n += 1;
+        } else {
+            row_of[k] = row_of[snap.parent[j] - lo];
+        }
+        j += 1;
+    }
+
+    const header = 2 * 4;
+    const byte_len = header + n * (DUMP_U32_COLUMNS * 4 + 2 + 1);
+    const buf = gpa.alignedAlloc(u8, .@"4", byte_len) catch return null;
+    const words: [*]u32 = @ptrCast(buf.ptr);
+    words[0] = byte_len;
+    words[1] = n;
+    const col = struct {
+        fn at(w: [*]u32, count: u32, c: u32) []u32 {
+            return w[2 + c * count ..][0..count];
+        }
+    };
+    const sb = col.at(words, n, 0);
+    const eb = col.at(words, n, 1);
+    const sr = col.at(words, n, 2);
+    const sc = col.at(words, n, 3);
+    const er = col.at(words, n, 4);
+    const ec = col.at(words, n, 5);
+    const parent = col.at(words, n, 6);
+    const first_child = col.at(words, n, 7);
+    const next_sibling = col.at(words, n, 8);
+    const ids = col.at(words, n, 9);
+    const kinds: [*]u16 = @ptrCast(@alignCast(buf.ptr + header + n * DUMP_U32_COLUMNS * 4));
+    const named = buf[header + n * (DUMP_U32_COLUMNS * 4 + 2) ..][0..n];
+
+    // Pass 2: fill rows. last_child tracks each row's most recent child row.
+    @memset(first_child, NO_NODE);
+    @memset(next_sibling, NO_NODE);
+    const last_child = gpa.alloc(u32, n) catch {
+        gpa.free(buf);
+        return null;
+    };
+    defer gpa.free(last_child);
+    @memset(last_child, NO_NODE);
+
+    j = lo;
+    while (j < hi) : (j += 1) {
+        const row = row_of[j - lo];
+        if (row == NO_NODE) continue;
+        if (j != lo and row == row_of[snap.parent[j] - lo]) continue; // folded into an ancestor
+        sb[row] = snap.start_byte[j];
+        eb[row] = snap.end_byte[j];
+        sr[row] = snap.start_row[j];
+        sc[row] = snap.start_col[j];
+        er[row] = snap.end_row[j];
+        ec[row] = snap.end_col[j];
+        ids[row] = j;
+        kinds[row] = snap.kind[j];
+        named[row] = @intFromBool(snap.named[j]);
+        if (j == lo) {
+            parent[row] = NO_NODE;
+            continue;
+        }
+        const p = row_of[snap.parent[j] - lo];
+        parent[row] = p;
+        if (last_child[p] == NO_NODE) first_child[p] = row else next_sibling[last_child[p]] = row;
+        last_child[p] = row;
+    }
+    return buf.ptr;
 }
 
 // ── Rule engine exports ──────────────────────────────────
@@ -609,6 +1342,8 @@ const rule_engine = @import("rule_engine.zig");
 
 const MAX_RULESETS = 2;
 var ruleset_slots: [MAX_RULESETS]?rule_engine.CompiledRuleset = .{null} ** MAX_RULESETS;
+// Bumped on every load so incremental caches can tell a reused handle apart.
+var ruleset_generation: [MAX_RULESETS]u16 = .{0} ** MAX_RULESETS;
 
 /// Decode bytecode → CompiledRuleset, compile all patterns → handles.
 /// Returns 1-based ruleset handle (0 = error).
@@ -618,22 +1353,326 @@ export fn load_ruleset(bytecode_ptr: [*]const u8, bytecode_len: u32) u32 {
 
     var rs = rule_engine.decode(bytecode) orelse return 0;
 
-    // Compile all pattern strings into cached pattern handles
-    rule_engine.compilePatterns(&rs, &compiled_slots, &getOrInitParser) orelse return 0;
+    // Acquire every pattern from the shared cache
+    rule_engine.compilePatterns(&rs, acquireRulePattern) orelse {
+        rule_engine.freePatterns(&rs, releasePattern);
+        return 0;
+    };
+    rule_engine.computeLiterals(&rs, &compiled_slots);
+    rule_engine.compileQuery(&rs, &compiled_slots);
 
     ruleset_slots[slot_idx] = rs;
+    ruleset_generation[slot_idx] +%= 1;
     return slot_idx + 1;
 }
 
+/// Identifies one load of a ruleset handle, for state cached on sources.
+fn rulesetKey(ruleset_handle: u32) u32 {
+    return (ruleset_handle << 16) | ruleset_generation[ruleset_handle - 1];
+}
+
 /// Evaluate all rules against compiled source.
-/// Write result JSON to result_buf.
-export fn apply_ruleset(ruleset_handle: u32, src_handle: u32) void {
-    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { writeEmptyArray(); return; }
-    if (src_handle == 0 or src_handle > MAX_SOURCES) { writeEmptyArray(); return; }
-    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { writeEmptyArray(); return; });
-    const src_slot = source_slots[src_handle - 1] orelse { writeEmptyArray(); return; };
+/// Write result JSON to the context's result buffer.
+export fn apply_ruleset(ctx_handle: u32, ruleset_handle: u32, src_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { ctx.writeEmptyArray(); return; });
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+
+    ctx.result_len = rule_engine.applyAndSerialize(rs, &src_slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, null);
+}
+
+/// Count each rule's matches without collecting them. Writes a JSON array
+/// of {"ruleId","count","capped"} to the result buffer
+/// (rule_engine.countAndSerialize).
+export fn count_ruleset(ctx_handle: u32, ruleset_handle: u32, src_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { ctx.writeEmptyArray(); return; });
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+
+    ctx.result_len = rule_engine.countAndSerialize(rs, &src_slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, &ctx.match_tally);
+}
+
+/// Check raw source bytes for each rule's required literals before parsing.
+/// Returns how many rules can still match (0 = skip the parse entirely, as
+/// for binary or malformed UTF-8 bytes); apply_ruleset_prefiltered in the
+/// same context then evaluates only those rules. The verdict is kept in the
+/// context, so contexts on other threads can prefilter with the same ruleset.
+export fn ruleset_prefilter(ctx_handle: u32, ruleset_handle: u32, src_ptr: [*]const u8, src_len: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    ctx.skip_ruleset = 0;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) return 0;
+    const rs = if (ruleset_slots[ruleset_handle - 1]) |*r| r else return 0;
+    if (!utf8.isText(src_ptr[0..src_len])) return 0;
+    const live = rule_engine.prefilter(rs, src_ptr[0..src_len], &ctx.skip);
+    ctx.skip_ruleset = ruleset_handle;
+    return live;
+}
+
+/// The rules the context's last ruleset_prefilter kept, if it ran for this
+/// ruleset; otherwise null, and every rule is evaluated.
+fn prefilterVerdict(ctx: *const EngineContext, ruleset_handle: u32) ?*const rule_engine.SkipSet {
+    return if (ctx.skip_ruleset == ruleset_handle) &ctx.skip else null;
+}
+
+/// apply_ruleset restricted to the rules the context's last ruleset_prefilter kept.
+export fn apply_ruleset_prefiltered(ctx_handle: u32, ruleset_handle: u32, src_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { ctx.writeEmptyArray(); return; });
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
 
-    result_len = rule_engine.applyAndSerialize(rs, &src_slot, &compiled_slots, &result_buf);
+    ctx.result_len = rule_engine.applyAndSerialize(rs, &src_slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, prefilterVerdict(ctx, ruleset_handle));
+}
+
+/// apply_ruleset_prefiltered over part `part` of `parts` of the kept rules
+/// (rule_engine.applyPartAndSerialize). In the threaded engine build, each
+/// thread applies one part against the same source handle, each in its own
+/// context; the parts' findings, concatenated in part order, are the
+/// findings of the whole apply. The calling threads only read the ruleset
+/// and the tree: loading, prefiltering, parsing and prepare_partitions stay
+/// on one thread, before the parts start. Every part skips the rules the
+/// prepared pass carries over from the prefilter; without one, no part
+/// skips any, so all parts still split the same rules.
+export fn apply_ruleset_partition(ctx_handle: u32, ruleset_handle: u32, src_handle: u32, part: u32, parts: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    if (parts == 0 or part >= parts) { ctx.writeEmptyArray(); return; }
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { ctx.writeEmptyArray(); return; });
+    const src_slot = source_slots[src_handle - 1] orelse { ctx.writeEmptyArray(); return; };
+
+    // Without a shared pass for this ruleset, each part queries the tree.
+    const shared = if (src_slot.pass_ruleset == ruleset_handle) src_slot.pass else null;
+    const skip = if (shared) |pass| &pass.skip else null;
+    ctx.result_len = rule_engine.applyPartAndSerialize(rs, &src_slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, skip, shared, part, parts);
+}
+
+/// Ready a source for the partitions applied to it next: run the ruleset's
+/// query over it once, for all of them to read its hits, and carry over the
+/// rules this context's ruleset_prefilter kept. Returns 1, or 0 on a bad
+/// handle or allocation failure (the parts then query the tree each and
+/// evaluate every rule).
+export fn prepare_partitions(ctx_handle: u32, ruleset_handle: u32, src_handle: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) return 0;
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return 0;
+    const rs = if (ruleset_slots[ruleset_handle - 1]) |*r| r else return 0;
+    const slot = if (source_slots[src_handle - 1]) |*s| s else return 0;
+    dropSharedPass(slot);
+    slot.pass = rule_engine.createSharedPass(rs, slot.tree.rootNode(), prefilterVerdict(ctx, ruleset_handle)) orelse return 0;
+    slot.pass_ruleset = ruleset_handle;
+    return 1;
+}
+
+// ── Batch apply ──────────────────────────────────────────
+//
+// apply_ruleset_many runs prefilter, parse and apply for many sources in one
+// call, so small files do not pay a host round trip each. The host packs
+// the sources back to back into one buffer and passes a table of
+// [start][len][lang] u32 triples, one per source.
+//
+// The result lives in an output buffer the context keeps and reuses across
+// calls (valid until its next call): [byte_len][n][n+1 offsets][n parse
+// statuses], then the findings JSON of each source, as apply_ruleset writes
+// it, from data + offsets[i] to data + offsets[i+1]. An empty slice means
+// no findings.
+//
+// Flags in an entry's lang word let the host skip the parse with the scan
+// cache's tree snapshots (snapshot.zig). BATCH_HAS_SNAPSHOT: a saved
+// snapshot of the source follows it, at the next multiple of 4 bytes; it is
+// applied in place of a parse unless it is malformed or from another
+// grammar build. BATCH_SAVE_SNAPSHOT: when the source is parsed, its
+// snapshot is saved for get_batch_snapshots, laid out like the findings:
+// [byte_len][n][n+1 offsets], then the snapshots.
+
+const BATCH_HAS_SNAPSHOT: u32 = 0x100;
+const BATCH_SAVE_SNAPSHOT: u32 = 0x200;
+
+export fn apply_ruleset_many(
+    ctx_handle: u32,
+    ruleset_handle: u32,
+    sources_ptr: [*]const u8,
+    sources_len: u32,
+    table_ptr: [*]const u32,
+    count: u32,
+    budget_us: u32,
+) ?[*]const u8 {
+    const ctx = context(ctx_handle) orelse return null;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) return null;
+    const rs = if (ruleset_slots[ruleset_handle - 1]) |*r| r else return null;
+    const sources = sources_ptr[0..sources_len];
+    const table = table_ptr[0 .. count * 3];
+
+    const out = &ctx.batch_out;
+    const header_len = (3 + 2 * count) * 4;
+    out.clearRetainingCapacity();
+    out.appendNTimes(gpa, 0, header_len) catch return null;
+    const snaps = &ctx.snap_out;
+    const snaps_header_len = (3 + count) * 4;
+    snaps.clearRetainingCapacity();
+    snaps.appendNTimes(gpa, 0, snaps_header_len) catch return null;
+
+    var i: u32 = 0;
+    while (i < count) : (i += 1) {
+        putBatchWord(out, 2 + i, @intCast(out.items.len - header_len));
+        putBatchWord(snaps, 2 + i, @intCast(snaps.items.len - snaps_header_len));
+        const status = applyBatchEntry(ctx, rs, sources, table[i * 3 ..][0..3], budget_us) catch return null;
+        putBatchWord(out, 3 + count + i, @intFromEnum(status));
+    }
+    putBatchWord(out, 2 + count, @intCast(out.items.len - header_len));
+    putBatchWord(out, 0, @intCast(out.items.len));
+    putBatchWord(out, 1, count);
+    putBatchWord(snaps, 2 + count, @intCast(snaps.items.len - snaps_header_len));
+    putBatchWord(snaps, 0, @intCast(snaps.items.len));
+    putBatchWord(snaps, 1, count);
+    return out.items.ptr;
+}
+
+/// The tree snapshots saved by the context's last apply_ruleset_many, one
+/// slice per source (empty where none was saved). Valid until its next call.
+export fn get_batch_snapshots(ctx_handle: u32) ?[*]const u8 {
+    const ctx = context(ctx_handle) orelse return null;
+    if (ctx.snap_out.items.len == 0) return null;
+    return ctx.snap_out.items.ptr;
+}
+
+fn putBatchWord(out: *std.ArrayListUnmanaged(u8), index: u32, val: u32) void {
+    std.mem.writeInt(u32, out.items[index * 4 ..][0..4], val, .little);
+}
+
+/// One source of a batch: skipped without parsing when it is not text or
+/// the prefilter rules out every rule, else applied to its snapshot, or
+/// parsed with the context's parser and applied, with the findings
+/// appended to its batch_out.
+fn applyBatchEntry(
+    ctx: *EngineContext,
+    rs: *rule_engine.CompiledRuleset,
+    sources: []const u8,
+    entry: *const [3]u32,
+    budget_us: u32,
+) !ParseStatus {
+    const start = entry[0];
+    const len = entry[1];
+    if (start > sources.len or len > sources.len - start) return .failed;
+    const source = sources[start..][0..len];
+    if (!utf8.isText(source)) return .not_text;
+    var skip: rule_engine.SkipSet = undefined;
+    if (rule_engine.prefilter(rs, source, &skip) == 0) return .ok;
+
+    const ts_lang = toTsLang(entry[2]);
+    if (entry[2] & BATCH_HAS_SNAPSHOT != 0) {
+        if (loadBatchSnapshot(sources, start + len, source, ts_lang)) |snap| {
+            defer snap.deinit();
+            const slot = .{ .tree = snapshot.FlatTree{ .snap = snap, .source = source } };
+            const n = rule_engine.applyAndSerialize(rs, &slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, &skip);
+            if (n > 2) try ctx.batch_out.appendSlice(gpa, ctx.result_buf[0..n]);
+            return .ok;
+        }
+    }
+
+    const parser = ctx.parsers.get(ts_lang) orelse return .failed;
+    ctx.parse_status = .ok;
+    var tree = parseBudgeted(parser, source, budget_us, &ctx.parse_status) orelse return ctx.parse_status;
+    defer {
+        tree.deinit();
+        parser.reset();
+    }
+
+    const slot = CompiledSource{ .tree = tree, .lang = ts_lang };
+    const n = rule_engine.applyAndSerialize(rs, &slot, &compiled_slots, &ctx.scratch, &ctx.result_buf, &skip);
+    if (n > 2) try ctx.batch_out.appendSlice(gpa, ctx.result_buf[0..n]);
+    // A snapshot that cannot be built or saved is only a cache miss later.
+    if (entry[2] & BATCH_SAVE_SNAPSHOT != 0) {
+        if (snapshot.Snapshot.build(&tree)) |snap| {
+            defer snap.deinit();
+            snap.save(&ctx.snap_out, gpa) catch {};
+        }
+    }
+    return .ok;
+}
+
+/// The snapshot packed after a batch entry's source (BATCH_HAS_SNAPSHOT),
+/// loaded in place; null when it is missing, malformed or was saved by
+/// another build of the grammar.
+fn loadBatchSnapshot(sources: []const u8, source_end: usize, source: []const u8, ts_lang: ts.Language) ?*snapshot.Snapshot {
+    const at = std.mem.alignForward(usize, source_end, 4);
+    if (at > sources.len) return null;
+    const saved_len = snapshot.Snapshot.savedLenAt(sources[at..]) orelse return null;
+    const language = ts.grammar(ts_lang) orelse return null;
+    return snapshot.Snapshot.load(sources[at..][0..saved_len], source, language);
+}
+
+/// Evaluate all rules, reusing the findings cached on the source by the
+/// previous call with this ruleset. Only the region dirtied by edit_source
+/// is re-searched; the first call (or a different ruleset) evaluates in full.
+/// Writes result JSON to the context's result buffer.
+export fn apply_ruleset_incremental(ctx_handle: u32, ruleset_handle: u32, src_handle: u32) void {
+    const ctx = context(ctx_handle) orelse return;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) { ctx.writeEmptyArray(); return; }
+    if (src_handle == 0 or src_handle > MAX_SOURCES) { ctx.writeEmptyArray(); return; }
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse { ctx.writeEmptyArray(); return; });
+    const src_slot = if (source_slots[src_handle - 1]) |*s| s else { ctx.writeEmptyArray(); return; };
+
+    const key = rulesetKey(ruleset_handle);
+    if (src_slot.incr) |state| {
+        if (state.ruleset_key != key) {
+            rule_engine.freeIncremental(state);
+            src_slot.incr = null;
+        }
+    }
+
+    var fresh = false;
+    if (src_slot.incr == null) {
+        src_slot.incr = rule_engine.initIncremental(rs, key) orelse { ctx.writeEmptyArray(); return; };
+        fresh = true;
+    }
+
+    ctx.result_len = rule_engine.applyIncrementalAndSerialize(rs, src_slot.incr.?, src_slot, src_slot.dirty, fresh, &compiled_slots, &ctx.scratch, &ctx.result_buf);
+    src_slot.dirty = null;
+}
+
+const STEP_DONE: u32 = 1;
+const STEP_PARTIAL: u32 = 2;
+
+/// Resumable apply_ruleset. Evaluates rules until `fuel` (one unit per rule
+/// plus one per node visited) is spent. Returns STEP_PARTIAL with progress
+/// kept on the source, or STEP_DONE with the full result JSON in the
+/// context's result buffer. 0 = error. A nonzero `restart`, or a different
+/// ruleset, drops any evaluation left on the source (say, by a caller that
+/// gave up on it) and starts over.
+export fn apply_ruleset_step(ctx_handle: u32, ruleset_handle: u32, src_handle: u32, fuel: u32, restart: u32) u32 {
+    const ctx = context(ctx_handle) orelse return 0;
+    if (ruleset_handle == 0 or ruleset_handle > MAX_RULESETS) return 0;
+    if (src_handle == 0 or src_handle > MAX_SOURCES) return 0;
+    const rs = &(ruleset_slots[ruleset_handle - 1] orelse return 0);
+    const src_slot = if (source_slots[src_handle - 1]) |*s| s else return 0;
+
+    const key = rulesetKey(ruleset_handle);
+    if (src_slot.step) |state| {
+        if (restart != 0 or state.ruleset_key != key) {
+            rule_engine.freeStep(state);
+            src_slot.step = null;
+        }
+    }
+    const state = src_slot.step orelse blk: {
+        const fresh = rule_engine.initStep(key) orelse return 0;
+        src_slot.step = fresh;
+        break :blk fresh;
+    };
+
+    switch (rule_engine.applyStep(rs, state, src_slot, &compiled_slots, &ctx.scratch, fuel, &ctx.result_buf, &ctx.result_len)) {
+        .partial => return STEP_PARTIAL,
+        .done => {
+            rule_engine.freeStep(state);
+            src_slot.step = null;
+            return STEP_DONE;
+        },
+    }
 }
 
 /// Free all compiled pattern handles and release ruleset slot.
@@ -641,18 +1680,25 @@ export fn free_ruleset(handle: u32) void {
     if (handle == 0 or handle > MAX_RULESETS) return;
     const idx = handle - 1;
     if (ruleset_slots[idx]) |*rs| {
-        rule_engine.freePatterns(rs, &compiled_slots);
+        // A later ruleset may reuse the handle of these passes.
+        for (&source_slots) |*entry| {
+            if (entry.*) |*slot| {
+                if (slot.pass_ruleset == handle) dropSharedPass(slot);
+            }
+        }
+        rule_engine.freePatterns(rs, releasePattern);
         rule_engine.freeConstraintRegexes(rs);
+        rule_engine.freeQuery(rs);
         ruleset_slots[idx] = null;
     }
 }
 
-export fn get_ruleset_result_ptr() [*]const u8 {
-    return &result_buf;
+export fn get_ruleset_result_ptr(ctx_handle: u32) ?[*]const u8 {
+    return get_result_ptr(ctx_handle);
 }
 
-export fn get_ruleset_result_len() u32 {
-    return result_len;
+export fn get_ruleset_result_len(ctx_handle: u32) u32 {
+    return get_result_len(ctx_handle);
 }
 
 // ── Serialization (Binary protocol) ──────────────────────
@@ -710,6 +1756,41 @@ fn serializeMatches(matches: *const matcher.MatchList, buf: *[MAX_OUTPUT]u8) u32
     return @intCast(pos);
 }
 
+// ── Tally protocol ───────────────────────────────────────
+//
+// Header: [4B total][4B ungrouped][4B other][4B group_count], then per
+// group: [4B count][4B text_len][text_bytes], most frequent first. Groups
+// past the end of the buffer are folded into `other`.
+
+fn groupName(ptr: ?[*]const u8, len: u32) []const u8 {
+    const p = ptr orelse return "";
+    return p[0..len];
+}
+
+fn serializeTally(t: *matcher.Tally, buf: *[MAX_OUTPUT]u8) u32 {
+    var pos: usize = 16;
+    var written: u32 = 0;
+    var other = t.other;
+    var overflowed = false;
+    for (t.sortedGroups()) |g| {
+        if (overflowed or pos + 8 + g.text.len > MAX_OUTPUT) {
+            overflowed = true;
+            other += g.count;
+            continue;
+        }
+        writeU32LE(buf, pos, g.count);
+        writeU32LE(buf, pos + 4, @intCast(g.text.len));
+        @memcpy(buf[pos + 8 ..][0..g.text.len], g.text);
+        pos += 8 + g.text.len;
+        written += 1;
+    }
+    writeU32LE(buf, 0, t.total);
+    writeU32LE(buf, 4, t.ungrouped);
+    writeU32LE(buf, 8, other);
+    writeU32LE(buf, 12, written);
+    return @intCast(pos);
+}
+
 inline fn writeU32LE(buf: *[MAX_OUTPUT]u8, pos: usize, val: u32) void {
     buf[pos] = @truncate(val);
     buf[pos + 1] = @truncate(val >> 8);
@@ -722,4 +1803,8 @@ comptime {
     _ = @import("alloc.zig");
     _ = @import("matcher.zig");
     _ = @import("rule_engine.zig");
+    _ = @import("snapshot.zig");
+    _ = @import("literals.zig");
+    _ = @import("utf8.zig");
+    _ = @import("query.zig");
 }
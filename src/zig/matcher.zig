@@ -14,6 +14,7 @@ const std = @import("std");
 const builtin = @import("builtin");
 const ts = @import("ts_bridge.zig");
 const rules = @import("rules.zig");
+const snapshot = @import("snapshot.zig");
 
 // ── SIMD batch operations on match ranges ─────────────────────
 //
@@ -202,23 +203,125 @@ pub const Match = struct {
 pub const MatchList = struct {
     items: [MAX_MATCHES]Match = undefined,
     count: u32 = 0,
+    /// Matches kept before searches stop early (at most MAX_MATCHES).
+    limit: u32 = MAX_MATCHES,
+    /// When set, matches are counted into the tally instead of kept, so a
+    /// search is never cut short by the list filling up.
+    tally: ?*Tally = null,
+
+    /// An empty list that stops collecting after `limit` matches (0 = no limit).
+    pub fn withLimit(limit: u32) MatchList {
+        return .{ .limit = if (limit == 0) MAX_MATCHES else @min(limit, MAX_MATCHES) };
+    }
 
     pub fn add(self: *MatchList, m: Match) void {
-        if (self.count < MAX_MATCHES) {
+        if (self.tally) |t| {
+            t.record(&m);
+            return;
+        }
+        if (self.count < self.limit) {
             self.items[self.count] = m;
             self.count += 1;
         }
     }
 
+    /// True once the limit is reached: searches return without visiting more nodes.
+    pub fn full(self: *const MatchList) bool {
+        return self.count >= self.limit;
+    }
+
     pub fn slice(self: *const MatchList) []const Match {
         return self.items[0..self.count];
     }
 };
 
+// ── Aggregation ───────────────────────────────────────────────
+
+/// Distinct group_by texts a Tally tracks; further texts count as `other`.
+pub const MAX_GROUPS = 1024;
+const GROUP_INDEX_SIZE = MAX_GROUPS * 2;
+
+/// Match counts kept in place of the matches themselves (MatchList.tally):
+/// a total and, with `group_by`, a histogram of that metavariable's bound
+/// text. Group texts are slices of `source`, so nothing is copied per match.
+pub const Tally = struct {
+    source: []const u8,
+    /// Metavariable name without $, or "" to count only.
+    group_by: []const u8 = "",
+    total: u32 = 0,
+    /// Matches that did not bind `group_by`.
+    ungrouped: u32 = 0,
+    /// Matches whose text did not fit in `groups`.
+    other: u32 = 0,
+    groups: [MAX_GROUPS]Group = undefined,
+    group_count: u32 = 0,
+    /// Open-addressed by text hash: group index + 1, or 0 for an empty slot.
+    index: [GROUP_INDEX_SIZE]u16 = [_]u16{0} ** GROUP_INDEX_SIZE,
+    // Range of the last match recorded. Searches add in preorder, so a
+    // repeated range always follows its first occurrence directly.
+    last_start: u32 = std.math.maxInt(u32),
+    last_end: u32 = std.math.maxInt(u32),
+
+    pub const Group = struct {
+        text: []const u8,
+        count: u32,
+    };
+
+    fn record(self: *Tally, m: *const Match) void {
+        if (m.start_byte == self.last_start and m.end_byte == self.last_end) return;
+        self.last_start = m.start_byte;
+        self.last_end = m.end_byte;
+        self.total += 1;
+        if (self.group_by.len == 0) return;
+
+        const text = self.bindingText(&m.bindings) orelse {
+            self.ungrouped += 1;
+            return;
+        };
+        var at: usize = @intCast(std.hash.Wyhash.hash(0, text) % GROUP_INDEX_SIZE);
+        while (self.index[at] != 0) : (at = (at + 1) % GROUP_INDEX_SIZE) {
+            const g = &self.groups[self.index[at] - 1];
+            if (std.mem.eql(u8, g.text, text)) {
+                g.count += 1;
+                return;
+            }
+        }
+        if (self.group_count == MAX_GROUPS) {
+            self.other += 1;
+            return;
+        }
+        self.groups[self.group_count] = .{ .text = text, .count = 1 };
+        self.group_count += 1;
+        self.index[at] = @intCast(self.group_count);
+    }
+
+    fn bindingText(self: *const Tally, bindings: *const Bindings) ?[]const u8 {
+        for (bindings.items[0..bindings.count]) |*b| {
+            if (!std.mem.eql(u8, b.name[0..b.name_len], self.group_by)) continue;
+            if (b.start_byte > b.end_byte or b.end_byte > self.source.len) return "";
+            return self.source[b.start_byte..b.end_byte];
+        }
+        return null;
+    }
+
+    /// Groups by descending count, ties by text. The lookup index is stale
+    /// afterwards, so call this once the search is done.
+    pub fn sortedGroups(self: *Tally) []const Group {
+        const groups = self.groups[0..self.group_count];
+        std.mem.sort(Group, groups, {}, struct {
+            fn lessThan(_: void, a: Group, b: Group) bool {
+                if (a.count != b.count) return a.count > b.count;
+                return std.mem.lessThan(u8, a.text, b.text);
+            }
+        }.lessThan);
+        return groups;
+    }
+};
+
 // ── Pattern token types ───────────────────────────────────────
 
 /// Check if a node's text is a metavariable ($UPPERCASE...).
-fn isMetavar(node_text: []const u8) bool {
+pub fn isMetavar(node_text: []const u8) bool {
     if (node_text.len < 2) return false;
     if (node_text[0] != '$') return false;
     // $... is an ellipsis metavariable, handled separately
@@ -236,12 +339,12 @@ fn metavarName(node_text: []const u8) []const u8 {
 }
 
 /// Check if a node represents ellipsis (...).
-fn isEllipsis(node_text: []const u8) bool {
+pub fn isEllipsis(node_text: []const u8) bool {
     return std.mem.eql(u8, node_text, "...");
 }
 
 /// Check if a node is an ellipsis metavariable ($...NAME).
-fn isEllipsisMetavar(node_text: []const u8) bool {
+pub fn isEllipsisMetavar(node_text: []const u8) bool {
     if (node_text.len < 5) return false; // $...X minimum
     return node_text[0] == '$' and std.mem.startsWith(u8, node_text[1..], "...");
 }
@@ -275,7 +378,12 @@ pub fn matchNode(
     const src_type = source.nodeType();
 
     // ── Same node type: compare children structurally ─────
+    // Leaves (identifiers, numbers, string fragments) have no children to
+    // compare, so they must spell the same; the literal prefilter relies on it.
     if (std.mem.eql(u8, pat_type, src_type)) {
+        if (pattern.childCount() == 0 and source.childCount() == 0) {
+            return std.mem.eql(u8, pat_text, source.text());
+        }
         return matchChildren(pattern, source, bindings, depth);
     }
 
@@ -383,6 +491,13 @@ fn matchChildSeq(
 /// Unwraps expression_statement to match the actual target kind, since
 /// matchNode transparently unwraps expression_statement during matching.
 fn patternTargetKind(pattern_root: ts.Node) ?[]const u8 {
+    const pat = patternRoot(pattern_root) orelse return null;
+    return pat.nodeType();
+}
+
+/// The pattern node whose kind every match has (see patternTargetKind), or
+/// null when the pattern is a bare metavariable or ellipsis.
+pub fn patternRoot(pattern_root: ts.Node) ?ts.Node {
     var pat = unwrapProgramRoot(pattern_root);
     // matchNode unwraps expression_statement with 1 child — do the same here
     if (std.mem.eql(u8, pat.nodeType(), "expression_statement") and pat.namedChildCount() == 1) {
@@ -392,9 +507,15 @@ fn patternTargetKind(pattern_root: ts.Node) ?[]const u8 {
     }
     const pat_text = pat.text();
     if (isMetavar(pat_text) or isEllipsis(pat_text) or isEllipsisMetavar(pat_text)) return null;
-    return pat.nodeType();
+    return pat;
 }
 
+/// Running count of source nodes visited by the tree walks below. Callers
+/// diff it around a walk to meter work deterministically (see
+/// rule_engine.applyStep); it is never reset. Per thread in the threaded
+/// engine build.
+pub threadlocal var node_visits: u64 = 0;
+
 /// Walk the entire source tree and collect all nodes that match the pattern.
 /// Uses kind-based pruning to skip nodes that can't match the pattern's root kind.
 pub fn searchMatches(
@@ -408,6 +529,10 @@ pub fn searchMatches(
     const pat = unwrapProgramRoot(pattern_root);
     const target_kind = patternTargetKind(pattern_root);
 
+    if (snapshot.lookup(source_root)) |pos| {
+        searchSnapshot(pat, pos, depth, source_root.source, null, matches, target_kind);
+        return;
+    }
     searchMatchesInner(pat, source_root, matches, depth, target_kind);
 }
 
@@ -418,21 +543,112 @@ fn searchMatchesInner(
     depth: u32,
     target_kind: ?[]const u8,
 ) void {
-    if (depth > 200) return;
+    if (depth > 200 or matches.full()) return;
+    node_visits += 1;
 
     tryMatch(pat, source_root, matches, target_kind);
 
     // Recurse into named children
     var i: u32 = 0;
-    while (i < source_root.namedChildCount()) : (i += 1) {
+    while (i < source_root.namedChildCount() and !matches.full()) : (i += 1) {
         if (source_root.namedChild(i)) |child| {
             searchMatchesInner(pat, child, matches, depth + 1, target_kind);
         }
     }
 }
 
+/// searchMatches over a snapshot subtree rooted at `pos`, which the walk
+/// would enter at `depth`: candidates come from a SIMD scan of the kind
+/// column for the pattern's root kind instead of a recursive walk. With
+/// `range`, only nodes inside it are tried, as in searchMatchesInRange.
+fn searchSnapshot(
+    pat: ts.Node,
+    pos: snapshot.Position,
+    depth: u32,
+    source: []const u8,
+    range: ?Range,
+    matches: *MatchList,
+    target_kind: ?[]const u8,
+) void {
+    const snap = pos.snap;
+    var lo = pos.index;
+    var hi = snap.subtree_end[pos.index];
+    if (range) |r| {
+        lo = @max(lo, snap.lowerBound(r.start_byte));
+        hi = @min(hi, snap.lowerBound(r.end_byte));
+    }
+    if (lo >= hi) return;
+
+    // Visits are metered up to the last node scanned, which is `hi` unless
+    // the match limit stops the scan early.
+    var i = lo;
+    if (target_kind) |tk| {
+        const named_id = snap.kindId(tk, true);
+        const anon_id = snap.kindId(tk, false);
+        i = snap.nextKind(lo, hi, named_id, anon_id);
+        while (i < hi and !matches.full()) : (i = snap.nextKind(i + 1, hi, named_id, anon_id)) {
+            if (walkVisits(pos, depth, i) and inSnapshotRange(snap, i, range)) tryMatch(pat, snap.tsNode(i, source), matches, null);
+        }
+    } else {
+        while (i < hi and !matches.full()) {
+            if (!walkReaches(pos, depth, i)) {
+                i = snap.subtree_end[i];
+                continue;
+            }
+            if (walkVisits(pos, depth, i) and inSnapshotRange(snap, i, range)) {
+                tryMatch(pat, snap.tsNode(i, source), matches, null);
+            }
+            i += 1;
+        }
+    }
+    node_visits += @min(i, hi) - lo;
+}
+
+/// Whether a named walk (searchMatches, collectByKind, collectByNthChild)
+/// entered at `pos` with `depth` visits snapshot node `i` of that subtree:
+/// it tests its starting node whatever its kind, then only named nodes,
+/// down to depth 200.
+fn walkVisits(pos: snapshot.Position, depth: u32, i: u32) bool {
+    return (pos.snap.named[i] or i == pos.index) and walkReaches(pos, depth, i);
+}
+
+/// Whether `i` is within the depth cap of a walk entered at `pos` with `depth`.
+pub fn walkReaches(pos: snapshot.Position, depth: u32, i: u32) bool {
+    return depth + (pos.snap.depth[i] - pos.snap.depth[pos.index]) <= 200;
+}
+
+/// Same inclusion test searchMatchesInRange applies while walking.
+fn inSnapshotRange(snap: *const snapshot.Snapshot, i: u32, range: ?Range) bool {
+    const r = range orelse return true;
+    const sb = snap.start_byte[i];
+    const eb = snap.end_byte[i];
+    return sb >= r.start_byte and eb <= r.end_byte and eb > r.start_byte and sb < r.end_byte;
+}
+
+/// Add a match for snapshot node `i` (with deduplication).
+pub fn addMatchFromSnapshot(snap: *const snapshot.Snapshot, i: u32, matches: *MatchList) void {
+    const sb = snap.start_byte[i];
+    const eb = snap.end_byte[i];
+    if (isDuplicate(matches.slice(), sb, eb)) return;
+    matches.add(.{
+        .start_byte = sb,
+        .end_byte = eb,
+        .start_row = snap.start_row[i],
+        .start_col = snap.start_col[i],
+        .end_row = snap.end_row[i],
+        .end_col = snap.end_col[i],
+        .bindings = .{},
+    });
+}
+
 /// Add a match from a node (with deduplication).
 pub fn addMatchFromNode(node: ts.Node, matches: *MatchList) void {
+    const none = Bindings{};
+    addMatchWithBindings(node, &none, matches);
+}
+
+/// Add a match from a node carrying `bindings` (with deduplication).
+pub fn addMatchWithBindings(node: ts.Node, bindings: *const Bindings, matches: *MatchList) void {
     const sb = node.startByte();
     const eb = node.endByte();
     if (isDuplicate(matches.slice(), sb, eb)) return;
@@ -445,36 +661,34 @@ pub fn addMatchFromNode(node: ts.Node, matches: *MatchList) void {
         .start_col = sp.col,
         .end_row = ep.row,
         .end_col = ep.col,
-        .bindings = .{},
+        .bindings = bindings.*,
     });
 }
 
 /// Try matching the pattern at a single source node, with optional kind pruning.
 fn tryMatch(pat: ts.Node, source_node: ts.Node, matches: *MatchList, target_kind: ?[]const u8) void {
+    // A statement wrapping one expression matches wherever that expression
+    // does (matchNode unwraps it). Only the expression is reported, so each
+    // occurrence counts once against a limit or a tally.
+    if (isWrappingStatement(source_node)) return;
+
     // Kind-based pruning: skip matchNode if source kind doesn't match pattern kind
     if (target_kind) |tk| {
-        const src_type = source_node.nodeType();
-        if (!std.mem.eql(u8, src_type, tk) and !std.mem.eql(u8, src_type, "expression_statement")) return;
+        if (!std.mem.eql(u8, source_node.nodeType(), tk)) return;
     }
 
     var bindings = Bindings{};
-    if (matchNode(pat, source_node, &bindings, 0)) {
-        const sb = source_node.startByte();
-        const eb = source_node.endByte();
-        if (!isDuplicate(matches.slice(), sb, eb)) {
-            const sp = source_node.startPoint();
-            const ep = source_node.endPoint();
-            matches.add(.{
-                .start_byte = sb,
-                .end_byte = eb,
-                .start_row = sp.row,
-                .start_col = sp.col,
-                .end_row = ep.row,
-                .end_col = ep.col,
-                .bindings = bindings,
-            });
-        }
-    }
+    if (matchNode(pat, source_node, &bindings, 0)) addMatchWithBindings(source_node, &bindings, matches);
+}
+
+fn isWrappingStatement(node: ts.Node) bool {
+    return std.mem.eql(u8, node.nodeType(), "expression_statement") and node.namedChildCount() == 1;
+}
+
+/// Try the pattern at exactly one source node (no descent into children).
+/// Used by incremental re-evaluation to re-check the ancestors of an edit.
+pub fn matchAt(pattern_root: ts.Node, source_node: ts.Node, matches: *MatchList) void {
+    tryMatch(unwrapProgramRoot(pattern_root), source_node, matches, patternTargetKind(pattern_root));
 }
 
 /// Skip the "program" root node wrapper (tree-sitter always wraps in a program node).
@@ -548,6 +762,94 @@ pub fn intersect(a: *const MatchList, b: *const MatchList) MatchList {
     return result;
 }
 
+// ── Edit shifting for incremental re-evaluation ───────────────
+
+/// A single source edit, in the same terms as tree-sitter's TSInputEdit.
+pub const Edit = struct {
+    start_byte: u32,
+    old_end_byte: u32,
+    new_end_byte: u32,
+    old_end_row: u32,
+    old_end_col: u32,
+    new_end_row: u32,
+    new_end_col: u32,
+};
+
+/// Move a position at or after the old edit end to its post-edit location.
+fn shiftPoint(row: *u32, col: *u32, e: Edit) void {
+    if (row.* == e.old_end_row) {
+        col.* = e.new_end_col + (col.* - e.old_end_col);
+        row.* = e.new_end_row;
+    } else {
+        row.* = row.* - e.old_end_row + e.new_end_row;
+    }
+}
+
+fn shiftByte(b: u32, e: Edit) u32 {
+    return b - e.old_end_byte + e.new_end_byte;
+}
+
+/// Carry a match list across an edit: matches before the edit are kept,
+/// matches after it are shifted, and matches touching the edited bytes
+/// are dropped (their text may have changed).
+pub fn shiftMatches(list: *MatchList, e: Edit) void {
+    var keep: u32 = 0;
+    for (list.items[0..list.count]) |m| {
+        var moved = m;
+        if (m.end_byte <= e.start_byte) {
+            // Entirely before the edit — unchanged.
+        } else if (m.start_byte >= e.old_end_byte) {
+            moved.start_byte = shiftByte(m.start_byte, e);
+            moved.end_byte = shiftByte(m.end_byte, e);
+            shiftPoint(&moved.start_row, &moved.start_col, e);
+            shiftPoint(&moved.end_row, &moved.end_col, e);
+            for (moved.bindings.items[0..moved.bindings.count]) |*b| {
+                b.start_byte = shiftByte(b.start_byte, e);
+                b.end_byte = shiftByte(b.end_byte, e);
+            }
+        } else {
+            continue;
+        }
+        list.items[keep] = moved;
+        keep += 1;
+    }
+    list.count = keep;
+}
+
+/// Drop matches that overlap or enclose [start, end).
+pub fn dropOverlapping(list: *MatchList, start: u32, end: u32) void {
+    var keep: u32 = 0;
+    for (list.items[0..list.count]) |m| {
+        const overlaps = m.start_byte < end and start < m.end_byte;
+        const encloses = m.start_byte <= start and m.end_byte >= end;
+        if (overlaps or encloses) continue;
+        list.items[keep] = m;
+        keep += 1;
+    }
+    list.count = keep;
+}
+
+fn sourceOrderLessThan(_: void, a: Match, b: Match) bool {
+    if (a.start_byte != b.start_byte) return a.start_byte < b.start_byte;
+    return a.end_byte > b.end_byte;
+}
+
+/// Sort matches into preorder (start ascending, enclosing node first) —
+/// the order a full tree walk produces. Insertion sort: lists are capped at
+/// MAX_MATCHES, and block sort's on-stack cache of Match values would not
+/// fit the WASM stack.
+pub fn sortSourceOrder(list: *MatchList) void {
+    std.sort.insertion(Match, list.items[0..list.count], {}, sourceOrderLessThan);
+}
+
+/// Carry a byte range across an edit. Bounds inside the edited bytes snap
+/// outward to the edit's new extent so the range never shrinks.
+pub fn shiftRange(r: Range, e: Edit) Range {
+    const start = if (r.start_byte <= e.start_byte) r.start_byte else if (r.start_byte >= e.old_end_byte) shiftByte(r.start_byte, e) else e.start_byte;
+    const end = if (r.end_byte <= e.start_byte) r.end_byte else if (r.end_byte >= e.old_end_byte) shiftByte(r.end_byte, e) else e.new_end_byte;
+    return .{ .start_byte = start, .end_byte = end };
+}
+
 // ── Kind matching ─────────────────────────────────────────────
 
 /// Walk the tree and collect all nodes whose nodeType() matches `kind`.
@@ -562,7 +864,14 @@ pub fn collectByKindAll(source_root: ts.Node, kind: []const u8, matches: *MatchL
 }
 
 fn collectByKindImpl(source_root: ts.Node, kind: []const u8, matches: *MatchList, depth: u32, named_only: bool) void {
-    if (depth > 200) return;
+    if (depth > 200 or matches.full()) return;
+    if (depth == 0) {
+        if (snapshot.lookup(source_root)) |pos| {
+            collectByKindSnapshot(pos, kind, matches, named_only);
+            return;
+        }
+    }
+    node_visits += 1;
 
     if (std.mem.eql(u8, source_root.nodeType(), kind)) {
         addMatchFromNode(source_root, matches);
@@ -570,7 +879,7 @@ fn collectByKindImpl(source_root: ts.Node, kind: []const u8, matches: *MatchList
 
     const count = if (named_only) source_root.namedChildCount() else source_root.childCount();
     var i: u32 = 0;
-    while (i < count) : (i += 1) {
+    while (i < count and !matches.full()) : (i += 1) {
         const child_node = if (named_only) source_root.namedChild(i) else source_root.child(i);
         if (child_node) |ch| {
             collectByKindImpl(ch, kind, matches, depth + 1, named_only);
@@ -578,6 +887,23 @@ fn collectByKindImpl(source_root: ts.Node, kind: []const u8, matches: *MatchList
     }
 }
 
+/// collectByKind over a snapshot subtree. Kind ids already encode
+/// named-ness, so the named-only walk is a scan for the named id alone.
+fn collectByKindSnapshot(pos: snapshot.Position, kind: []const u8, matches: *MatchList, named_only: bool) void {
+    const snap = pos.snap;
+    const lo = pos.index;
+    const hi = snap.subtree_end[pos.index];
+    node_visits += hi - lo;
+
+    const named_id = snap.kindId(kind, true);
+    const anon_id = snap.kindId(kind, false);
+    var i = snap.nextKind(lo, hi, named_id, anon_id);
+    while (i < hi and !matches.full()) : (i = snap.nextKind(i + 1, hi, named_id, anon_id)) {
+        const visited = if (named_only) walkVisits(pos, 0, i) else walkReaches(pos, 0, i);
+        if (visited) addMatchFromSnapshot(snap, i, matches);
+    }
+}
+
 // ── Range-constrained matching ────────────────────────────────
 
 /// Same as searchMatches but skips nodes outside [range_start, range_end).
@@ -601,6 +927,11 @@ pub fn searchMatchesInRange(
     const pat = unwrapProgramRoot(pattern_root);
     const target_kind = patternTargetKind(pattern_root);
 
+    if (snapshot.lookup(source_root)) |pos| {
+        searchSnapshot(pat, pos, depth, source_root.source, .{ .start_byte = range_start, .end_byte = range_end }, matches, target_kind);
+        return;
+    }
+
     // Try matching at this node if it's within range
     if (node_start >= range_start and node_end <= range_end) {
         tryMatch(pat, source_root, matches, target_kind);
@@ -608,7 +939,7 @@ pub fn searchMatchesInRange(
 
     // Recurse into named children
     var i: u32 = 0;
-    while (i < source_root.namedChildCount()) : (i += 1) {
+    while (i < source_root.namedChildCount() and !matches.full()) : (i += 1) {
         if (source_root.namedChild(i)) |child_node| {
             searchMatchesInRangeInner(pat, child_node, matches, depth + 1, range_start, range_end, target_kind);
         }
@@ -624,7 +955,8 @@ fn searchMatchesInRangeInner(
     range_end: u32,
     target_kind: ?[]const u8,
 ) void {
-    if (depth > 200) return;
+    if (depth > 200 or matches.full()) return;
+    node_visits += 1;
 
     const node_start = source_root.startByte();
     const node_end = source_root.endByte();
@@ -639,7 +971,7 @@ fn searchMatchesInRangeInner(
 
     // Recurse into named children
     var i: u32 = 0;
-    while (i < source_root.namedChildCount()) : (i += 1) {
+    while (i < source_root.namedChildCount() and !matches.full()) : (i += 1) {
         if (source_root.namedChild(i)) |child_node| {
             searchMatchesInRangeInner(pat, child_node, matches, depth + 1, range_start, range_end, target_kind);
         }
@@ -666,8 +998,20 @@ fn findNodeAtRange(root: ts.Node, target_start: u32, target_end: u32, depth: u32
     return null;
 }
 
+/// Collect the named siblings of the node at [node_start, node_end) from a
+/// snapshot, nearest first.
+fn collectSiblingsSnapshot(pos: snapshot.Position, node_start: u32, node_end: u32, matches: *MatchList, forward: bool) void {
+    const snap = pos.snap;
+    const target = snap.outermostAt(node_start, node_end) orelse return;
+    var sib = snap.namedSibling(target, forward);
+    while (sib != snapshot.NONE) : (sib = snap.namedSibling(sib, forward)) {
+        addMatchFromSnapshot(snap, sib, matches);
+    }
+}
+
 /// Collect all preceding named siblings of the node at [node_start, node_end).
 pub fn collectPrecedingSiblings(source_root: ts.Node, node_start: u32, node_end: u32, matches: *MatchList) void {
+    if (snapshot.lookup(source_root)) |pos| return collectSiblingsSnapshot(pos, node_start, node_end, matches, false);
     const target = findNodeAtRange(source_root, node_start, node_end, 0) orelse return;
     var current = target;
     while (current.prevNamedSibling()) |sib| {
@@ -678,6 +1022,7 @@ pub fn collectPrecedingSiblings(source_root: ts.Node, node_start: u32, node_end:
 
 /// Collect all following named siblings of the node at [node_start, node_end).
 pub fn collectFollowingSiblings(source_root: ts.Node, node_start: u32, node_end: u32, matches: *MatchList) void {
+    if (snapshot.lookup(source_root)) |pos| return collectSiblingsSnapshot(pos, node_start, node_end, matches, true);
     const target = findNodeAtRange(source_root, node_start, node_end, 0) orelse return;
     var current = target;
     while (current.nextNamedSibling()) |sib| {
@@ -691,6 +1036,13 @@ pub fn collectFollowingSiblings(source_root: ts.Node, node_start: u32, node_end:
 /// Collect all nodes that are the nth named child (0-based) of their parent.
 pub fn collectByNthChild(source_root: ts.Node, index: u32, matches: *MatchList, depth: u32) void {
     if (depth > 200) return;
+    if (depth == 0) {
+        if (snapshot.lookup(source_root)) |pos| {
+            collectByNthChildSnapshot(pos, index, matches);
+            return;
+        }
+    }
+    node_visits += 1;
 
     // Check if this node is the nth named child of its parent
     if (source_root.parent()) |par| {
@@ -709,6 +1061,23 @@ pub fn collectByNthChild(source_root: ts.Node, index: u32, matches: *MatchList,
     }
 }
 
+/// collectByNthChild over a snapshot subtree: a named node qualifies when
+/// exactly `index` named siblings precede it.
+fn collectByNthChildSnapshot(pos: snapshot.Position, index: u32, matches: *MatchList) void {
+    const snap = pos.snap;
+    const hi = snap.subtree_end[pos.index];
+    node_visits += hi - pos.index;
+
+    var i = pos.index;
+    while (i < hi) : (i += 1) {
+        if (!walkVisits(pos, 0, i) or snap.parent[i] == snapshot.NONE) continue;
+        var before: u32 = 0;
+        var sib = snap.namedSibling(i, false);
+        while (sib != snapshot.NONE and before <= index) : (sib = snap.namedSibling(sib, false)) before += 1;
+        if (before == index) addMatchFromSnapshot(snap, i, matches);
+    }
+}
+
 /// Union two match lists: combine results, deduplicating by byte range.
 pub fn unionMatches(a: *const MatchList, b: *const MatchList) MatchList {
     var result = MatchList{};
@@ -1147,3 +1516,308 @@ test "unionMatches deduplicates" {
     const result = unionMatches(&a_list, &b_list);
     try std.testing.expectEqual(@as(u32, 3), result.count);
 }
+
+test "shiftMatches keeps, shifts and drops around an edit" {
+    // "a = 1;\nb = 2;\nc = 3;" with "2" replaced by "200" (bytes 11..12).
+    var list = MatchList{};
+    list.add(.{ .start_byte = 0, .end_byte = 6, .start_row = 0, .start_col = 0, .end_row = 0, .end_col = 6, .bindings = .{} });
+    list.add(.{ .start_byte = 7, .end_byte = 13, .start_row = 1, .start_col = 0, .end_row = 1, .end_col = 6, .bindings = .{} });
+    list.add(.{ .start_byte = 14, .end_byte = 20, .start_row = 2, .start_col = 0, .end_row = 2, .end_col = 6, .bindings = .{} });
+
+    shiftMatches(&list, .{
+        .start_byte = 11,
+        .old_end_byte = 12,
+        .new_end_byte = 14,
+        .old_end_row = 1,
+        .old_end_col = 5,
+        .new_end_row = 1,
+        .new_end_col = 7,
+    });
+
+    try std.testing.expectEqual(@as(u32, 2), list.count);
+    try std.testing.expectEqual(@as(u32, 0), list.items[0].start_byte);
+    try std.testing.expectEqual(@as(u32, 16), list.items[1].start_byte);
+    try std.testing.expectEqual(@as(u32, 22), list.items[1].end_byte);
+    try std.testing.expectEqual(@as(u32, 2), list.items[1].start_row);
+    try std.testing.expectEqual(@as(u32, 0), list.items[1].start_col);
+}
+
+test "sortSourceOrder puts enclosing matches first" {
+    var list = MatchList{};
+    list.add(.{ .start_byte = 5, .end_byte = 8, .start_row = 0, .start_col = 5, .end_row = 0, .end_col = 8, .bindings = .{} });
+    list.add(.{ .start_byte = 0, .end_byte = 4, .start_row = 0, .start_col = 0, .end_row = 0, .end_col = 4, .bindings = .{} });
+    list.add(.{ .start_byte = 5, .end_byte = 12, .start_row = 0, .start_col = 5, .end_row = 0, .end_col = 12, .bindings = .{} });
+
+    sortSourceOrder(&list);
+    try std.testing.expectEqual(@as(u32, 0), list.items[0].start_byte);
+    try std.testing.expectEqual(@as(u32, 12), list.items[1].end_byte);
+    try std.testing.expectEqual(@as(u32, 8), list.items[2].end_byte);
+}
+
+fn expectSameRanges(a: *const MatchList, b: *const MatchList) !void {
+    try std.testing.expectEqual(a.count, b.count);
+    for (a.slice(), b.slice()) |x, y| {
+        try std.testing.expectEqual(x.start_byte, y.start_byte);
+        try std.testing.expectEqual(x.end_byte, y.end_byte);
+        try std.testing.expectEqual(x.start_row, y.start_row);
+        try std.testing.expectEqual(x.end_col, y.end_col);
+        try std.testing.expectEqual(x.bindings.count, y.bindings.count);
+    }
+}
+
+test "same-kind leaves must have the same text" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    var source_tree = parser.parse("bar(x); foo(y);") orelse return;
+    defer source_tree.deinit();
+    var pat_tree = parser.parse("foo($X)") orelse return;
+    defer pat_tree.deinit();
+
+    var matches = MatchList{};
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &matches, 0);
+    try std.testing.expect(matches.count > 0);
+    for (matches.slice()) |m| try std.testing.expectEqualStrings("y", m.bindings.get("X").?);
+}
+
+test "match limit stops the search early" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    var source_tree = parser.parse("foo(1); foo(2); foo(3);") orelse return;
+    defer source_tree.deinit();
+    var pat_tree = parser.parse("foo($A)") orelse return;
+    defer pat_tree.deinit();
+
+    var all = MatchList{};
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &all, 0);
+    try std.testing.expectEqual(@as(u32, 3), all.count);
+
+    const before = node_visits;
+    var first = MatchList.withLimit(1);
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &first, 0);
+    try std.testing.expectEqual(@as(u32, 1), first.count);
+    try std.testing.expectEqual(all.items[0].start_byte, first.items[0].start_byte);
+    try std.testing.expect(node_visits - before < countNamed(source_tree.rootNode()));
+}
+
+test "a limit counts each occurrence once" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    const source = "eval(a); eval(b); eval(c);";
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    var pat_tree = parser.parse("eval($X)") orelse return;
+    defer pat_tree.deinit();
+
+    // The statements wrapping each call are not reported beside it.
+    var all = MatchList{};
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &all, 0);
+    try std.testing.expectEqual(@as(u32, 3), all.count);
+
+    var two = MatchList.withLimit(2);
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &two, 0);
+    try std.testing.expectEqual(@as(u32, 2), two.count);
+    try std.testing.expectEqualStrings("eval(a)", source[two.items[0].start_byte..two.items[0].end_byte]);
+    try std.testing.expectEqualStrings("eval(b)", source[two.items[1].start_byte..two.items[1].end_byte]);
+}
+
+test "tally counts each expression once and groups by binding" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    const source = "foo(a); foo(b); x = foo(a); foo(foo(c));";
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    var pat_tree = parser.parse("foo($A)") orelse return;
+    defer pat_tree.deinit();
+
+    var tally = Tally{ .source = source, .group_by = "A" };
+    var counted = MatchList{ .tally = &tally };
+    searchMatches(pat_tree.rootNode(), source_tree.rootNode(), &counted, 0);
+    try std.testing.expectEqual(@as(u32, 0), counted.count);
+    try std.testing.expectEqual(@as(u32, 5), tally.total);
+    try std.testing.expectEqual(@as(u32, 0), tally.ungrouped);
+
+    const groups = tally.sortedGroups();
+    try std.testing.expectEqual(@as(usize, 4), groups.len);
+    try std.testing.expectEqualStrings("a", groups[0].text);
+    try std.testing.expectEqual(@as(u32, 2), groups[0].count);
+}
+
+fn countNamed(node: ts.Node) u64 {
+    var n: u64 = 1;
+    var i: u32 = 0;
+    while (i < node.namedChildCount()) : (i += 1) {
+        if (node.namedChild(i)) |ch| n += countNamed(ch);
+    }
+    return n;
+}
+
+test "snapshot scans agree with tree walks" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+
+    const source =
+        \\function f(a) { foo(a); bar(1, 2); }
+        \\const x = foo(b); // note
+        \\foo(c);
+        \\if (x) { foo(d); }
+    ;
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    var pattern_tree = parser.parse("foo($A)") orelse return;
+    defer pattern_tree.deinit();
+    const root = source_tree.rootNode();
+    const second = root.namedChild(1) orelse return;
+
+    var walked: [6]MatchList = .{MatchList{}} ** 6;
+    searchMatches(pattern_tree.rootNode(), root, &walked[0], 0);
+    collectByKind(root, "call_expression", &walked[1], 0);
+    collectByKindAll(root, "comment", &walked[2], 0);
+    collectByNthChild(root, 1, &walked[3], 0);
+    collectFollowingSiblings(root, second.startByte(), second.endByte(), &walked[4]);
+    searchMatchesInRange(pattern_tree.rootNode(), root, &walked[5], 0, 0, 40);
+
+    const snap = snapshot.Snapshot.build(&source_tree) orelse return error.OutOfMemory;
+    defer snap.deinit();
+    try std.testing.expect(snapshot.register(snap));
+    defer snapshot.unregister(snap);
+    try std.testing.expectEqual(@as(u32, 0), snap.indexOf(root).?);
+
+    var scanned: [6]MatchList = .{MatchList{}} ** 6;
+    searchMatches(pattern_tree.rootNode(), root, &scanned[0], 0);
+    collectByKind(root, "call_expression", &scanned[1], 0);
+    collectByKindAll(root, "comment", &scanned[2], 0);
+    collectByNthChild(root, 1, &scanned[3], 0);
+    collectFollowingSiblings(root, second.startByte(), second.endByte(), &scanned[4]);
+    searchMatchesInRange(pattern_tree.rootNode(), root, &scanned[5], 0, 0, 40);
+
+    try std.testing.expect(walked[0].count >= 4);
+    for (&walked, &scanned) |*w, *s| try expectSameRanges(w, s);
+}
+
+test "snapshot scans keep the walks' depth cap" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+
+    // The 1 sits deeper than the walks go; the 2 does not.
+    const source = "y = 2; x = " ++ "[" ** 250 ++ "1" ++ "]" ** 250 ++ ";";
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    var pattern_tree = parser.parse("1") orelse return;
+    defer pattern_tree.deinit();
+    const root = source_tree.rootNode();
+
+    var walked: [3]MatchList = .{MatchList{}} ** 3;
+    collectByKind(root, "number", &walked[0], 0);
+    collectByKindAll(root, "number", &walked[1], 0);
+    searchMatches(pattern_tree.rootNode(), root, &walked[2], 0);
+    try std.testing.expectEqual(@as(u32, 1), walked[0].count);
+    try std.testing.expectEqualStrings("2", source[walked[0].items[0].start_byte..walked[0].items[0].end_byte]);
+    try std.testing.expectEqual(@as(u32, 0), walked[2].count);
+
+    const snap = snapshot.Snapshot.build(&source_tree) orelse return error.OutOfMemory;
+    defer snap.deinit();
+    try std.testing.expect(snapshot.register(snap));
+    defer snapshot.unregister(snap);
+
+    var scanned: [3]MatchList = .{MatchList{}} ** 3;
+    collectByKind(root, "number", &scanned[0], 0);
+    collectByKindAll(root, "number", &scanned[1], 0);
+    searchMatches(pattern_tree.rootNode(), root, &scanned[2], 0);
+    for (&walked, &scanned) |*w, *sc| try expectSameRanges(w, sc);
+}
+
+test "snapshot scans test an anonymous starting node" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+
+    const source = "f = (a) => a;";
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    const root = source_tree.rootNode();
+    const assignment = (root.namedChild(0) orelse return).namedChild(0) orelse return;
+    const arrow_fn = assignment.childByFieldName("right") orelse return;
+    var arrow: ?ts.Node = null;
+    var i: u32 = 0;
+    while (i < arrow_fn.childCount()) : (i += 1) {
+        const ch = arrow_fn.child(i) orelse continue;
+        if (std.mem.eql(u8, ch.nodeType(), "=>")) arrow = ch;
+    }
+    const token = arrow orelse return error.TestUnexpectedResult;
+
+    var walked: [3]MatchList = .{MatchList{}} ** 3;
+    collectByKind(token, "=>", &walked[0], 0);
+    collectByKind(root, "=>", &walked[1], 0);
+    collectByKindAll(root, "=>", &walked[2], 0);
+    try std.testing.expectEqual(@as(u32, 1), walked[0].count);
+    try std.testing.expectEqual(@as(u32, 0), walked[1].count);
+    try std.testing.expectEqual(@as(u32, 1), walked[2].count);
+
+    const snap = snapshot.Snapshot.build(&source_tree) orelse return error.OutOfMemory;
+    defer snap.deinit();
+    try std.testing.expect(snapshot.register(snap));
+    defer snapshot.unregister(snap);
+
+    var scanned: [3]MatchList = .{MatchList{}} ** 3;
+    collectByKind(token, "=>", &scanned[0], 0);
+    collectByKind(root, "=>", &scanned[1], 0);
+    collectByKindAll(root, "=>", &scanned[2], 0);
+    for (&walked, &scanned) |*w, *sc| try expectSameRanges(w, sc);
+}
+
+test "loaded snapshots match like the tree they were saved from" {
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+
+    const source =
+        \\function f(a) { foo(a); bar(1, 2); }
+        \\const x = foo(b); // note
+        \\foo(c);
+        \\if (x) { foo(d); }
+    ;
+    var source_tree = parser.parse(source) orelse return;
+    defer source_tree.deinit();
+    var pattern_tree = parser.parse("foo($A)") orelse return;
+    defer pattern_tree.deinit();
+    const root = source_tree.rootNode();
+    const second = root.namedChild(1) orelse return;
+
+    const built = snapshot.Snapshot.build(&source_tree) orelse return error.OutOfMemory;
+    defer built.deinit();
+    var saved: std.ArrayListUnmanaged(u8) = .empty;
+    defer saved.deinit(std.testing.allocator);
+    try built.save(&saved, std.testing.allocator);
+    try std.testing.expectEqual(snapshot.Snapshot.savedLen(built.len), saved.items.len);
+
+    const language = ts.grammar(.javascript).?;
+    try std.testing.expect(snapshot.Snapshot.load(saved.items, source[1..], language) == null);
+    const loaded = snapshot.Snapshot.load(saved.items, source, language) orelse return error.OutOfMemory;
+    defer loaded.deinit();
+    inline for (.{ "start_row", "start_col", "end_row", "end_col", "first_child", "next_sibling", "prev_sibling", "subtree_end" }) |col| {
+        try std.testing.expectEqualSlices(u32, @field(built, col)[0..built.len], @field(loaded, col)[0..loaded.len]);
+    }
+
+    const flat = loaded.tsNode(0, source);
+    try std.testing.expectEqualStrings("program", flat.nodeType());
+    try std.testing.expectEqual(root.hasError(), flat.hasError());
+    try std.testing.expectEqual(root.childCount(), flat.childCount());
+
+    var walked: [5]MatchList = .{MatchList{}} ** 5;
+    searchMatches(pattern_tree.rootNode(), root, &walked[0], 0);
+    collectByKind(root, "call_expression", &walked[1], 0);
+    collectByKindAll(root, "comment", &walked[2], 0);
+    collectFollowingSiblings(root, second.startByte(), second.endByte(), &walked[3]);
+    searchMatchesInRange(pattern_tree.rootNode(), root, &walked[4], 0, 0, 40);
+
+    var scanned: [5]MatchList = .{MatchList{}} ** 5;
+    searchMatches(pattern_tree.rootNode(), flat, &scanned[0], 0);
+    collectByKind(flat, "call_expression", &scanned[1], 0);
+    collectByKindAll(flat, "comment", &scanned[2], 0);
+    collectFollowingSiblings(flat, second.startByte(), second.endByte(), &scanned[3]);
+    searchMatchesInRange(pattern_tree.rootNode(), flat, &scanned[4], 0, 0, 40);
+
+    try std.testing.expect(walked[0].count >= 4);
+    for (&walked, &scanned) |*w, *s| try expectSameRanges(w, s);
+    for (walked[0].slice(), scanned[0].slice()) |w, s| {
+        try std.testing.expectEqualStrings(w.bindings.get("A").?, s.bindings.get("A").?);
+    }
+}
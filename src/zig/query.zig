@@ -0,0 +1,360 @@
+///! query.zig — tree-sitter queries as a matching backend.
+///!
+///! tree-sitter's query engine finds the nodes of many S-expression patterns
+///! in one cursor pass over a tree. This module translates structural
+///! patterns into query patterns, evaluates the text predicates the query
+///! engine leaves to its host, and runs raw queries for `query_source`.
+///!
+///! A translated pattern is a filter, not a replacement: it accepts every node
+///! matchNode could match but may accept more (metavariables become `(_)`,
+///! repeated metavariables are not unified, leaves are compared by text
+///! only), so callers confirm each hit with matcher.matchAt.
+
+const std = @import("std");
+const ts = @import("ts_bridge.zig");
+const matcher = @import("matcher.zig");
+const regex = @import("regex");
+
+const gpa = @import("alloc.zig").gpa;
+const c = ts.c;
+
+/// Capture on the node a translated pattern matched.
+pub const ROOT_CAPTURE = "_root";
+
+/// Capture a raw query uses to name its match range (otherwise its first capture).
+pub const MATCH_CAPTURE = "match";
+
+// ── Pattern → query translation ──────────────────────────
+
+const TranslateError = error{ OutOfMemory, Unsupported };
+
+const Translator = struct {
+    allocator: std.mem.Allocator,
+    out: *std.ArrayList(u8),
+    preds: std.ArrayList(u8) = .empty,
+    leaves: u32 = 0,
+
+    fn node(self: *Translator, pat: ts.Node, depth: u32, is_root: bool) TranslateError!void {
+        if (depth > 100) return error.Unsupported;
+        const w = self.out.writer(self.allocator);
+        const text = pat.text();
+        if (matcher.isMetavar(text)) return w.writeAll("(_)");
+
+        if (pat.namedChildCount() == 0) {
+            // matchNode lets a child leaf match a leaf of another kind with
+            // the same text, and a same-kind node whatever its anonymous
+            // children, so only the root keeps its kind.
+            const kind = if (is_root) pat.nodeType() else "_";
+            if (pat.childCount() > 0) return w.print("({s})", .{kind});
+            try w.print("({s}) @_l{d}", .{ kind, self.leaves });
+            const pw = self.preds.writer(self.allocator);
+            try pw.print(" (#eq? @_l{d} ", .{self.leaves});
+            try writeString(pw, text);
+            try pw.writeByte(')');
+            self.leaves += 1;
+            return;
+        }
+
+        // A nested statement may match its bare expression (matchNode unwraps
+        // expression_statement), which no single kind describes.
+        if (!is_root and std.mem.eql(u8, pat.nodeType(), "expression_statement")) return w.writeAll("(_)");
+
+        try w.print("({s}", .{pat.nodeType()});
+        try self.children(pat, depth);
+        try w.writeByte(')');
+    }
+
+    /// Named children in order. Anchors pin the first, last and adjacent
+    /// children, as matchChildSeq requires, except next to an ellipsis.
+    fn children(self: *Translator, pat: ts.Node, depth: u32) TranslateError!void {
+        const w = self.out.writer(self.allocator);
+        var gap = false;
+        var emitted = false;
+        var i: u32 = 0;
+        while (i < pat.namedChildCount()) : (i += 1) {
+            const child = pat.namedChild(i) orelse return error.Unsupported;
+            const text = child.text();
+            if (matcher.isEllipsis(text) or matcher.isEllipsisMetavar(text)) {
+                gap = true;
+                continue;
+            }
+            if (!gap) try w.writeAll(" .");
+            try w.writeByte(' ');
+            try self.node(child, depth + 1, false);
+            gap = false;
+            emitted = true;
+        }
+        if (emitted and !gap) try w.writeAll(" .");
+    }
+};
+
+/// Append one query pattern for a parsed structural pattern, capturing its
+/// root as @_root. Returns false, leaving `out` as it was, for patterns
+/// with no fixed root kind (a bare metavariable) or a parse error.
+/// `allocator` is the one that owns `out`.
+pub fn translate(allocator: std.mem.Allocator, pattern_root: ts.Node, out: *std.ArrayList(u8)) bool {
+    if (pattern_root.hasError()) return false;
+    const root = matcher.patternRoot(pattern_root) orelse return false;
+    const start = out.items.len;
+    var t = Translator{ .allocator = allocator, .out = out };
+    defer t.preds.deinit(allocator);
+
+    const ok = blk: {
+        out.append(allocator, '(') catch break :blk false;
+        t.node(root, 0, true) catch break :blk false;
+        out.writer(allocator).print(" @{s}{s})", .{ ROOT_CAPTURE, t.preds.items }) catch break :blk false;
+        break :blk true;
+    };
+    if (!ok) out.shrinkRetainingCapacity(start);
+    return ok;
+}
+
+/// Append a query pattern for every named node of `kind`.
+pub fn translateKind(allocator: std.mem.Allocator, kind: []const u8, out: *std.ArrayList(u8)) bool {
+    for (kind) |ch| {
+        if (!std.ascii.isAlphanumeric(ch) and ch != '_') return false;
+    }
+    out.writer(allocator).print("({s}) @{s}", .{ kind, ROOT_CAPTURE }) catch return false;
+    return true;
+}
+
+fn writeString(w: anytype, s: []const u8) !void {
+    try w.writeByte('"');
+    for (s) |ch| {
+        switch (ch) {
+            '"' => try w.writeAll("\\\""),
+            '\\' => try w.writeAll("\\\\"),
+            '\n' => try w.writeAll("\\n"),
+            '\r' => try w.writeAll("\\r"),
+            '\t' => try w.writeAll("\\t"),
+            else => try w.writeByte(ch),
+        }
+    }
+    try w.writeByte('"');
+}
+
+// ── Running queries ──────────────────────────────────────
+
+const MAX_REGEXES = 8;
+
+/// Iterates the matches of a query that satisfy their predicates.
+pub const Runner = struct {
+    query: *const ts.Query,
+    cursor: ts.QueryCursor,
+    source: []const u8,
+    regex_ids: [MAX_REGEXES]u32 = undefined,
+    regexes: [MAX_REGEXES]?regex.Regex = undefined,
+    regex_count: u8 = 0,
+
+    pub fn init(query: *const ts.Query, root: ts.Node) ?Runner {
+        var cursor = ts.QueryCursor.init() orelse return null;
+        cursor.exec(query, root);
+        return .{ .query = query, .cursor = cursor, .source = root.source };
+    }
+
+    pub fn deinit(self: *Runner) void {
+        for (self.regexes[0..self.regex_count]) |*re| {
+            if (re.*) |*compiled| compiled.deinit();
+        }
+        self.cursor.deinit();
+    }
+
+    pub fn next(self: *Runner) ?c.TSQueryMatch {
+        var m: c.TSQueryMatch = undefined;
+        while (self.cursor.nextMatch(&m)) {
+            if (self.satisfies(&m)) return m;
+        }
+        return null;
+    }
+
+    pub fn node(self: *const Runner, raw: c.TSNode) ts.Node {
+        return .{ .node = raw, .source = self.source };
+    }
+
+    /// First node captured as `id`, or null when the capture is absent
+    /// (an optional or alternative branch that did not match).
+    pub fn captured(self: *const Runner, m: *const c.TSQueryMatch, id: u32) ?ts.Node {
+        for (m.captures[0..m.capture_count]) |cap| {
+            if (cap.index == id) return self.node(cap.node);
+        }
+        return null;
+    }
+
+    /// The query engine parses predicates but leaves evaluating them to the
+    /// host. Supported: #eq?, #not-eq?, #match?, #not-match?, #any-of?;
+    /// others are ignored.
+    fn satisfies(self: *Runner, m: *const c.TSQueryMatch) bool {
+        const steps = self.query.predicates(m.pattern_index);
+        var i: usize = 0;
+        while (i < steps.len) {
+            var end = i;
+            while (end < steps.len and steps[end].@"type" != c.TSQueryPredicateStepTypeDone) end += 1;
+            if (!self.check(m, steps[i..end])) return false;
+            i = end + 1;
+        }
+        return true;
+    }
+
+    fn check(self: *Runner, m: *const c.TSQueryMatch, pred: []const c.TSQueryPredicateStep) bool {
+        if (pred.len < 3 or pred[0].@"type" != c.TSQueryPredicateStepTypeString) return true;
+        if (pred[1].@"type" != c.TSQueryPredicateStepTypeCapture) return true;
+        const name = self.query.stringValue(pred[0].value_id);
+        const subject = (self.captured(m, pred[1].value_id) orelse return true).text();
+
+        if (std.mem.eql(u8, name, "eq?") or std.mem.eql(u8, name, "not-eq?")) {
+            const want = name[0] == 'e';
+            const other = self.operand(m, pred[2]) orelse return true;
+            return std.mem.eql(u8, subject, other) == want;
+        }
+        if (std.mem.eql(u8, name, "match?") or std.mem.eql(u8, name, "not-match?")) {
+            const want = name[0] == 'm';
+            if (pred[2].@"type" != c.TSQueryPredicateStepTypeString) return true;
+            const re = self.regexFor(pred[2].value_id) orelse return !want;
+            const found: ?regex.Match = re.find(subject) catch null;
+            return (found != null) == want;
+        }
+        if (std.mem.eql(u8, name, "any-of?")) {
+            for (pred[2..]) |step| {
+                if (step.@"type" == c.TSQueryPredicateStepTypeString and std.mem.eql(u8, subject, self.query.stringValue(step.value_id))) return true;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    fn operand(self: *const Runner, m: *const c.TSQueryMatch, step: c.TSQueryPredicateStep) ?[]const u8 {
+        if (step.@"type" == c.TSQueryPredicateStepTypeString) return self.query.stringValue(step.value_id);
+        const n = self.captured(m, step.value_id) orelse return null;
+        return n.text();
+    }
+
+    /// Compiled regex for a string id, compiled once per run. Null if the
+    /// pattern does not compile or the cache is full.
+    fn regexFor(self: *Runner, id: u32) ?*regex.Regex {
+        for (self.regex_ids[0..self.regex_count], 0..) |cached, k| {
+            if (cached == id) return if (self.regexes[k]) |*re| re else null;
+        }
+        if (self.regex_count == MAX_REGEXES) return null;
+        const k = self.regex_count;
+        self.regex_ids[k] = id;
+        self.regexes[k] = regex.Regex.compile(gpa, self.query.stringValue(id)) catch null;
+        self.regex_count += 1;
+        return if (self.regexes[k]) |*re| re else null;
+    }
+};
+
+/// A node captured as @_root by pattern `pattern` of a translated query.
+pub const Hit = struct {
+    pattern: u16,
+    node: c.TSNode,
+    start_byte: u32,
+    end_byte: u32,
+};
+
+fn preorderLessThan(_: void, a: Hit, b: Hit) bool {
+    if (a.start_byte != b.start_byte) return a.start_byte < b.start_byte;
+    return a.end_byte > b.end_byte;
+}
+
+/// Collect the @_root node of every match of a translated query, in the
+/// preorder a tree walk visits them (the cursor reports a match when its
+/// last node is reached, so an outer match can follow an inner one).
+pub fn collectHits(query: *const ts.Query, root: ts.Node, hits: *std.ArrayListUnmanaged(Hit)) void {
+    const root_id = query.captureId(ROOT_CAPTURE) orelse return;
+    var runner = Runner.init(query, root) orelse return;
+    defer runner.deinit();
+    // The tree walks the hits stand in for stop 200 levels down.
+    runner.cursor.setMaxStartDepth(200);
+    while (runner.next()) |m| {
+        const n = runner.captured(&m, root_id) orelse continue;
+        hits.append(gpa, .{
+            .pattern = m.pattern_index,
+            .node = n.node,
+            .start_byte = n.startByte(),
+            .end_byte = n.endByte(),
+        }) catch break;
+    }
+    std.mem.sort(Hit, hits.items, {}, preorderLessThan);
+}
+
+/// Run a raw query, one match per query match. The range is the @match
+/// capture's, or the first capture's; other captures not starting with `_`
+/// become bindings.
+pub fn search(query: *const ts.Query, root: ts.Node, matches: *matcher.MatchList) void {
+    const match_id = query.captureId(MATCH_CAPTURE);
+    var runner = Runner.init(query, root) orelse return;
+    defer runner.deinit();
+    while (!matches.full()) {
+        const m = runner.next() orelse return;
+        if (m.capture_count == 0) continue;
+        const range_node = if (match_id) |id| runner.captured(&m, id) orelse runner.node(m.captures[0].node) else runner.node(m.captures[0].node);
+
+        var bindings = matcher.Bindings{};
+        for (m.captures[0..m.capture_count]) |cap| {
+            const name = query.captureName(cap.index);
+            if (name.len == 0 or name[0] == '_' or std.mem.eql(u8, name, MATCH_CAPTURE)) continue;
+            const n = runner.node(cap.node);
+            // A quantified capture keeps its first node.
+            _ = bindings.bind(name, n.text(), n.startByte(), n.endByte());
+        }
+        matcher.addMatchWithBindings(range_node, &bindings, matches);
+    }
+}
+
+// ── Tests ──────────────────────────────────────────────────
+
+fn translated(pattern: []const u8, out: *std.ArrayList(u8)) !bool {
+    var parser = ts.Parser.init(.javascript) orelse return error.SkipZigTest;
+    defer parser.deinit();
+    var tree = parser.parse(pattern) orelse return error.SkipZigTest;
+    defer tree.deinit();
+    return translate(std.testing.allocator, tree.rootNode(), out);
+}
+
+test "translate anchors children and checks leaf text" {
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(std.testing.allocator);
+    try std.testing.expect(try translated("eval($X)", &out));
+    try std.testing.expectEqualStrings(
+        "((call_expression . (_) @_l0 . (arguments . (_) .) .) @_root (#eq? @_l0 \"eval\"))",
+        out.items,
+    );
+}
+
+test "translate rejects a bare metavariable" {
+    var out: std.ArrayList(u8) = .empty;
+    defer out.deinit(std.testing.allocator);
+    try std.testing.expect(!try translated("$X", &out));
+    try std.testing.expectEqual(@as(usize, 0), out.items.len);
+}
+
+test "translated query finds the structural matches" {
+    var parser = ts.Parser.init(.javascript) orelse return error.SkipZigTest;
+    defer parser.deinit();
+    var pat = parser.parse("foo($A)") orelse return error.SkipZigTest;
+    defer pat.deinit();
+    var src = parser.parse("foo(1); bar(2); x = foo(b, c); foo(bar(3));") orelse return error.SkipZigTest;
+    defer src.deinit();
+
+    var text: std.ArrayList(u8) = .empty;
+    defer text.deinit(std.testing.allocator);
+    try std.testing.expect(translate(std.testing.allocator, pat.rootNode(), &text));
+    var offset: u32 = 0;
+    var q = try ts.Query.init(.javascript, text.items, &offset);
+    defer q.deinit();
+
+    var hits: std.ArrayListUnmanaged(Hit) = .empty;
+    defer hits.deinit(gpa);
+    collectHits(&q, src.rootNode(), &hits);
+
+    var via_query = matcher.MatchList{};
+    for (hits.items) |h| matcher.matchAt(pat.rootNode(), .{ .node = h.node, .source = src.source }, &via_query);
+    var via_walk = matcher.MatchList{};
+    matcher.searchMatches(pat.rootNode(), src.rootNode(), &via_walk, 0);
+
+    try std.testing.expectEqual(via_walk.count, via_query.count);
+    for (via_walk.slice(), via_query.slice()) |a, b| {
+        try std.testing.expectEqual(a.start_byte, b.start_byte);
+        try std.testing.expectEqual(a.end_byte, b.end_byte);
+    }
+}
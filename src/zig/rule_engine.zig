@@ -16,6 +16,9 @@
 const std = @import("std");
 const matcher = @import("matcher.zig");
 const ts = @import("ts_bridge.zig");
+const snapshot = @import("snapshot.zig");
+const literals = @import("literals.zig");
+const query = @import("query.zig");
 const rules_mod = @import("rules.zig");
 const regex = @import("regex");
 
@@ -101,8 +104,12 @@ pub const RuleNode = struct {
     ref_index: u16 = 0,
     // Compiled pattern handle (populated during load for .pattern nodes)
     compiled_handle: u32 = 0,
+    // Pattern index in the ruleset's query (compileQuery), or NO_QUERY
+    query_pattern: u16 = NO_QUERY,
 };
 
+pub const NO_QUERY: u16 = 0xFFFF;
+
 pub const Constraint = struct {
     metavar_offset: u32 = 0,
     metavar_len: u16 = 0,
@@ -138,12 +145,6 @@ pub const Rule = struct {
     transforms_count: u16 = 0,
 };
 
-// ── Children index pool ──────────────────────────────────
-// For all/any nodes, children indices are stored contiguously.
-
-var children_pool: [MAX_CHILDREN]u16 = undefined;
-var children_pool_count: u16 = 0;
-
 // ── Compiled ruleset ─────────────────────────────────────
 
 pub const CompiledRuleset = struct {
@@ -155,8 +156,17 @@ pub const CompiledRuleset = struct {
     constraint_count: u16 = 0,
     transforms: [MAX_TRANSFORMS]Transform = undefined,
     transform_count: u16 = 0,
+    // Children of all/any nodes, stored contiguously (children_start/count)
+    children: [MAX_CHILDREN]u16 = undefined,
+    children_count: u16 = 0,
     // Points into the original bytecode buffer (kept alive by WASM memory)
     bytecode: []const u8 = &.{},
+    // Per rule: literals any match needs in the source bytes (computeLiterals)
+    required: [MAX_RULES]literals.Set = [_]literals.Set{.{}} ** MAX_RULES,
+    // Pattern and kind nodes translated to one tree-sitter query (compileQuery)
+    query: ?ts.Query = null,
+    // The grammar the query was compiled for; other trees skip it
+    query_language: ts.Language = .javascript,
 };
 
 // ── Bytecode decoder ─────────────────────────────────────
@@ -208,7 +218,6 @@ const Decoder = struct {
 pub fn decode(bytecode: []const u8) ?CompiledRuleset {
     var rs = CompiledRuleset{};
     rs.bytecode = bytecode;
-    children_pool_count = 0;
 
     var dec = Decoder.init(bytecode);
 
@@ -357,15 +366,15 @@ fn decodeRuleNode(dec: *Decoder, rs: *CompiledRuleset) ?u16 {
         OP_ALL, OP_ANY => {
             node.tag = if (op == OP_ALL) .all else .any;
             const count = dec.readU16() orelse return null;
-            node.children_start = children_pool_count;
+            node.children_start = rs.children_count;
             node.children_count = count;
 
             var ci: u16 = 0;
             while (ci < count) : (ci += 1) {
-                if (children_pool_count >= MAX_CHILDREN) return null;
+                if (rs.children_count >= MAX_CHILDREN) return null;
                 const child_idx = decodeRuleNode(dec, rs) orelse return null;
-                children_pool[children_pool_count] = child_idx;
-                children_pool_count += 1;
+                rs.children[rs.children_count] = child_idx;
+                rs.children_count += 1;
             }
         },
         OP_NOT => {
@@ -412,78 +421,246 @@ fn decodeRuleNode(dec: *Decoder, rs: *CompiledRuleset) ?u16 {
 
 // ── Pattern compilation ──────────────────────────────────
 
-/// Compile all pattern strings in the ruleset into cached pattern handles.
-/// `compiled_slots` uses the same CompiledPattern type from main.zig (passed as anytype).
-pub fn compilePatterns(
-    rs: *CompiledRuleset,
-    compiled_slots: anytype,
-    getOrInitParser: anytype,
-) ?void {
+/// For now, a ruleset uses the language of its first rule.
+fn rulesetLanguage(rs: *const CompiledRuleset) ts.Language {
+    const lang_byte = if (rs.rule_count > 0) rs.rules[0].language else 1;
+    return switch (lang_byte) {
+        1 => .javascript,
+        2 => .typescript,
+        3 => .tsx,
+        else => .javascript,
+    };
+}
+
+/// Acquire a compiled pattern handle for every pattern node. `acquire` is
+/// main.zig's shared pattern cache, fn (text, language) u32 (0 = error), so
+/// a pattern used by several rules, or already compiled elsewhere, is
+/// parsed once.
+pub fn compilePatterns(rs: *CompiledRuleset, acquire: anytype) ?void {
+    const ts_lang = rulesetLanguage(rs);
     var ni: u16 = 0;
     while (ni < rs.node_count) : (ni += 1) {
         if (rs.nodes[ni].tag == .pattern) {
             const pat_str = rs.bytecode[rs.nodes[ni].str_offset..][0..rs.nodes[ni].str_len];
+            const handle = acquire(pat_str, ts_lang);
+            if (handle == 0) return null;
+            rs.nodes[ni].compiled_handle = handle;
+        }
+    }
+}
 
-            // Find a free compiled slot
-            var slot_idx: ?u32 = null;
-            for (0..64) |i| {
-                if (compiled_slots[i] == null) {
-                    slot_idx = @intCast(i);
-                    break;
-                }
-            }
-            const si = slot_idx orelse return null;
-
-            // For now, use the language from the first rule
-            const lang_byte = if (rs.rule_count > 0) rs.rules[0].language else 1;
-            const ts_lang: ts.Language = switch (lang_byte) {
-                1 => .javascript,
-                2 => .typescript,
-                3 => .tsx,
-                else => .javascript,
-            };
 
-            const parser = getOrInitParser(ts_lang) orelse return null;
-            var tree = parser.parse(pat_str) orelse {
-                parser.reset();
-                return null;
-            };
+// ── Query backend ────────────────────────────────────────
+
+/// Translate every pattern and kind node that can be (query.translate) into
+/// one tree-sitter query, so applyAndSerialize finds the candidates of all
+/// of them in a single cursor pass instead of one tree walk per node. Each
+/// piece is compiled alone first: a kind the grammar does not know fails
+/// there, and its node keeps the tree walk. So does a supertype kind, which
+/// a query would match against its subtypes but the walk never matches.
+/// Call after compilePatterns.
+pub fn compileQuery(rs: *CompiledRuleset, compiled_slots: anytype) void {
+    var text: std.ArrayList(u8) = .empty;
+    defer text.deinit(gpa);
+    const lang = rulesetLanguage(rs);
+
+    var patterns: u16 = 0;
+    for (rs.nodes[0..rs.node_count]) |*node| {
+        const start = text.items.len;
+        const ok = switch (node.tag) {
+            .pattern => blk: {
+                const handle = node.compiled_handle;
+                if (handle == 0 or handle > 64) break :blk false;
+                const slot = compiled_slots[handle - 1] orelse break :blk false;
+                break :blk query.translate(gpa, slot.tree.rootNode(), &text);
+            },
+            .kind => blk: {
+                const kind = rs.bytecode[node.str_offset..][0..node.str_len];
+                if (ts.isSupertype(lang, kind)) break :blk false;
+                break :blk query.translateKind(gpa, kind, &text);
+            },
+            else => false,
+        };
+        if (!ok) continue;
 
-            // Copy pattern source into stable memory
-            const owned = gpa.alloc(u8, pat_str.len) catch {
-                tree.deinit();
-                parser.reset();
-                return null;
-            };
-            @memcpy(owned, pat_str);
-            tree.source = owned;
+        var offset: u32 = 0;
+        var single = ts.Query.init(lang, text.items[start..], &offset) catch {
+            text.shrinkRetainingCapacity(start);
+            continue;
+        };
+        single.deinit();
+        text.append(gpa, '\n') catch return;
+        node.query_pattern = patterns;
+        patterns += 1;
+    }
+    if (patterns == 0) return;
 
-            parser.reset();
+    var offset: u32 = 0;
+    rs.query = ts.Query.init(lang, text.items, &offset) catch null;
+    rs.query_language = lang;
+}
 
-            compiled_slots[si] = .{
-                .tree = tree,
-                .lang = ts_lang,
-                .active = true,
-            };
+/// Free the ruleset's query (compileQuery).
+pub fn freeQuery(rs: *CompiledRuleset) void {
+    if (rs.query) |*q| q.deinit();
+    rs.query = null;
+}
 
-            rs.nodes[ni].compiled_handle = si + 1; // 1-based
-        }
+/// Run the ruleset's query over the tree; evaluate then takes the candidates
+/// of covered nodes from scratch.hits until endQueryPass. A loaded
+/// snapshot has no tree to query, so its rule nodes scan the snapshot; a
+/// tree of another grammar numbers its node kinds differently, so its rule
+/// nodes walk it.
+fn beginQueryPass(rs: *const CompiledRuleset, root: ts.Node, scratch: *Scratch) void {
+    if (runQuery(rs, root, &scratch.query_hits)) useQueryHits(rs, scratch.query_hits.items, scratch);
+}
+
+fn useQueryHits(rs: *const CompiledRuleset, hits: []const query.Hit, scratch: *Scratch) void {
+    scratch.hits = hits;
+    scratch.query_ruleset = rs;
+}
+
+fn endQueryPass(scratch: *Scratch) void {
+    scratch.query_ruleset = null;
+    scratch.hits = &.{};
+}
+
+/// Collect the hits of the ruleset's query over the tree into `hits`;
+/// false when the query does not run on it (see beginQueryPass).
+fn runQuery(rs: *const CompiledRuleset, root: ts.Node, hits: *std.ArrayListUnmanaged(query.Hit)) bool {
+    if (root.flat != null) return false;
+    const q = if (rs.query) |*compiled| compiled else return false;
+    const grammar = ts.grammar(rs.query_language) orelse return false;
+    const tree_grammar = ts.c.ts_node_language(root.node) orelse return false;
+    if (tree_grammar != grammar) return false;
+    hits.clearRetainingCapacity();
+    query.collectHits(q, root, hits);
+    return true;
+}
+
+/// One query pass over a tree, run before the partitions of an apply start
+/// and read by all of them (applyPartAndSerialize), so the tree is queried
+/// once rather than once per part. It also carries the prefilter's verdict
+/// from the context that ran it to the contexts applying the parts.
+pub const SharedPass = struct {
+    skip: SkipSet = [_]bool{false} ** MAX_RULES,
+    /// False when the query did not run; covered nodes walk the tree.
+    queried: bool = false,
+    hits: std.ArrayListUnmanaged(query.Hit) = .empty,
+};
+
+pub fn createSharedPass(rs: *const CompiledRuleset, root: ts.Node, skip: ?*const SkipSet) ?*SharedPass {
+    const pass = gpa.create(SharedPass) catch return null;
+    pass.* = .{};
+    if (skip) |set| pass.skip = set.*;
+    pass.queried = runQuery(rs, root, &pass.hits);
+    return pass;
+}
+
+pub fn freeSharedPass(pass: *SharedPass) void {
+    pass.hits.deinit(gpa);
+    gpa.destroy(pass);
+}
+
+/// Candidates for a rule node from the current query pass, or null when the
+/// node is not covered by it and must walk the tree.
+fn queryHits(rs: *const CompiledRuleset, node: RuleNode, scratch: *const Scratch) ?[]const query.Hit {
+    const active = scratch.query_ruleset orelse return null;
+    if (node.query_pattern == NO_QUERY or active != rs) return null;
+    return scratch.hits;
+}
+
+// ── Required literals ────────────────────────────────────
+
+/// Compute each rule's required literals from its compiled patterns.
+/// Call after compilePatterns; the sets point into the patterns' sources.
+pub fn computeLiterals(rs: *CompiledRuleset, compiled_slots: anytype) void {
+    for (rs.rules[0..rs.rule_count], 0..) |rule, ri| {
+        rs.required[ri] = nodeLiterals(rs, rule.root_node, compiled_slots, 0);
+    }
+}
+
+/// Literals every match of a rule node needs: `all` needs each child's,
+/// `any` only those common to every branch, and negations need nothing.
+fn nodeLiterals(rs: *const CompiledRuleset, node_idx: u16, compiled_slots: anytype, depth: u32) literals.Set {
+    if (depth > 32 or node_idx >= rs.node_count) return .{};
+    const node = rs.nodes[node_idx];
+    switch (node.tag) {
+        .pattern => {
+            const handle = node.compiled_handle;
+            if (handle == 0 or handle > 64) return .{};
+            const slot = compiled_slots[handle - 1] orelse return .{};
+            return slot.required;
+        },
+        .kind, .regex, .nth_child, .op_not => return .{},
+        .all => {
+            var set = literals.Set{};
+            for (rs.children[node.children_start..][0..node.children_count]) |child_idx| {
+                const child_set = nodeLiterals(rs, child_idx, compiled_slots, depth + 1);
+                set.merge(&child_set);
+            }
+            return set;
+        },
+        .any => {
+            if (node.children_count == 0) return .{};
+            const kids = rs.children[node.children_start..][0..node.children_count];
+            var set = nodeLiterals(rs, kids[0], compiled_slots, depth + 1);
+            for (kids[1..]) |child_idx| {
+                const child_set = nodeLiterals(rs, child_idx, compiled_slots, depth + 1);
+                set.intersect(&child_set);
+            }
+            return set;
+        },
+        .inside, .has, .follows, .precedes => return nodeLiterals(rs, node.child, compiled_slots, depth + 1),
+        .matches => {
+            if (node.ref_index >= rs.rule_count) return .{};
+            return nodeLiterals(rs, rs.rules[node.ref_index].root_node, compiled_slots, depth + 1);
+        },
     }
 }
 
+/// Per rule: ruled out by a prefilter call. Kept by the caller, not the
+/// ruleset, so contexts can prefilter different sources with one ruleset.
+pub const SkipSet = [MAX_RULES]bool;
+
+/// Check `source` for each rule's required literals, marking the rules that
+/// cannot match in `skip`. Returns how many rules remain; 0 means the
+/// source need not be parsed. A literal shared by several rules is scanned once.
+pub fn prefilter(rs: *const CompiledRuleset, source: []const u8, skip: *SkipSet) u16 {
+    var scanned: [MAX_RULES * literals.MAX_LITERALS][]const u8 = undefined;
+    var present: [MAX_RULES * literals.MAX_LITERALS]bool = undefined;
+    var scanned_count: usize = 0;
+
+    var live: u16 = 0;
+    for (0..rs.rule_count) |ri| {
+        var ok = true;
+        for (rs.required[ri].slice()) |lit| {
+            const found = for (scanned[0..scanned_count], 0..) |prev, k| {
+                if (std.mem.eql(u8, prev, lit)) break present[k];
+            } else blk: {
+                const hit = literals.contains(source, lit);
+                scanned[scanned_count] = lit;
+                present[scanned_count] = hit;
+                scanned_count += 1;
+                break :blk hit;
+            };
+            if (!found) {
+                ok = false;
+                break;
+            }
+        }
+        skip[ri] = !ok;
+        if (ok) live += 1;
+    }
+    return live;
+}
 
-/// Free all compiled pattern handles owned by this ruleset.
-pub fn freePatterns(rs: *CompiledRuleset, compiled_slots: anytype) void {
+/// Release the pattern handles this ruleset acquired (compilePatterns).
+pub fn freePatterns(rs: *CompiledRuleset, release: anytype) void {
     var ni: u16 = 0;
     while (ni < rs.node_count) : (ni += 1) {
         if (rs.nodes[ni].tag == .pattern and rs.nodes[ni].compiled_handle > 0) {
-            const handle = rs.nodes[ni].compiled_handle;
-            const idx = handle - 1;
-            if (compiled_slots[idx]) |*slot| {
-                gpa.free(slot.tree.source);
-                slot.tree.deinit();
-                compiled_slots[idx] = null;
-            }
+            release(rs.nodes[ni].compiled_handle);
             rs.nodes[ni].compiled_handle = 0;
         }
     }
@@ -505,16 +682,67 @@ pub fn freeConstraintRegexes(rs: *CompiledRuleset) void {
 // IMPORTANT: evaluate() writes to caller-provided *MatchList (output param)
 // instead of returning MatchList by value. This avoids 338KB stack
 // allocations per call frame, which would blow the WASM stack (~1MB).
-// A small static pool (eval_temp) is used for intermediate results
-// during all/any/not composition.
+// Intermediate results during all/any/not composition go to a Scratch
+// owned by the caller's engine context.
+
+/// Deepest nesting of all/any/matches evaluate() follows; deeper rule nodes
+/// (including `matches` cycles) evaluate to no matches.
+pub const MAX_EVAL_DEPTH = 32;
+
+/// Temporary match lists for rule evaluation, one per engine context (see
+/// main.zig), so independent callers and threads never share them. A nested
+/// all/any (directly or through `matches`) gets its own Level, so it cannot
+/// overwrite a list its caller is still reading.
+pub const Scratch = struct {
+    /// Child and relational results of the all/any at each nesting depth,
+    /// allocated on first use.
+    levels: [MAX_EVAL_DEPTH]?*Level = [_]?*Level{null} ** MAX_EVAL_DEPTH,
+    depth: u16 = 0,
+    /// Top-level rule output (apply, count, step).
+    merge: matcher.MatchList = .{},
+    /// Freshly re-searched matches of one rule (incremental apply).
+    incr: matcher.MatchList = .{},
+    /// Candidates from this context's query passes.
+    query_hits: std.ArrayListUnmanaged(query.Hit) = .empty,
+    /// Candidates of the apply in progress: query_hits, or a SharedPass's.
+    hits: []const query.Hit = &.{},
+    query_ruleset: ?*const CompiledRuleset = null,
+
+    pub const Level = struct {
+        child: matcher.MatchList = .{},
+        relational: matcher.MatchList = .{},
+    };
 
-// Static temp buffers for rule evaluation. Avoids putting 338KB MatchList
-// on the WASM stack (~1MB limit). Single-threaded, so no races.
-//   eval_child_temp: child results inside all/any evaluate loops
-//   eval_merge_temp: top-level rule output from applyAndSerialize
-var eval_child_temp: matcher.MatchList = .{};
-var eval_merge_temp: matcher.MatchList = .{};
-var eval_relational_temp: matcher.MatchList = .{};
+    /// Go one nesting level deeper; false past MAX_EVAL_DEPTH.
+    fn enter(self: *Scratch) bool {
+        if (self.depth >= MAX_EVAL_DEPTH) return false;
+        self.depth += 1;
+        return true;
+    }
+
+    fn leave(self: *Scratch) void {
+        self.depth -= 1;
+    }
+
+    /// The temporaries of the current nesting level (after enter()).
+    fn level(self: *Scratch) ?*Level {
+        const i = self.depth - 1;
+        if (self.levels[i]) |lvl| return lvl;
+        const lvl = gpa.create(Level) catch return null;
+        lvl.* = .{};
+        self.levels[i] = lvl;
+        return lvl;
+    }
+
+    pub fn deinit(self: *Scratch) void {
+        for (&self.levels) |*slot| {
+            if (slot.*) |lvl| gpa.destroy(lvl);
+            slot.* = null;
+        }
+        self.query_hits.deinit(gpa);
+        self.* = .{};
+    }
+};
 
 /// Classify whether a rule node tag is a relational operator (filter semantics).
 fn isRelationalTag(tag: RuleNodeTag) bool {
@@ -656,14 +884,20 @@ fn applyRelationalFilter(tag: RuleNodeTag, out: *matcher.MatchList, refs: *const
 }
 
 /// Evaluate a rule node against a source tree, writing matches to `out`.
+/// `out.limit` caps the result; leaf searches stop as soon as it is reached,
+/// while `all` evaluates its children in full and truncates afterwards.
 pub fn evaluate(
     rs: *const CompiledRuleset,
     node_idx: u16,
     source_root: ts.Node,
     compiled_slots: anytype,
+    scratch: *Scratch,
     out: *matcher.MatchList,
 ) void {
-    out.* = .{};
+    const limit = out.limit;
+    const tally = out.tally;
+    out.* = matcher.MatchList.withLimit(limit);
+    out.tally = tally;
     if (node_idx >= rs.node_count) return;
     const node = rs.nodes[node_idx];
 
@@ -672,14 +906,30 @@ pub fn evaluate(
             const handle = node.compiled_handle;
             if (handle > 0 and handle <= 64) {
                 if (compiled_slots[handle - 1]) |slot| {
-                    matcher.searchMatches(slot.tree.rootNode(), source_root, out, 0);
+                    if (queryHits(rs, node, scratch)) |hits| {
+                        // A translated pattern over-approximates; matchNode decides.
+                        for (hits) |h| {
+                            if (out.full()) break;
+                            if (h.pattern != node.query_pattern) continue;
+                            matcher.matchAt(slot.tree.rootNode(), .{ .node = h.node, .source = source_root.source }, out);
+                        }
+                    } else {
+                        matcher.searchMatches(slot.tree.rootNode(), source_root, out, 0);
+                    }
                 }
             }
         },
         .kind => {
+            if (queryHits(rs, node, scratch)) |hits| {
+                for (hits) |h| {
+                    if (out.full()) break;
+                    if (h.pattern == node.query_pattern) matcher.addMatchFromNode(.{ .node = h.node, .source = source_root.source }, out);
+                }
+                return;
+            }
             const kind_str = rs.bytecode[node.str_offset..][0..node.str_len];
             // Use collectByKindAll for comment types (extras invisible to namedChild)
-            if (std.mem.eql(u8, kind_str, "comment") or std.mem.eql(u8, kind_str, "html_comment")) {
+            if (isCommentKind(kind_str)) {
                 matcher.collectByKindAll(source_root, kind_str, out, 0);
             } else {
                 matcher.collectByKind(source_root, kind_str, out, 0);
@@ -696,31 +946,39 @@ pub fn evaluate(
         },
         .all => {
             if (node.children_count == 0) return;
+            if (!scratch.enter()) return;
+            defer scratch.leave();
+            const lvl = scratch.level() orelse return;
 
             // Phase 1: Evaluate primary children (non-relational) with intersection.
             var primary_initialized = false;
             var ci: u16 = 0;
             while (ci < node.children_count) : (ci += 1) {
-                const child_idx = children_pool[node.children_start + ci];
+                const child_idx = rs.children[node.children_start + ci];
                 const child_node = rs.nodes[child_idx];
                 if (isRelationalTag(child_node.tag)) continue;
 
-                evaluate(rs, child_idx, source_root, compiled_slots, &eval_child_temp);
+                evaluate(rs, child_idx, source_root, compiled_slots, scratch, &lvl.child);
                 if (!primary_initialized) {
-                    out.* = eval_child_temp;
+                    out.* = lvl.child;
                     primary_initialized = true;
                 } else {
-                    intersectInPlace(out, &eval_child_temp);
+                    intersectInPlace(out, &lvl.child);
                 }
             }
 
             // If no primary children, nothing to filter
             if (!primary_initialized) return;
+            // The children ran unlimited, so filters see every candidate.
+            defer {
+                out.limit = limit;
+                out.count = @min(out.count, limit);
+            }
 
             // Phase 2: Apply relational children as filters on primary matches.
             ci = 0;
             while (ci < node.children_count) : (ci += 1) {
-                const child_idx = children_pool[node.children_start + ci];
+                const child_idx = rs.children[node.children_start + ci];
                 const child_node = rs.nodes[child_idx];
                 if (!isRelationalTag(child_node.tag)) continue;
 
@@ -730,20 +988,23 @@ pub fn evaluate(
                         not_child.child
                     else
                         child_node.child;
-                    evaluate(rs, eval_target, source_root, compiled_slots, &eval_relational_temp);
-                    applyRelationalFilter(not_child.tag, out, &eval_relational_temp, true);
+                    evaluate(rs, eval_target, source_root, compiled_slots, scratch, &lvl.relational);
+                    applyRelationalFilter(not_child.tag, out, &lvl.relational, true);
                 } else {
-                    evaluate(rs, child_node.child, source_root, compiled_slots, &eval_relational_temp);
-                    applyRelationalFilter(child_node.tag, out, &eval_relational_temp, false);
+                    evaluate(rs, child_node.child, source_root, compiled_slots, scratch, &lvl.relational);
+                    applyRelationalFilter(child_node.tag, out, &lvl.relational, false);
                 }
             }
         },
         .any => {
+            if (!scratch.enter()) return;
+            defer scratch.leave();
+            const lvl = scratch.level() orelse return;
             var ci: u16 = 0;
-            while (ci < node.children_count) : (ci += 1) {
-                const child_idx = children_pool[node.children_start + ci];
-                evaluate(rs, child_idx, source_root, compiled_slots, &eval_child_temp);
-                unionInPlace(out, &eval_child_temp);
+            while (ci < node.children_count and !out.full()) : (ci += 1) {
+                const child_idx = rs.children[node.children_start + ci];
+                evaluate(rs, child_idx, source_root, compiled_slots, scratch, &lvl.child);
+                unionInPlace(out, &lvl.child);
             }
         },
         .op_not => {
@@ -752,12 +1013,14 @@ pub fn evaluate(
         },
         .inside, .has, .follows, .precedes => {
             // Standalone relational: pass-through to child evaluation.
-            evaluate(rs, node.child, source_root, compiled_slots, out);
+            evaluate(rs, node.child, source_root, compiled_slots, scratch, out);
         },
         .matches => {
             if (node.ref_index < rs.rule_count) {
+                if (!scratch.enter()) return;
+                defer scratch.leave();
                 const ref_rule = rs.rules[node.ref_index];
-                evaluate(rs, ref_rule.root_node, source_root, compiled_slots, out);
+                evaluate(rs, ref_rule.root_node, source_root, compiled_slots, scratch, out);
             }
         },
     }
@@ -766,7 +1029,14 @@ pub fn evaluate(
 /// Walk tree and collect nodes whose text matches a regex.
 /// Uses childCount()/child() to see ALL nodes including extras (comments).
 fn collectByRegex(source_root: ts.Node, compiled: *regex.Regex, matches: *matcher.MatchList, depth: u32) void {
-    if (depth > 200) return;
+    if (depth > 200 or matches.full()) return;
+    if (depth == 0) {
+        if (snapshot.lookup(source_root)) |pos| {
+            collectByRegexSnapshot(pos, source_root.source, compiled, matches);
+            return;
+        }
+    }
+    matcher.node_visits += 1;
 
     // Check if this node's text matches (leaf = no children at all)
     if (source_root.childCount() == 0) {
@@ -788,49 +1058,200 @@ fn collectByRegex(source_root: ts.Node, compiled: *regex.Regex, matches: *matche
     }
 }
 
+/// collectByRegex over a snapshot subtree: leaves are the entries without a
+/// first child, visited in one linear pass.
+fn collectByRegexSnapshot(pos: snapshot.Position, source: []const u8, compiled: *regex.Regex, matches: *matcher.MatchList) void {
+    const snap = pos.snap;
+    const hi = snap.subtree_end[pos.index];
+    matcher.node_visits += hi - pos.index;
+
+    var i = pos.index;
+    while (i < hi and !matches.full()) : (i += 1) {
+        if (snap.first_child[i] != snapshot.NONE or !matcher.walkReaches(pos, 0, i)) continue;
+        const sb = snap.start_byte[i];
+        const eb = snap.end_byte[i];
+        if (sb > eb or eb > source.len) continue;
+        const find_result: ?regex.Match = compiled.find(source[sb..eb]) catch null;
+        if (find_result) |m_val| {
+            var m_copy = m_val;
+            m_copy.deinit(gpa);
+            matcher.addMatchFromSnapshot(snap, i, matches);
+        }
+    }
+}
+
 /// Evaluate all rules in a ruleset and check constraints.
 fn evaluateRuleWithConstraints(
     rs: *const CompiledRuleset,
     rule: *const Rule,
     source_root: ts.Node,
     compiled_slots: anytype,
+    scratch: *Scratch,
     out: *matcher.MatchList,
 ) void {
-    evaluate(rs, rule.root_node, source_root, compiled_slots, out);
-
-    // Apply constraints (filter matches by metavariable regex).
-    // Reuses eval_child_temp as scratch space (safe: evaluate is done).
-    if (rule.constraints_count > 0) {
-        eval_child_temp = .{};
-        for (out.slice()) |m| {
-            var passes = true;
-            var ci: u16 = rule.constraints_start;
-            while (ci < rule.constraints_start + rule.constraints_count) : (ci += 1) {
-                const constraint = rs.constraints[ci];
-                const metavar_name = rs.bytecode[constraint.metavar_offset..][0..constraint.metavar_len];
-
-                if (m.bindings.get(metavar_name)) |value| {
-                    if (constraint.compiled_regex) |re| {
-                        const find_res: ?regex.Match = re.find(value) catch null;
-                        const matched = if (find_res) |f_val| blk: {
-                            var f_copy = f_val;
-                            f_copy.deinit(gpa);
-                            break :blk true;
-                        } else false;
-                        if (constraint.constraint_type == 0 and !matched) {
-                            passes = false;
-                            break;
-                        }
-                        if (constraint.constraint_type == 1 and matched) {
-                            passes = false;
-                            break;
-                        }
+    evaluate(rs, rule.root_node, source_root, compiled_slots, scratch, out);
+    applyConstraints(rs, rule, out);
+}
+
+/// Filter matches by the rule's metavariable regex constraints, in place.
+fn applyConstraints(rs: *const CompiledRuleset, rule: *const Rule, out: *matcher.MatchList) void {
+    if (rule.constraints_count == 0) return;
+    var kept: u32 = 0;
+    for (out.slice()) |m| {
+        var passes = true;
+        var ci: u16 = rule.constraints_start;
+        while (ci < rule.constraints_start + rule.constraints_count) : (ci += 1) {
+            const constraint = rs.constraints[ci];
+            const metavar_name = rs.bytecode[constraint.metavar_offset..][0..constraint.metavar_len];
+
+            if (m.bindings.get(metavar_name)) |value| {
+                if (constraint.compiled_regex) |re| {
+                    const find_res: ?regex.Match = re.find(value) catch null;
+                    const matched = if (find_res) |f_val| blk: {
+                        var f_copy = f_val;
+                        f_copy.deinit(gpa);
+                        break :blk true;
+                    } else false;
+                    if (constraint.constraint_type == 0 and !matched) {
+                        passes = false;
+                        break;
+                    }
+                    if (constraint.constraint_type == 1 and matched) {
+                        passes = false;
+                        break;
                     }
                 }
             }
-            if (passes) eval_child_temp.add(m);
         }
-        out.* = eval_child_temp;
+        if (passes) {
+            out.items[kept] = m;
+            kept += 1;
+        }
+    }
+    out.count = kept;
+}
+
+// ── Incremental evaluation ───────────────────────────────
+//
+// An IncrementalState caches every rule's findings for one (ruleset, source)
+// pair. edit_source shifts the cached matches across each edit and records
+// the dirty byte range (edit + tree-sitter's changed ranges). On the next
+// apply, rules whose matches depend only on the matched node's own subtree
+// ("local" rules) re-search just the smallest named node covering the dirty
+// range and re-test its ancestors; all other rules are re-evaluated in full.
+
+pub const IncrementalState = struct {
+    /// Identity of the ruleset load the cache was built for.
+    ruleset_key: u32,
+    /// One cached match list per rule, in source order.
+    findings: []matcher.MatchList,
+};
+
+/// Allocate an empty cache for `rs`. Caller owns the returned pointer.
+pub fn initIncremental(rs: *const CompiledRuleset, ruleset_key: u32) ?*IncrementalState {
+    const state = gpa.create(IncrementalState) catch return null;
+    const findings = gpa.alloc(matcher.MatchList, rs.rule_count) catch {
+        gpa.destroy(state);
+        return null;
+    };
+    for (findings) |*f| f.* = .{};
+    state.* = .{ .ruleset_key = ruleset_key, .findings = findings };
+    return state;
+}
+
+pub fn freeIncremental(state: *IncrementalState) void {
+    gpa.free(state.findings);
+    gpa.destroy(state);
+}
+
+/// Carry every cached finding across a source edit.
+pub fn shiftIncremental(state: *IncrementalState, e: matcher.Edit) void {
+    for (state.findings) |*f| matcher.shiftMatches(f, e);
+}
+
+/// A rule is local when each match is decided by the matched node's own
+/// subtree: patterns, kinds, regexes, and `any` over those. Relational
+/// operators, `not`, `all` (intersection), nthChild and `matches` look
+/// outside the node and always get a full re-evaluation.
+fn isLocalNode(rs: *const CompiledRuleset, node_idx: u16, allow_any: bool) bool {
+    const node = rs.nodes[node_idx];
+    return switch (node.tag) {
+        .pattern, .kind, .regex => true,
+        .any => blk: {
+            if (!allow_any) break :blk false;
+            var ci: u16 = 0;
+            while (ci < node.children_count) : (ci += 1) {
+                if (!isLocalNode(rs, rs.children[node.children_start + ci], false)) break :blk false;
+            }
+            break :blk true;
+        },
+        else => false,
+    };
+}
+
+fn isCommentKind(kind_str: []const u8) bool {
+    return std.mem.eql(u8, kind_str, "comment") or std.mem.eql(u8, kind_str, "html_comment");
+}
+
+/// Evaluate a local rule node over `region` and each of its ancestors.
+/// The region subtree is searched in full; ancestors are tested in place.
+fn evaluateLocal(
+    rs: *const CompiledRuleset,
+    node_idx: u16,
+    region: ts.Node,
+    compiled_slots: anytype,
+    scratch: *Scratch,
+    out: *matcher.MatchList,
+) void {
+    out.* = .{};
+    const node = rs.nodes[node_idx];
+
+    switch (node.tag) {
+        .pattern => {
+            const handle = node.compiled_handle;
+            if (handle > 0 and handle <= 64) {
+                if (compiled_slots[handle - 1]) |slot| {
+                    const pat_root = slot.tree.rootNode();
+                    var anc = region.parent();
+                    while (anc) |a| {
+                        matcher.matchAt(pat_root, a, out);
+                        anc = a.parent();
+                    }
+                    matcher.searchMatches(pat_root, region, out, 0);
+                }
+            }
+        },
+        .kind => {
+            const kind_str = rs.bytecode[node.str_offset..][0..node.str_len];
+            var anc = region.parent();
+            while (anc) |a| {
+                if (std.mem.eql(u8, a.nodeType(), kind_str)) matcher.addMatchFromNode(a, out);
+                anc = a.parent();
+            }
+            if (isCommentKind(kind_str)) {
+                matcher.collectByKindAll(region, kind_str, out, 0);
+            } else {
+                matcher.collectByKind(region, kind_str, out, 0);
+            }
+        },
+        .regex => {
+            // Regex rules only match leaves, so ancestors never qualify.
+            const regex_str = rs.bytecode[node.str_offset..][0..node.str_len];
+            var compiled = regex.Regex.compile(gpa, regex_str) catch return;
+            defer compiled.deinit();
+            collectByRegex(region, &compiled, out, 0);
+        },
+        .any => {
+            if (!scratch.enter()) return;
+            defer scratch.leave();
+            const lvl = scratch.level() orelse return;
+            var ci: u16 = 0;
+            while (ci < node.children_count) : (ci += 1) {
+                evaluateLocal(rs, rs.children[node.children_start + ci], region, compiled_slots, scratch, &lvl.child);
+                unionInPlace(out, &lvl.child);
+            }
+        },
+        else => {},
     }
 }
 
@@ -838,91 +1259,469 @@ fn evaluateRuleWithConstraints(
 
 const MAX_OUTPUT = 64 * 1024;
 
-/// Apply all rules and serialize results to JSON buffer.
+/// Apply all rules and serialize results to JSON buffer. With
+/// `skip` from prefilter(), the rules it rules out are not evaluated.
 pub fn applyAndSerialize(
     rs: *const CompiledRuleset,
     src_slot: anytype,
     compiled_slots: anytype,
+    scratch: *Scratch,
+    buf: *[MAX_OUTPUT]u8,
+    skip: ?*const SkipSet,
+) u32 {
+    return applyPartAndSerialize(rs, src_slot, compiled_slots, scratch, buf, skip, null, 0, 1);
+}
+
+/// applyAndSerialize over part `part` of `parts`: the rules to evaluate are
+/// split into contiguous runs of near-equal length, so the parts' findings,
+/// concatenated in part order, are the findings of the whole apply. The
+/// ruleset, tree and compiled patterns are only read, so parts can run on
+/// separate threads against one shared tree. Given the tree's `shared`
+/// pass, a part takes its query hits from there instead of querying.
+pub fn applyPartAndSerialize(
+    rs: *const CompiledRuleset,
+    src_slot: anytype,
+    compiled_slots: anytype,
+    scratch: *Scratch,
     buf: *[MAX_OUTPUT]u8,
+    skip: ?*const SkipSet,
+    shared: ?*const SharedPass,
+    part: u32,
+    parts: u32,
 ) u32 {
     var stream = std.io.fixedBufferStream(buf);
     var w = stream.writer();
 
     w.writeByte('[') catch return 0;
 
+    const none: SkipSet = [_]bool{false} ** MAX_RULES;
+    const skipped = skip orelse &none;
+    var live: u32 = 0;
+    for (skipped[0..rs.rule_count]) |ruled_out| {
+        if (!ruled_out) live += 1;
+    }
+    const lo = live * part / parts;
+    const hi = live * (part + 1) / parts;
+    if (lo >= hi) {
+        w.writeByte(']') catch return 0;
+        return @intCast(stream.pos);
+    }
+
+    const root = src_slot.tree.rootNode();
+    if (shared) |pass| {
+        if (pass.queried) useQueryHits(rs, pass.hits.items, scratch);
+    } else {
+        beginQueryPass(rs, root, scratch);
+    }
+    defer endQueryPass(scratch);
+
     var first_rule = true;
+    var ordinal: u32 = 0;
     var ri: u16 = 0;
     while (ri < rs.rule_count) : (ri += 1) {
+        if (skipped[ri]) continue;
+        ordinal += 1;
+        if (ordinal <= lo) continue;
+        if (ordinal > hi) break;
         const rule = &rs.rules[ri];
-        evaluateRuleWithConstraints(rs, rule, src_slot.tree.rootNode(), compiled_slots, &eval_merge_temp);
+        evaluateRuleWithConstraints(rs, rule, root, compiled_slots, scratch, &scratch.merge);
 
-        if (eval_merge_temp.count == 0) {
+        if (scratch.merge.count == 0) {
             continue;
         }
 
         if (!first_rule) w.writeByte(',') catch return 0;
         first_rule = false;
+        writeFinding(w, rs, rule, &scratch.merge) catch return 0;
+    }
+
+    w.writeByte(']') catch return 0;
+    return @intCast(stream.pos);
+}
 
-        // Write rule finding (camelCase to match TS Finding interface)
+/// Count every rule's matches and serialize them as a JSON array of
+/// {"ruleId","count","capped"}, one per rule, zero counts included. Rules
+/// that are a single pattern, kind, regex or nth-child node without
+/// constraints are counted into `tally` without collecting matches; other
+/// rules are evaluated as in apply, so their count stops at MAX_MATCHES and
+/// is marked capped there. Both paths count a byte range once, and a
+/// statement wrapping an expression match not at all (matcher.tryMatch), so
+/// a count equals the length of apply's uncapped match list.
+pub fn countAndSerialize(
+    rs: *const CompiledRuleset,
+    src_slot: anytype,
+    compiled_slots: anytype,
+    scratch: *Scratch,
+    buf: *[MAX_OUTPUT]u8,
+    tally: *matcher.Tally,
+) u32 {
+    var stream = std.io.fixedBufferStream(buf);
+    var w = stream.writer();
+
+    w.writeByte('[') catch return 0;
+
+    const root = src_slot.tree.rootNode();
+    beginQueryPass(rs, root, scratch);
+    defer endQueryPass(scratch);
+
+    var ri: u16 = 0;
+    while (ri < rs.rule_count) : (ri += 1) {
+        const rule = &rs.rules[ri];
+        var count: u32 = 0;
+        var capped = false;
+        if (isCountable(rs, rule)) {
+            tally.* = .{ .source = root.source };
+            scratch.merge.tally = tally;
+            evaluate(rs, rule.root_node, root, compiled_slots, scratch, &scratch.merge);
+            scratch.merge.tally = null;
+            count = tally.total;
+        } else {
+            evaluateRuleWithConstraints(rs, rule, root, compiled_slots, scratch, &scratch.merge);
+            count = scratch.merge.count;
+            capped = count >= matcher.MAX_MATCHES;
+        }
+
+        if (ri > 0) w.writeByte(',') catch return 0;
         w.writeAll("{\"ruleId\":\"") catch return 0;
         w.writeAll(rs.bytecode[rule.id_offset..][0..rule.id_len]) catch return 0;
-        w.writeAll("\",\"severity\":\"") catch return 0;
-        const sev_str = switch (rule.severity) {
-            SEV_ERROR => "error",
-            SEV_WARNING => "warning",
-            SEV_INFO => "info",
-            SEV_HINT => "hint",
-            else => "error",
-        };
-        w.writeAll(sev_str) catch return 0;
-        w.writeAll("\",\"message\":\"") catch return 0;
-        writeJsonEscaped(w, rs.bytecode[rule.message_offset..][0..rule.message_len]) catch return 0;
-        w.writeAll("\",\"matches\":[") catch return 0;
-
-        for (eval_merge_temp.slice(), 0..) |m, mi| {
-            if (mi > 0) w.writeByte(',') catch return 0;
-            w.writeAll("{\"start_row\":") catch return 0;
-            w.print("{d}", .{m.start_row}) catch return 0;
-            w.writeAll(",\"start_col\":") catch return 0;
-            w.print("{d}", .{m.start_col}) catch return 0;
-            w.writeAll(",\"end_row\":") catch return 0;
-            w.print("{d}", .{m.end_row}) catch return 0;
-            w.writeAll(",\"end_col\":") catch return 0;
-            w.print("{d}", .{m.end_col}) catch return 0;
-            w.writeAll(",\"start_byte\":") catch return 0;
-            w.print("{d}", .{m.start_byte}) catch return 0;
-            w.writeAll(",\"end_byte\":") catch return 0;
-            w.print("{d}", .{m.end_byte}) catch return 0;
-            w.writeAll(",\"bindings\":{") catch return 0;
-            var first_b = true;
-            for (m.bindings.items[0..m.bindings.count]) |b| {
-                if (!first_b) w.writeByte(',') catch return 0;
-                first_b = false;
-                w.writeByte('"') catch return 0;
-                w.writeAll(b.name[0..b.name_len]) catch return 0;
-                w.writeAll("\":\"") catch return 0;
-                writeJsonEscaped(w, b.text[0..b.text_len]) catch return 0;
-                w.writeByte('"') catch return 0;
+        w.print("\",\"count\":{d},\"capped\":{}}}", .{ count, capped }) catch return 0;
+    }
+
+    w.writeByte(']') catch return 0;
+    return @intCast(stream.pos);
+}
+
+/// Whether a rule's matches come straight from one tree search, so a tally
+/// sees every one of them (see countAndSerialize).
+fn isCountable(rs: *const CompiledRuleset, rule: *const Rule) bool {
+    if (rule.constraints_count > 0 or rule.root_node >= rs.node_count) return false;
+    return switch (rs.nodes[rule.root_node].tag) {
+        .pattern, .kind, .regex, .nth_child => true,
+        else => false,
+    };
+}
+
+// ── Resumable evaluation ─────────────────────────────────
+//
+// applyStep evaluates rules until a fuel budget is spent and keeps the JSON
+// written so far in a StepState, so the host can yield between steps. Fuel
+// is metered deterministically: one unit per rule plus one per source node
+// visited by the tree walks. A rule whose root is a pattern, kind or regex
+// is one walk, which a step suspends between nodes (see stepWalk); other
+// rules run whole, so a step may overdraw its fuel by the cost of one of
+// them. Every step makes progress.
+
+pub const StepState = struct {
+    ruleset_key: u32,
+    next_rule: u16 = 0,
+    first_rule: bool = true,
+    /// Bytes of `buf` written so far (starts after the opening '[').
+    pos: u32 = 1,
+    buf: [MAX_OUTPUT]u8 = undefined,
+    /// Where the walk of rule `next_rule` resumes, in preorder; null once
+    /// it is done. Only meaningful while `walking`.
+    walking: bool = false,
+    cursor: ?ts.Node = null,
+    cursor_depth: u32 = 0,
+    /// Matches the suspended walk has found so far.
+    matches: matcher.MatchList = .{},
+};
+
+pub const StepResult = enum { done, partial };
+
+pub fn initStep(ruleset_key: u32) ?*StepState {
+    const state = gpa.create(StepState) catch return null;
+    state.* = .{ .ruleset_key = ruleset_key };
+    state.buf[0] = '[';
+    return state;
+}
+
+pub fn freeStep(state: *StepState) void {
+    gpa.destroy(state);
+}
+
+/// Continue evaluating from where `state` left off. On .done the complete
+/// JSON array is copied to `buf` and its length stored in `out_len`
+/// (0 if the output overflowed, as with applyAndSerialize).
+pub fn applyStep(
+    rs: *const CompiledRuleset,
+    state: *StepState,
+    src_slot: anytype,
+    compiled_slots: anytype,
+    scratch: *Scratch,
+    fuel: u32,
+    buf: *[MAX_OUTPUT]u8,
+    out_len: *u32,
+) StepResult {
+    var stream = std.io.fixedBufferStream(&state.buf);
+    stream.pos = state.pos;
+    var w = stream.writer();
+    const root = src_slot.tree.rootNode();
+
+    var spent: u64 = 0;
+    while (state.next_rule < rs.rule_count) {
+        const rule = &rs.rules[state.next_rule];
+        var found = &scratch.merge;
+        if (isWalk(rs, rule)) {
+            if (!stepWalk(rs, rule.root_node, state, root, compiled_slots, fuel, &spent)) break;
+            applyConstraints(rs, rule, &state.matches);
+            found = &state.matches;
+        } else {
+            const visits_before = matcher.node_visits;
+            evaluateRuleWithConstraints(rs, rule, root, compiled_slots, scratch, &scratch.merge);
+            spent += matcher.node_visits - visits_before;
+        }
+        spent += 1;
+        state.next_rule += 1;
+
+        if (found.count > 0) {
+            if (!state.first_rule) w.writeByte(',') catch return overflowed(out_len);
+            state.first_rule = false;
+            writeFinding(w, rs, rule, found) catch return overflowed(out_len);
+        }
+
+        if (spent >= fuel) break;
+    }
+    state.pos = @intCast(stream.pos);
+    if (state.next_rule < rs.rule_count) return .partial;
+
+    w.writeByte(']') catch return overflowed(out_len);
+    const len: u32 = @intCast(stream.pos);
+    @memcpy(buf[0..len], state.buf[0..len]);
+    out_len.* = len;
+    return .done;
+}
+
+/// Rules whose matches come from one walk of the tree (see stepWalk).
+fn isWalk(rs: *const CompiledRuleset, rule: *const Rule) bool {
+    if (rule.root_node >= rs.node_count) return false;
+    return switch (rs.nodes[rule.root_node].tag) {
+        .pattern, .kind, .regex => true,
+        else => false,
+    };
+}
+
+/// Walk rule node `node_idx` (a pattern, kind or regex) from the state's
+/// cursor into state.matches until it is done (true) or `fuel` is spent
+/// (false, with the cursor saved). A subtree with no more nodes than the
+/// fuel left is searched in one call, at its own depth; a larger one has
+/// its root tested alone and the walk descends into it. The matches come
+/// out in the same preorder, under the same depth cap, as evaluate's.
+fn stepWalk(
+    rs: *const CompiledRuleset,
+    node_idx: u16,
+    state: *StepState,
+    root: ts.Node,
+    compiled_slots: anytype,
+    fuel: u32,
+    spent: *u64,
+) bool {
+    if (!state.walking) {
+        state.walking = true;
+        state.cursor = root;
+        state.cursor_depth = 0;
+        state.matches = .{};
+    }
+    defer {
+        if (state.cursor == null) state.walking = false;
+    }
+
+    const node = rs.nodes[node_idx];
+    const str = rs.bytecode[node.str_offset..][0..node.str_len];
+    var pat_root: ?ts.Node = null;
+    var compiled: ?regex.Regex = null;
+    defer if (compiled) |*re| re.deinit();
+    switch (node.tag) {
+        .pattern => {
+            const handle = node.compiled_handle;
+            if (handle > 0 and handle <= 64) {
+                if (compiled_slots[handle - 1]) |slot| pat_root = slot.tree.rootNode();
+            }
+            if (pat_root == null) state.cursor = null;
+        },
+        .regex => {
+            compiled = regex.Regex.compile(gpa, str) catch null;
+            if (compiled == null) state.cursor = null;
+        },
+        else => {},
+    }
+    // Comments are extras, which only the walks over all children see.
+    const all_children = node.tag == .regex or (node.tag == .kind and isCommentKind(str));
+
+    while (state.cursor) |n| {
+        const depth = state.cursor_depth;
+        if (depth > 200) {
+            advanceCursor(state, n, all_children);
+        } else if (n.descendantCount() <= fuel -| spent.*) {
+            const visits_before = matcher.node_visits;
+            switch (node.tag) {
+                .pattern => matcher.searchMatches(pat_root.?, n, &state.matches, depth),
+                .kind => if (all_children) {
+                    matcher.collectByKindAll(n, str, &state.matches, depth);
+                } else {
+                    matcher.collectByKind(n, str, &state.matches, depth);
+                },
+                .regex => collectByRegex(n, &compiled.?, &state.matches, depth),
+                else => {},
+            }
+            spent.* += matcher.node_visits - visits_before;
+            advanceCursor(state, n, all_children);
+        } else {
+            // Regexes only match leaves, which always fit in one call.
+            switch (node.tag) {
+                .pattern => matcher.matchAt(pat_root.?, n, &state.matches),
+                .kind => if (std.mem.eql(u8, n.nodeType(), str)) matcher.addMatchFromNode(n, &state.matches),
+                else => {},
+            }
+            matcher.node_visits += 1;
+            spent.* += 1;
+            const first = if (all_children) n.child(0) else n.namedChild(0);
+            if (first) |ch| {
+                state.cursor = ch;
+                state.cursor_depth = depth + 1;
+            } else {
+                advanceCursor(state, n, all_children);
             }
-            w.writeAll("}}") catch return 0;
         }
+        if (state.matches.full()) state.cursor = null;
+        if (state.cursor != null and spent.* >= fuel) return false;
+    }
+    return true;
+}
 
-        w.writeByte(']') catch return 0;
+/// Move the cursor past `n`'s subtree: to its next sibling, or to the next
+/// sibling of its nearest ancestor that has one, or to null at the root.
+fn advanceCursor(state: *StepState, n: ts.Node, all_children: bool) void {
+    var at = n;
+    while (state.cursor_depth > 0) {
+        const next = if (all_children) at.nextSibling() else at.nextNamedSibling();
+        if (next) |sib| {
+            state.cursor = sib;
+            return;
+        }
+        at = at.parent() orelse break;
+        state.cursor_depth -= 1;
+    }
+    state.cursor = null;
+}
+
+fn overflowed(out_len: *u32) StepResult {
+    out_len.* = 0;
+    return .done;
+}
+
+/// Incremental variant of applyAndSerialize. `dirty` is the byte range
+/// touched since the cache was last brought up to date (null = no edits);
+/// `fresh` forces a full evaluation to (re)build the cache.
+pub fn applyIncrementalAndSerialize(
+    rs: *const CompiledRuleset,
+    state: *IncrementalState,
+    src_slot: anytype,
+    dirty: ?matcher.Range,
+    fresh: bool,
+    compiled_slots: anytype,
+    scratch: *Scratch,
+    buf: *[MAX_OUTPUT]u8,
+) u32 {
+    const root = src_slot.tree.rootNode();
 
-        // Fix template
-        if (rule.fix_len > 0) {
-            w.writeAll(",\"fix\":\"") catch return 0;
-            writeJsonEscaped(w, rs.bytecode[rule.fix_offset..][0..rule.fix_len]) catch return 0;
-            w.writeByte('"') catch return 0;
+    var ri: u16 = 0;
+    while (ri < rs.rule_count) : (ri += 1) {
+        const rule = &rs.rules[ri];
+        const cached = &state.findings[ri];
+
+        if (!fresh) {
+            const d = dirty orelse continue;
+            // A cache that hit MAX_MATCHES may be hiding matches that an
+            // edit would now expose, so it cannot be patched locally.
+            if (isLocalNode(rs, rule.root_node, true) and cached.count < matcher.MAX_MATCHES) {
+                const region = root.namedDescendantForByteRange(d.start_byte, d.end_byte) orelse root;
+                matcher.dropOverlapping(cached, region.startByte(), region.endByte());
+                evaluateLocal(rs, rule.root_node, region, compiled_slots, scratch, &scratch.incr);
+                applyConstraints(rs, rule, &scratch.incr);
+                unionInPlace(cached, &scratch.incr);
+                matcher.sortSourceOrder(cached);
+                continue;
+            }
         }
 
-        w.writeByte('}') catch return 0;
+        evaluateRuleWithConstraints(rs, rule, root, compiled_slots, scratch, cached);
+        matcher.sortSourceOrder(cached);
     }
 
+    var stream = std.io.fixedBufferStream(buf);
+    var w = stream.writer();
+
+    w.writeByte('[') catch return 0;
+    var first_rule = true;
+    ri = 0;
+    while (ri < rs.rule_count) : (ri += 1) {
+        if (state.findings[ri].count == 0) continue;
+        if (!first_rule) w.writeByte(',') catch return 0;
+        first_rule = false;
+        writeFinding(w, rs, &rs.rules[ri], &state.findings[ri]) catch return 0;
+    }
     w.writeByte(']') catch return 0;
     return @intCast(stream.pos);
 }
 
+/// Write one rule's finding object (camelCase to match TS Finding interface).
+fn writeFinding(w: anytype, rs: *const CompiledRuleset, rule: *const Rule, list: *const matcher.MatchList) !void {
+    try w.writeAll("{\"ruleId\":\"");
+    try w.writeAll(rs.bytecode[rule.id_offset..][0..rule.id_len]);
+    try w.writeAll("\",\"severity\":\"");
+    const sev_str = switch (rule.severity) {
+        SEV_ERROR => "error",
+        SEV_WARNING => "warning",
+        SEV_INFO => "info",
+        SEV_HINT => "hint",
+        else => "error",
+    };
+    try w.writeAll(sev_str);
+    try w.writeAll("\",\"message\":\"");
+    try writeJsonEscaped(w, rs.bytecode[rule.message_offset..][0..rule.message_len]);
+    try w.writeAll("\",\"matches\":[");
+
+    for (list.slice(), 0..) |m, mi| {
+        if (mi > 0) try w.writeByte(',');
+        try w.writeAll("{\"start_row\":");
+        try w.print("{d}", .{m.start_row});
+        try w.writeAll(",\"start_col\":");
+        try w.print("{d}", .{m.start_col});
+        try w.writeAll(",\"end_row\":");
+        try w.print("{d}", .{m.end_row});
+        try w.writeAll(",\"end_col\":");
+        try w.print("{d}", .{m.end_col});
+        try w.writeAll(",\"start_byte\":");
+        try w.print("{d}", .{m.start_byte});
+        try w.writeAll(",\"end_byte\":");
+        try w.print("{d}", .{m.end_byte});
+        try w.writeAll(",\"bindings\":{");
+        var first_b = true;
+        for (m.bindings.items[0..m.bindings.count]) |b| {
+            if (!first_b) try w.writeByte(',');
+            first_b = false;
+            try w.writeByte('"');
+            try w.writeAll(b.name[0..b.name_len]);
+            try w.writeAll("\":\"");
+            try writeJsonEscaped(w, b.text[0..b.text_len]);
+            try w.writeByte('"');
+        }
+        try w.writeAll("}}");
+    }
+
+    try w.writeByte(']');
+
+    // Fix template
+    if (rule.fix_len > 0) {
+        try w.writeAll(",\"fix\":\"");
+        try writeJsonEscaped(w, rs.bytecode[rule.fix_offset..][0..rule.fix_len]);
+        try w.writeByte('"');
+    }
+
+    try w.writeByte('}');
+}
+
 fn writeJsonEscaped(w: anytype, s: []const u8) !void {
     for (s) |c_byte| {
         switch (c_byte) {
@@ -1092,3 +1891,138 @@ test "rule_engine decode all/any composition" {
     try std.testing.expect(rs.node_count >= 3); // ALL + PATTERN + NOT(KIND)
     try std.testing.expectEqual(RuleNodeTag.all, rs.nodes[rs.rules[0].root_node].tag);
 }
+
+/// Append a rule header (no constraints or transforms); its body follows.
+fn appendRuleHeader(buf: []u8, pos: *usize, id: []const u8) void {
+    buf[pos.*] = OP_RULE;
+    pos.* += 1;
+    for ([_][]const u8{ id, "msg" }, 0..) |str, i| {
+        std.mem.writeInt(u16, buf[pos.*..][0..2], @intCast(str.len), .little);
+        pos.* += 2;
+        @memcpy(buf[pos.*..][0..str.len], str);
+        pos.* += str.len;
+        if (i == 0) {
+            buf[pos.*] = SEV_INFO;
+            pos.* += 1;
+        }
+    }
+    buf[pos.*] = 1; // javascript
+    pos.* += 1;
+    @memset(buf[pos.*..][0..4], 0); // 0 constraints, 0 transforms
+    pos.* += 4;
+}
+
+/// Append an OP_KIND node.
+fn appendKindNode(buf: []u8, pos: *usize, kind: []const u8) void {
+    buf[pos.*] = OP_KIND;
+    pos.* += 1;
+    std.mem.writeInt(u16, buf[pos.*..][0..2], @intCast(kind.len), .little);
+    pos.* += 2;
+    @memcpy(buf[pos.*..][0..kind.len], kind);
+    pos.* += kind.len;
+}
+
+/// Append an OP_ALL or OP_ANY header over `count` children, which follow.
+fn appendListNode(buf: []u8, pos: *usize, op: u8, count: u16) void {
+    buf[pos.*] = op;
+    pos.* += 1;
+    std.mem.writeInt(u16, buf[pos.*..][0..2], count, .little);
+    pos.* += 2;
+}
+
+/// Append a rule whose body is OP_KIND `kind`.
+fn appendKindRule(buf: []u8, pos: *usize, id: []const u8, kind: []const u8) void {
+    appendRuleHeader(buf, pos, id);
+    appendKindNode(buf, pos, kind);
+}
+
+/// Append an OP_RULESET header for `count` rules, which follow.
+fn appendRulesetHeader(buf: []u8, pos: *usize, count: u16) void {
+    buf[pos.*] = OP_RULESET;
+    pos.* += 1;
+    std.mem.writeInt(u16, buf[pos.*..][0..2], 1, .little);
+    pos.* += 2;
+    std.mem.writeInt(u16, buf[pos.*..][0..2], count, .little);
+    pos.* += 2;
+}
+
+test "rule_engine partitions concatenate to the whole apply" {
+    const kinds = [_][]const u8{ "call_expression", "identifier", "number", "string", "arguments" };
+    var buf: [512]u8 = undefined;
+    var pos: usize = 0;
+    appendRulesetHeader(&buf, &pos, kinds.len);
+    for (kinds) |kind| appendKindRule(&buf, &pos, kind, kind);
+
+    var rs = decode(buf[0..pos]) orelse return error.TestUnexpectedResult;
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    var tree = parser.parse("f(1); g(x, 'y');") orelse return;
+    defer tree.deinit();
+    const Slot = struct { tree: ts.Tree };
+    const src = Slot{ .tree = tree };
+    const no_patterns = [_]?Slot{null};
+    compileQuery(&rs, &no_patterns);
+    defer freeQuery(&rs);
+    var scratch: Scratch = .{};
+    defer scratch.deinit();
+
+    var whole: [MAX_OUTPUT]u8 = undefined;
+    const whole_len = applyAndSerialize(&rs, &src, &no_patterns, &scratch, &whole, null);
+
+    const pass = createSharedPass(&rs, tree.rootNode(), null) orelse return error.OutOfMemory;
+    defer freeSharedPass(pass);
+    try std.testing.expect(pass.queried);
+
+    // Three parts over five rules, each querying the tree or all reading
+    // one shared pass: the parts' arrays, joined, are the whole array.
+    for ([_]?*const SharedPass{ null, pass }) |shared| {
+        var joined: std.ArrayListUnmanaged(u8) = .empty;
+        defer joined.deinit(std.testing.allocator);
+        var part_buf: [MAX_OUTPUT]u8 = undefined;
+        for (0..3) |part| {
+            const n = applyPartAndSerialize(&rs, &src, &no_patterns, &scratch, &part_buf, null, shared, @intCast(part), 3);
+            const body = part_buf[1 .. n - 1];
+            if (body.len == 0) continue;
+            if (joined.items.len > 0) try joined.append(std.testing.allocator, ',');
+            try joined.appendSlice(std.testing.allocator, body);
+        }
+        try std.testing.expectEqualStrings(whole[1 .. whole_len - 1], joined.items);
+    }
+}
+
+test "rule_engine nested all through matches keeps its own scratch" {
+    // outer: all[kind call_expression, matches inner]
+    // inner: all[kind identifier, kind call_expression], which nothing matches.
+    var buf: [512]u8 = undefined;
+    var pos: usize = 0;
+    appendRulesetHeader(&buf, &pos, 2);
+    appendRuleHeader(&buf, &pos, "outer");
+    appendListNode(&buf, &pos, OP_ALL, 2);
+    appendKindNode(&buf, &pos, "call_expression");
+    buf[pos] = OP_MATCHES;
+    pos += 1;
+    std.mem.writeInt(u16, buf[pos..][0..2], 1, .little);
+    pos += 2;
+    appendRuleHeader(&buf, &pos, "inner");
+    appendListNode(&buf, &pos, OP_ALL, 2);
+    appendKindNode(&buf, &pos, "identifier");
+    appendKindNode(&buf, &pos, "call_expression");
+
+    const rs = decode(buf[0..pos]) orelse return error.TestUnexpectedResult;
+    var parser = ts.Parser.init(.javascript) orelse return;
+    defer parser.deinit();
+    var tree = parser.parse("f(1); g(x);") orelse return;
+    defer tree.deinit();
+    const Slot = struct { tree: ts.Tree };
+    const src = Slot{ .tree = tree };
+    const no_patterns = [_]?Slot{null};
+    var scratch: Scratch = .{};
+    defer scratch.deinit();
+
+    // Sharing one child list across depths made inner return its last
+    // child's matches, and outer with it.
+    var out: [MAX_OUTPUT]u8 = undefined;
+    const len = applyAndSerialize(&rs, &src, &no_patterns, &scratch, &out, null);
+    try std.testing.expectEqualStrings("[]", out[0..len]);
+    try std.testing.expectEqual(@as(u16, 0), scratch.depth);
+}
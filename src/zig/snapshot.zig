@@ -0,0 +1,592 @@
+///! snapshot.zig — Flattened struct-of-arrays copy of a parsed tree.
+///!
+///! Every visible node is laid out in preorder, one column per field, so
+///! a subtree is the contiguous index run [i, subtree_end[i]) and a tree
+///! walk becomes a linear scan. Kinds are tree-sitter public symbols (one
+///! id per name and named-ness), stored as contiguous u16s and compared
+///! eight at a time with simd128.
+///!
+///! Snapshots are built on request (snapshot_source) and registered by
+///! tree, so the matcher's walks find them from any node of that tree
+///! without callers threading them through. A snapshot is only valid for
+///! the exact tree it was built from; edit_source and free_source drop it.
+///!
+///! save() writes the columns that cannot be derived (kind, named, byte
+///! range, parent) for the scan cache; load() uses them in place and
+///! derives the rest, giving a snapshot with no tree behind it. Its nodes
+///! are ts.Node values that read the columns (ts.Node.flat), so the
+///! matcher and rule engine run on it unchanged.
+const std = @import("std");
+const ts = @import("ts_bridge.zig");
+const gpa = @import("alloc.zig").gpa;
+const c = ts.c;
+
+/// Sentinel for "no node" in the link columns.
+pub const NONE: u32 = std.math.maxInt(u32);
+
+/// Kind id that no visible node has (tree-sitter's end-of-input symbol).
+pub const NO_KIND: u16 = 0;
+
+/// tree-sitter's ts_builtin_sym_error: the kind of ERROR nodes.
+const ERROR_KIND: u16 = std.math.maxInt(u16);
+
+const KIND_LANES = 8;
+const KindVec = @Vector(KIND_LANES, u16);
+
+pub const Snapshot = struct {
+    arena: std.heap.ArenaAllocator,
+    /// The tree flattened, or null for a snapshot from load().
+    tree: ?*const c.TSTree,
+    language: *const c.TSLanguage,
+    len: u32,
+    source_len: u32,
+
+    kind: []u16,
+    named: []bool,
+    start_byte: []u32,
+    end_byte: []u32,
+    start_row: []u32,
+    start_col: []u32,
+    end_row: []u32,
+    end_col: []u32,
+    parent: []u32,
+    first_child: []u32,
+    next_sibling: []u32,
+    prev_sibling: []u32,
+    /// One past the last preorder index of the node's subtree.
+    subtree_end: []u32,
+    /// Ancestors of the node: its depth below the root, as the tree walks
+    /// count it.
+    depth: []u32,
+    /// The tree-sitter node for each entry, for structural comparison
+    /// (empty without a tree).
+    nodes: []c.TSNode,
+    /// Children of node i are child_list[child_offset[i]..child_offset[i + 1]]
+    /// (named ones likewise in named_list), so child(i, k) is one load.
+    child_offset: []u32,
+    child_list: []u32,
+    named_offset: []u32,
+    named_list: []u32,
+
+    /// Flatten `tree`. Returns null when out of memory.
+    pub fn build(tree: *const ts.Tree) ?*Snapshot {
+        const self = gpa.create(Snapshot) catch return null;
+        self.arena = std.heap.ArenaAllocator.init(gpa);
+        self.fill(tree) catch {
+            self.arena.deinit();
+            gpa.destroy(self);
+            return null;
+        };
+        return self;
+    }
+
+    pub fn deinit(self: *Snapshot) void {
+        self.arena.deinit();
+        gpa.destroy(self);
+    }
+
+    fn fill(self: *Snapshot, tree: *const ts.Tree) !void {
+        const a = self.arena.allocator();
+        const root = c.ts_tree_root_node(tree.tree);
+        const n = c.ts_node_descendant_count(root);
+
+        self.tree = tree.tree;
+        self.language = c.ts_tree_language(tree.tree) orelse return error.NoLanguage;
+        self.len = 0;
+        self.source_len = @intCast(tree.source.len);
+        self.kind = try a.alloc(u16, n);
+        self.named = try a.alloc(bool, n);
+        self.start_byte = try a.alloc(u32, n);
+        self.end_byte = try a.alloc(u32, n);
+        self.start_row = try a.alloc(u32, n);
+        self.start_col = try a.alloc(u32, n);
+        self.end_row = try a.alloc(u32, n);
+        self.end_col = try a.alloc(u32, n);
+        self.parent = try a.alloc(u32, n);
+        self.first_child = try a.alloc(u32, n);
+        self.next_sibling = try a.alloc(u32, n);
+        self.prev_sibling = try a.alloc(u32, n);
+        self.subtree_end = try a.alloc(u32, n);
+        self.depth = try a.alloc(u32, n);
+        self.nodes = try a.alloc(c.TSNode, n);
+
+        // Open ancestors of the cursor, innermost last, and the most recent
+        // child seen under each.
+        var ancestors: std.ArrayList(u32) = .empty;
+        defer ancestors.deinit(gpa);
+        var last_child: std.ArrayList(u32) = .empty;
+        defer last_child.deinit(gpa);
+
+        var cursor = c.ts_tree_cursor_new(root);
+        defer c.ts_tree_cursor_delete(&cursor);
+
+        while (true) {
+            if (self.len == n) return error.CountMismatch;
+            const i = self.len;
+            self.visit(i, c.ts_tree_cursor_current_node(&cursor));
+            self.depth[i] = @intCast(ancestors.items.len);
+
+            if (ancestors.items.len > 0) {
+                const top = ancestors.items.len - 1;
+                const p = ancestors.items[top];
+                self.parent[i] = p;
+                const prev = last_child.items[top];
+                if (prev == NONE) self.first_child[p] = i else self.next_sibling[prev] = i;
+                self.prev_sibling[i] = prev;
+                last_child.items[top] = i;
+            }
+            self.len += 1;
+
+            if (c.ts_tree_cursor_goto_first_child(&cursor)) {
+                try ancestors.append(gpa, i);
+                try last_child.append(gpa, NONE);
+                continue;
+            }
+            while (!c.ts_tree_cursor_goto_next_sibling(&cursor)) {
+                if (!c.ts_tree_cursor_goto_parent(&cursor)) return self.indexChildren(a);
+                const p = ancestors.pop().?;
+                _ = last_child.pop();
+                self.subtree_end[p] = self.len;
+            }
+        }
+    }
+
+    /// Build the child_* / named_* index from the parent column. Children
+    /// come out in sibling order because preorder indices ascend.
+    fn indexChildren(self: *Snapshot, a: std.mem.Allocator) !void {
+        const n = self.len;
+        self.child_offset = try a.alloc(u32, n + 1);
+        self.named_offset = try a.alloc(u32, n + 1);
+        @memset(self.child_offset, 0);
+        @memset(self.named_offset, 0);
+        var named_total: u32 = 0;
+        for (self.parent[0..n], self.named[0..n]) |p, is_named| {
+            if (p == NONE) continue;
+            self.child_offset[p + 1] += 1;
+            if (is_named) {
+                self.named_offset[p + 1] += 1;
+                named_total += 1;
+            }
+        }
+        for (1..n + 1) |i| {
+            self.child_offset[i] += self.child_offset[i - 1];
+            self.named_offset[i] += self.named_offset[i - 1];
+        }
+
+        self.child_list = try a.alloc(u32, self.child_offset[n]);
+        self.named_list = try a.alloc(u32, named_total);
+        // Fill cursors, one per parent, starting at each parent's offset.
+        const child_fill = try a.dupe(u32, self.child_offset[0..n]);
+        const named_fill = try a.dupe(u32, self.named_offset[0..n]);
+        for (self.parent[0..n], self.named[0..n], 0..) |p, is_named, i| {
+            if (p == NONE) continue;
+            self.child_list[child_fill[p]] = @intCast(i);
+            child_fill[p] += 1;
+            if (is_named) {
+                self.named_list[named_fill[p]] = @intCast(i);
+                named_fill[p] += 1;
+            }
+        }
+    }
+
+    fn visit(self: *Snapshot, i: u32, n: c.TSNode) void {
+        const sp = c.ts_node_start_point(n);
+        const ep = c.ts_node_end_point(n);
+        self.kind[i] = c.ts_node_symbol(n);
+        self.named[i] = c.ts_node_is_named(n);
+        self.start_byte[i] = c.ts_node_start_byte(n);
+        self.end_byte[i] = c.ts_node_end_byte(n);
+        self.start_row[i] = sp.row;
+        self.start_col[i] = sp.column;
+        self.end_row[i] = ep.row;
+        self.end_col[i] = ep.column;
+        self.parent[i] = NONE;
+        self.first_child[i] = NONE;
+        self.next_sibling[i] = NONE;
+        self.prev_sibling[i] = NONE;
+        self.subtree_end[i] = i + 1;
+        self.nodes[i] = n;
+    }
+
+    /// Kind id for a node type name, or NO_KIND if the grammar has none.
+    pub fn kindId(self: *const Snapshot, name: []const u8, named: bool) u16 {
+        // ts_language_symbol_for_name compares "ERROR" by prefix only.
+        if (named and name.len < 5 and std.mem.startsWith(u8, "ERROR", name)) return NO_KIND;
+        return c.ts_language_symbol_for_name(self.language, name.ptr, @intCast(name.len), named);
+    }
+
+    pub fn kindName(self: *const Snapshot, i: u32) []const u8 {
+        const name = c.ts_language_symbol_name(self.language, self.kind[i]);
+        return if (name == null) "" else std.mem.span(name);
+    }
+
+    pub fn tsNode(self: *const Snapshot, i: u32, source: []const u8) ts.Node {
+        if (self.tree == null) return .{ .node = std.mem.zeroes(c.TSNode), .source = source, .flat = self, .index = i };
+        return .{ .node = self.nodes[i], .source = source };
+    }
+
+    /// First index in [from, to) whose kind is `a` or `b`, or `to` if none.
+    /// Compares KIND_LANES kinds per step.
+    pub fn nextKind(self: *const Snapshot, from: u32, to: u32, a: u16, b: u16) u32 {
+        const a_vec: KindVec = @splat(a);
+        const b_vec: KindVec = @splat(b);
+        var i = from;
+        while (i + KIND_LANES <= to) : (i += KIND_LANES) {
+            const kinds: KindVec = self.kind[i..][0..KIND_LANES].*;
+            const hits = (kinds == a_vec) | (kinds == b_vec);
+            if (@reduce(.Or, hits)) {
+                const mask: u8 = @bitCast(hits);
+                return i + @ctz(mask);
+            }
+        }
+        while (i < to) : (i += 1) {
+            if (self.kind[i] == a or self.kind[i] == b) return i;
+        }
+        return to;
+    }
+
+    /// First index whose start byte is >= `byte` (preorder start bytes never decrease).
+    pub fn lowerBound(self: *const Snapshot, byte: u32) u32 {
+        var lo: u32 = 0;
+        var hi: u32 = self.len;
+        while (lo < hi) {
+            const mid = lo + (hi - lo) / 2;
+            if (self.start_byte[mid] < byte) lo = mid + 1 else hi = mid;
+        }
+        return lo;
+    }
+
+    /// Preorder index of a node of this snapshot's tree.
+    pub fn indexOf(self: *const Snapshot, n: ts.Node) ?u32 {
+        if (n.flat) |flat| return if (flat == self) n.index else null;
+        if (n.node.tree != self.tree) return null;
+        var i = self.lowerBound(n.startByte());
+        while (i < self.len and self.start_byte[i] == n.startByte()) : (i += 1) {
+            if (self.nodes[i].id == n.node.id) return i;
+        }
+        return null;
+    }
+
+    /// Outermost named node spanning exactly [start, end).
+    pub fn outermostAt(self: *const Snapshot, start: u32, end: u32) ?u32 {
+        var i = self.lowerBound(start);
+        while (i < self.len and self.start_byte[i] == start) : (i += 1) {
+            if (self.end_byte[i] == end and self.named[i]) return i;
+        }
+        return null;
+    }
+
+    /// Innermost node (named or not) spanning exactly [start, end).
+    pub fn innermostAt(self: *const Snapshot, start: u32, end: u32) ?u32 {
+        var found: ?u32 = null;
+        var i = self.lowerBound(start);
+        while (i < self.len and self.start_byte[i] == start) : (i += 1) {
+            if (self.end_byte[i] == end) found = i;
+        }
+        return found;
+    }
+
+    /// Children of `i`, all or named only, in sibling order.
+    pub fn children(self: *const Snapshot, i: u32, named_only: bool) []const u32 {
+        return if (named_only)
+            self.named_list[self.named_offset[i]..self.named_offset[i + 1]]
+        else
+            self.child_list[self.child_offset[i]..self.child_offset[i + 1]];
+    }
+
+    /// The k-th child of `i` (all or named only), or NONE.
+    pub fn child(self: *const Snapshot, i: u32, k: u32, named_only: bool) u32 {
+        const list = self.children(i, named_only);
+        return if (k < list.len) list[k] else NONE;
+    }
+
+    /// Next (or previous) named sibling of `i`, or NONE.
+    pub fn namedSibling(self: *const Snapshot, i: u32, forward: bool) u32 {
+        var s = if (forward) self.next_sibling[i] else self.prev_sibling[i];
+        while (s != NONE and !self.named[s]) {
+            s = if (forward) self.next_sibling[s] else self.prev_sibling[s];
+        }
+        return s;
+    }
+
+    /// Whether the subtree of `i` has an ERROR node. MISSING nodes are
+    /// zero-width tokens the snapshot does not mark, so unlike
+    /// ts_node_has_error they do not count.
+    pub fn hasError(self: *const Snapshot, i: u32) bool {
+        return std.mem.indexOfScalar(u16, self.kind[i..self.subtree_end[i]], ERROR_KIND) != null;
+    }
+
+    /// Smallest node in the subtree of `i` (named only, or any) spanning
+    /// [start, end), chosen as ts_node_descendant_for_byte_range does.
+    pub fn descendantFor(self: *const Snapshot, i: u32, start: u32, end: u32, named_only: bool) u32 {
+        var found = i;
+        var node = i;
+        descend: while (true) {
+            for (self.children(node, false)) |ch| {
+                const ch_end = self.end_byte[ch];
+                if (ch_end < end) continue;
+                const empty = self.start_byte[ch] == ch_end;
+                if (if (empty) ch_end < start else ch_end <= start) continue;
+                if (start < self.start_byte[ch]) break;
+                node = ch;
+                if (!named_only or self.named[ch]) found = ch;
+                continue :descend;
+            }
+            return found;
+        }
+    }
+
+    // ── Saved form ────────────────────────────────────────────
+    //
+    // A 32-byte header (magic, FORMAT_VERSION, grammar stamp, node count,
+    // source length), then the start_byte, end_byte and parent columns as
+    // u32s, kind as u16s and named as bytes, little-endian: 15 bytes a
+    // node. The grammar stamp ties it to one grammar build.
+
+    /// Bytes save() writes for a snapshot of `n` nodes.
+    pub fn savedLen(n: u32) usize {
+        return HEADER_LEN + @as(usize, n) * 15;
+    }
+
+    /// Length of the saved snapshot at the start of `bytes`, going by its
+    /// header, or null if `bytes` does not start with a whole one.
+    pub fn savedLenAt(bytes: []const u8) ?usize {
+        if (bytes.len < HEADER_LEN or std.mem.readInt(u32, bytes[0..4], .little) != MAGIC) return null;
+        const len = savedLen(std.mem.readInt(u32, bytes[16..20], .little));
+        return if (len <= bytes.len) len else null;
+    }
+
+    /// Append the saved form of this snapshot to `out`.
+    pub fn save(self: *const Snapshot, out: *std.ArrayListUnmanaged(u8), allocator: std.mem.Allocator) !void {
+        const n = self.len;
+        try out.ensureUnusedCapacity(allocator, savedLen(n));
+        const stamp = grammarStamp(self.language);
+        const header = [HEADER_LEN / 4]u32{ MAGIC, FORMAT_VERSION, @truncate(stamp), @truncate(stamp >> 32), n, self.source_len, 0, 0 };
+        for (header) |word| out.appendSliceAssumeCapacity(&std.mem.toBytes(std.mem.nativeToLittle(u32, word)));
+        out.appendSliceAssumeCapacity(std.mem.sliceAsBytes(self.start_byte[0..n]));
+        out.appendSliceAssumeCapacity(std.mem.sliceAsBytes(self.end_byte[0..n]));
+        out.appendSliceAssumeCapacity(std.mem.sliceAsBytes(self.parent[0..n]));
+        out.appendSliceAssumeCapacity(std.mem.sliceAsBytes(self.kind[0..n]));
+        out.appendSliceAssumeCapacity(std.mem.sliceAsBytes(self.named[0..n]));
+    }
+
+    /// Rebuild a saved snapshot of `source` without parsing. The saved
+    /// columns are used in place, so `bytes` must outlive the snapshot
+    /// (bytes that are not 4-byte aligned are copied first). Returns null
+    /// when `bytes` is malformed, or was saved for another source length,
+    /// format version or build of `language`'s grammar.
+    pub fn load(bytes: []const u8, source: []const u8, language: *const c.TSLanguage) ?*Snapshot {
+        const self = gpa.create(Snapshot) catch return null;
+        self.arena = std.heap.ArenaAllocator.init(gpa);
+        self.restore(bytes, source, language) catch {
+            self.arena.deinit();
+            gpa.destroy(self);
+            return null;
+        };
+        return self;
+    }
+
+    fn restore(self: *Snapshot, bytes: []const u8, source: []const u8, language: *const c.TSLanguage) !void {
+        const a = self.arena.allocator();
+        if (bytes.len < HEADER_LEN) return error.Malformed;
+        const data: []align(4) const u8 = if (std.mem.isAligned(@intFromPtr(bytes.ptr), 4)) @alignCast(bytes) else copy: {
+            const aligned = try a.alignedAlloc(u8, .@"4", bytes.len);
+            @memcpy(aligned, bytes);
+            break :copy aligned;
+        };
+
+        var header: [HEADER_LEN / 4]u32 = undefined;
+        for (&header, 0..) |*word, k| word.* = std.mem.readInt(u32, data[k * 4 ..][0..4], .little);
+        const stamp = grammarStamp(language);
+        if (header[0] != MAGIC or header[1] != FORMAT_VERSION) return error.Malformed;
+        if (header[2] != @as(u32, @truncate(stamp)) or header[3] != @as(u32, @truncate(stamp >> 32))) return error.OtherGrammar;
+        const n = header[4];
+        if (n == 0 or header[5] != source.len or data.len != savedLen(n)) return error.Malformed;
+
+        var at: usize = HEADER_LEN;
+        self.tree = null;
+        self.language = language;
+        self.len = n;
+        self.source_len = header[5];
+        self.start_byte = column(u32, data, &at, n);
+        self.end_byte = column(u32, data, &at, n);
+        self.parent = column(u32, data, &at, n);
+        self.kind = column(u16, data, &at, n);
+        // Only 0 and 1 are bools.
+        for (data[at..][0..n]) |b| if (b > 1) return error.Malformed;
+        self.named = column(bool, data, &at, n);
+        self.nodes = try a.alloc(c.TSNode, 0);
+
+        // Everything derived below indexes by these, so check them first:
+        // preorder puts each parent before its children and never moves
+        // start bytes back.
+        if (self.parent[0] != NONE) return error.Malformed;
+        for (0..n) |i| {
+            if (self.start_byte[i] > self.end_byte[i] or self.end_byte[i] > source.len) return error.Malformed;
+            if (i > 0 and (self.parent[i] >= i or self.start_byte[i] < self.start_byte[i - 1])) return error.Malformed;
+        }
+
+        try self.indexChildren(a);
+        try self.deriveLinks(a);
+        try self.derivePoints(a, source);
+
+        // Parents precede their children, so one forward pass.
+        self.depth = try a.alloc(u32, n);
+        for (self.parent[0..n], 0..) |p, i| self.depth[i] = if (p == NONE) 0 else self.depth[p] + 1;
+    }
+
+    /// Sibling, first-child and subtree_end columns from the child index:
+    /// siblings are adjacent in their parent's list, and a subtree ends
+    /// where its last child's does.
+    fn deriveLinks(self: *Snapshot, a: std.mem.Allocator) !void {
+        const n = self.len;
+        self.first_child = try a.alloc(u32, n);
+        self.next_sibling = try a.alloc(u32, n);
+        self.prev_sibling = try a.alloc(u32, n);
+        self.subtree_end = try a.alloc(u32, n);
+        @memset(self.first_child, NONE);
+        @memset(self.next_sibling, NONE);
+        @memset(self.prev_sibling, NONE);
+
+        var i = n;
+        while (i > 0) {
+            i -= 1;
+            const kids = self.children(i, false);
+            if (kids.len == 0) {
+                self.subtree_end[i] = i + 1;
+                continue;
+            }
+            self.first_child[i] = kids[0];
+            for (kids[0 .. kids.len - 1], kids[1..]) |prev, next| {
+                self.next_sibling[prev] = next;
+                self.prev_sibling[next] = prev;
+            }
+            self.subtree_end[i] = self.subtree_end[kids[kids.len - 1]];
+        }
+    }
+
+    /// Row and column columns from the byte columns, counted as
+    /// tree-sitter counts them: a row per '\n', columns in bytes.
+    fn derivePoints(self: *Snapshot, a: std.mem.Allocator, source: []const u8) !void {
+        const n = self.len;
+        self.start_row = try a.alloc(u32, n);
+        self.start_col = try a.alloc(u32, n);
+        self.end_row = try a.alloc(u32, n);
+        self.end_col = try a.alloc(u32, n);
+
+        // In the arena with the columns, freed with the snapshot.
+        var line_starts: std.ArrayList(u32) = .empty;
+        try line_starts.append(a, 0);
+        var pos: usize = 0;
+        while (std.mem.indexOfScalarPos(u8, source, pos, '\n')) |nl| {
+            pos = nl + 1;
+            try line_starts.append(a, @intCast(pos));
+        }
+
+        for (0..n) |i| {
+            const sr = rowOf(line_starts.items, self.start_byte[i]);
+            const er = rowOf(line_starts.items, self.end_byte[i]);
+            self.start_row[i] = sr;
+            self.start_col[i] = self.start_byte[i] - line_starts.items[sr];
+            self.end_row[i] = er;
+            self.end_col[i] = self.end_byte[i] - line_starts.items[er];
+        }
+    }
+};
+
+/// Row of `byte`: the last line start at or before it.
+fn rowOf(line_starts: []const u32, byte: u32) u32 {
+    var lo: u32 = 0;
+    var hi: u32 = @intCast(line_starts.len);
+    while (hi - lo > 1) {
+        const mid = lo + (hi - lo) / 2;
+        if (line_starts[mid] <= byte) lo = mid else hi = mid;
+    }
+    return lo;
+}
+
+/// `n` values of type T at `at.*` in a saved snapshot, in place.
+fn column(comptime T: type, data: []align(4) const u8, at: *usize, n: u32) []T {
+    const len = @as(usize, n) * @sizeOf(T);
+    const raw: []align(@alignOf(T)) const u8 = @alignCast(data[at.*..][0..len]);
+    at.* += len;
+    // Loaded columns are never written: only build() fills columns.
+    return @constCast(std.mem.bytesAsSlice(T, raw));
+}
+
+const MAGIC: u32 = 0x53415343; // "CSAS"
+const HEADER_LEN = 32;
+
+/// Version of the saved form; bump it when the layout changes.
+pub const FORMAT_VERSION: u32 = 1;
+
+/// Identity of a grammar build: a hash of its ABI version, table sizes and
+/// symbol names and types. Symbol ids are only meaningful within one build,
+/// so load() refuses snapshots saved under another stamp.
+pub fn grammarStamp(language: *const c.TSLanguage) u64 {
+    var h = std.hash.XxHash3.init(0);
+    const sizes = [_]u32{
+        c.ts_language_abi_version(language),
+        c.ts_language_symbol_count(language),
+        c.ts_language_state_count(language),
+        c.ts_language_field_count(language),
+    };
+    h.update(@as([]const u8, std.mem.asBytes(&sizes)));
+    var sym: u32 = 0;
+    while (sym < sizes[1]) : (sym += 1) {
+        const name = c.ts_language_symbol_name(language, @intCast(sym));
+        if (name != null) h.update(@as([]const u8, std.mem.span(name)));
+        const kind_type = [_]u8{ 0, @intCast(c.ts_language_symbol_type(language, @intCast(sym))) };
+        h.update(@as([]const u8, &kind_type));
+    }
+    return h.final();
+}
+
+/// A loaded snapshot in place of a ts.Tree where only the root node is
+/// needed (rule_engine.applyAndSerialize reads src_slot.tree.rootNode()).
+pub const FlatTree = struct {
+    snap: *const Snapshot,
+    source: []const u8,
+
+    pub fn rootNode(self: *const FlatTree) ts.Node {
+        return self.snap.tsNode(0, self.source);
+    }
+};
+
+// ── Registry ──────────────────────────────────────────────────
+//
+// One snapshot per compiled source at most, keyed by tree pointer.
+
+const MAX_SNAPSHOTS = 16;
+
+var registry: [MAX_SNAPSHOTS]?*Snapshot = .{null} ** MAX_SNAPSHOTS;
+
+pub fn register(snap: *Snapshot) bool {
+    for (&registry) |*slot| {
+        if (slot.* == null) {
+            slot.* = snap;
+            return true;
+        }
+    }
+    return false;
+}
+
+pub fn unregister(snap: *Snapshot) void {
+    for (&registry) |*slot| {
+        if (slot.* == snap) slot.* = null;
+    }
+}
+
+/// Snapshot position of `n`, if its tree has a registered snapshot.
+pub const Position = struct { snap: *const Snapshot, index: u32 };
+
+pub fn lookup(n: ts.Node) ?Position {
+    if (n.flat) |snap| return .{ .snap = snap, .index = n.index };
+    for (registry) |slot| {
+        const snap = slot orelse continue;
+        if (snap.tree != n.node.tree) continue;
+        const index = snap.indexOf(n) orelse return null;
+        return .{ .snap = snap, .index = index };
+    }
+    return null;
+}
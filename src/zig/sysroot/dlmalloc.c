@@ -144,9 +144,35 @@ static void maybe_split(struct block_header *block, size_t size) {
     }
 }
 
-/* ── Public API ─────────────────────────────────────────── */
+/* ── Heap lock ──────────────────────────────────────────── */
 
-void *malloc(size_t size) {
+/*
+ * The threaded engine build (compiled with the atomics feature) runs
+ * several threads against one shared linear memory, so the free list and
+ * heap end are guarded by a spin lock. Critical sections are a free-list
+ * walk at most, and single-threaded builds compile the lock away.
+ */
+#ifdef __wasm_atomics__
+static volatile int heap_lock = 0;
+
+static void lock_heap(void) {
+    while (__atomic_exchange_n(&heap_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&heap_lock, __ATOMIC_RELAXED)) {
+        }
+    }
+}
+
+static void unlock_heap(void) {
+    __atomic_store_n(&heap_lock, 0, __ATOMIC_RELEASE);
+}
+#else
+static void lock_heap(void) {}
+static void unlock_heap(void) {}
+#endif
+
+/* ── Allocation (callers hold the heap lock) ────────────── */
+
+static void *heap_malloc(size_t size) {
     if (size == 0) {
         return NULL;
     }
@@ -180,7 +206,7 @@ void *malloc(size_t size) {
     return (void *)((unsigned char *)block + HEADER_SIZE);
 }
 
-void free(void *ptr) {
+static void heap_free(void *ptr) {
     if (ptr == NULL) {
         return;
     }
@@ -210,34 +236,13 @@ void free(void *ptr) {
     insert_into_free_list(block);
 }
 
-void *calloc(size_t nmemb, size_t size) {
-    /* Check for overflow */
-    if (nmemb != 0 && size > (size_t)-1 / nmemb) {
-        return NULL;
-    }
-
-    size_t total = nmemb * size;
-    void *ptr = malloc(total);
-    if (ptr == NULL) {
-        return NULL;
-    }
-
-    /* Zero the memory */
-    unsigned char *p = (unsigned char *)ptr;
-    for (size_t i = 0; i < total; i++) {
-        p[i] = 0;
-    }
-
-    return ptr;
-}
-
-void *realloc(void *ptr, size_t size) {
+static void *heap_realloc(void *ptr, size_t size) {
     if (ptr == NULL) {
-        return malloc(size);
+        return heap_malloc(size);
     }
 
     if (size == 0) {
-        free(ptr);
+        heap_free(ptr);
         return NULL;
     }
 
@@ -257,7 +262,7 @@ void *realloc(void *ptr, size_t size) {
     }
 
     /* Allocate new block, copy, free old */
-    void *new_ptr = malloc(size);
+    void *new_ptr = heap_malloc(size);
     if (new_ptr == NULL) {
         return NULL;
     }
@@ -270,10 +275,53 @@ void *realloc(void *ptr, size_t size) {
         dst[i] = src[i];
     }
 
-    free(ptr);
+    heap_free(ptr);
     return new_ptr;
 }
 
+/* ── Public API ─────────────────────────────────────────── */
+
+void *malloc(size_t size) {
+    lock_heap();
+    void *ptr = heap_malloc(size);
+    unlock_heap();
+    return ptr;
+}
+
+void free(void *ptr) {
+    lock_heap();
+    heap_free(ptr);
+    unlock_heap();
+}
+
+void *realloc(void *ptr, size_t size) {
+    lock_heap();
+    void *new_ptr = heap_realloc(ptr, size);
+    unlock_heap();
+    return new_ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    /* Check for overflow */
+    if (nmemb != 0 && size > (size_t)-1 / nmemb) {
+        return NULL;
+    }
+
+    size_t total = nmemb * size;
+    void *ptr = malloc(total);
+    if (ptr == NULL) {
+        return NULL;
+    }
+
+    /* Zero the memory */
+    unsigned char *p = (unsigned char *)ptr;
+    for (size_t i = 0; i < total; i++) {
+        p[i] = 0;
+    }
+
+    return ptr;
+}
+
 /* ── Required C runtime stubs ───────────────────────────── */
 
 /*
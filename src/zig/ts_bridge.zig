@@ -5,6 +5,10 @@
 ///! every node so callers can extract text without threading extra state.
 
 const std = @import("std");
+const freeC = @import("alloc.zig").freeC;
+const clock = @import("clock.zig");
+const grammars = @import("grammars.zig");
+const snapshot = @import("snapshot.zig");
 
 pub const c = @cImport({
     @cInclude("tree_sitter/api.h");
@@ -14,12 +18,24 @@ pub const c = @cImport({
 
 pub const Language = enum { javascript, typescript, tsx };
 
-// External symbols provided by the compiled grammar C objects.
-// tree_sitter_javascript() and tree_sitter_typescript() both return
-// `const TSLanguage *`.  TSX reuses the TypeScript grammar (the TS
-// grammar already includes JSX/TSX syntax).
-extern fn tree_sitter_javascript() ?*const c.TSLanguage;
-extern fn tree_sitter_typescript() ?*const c.TSLanguage;
+// Grammars live in grammars.zig; an engine build may link only some of them,
+// in which case init() returns null for the others.
+
+pub fn grammar(lang: Language) ?*const c.TSLanguage {
+    return grammars.get(switch (lang) {
+        .javascript => .javascript,
+        .typescript => .typescript,
+        .tsx => .tsx,
+    });
+}
+
+/// Whether `name` is a supertype of `lang` (e.g. `expression`): a query
+/// matches it against any of its subtypes, though no node has it as its type.
+pub fn isSupertype(lang: Language, name: []const u8) bool {
+    const language = grammar(lang) orelse return false;
+    const sym = c.ts_language_symbol_for_name(language, name.ptr, @intCast(name.len), true);
+    return sym != 0 and c.ts_language_symbol_type(language, sym) == c.TSSymbolTypeSupertype;
+}
 
 // ── Parser ──────────────────────────────────────────────────
 
@@ -28,10 +44,7 @@ pub const Parser = struct {
 
     pub fn init(lang: Language) ?Parser {
         const p = c.ts_parser_new() orelse return null;
-        const language: ?*const c.TSLanguage = switch (lang) {
-            .javascript => tree_sitter_javascript(),
-            .typescript, .tsx => tree_sitter_typescript(),
-        };
+        const language = grammar(lang);
         if (language == null) {
             c.ts_parser_delete(p);
             return null;
@@ -53,6 +66,65 @@ pub const Parser = struct {
         return .{ .tree = tree, .source = source };
     }
 
+    /// Incrementally re-parse `source`, reusing the unchanged subtrees of
+    /// `old`. `old` must already have been edited via Tree.edit() so its
+    /// ranges line up with the new source.
+    pub fn reparse(self: *Parser, old: *const Tree, source: []const u8) ?Tree {
+        const tree = c.ts_parser_parse_string(
+            self.parser,
+            old.tree,
+            source.ptr,
+            @intCast(source.len),
+        ) orelse return null;
+        return .{ .tree = tree, .source = source };
+    }
+
+    pub const ParseError = error{ ParseFailed, BudgetExceeded };
+
+    /// Parse `source`, giving up once `budget_us` microseconds have elapsed
+    /// (0 = no limit). tree-sitter polls the progress callback every ~100
+    /// parse operations, so the budget is honoured to within that granularity.
+    /// The caller must reset() the parser after a BudgetExceeded, which
+    /// otherwise keeps the half-finished parse around for resumption.
+    pub fn parseWithBudget(self: *Parser, source: []const u8, budget_us: u32) ParseError!Tree {
+        if (budget_us == 0) return self.parse(source) orelse error.ParseFailed;
+
+        var input_source = source;
+        var deadline: u64 = clock.nowMicros() + budget_us;
+        const tree = c.ts_parser_parse_with_options(
+            self.parser,
+            null,
+            .{
+                .payload = @ptrCast(&input_source),
+                .read = &readSlice,
+                .encoding = c.TSInputEncodingUTF8,
+                .decode = null,
+            },
+            .{
+                .payload = @ptrCast(&deadline),
+                .progress_callback = &pastDeadline,
+            },
+        ) orelse {
+            return if (clock.nowMicros() >= deadline) error.BudgetExceeded else error.ParseFailed;
+        };
+        return .{ .tree = tree, .source = source };
+    }
+
+    fn readSlice(payload: ?*anyopaque, byte_index: u32, _: c.TSPoint, bytes_read: [*c]u32) callconv(.c) [*c]const u8 {
+        const src: *const []const u8 = @ptrCast(@alignCast(payload));
+        if (byte_index >= src.len) {
+            bytes_read.* = 0;
+            return "";
+        }
+        bytes_read.* = @intCast(src.len - byte_index);
+        return src.ptr + byte_index;
+    }
+
+    fn pastDeadline(state: [*c]c.TSParseState) callconv(.c) bool {
+        const deadline: *const u64 = @ptrCast(@alignCast(state.*.payload));
+        return clock.nowMicros() >= deadline.*;
+    }
+
     /// Reset parser state, clearing any retained internal caches.
     /// Call this between sequential parses to reduce memory pressure.
     pub fn reset(self: *Parser) void {
@@ -77,6 +149,29 @@ pub const Tree = struct {
         };
     }
 
+    /// Shallow copy (reference-counted subtrees). Used to edit a tree
+    /// without disturbing the original until a re-parse has succeeded.
+    pub fn copy(self: *const Tree) ?Tree {
+        const t = c.ts_tree_copy(self.tree) orelse return null;
+        return .{ .tree = t, .source = self.source };
+    }
+
+    /// Shift the tree's ranges to account for a source edit.
+    pub fn edit(self: *Tree, input_edit: *const c.TSInputEdit) void {
+        c.ts_tree_edit(self.tree, input_edit);
+    }
+
+    /// Ranges whose syntactic structure differs between an edited old tree
+    /// and the tree re-parsed from it. Calls `visit(ctx, range)` for each
+    /// range; the C array is released before returning.
+    pub fn forEachChangedRange(old: *const Tree, new: *const Tree, ctx: anytype, comptime visit: fn (@TypeOf(ctx), start_byte: u32, end_byte: u32) void) void {
+        var len: u32 = 0;
+        const ranges = c.ts_tree_get_changed_ranges(old.tree, new.tree, &len);
+        if (ranges == null) return;
+        defer freeC(@ptrCast(ranges));
+        for (ranges[0..len]) |r| visit(ctx, r.start_byte, r.end_byte);
+    }
+
     pub fn deinit(self: *Tree) void {
         c.ts_tree_delete(self.tree);
     }
@@ -89,9 +184,15 @@ pub const Point = struct { row: u32, col: u32 };
 pub const Node = struct {
     node: c.TSNode,
     source: []const u8,
+    /// Set for a node of a snapshot loaded without its tree
+    /// (snapshot.Snapshot.load): `node` is unused and every accessor reads
+    /// the snapshot's columns at `index` instead.
+    flat: ?*const snapshot.Snapshot = null,
+    index: u32 = 0,
 
     /// Node type string (e.g. "call_expression", "import_statement").
     pub fn nodeType(self: Node) []const u8 {
+        if (self.flat) |s| return s.kindName(self.index);
         const t = c.ts_node_type(self.node);
         if (t == null) return "";
         return std.mem.span(t);
@@ -99,39 +200,45 @@ pub const Node = struct {
 
     /// 0-based start position (row, column).
     pub fn startPoint(self: Node) Point {
+        if (self.flat) |s| return .{ .row = s.start_row[self.index], .col = s.start_col[self.index] };
         const p = c.ts_node_start_point(self.node);
         return .{ .row = p.row, .col = p.column };
     }
 
     /// 0-based end position (row, column).
     pub fn endPoint(self: Node) Point {
+        if (self.flat) |s| return .{ .row = s.end_row[self.index], .col = s.end_col[self.index] };
         const p = c.ts_node_end_point(self.node);
         return .{ .row = p.row, .col = p.column };
     }
 
     /// Extract the source text spanned by this node.
     pub fn text(self: Node) []const u8 {
-        const start = c.ts_node_start_byte(self.node);
-        const end = c.ts_node_end_byte(self.node);
+        const start = self.startByte();
+        const end = self.endByte();
         if (start >= self.source.len or end > self.source.len or start > end) return "";
         return self.source[start..end];
     }
 
     pub fn startByte(self: Node) u32 {
+        if (self.flat) |s| return s.start_byte[self.index];
         return c.ts_node_start_byte(self.node);
     }
 
     pub fn endByte(self: Node) u32 {
+        if (self.flat) |s| return s.end_byte[self.index];
         return c.ts_node_end_byte(self.node);
     }
 
     /// Number of *named* children (skips anonymous tokens like punctuation).
     pub fn namedChildCount(self: Node) u32 {
+        if (self.flat) |s| return @intCast(s.children(self.index, true).len);
         return c.ts_node_named_child_count(self.node);
     }
 
     /// Get the i-th named child, or null if it is a null node.
     pub fn namedChild(self: Node, i: u32) ?Node {
+        if (self.flat) |s| return self.flatAt(s.child(self.index, i, true));
         const named_ch = c.ts_node_named_child(self.node, i);
         if (c.ts_node_is_null(named_ch)) return null;
         return .{ .node = named_ch, .source = self.source };
@@ -139,18 +246,22 @@ pub const Node = struct {
 
     /// Total child count (named + anonymous).
     pub fn childCount(self: Node) u32 {
+        if (self.flat) |s| return @intCast(s.children(self.index, false).len);
         return c.ts_node_child_count(self.node);
     }
 
     /// Get the i-th child (named or anonymous).
     pub fn child(self: Node, i: u32) ?Node {
+        if (self.flat) |s| return self.flatAt(s.child(self.index, i, false));
         const ch = c.ts_node_child(self.node, i);
         if (c.ts_node_is_null(ch)) return null;
         return .{ .node = ch, .source = self.source };
     }
 
     /// Look up a child by its grammar field name (e.g. "function", "arguments").
+    /// Snapshots do not keep field names, so flat nodes have none.
     pub fn childByFieldName(self: Node, name: []const u8) ?Node {
+        if (self.flat != null) return null;
         const ch = c.ts_node_child_by_field_name(
             self.node,
             name.ptr,
@@ -160,46 +271,66 @@ pub const Node = struct {
         return .{ .node = ch, .source = self.source };
     }
 
+    /// Nodes in this subtree, the node itself included (named and
+    /// anonymous). Constant time.
+    pub fn descendantCount(self: Node) u32 {
+        if (self.flat) |s| return s.subtree_end[self.index] - self.index;
+        return c.ts_node_descendant_count(self.node);
+    }
+
     pub fn parent(self: Node) ?Node {
+        if (self.flat) |s| return self.flatAt(s.parent[self.index]);
         const p = c.ts_node_parent(self.node);
         if (c.ts_node_is_null(p)) return null;
         return .{ .node = p, .source = self.source };
     }
 
     pub fn isNull(self: Node) bool {
+        if (self.flat != null) return false;
         return c.ts_node_is_null(self.node);
     }
 
     pub fn isNamed(self: Node) bool {
+        if (self.flat) |s| return s.named[self.index];
         return c.ts_node_is_named(self.node);
     }
 
+    pub fn hasError(self: Node) bool {
+        if (self.flat) |s| return s.hasError(self.index);
+        return c.ts_node_has_error(self.node);
+    }
+
     pub fn nextNamedSibling(self: Node) ?Node {
+        if (self.flat) |s| return self.flatAt(s.namedSibling(self.index, true));
         const sib = c.ts_node_next_named_sibling(self.node);
         if (c.ts_node_is_null(sib)) return null;
         return .{ .node = sib, .source = self.source };
     }
 
     pub fn nextSibling(self: Node) ?Node {
+        if (self.flat) |s| return self.flatAt(s.next_sibling[self.index]);
         const sib = c.ts_node_next_sibling(self.node);
         if (c.ts_node_is_null(sib)) return null;
         return .{ .node = sib, .source = self.source };
     }
 
     pub fn prevNamedSibling(self: Node) ?Node {
+        if (self.flat) |s| return self.flatAt(s.namedSibling(self.index, false));
         const sib = c.ts_node_prev_named_sibling(self.node);
         if (c.ts_node_is_null(sib)) return null;
         return .{ .node = sib, .source = self.source };
     }
 
     pub fn prevSibling(self: Node) ?Node {
+        if (self.flat) |s| return self.flatAt(s.prev_sibling[self.index]);
         const sib = c.ts_node_prev_sibling(self.node);
         if (c.ts_node_is_null(sib)) return null;
         return .{ .node = sib, .source = self.source };
     }
 
-    /// Find the smallest named descendant covering the given byte range.
+    /// Find the smallest descendant covering the given byte range.
     pub fn descendantForByteRange(self: Node, start: u32, end: u32) ?Node {
+        if (self.flat) |s| return self.flatAt(s.descendantFor(self.index, start, end, false));
         const d = c.ts_node_descendant_for_byte_range(self.node, start, end);
         if (c.ts_node_is_null(d)) return null;
         return .{ .node = d, .source = self.source };
@@ -207,10 +338,17 @@ pub const Node = struct {
 
     /// Find the smallest named descendant covering the given byte range.
     pub fn namedDescendantForByteRange(self: Node, start: u32, end: u32) ?Node {
+        if (self.flat) |s| return self.flatAt(s.descendantFor(self.index, start, end, true));
         const d = c.ts_node_named_descendant_for_byte_range(self.node, start, end);
         if (c.ts_node_is_null(d)) return null;
         return .{ .node = d, .source = self.source };
     }
+
+    /// Another node of this node's flat snapshot, or null for NONE.
+    fn flatAt(self: Node, i: u32) ?Node {
+        if (i == snapshot.NONE) return null;
+        return .{ .node = self.node, .source = self.source, .flat = self.flat, .index = i };
+    }
 };
 
 // ── Cursor (efficient tree-walking) ─────────────────────────
@@ -249,3 +387,88 @@ pub const Cursor = struct {
         c.ts_tree_cursor_delete(&self.cursor);
     }
 };
+
+// ── Query ───────────────────────────────────────────────────
+
+pub const QueryError = error{ Syntax, NodeType, Field, Capture, Structure, Language };
+
+/// A compiled S-expression query (tree-sitter's query.c).
+pub const Query = struct {
+    query: *c.TSQuery,
+
+    /// Compile `source` for `lang`. On error, `error_offset` is the byte
+    /// offset in `source` where compilation failed.
+    pub fn init(lang: Language, source: []const u8, error_offset: *u32) QueryError!Query {
+        const language = grammar(lang) orelse return error.Language;
+        var error_type: c.TSQueryError = c.TSQueryErrorNone;
+        const q = c.ts_query_new(language, source.ptr, @intCast(source.len), error_offset, &error_type);
+        if (q) |ok| return .{ .query = ok };
+        return switch (error_type) {
+            c.TSQueryErrorNodeType => error.NodeType,
+            c.TSQueryErrorField => error.Field,
+            c.TSQueryErrorCapture => error.Capture,
+            c.TSQueryErrorStructure => error.Structure,
+            c.TSQueryErrorLanguage => error.Language,
+            else => error.Syntax,
+        };
+    }
+
+    pub fn deinit(self: *Query) void {
+        c.ts_query_delete(self.query);
+    }
+
+    pub fn captureName(self: *const Query, id: u32) []const u8 {
+        var len: u32 = 0;
+        const name = c.ts_query_capture_name_for_id(self.query, id, &len);
+        return if (name == null) "" else name[0..len];
+    }
+
+    /// Capture id for `name`, or null if the query has no such capture.
+    pub fn captureId(self: *const Query, name: []const u8) ?u32 {
+        var id: u32 = 0;
+        while (id < c.ts_query_capture_count(self.query)) : (id += 1) {
+            if (std.mem.eql(u8, self.captureName(id), name)) return id;
+        }
+        return null;
+    }
+
+    pub fn stringValue(self: *const Query, id: u32) []const u8 {
+        var len: u32 = 0;
+        const value = c.ts_query_string_value_for_id(self.query, id, &len);
+        return if (value == null) "" else value[0..len];
+    }
+
+    /// Predicate steps of one pattern, each predicate ending in a Done step.
+    pub fn predicates(self: *const Query, pattern_index: u32) []const c.TSQueryPredicateStep {
+        var count: u32 = 0;
+        const steps = c.ts_query_predicates_for_pattern(self.query, pattern_index, &count);
+        return if (count == 0) &.{} else steps[0..count];
+    }
+};
+
+pub const QueryCursor = struct {
+    cursor: *c.TSQueryCursor,
+
+    pub fn init() ?QueryCursor {
+        const cur = c.ts_query_cursor_new() orelse return null;
+        return .{ .cursor = cur };
+    }
+
+    pub fn exec(self: *QueryCursor, query: *const Query, node: Node) void {
+        c.ts_query_cursor_exec(self.cursor, query.query, node.node);
+    }
+
+    /// Start no match on a node more than `depth` visible levels below the
+    /// node passed to exec.
+    pub fn setMaxStartDepth(self: *QueryCursor, depth: u32) void {
+        c.ts_query_cursor_set_max_start_depth(self.cursor, depth);
+    }
+
+    pub fn nextMatch(self: *QueryCursor, match: *c.TSQueryMatch) bool {
+        return c.ts_query_cursor_next_match(self.cursor, match);
+    }
+
+    pub fn deinit(self: *QueryCursor) void {
+        c.ts_query_cursor_delete(self.cursor);
+    }
+};
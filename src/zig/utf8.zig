@@ -0,0 +1,56 @@
+///! utf8.zig — Binary and encoding check for raw source bytes.
+///!
+///! Grammars expect UTF-8 text. A file with a NUL byte (git's test for
+///! binary) or a malformed UTF-8 sequence is not source worth parsing, and
+///! tree-sitter would only spend its error recovery on it, so callers check
+///! the bytes before the prefilter and the parse.
+
+const std = @import("std");
+
+const LANES = 16;
+const ByteVec = @Vector(LANES, u8);
+
+/// Whether `bytes` is NUL-free, well-formed UTF-8 (no overlong forms,
+/// surrogates or code points past U+10FFFF). Runs of ASCII are checked
+/// LANES bytes per step; only the multi-byte sequences are decoded.
+pub fn isText(bytes: []const u8) bool {
+    const zero: ByteVec = @splat(0);
+    const high: ByteVec = @splat(0x80);
+    var i: usize = 0;
+    while (i < bytes.len) {
+        if (i + LANES <= bytes.len) {
+            const chunk: ByteVec = bytes[i..][0..LANES].*;
+            if (!@reduce(.Or, chunk == zero) and !@reduce(.Or, chunk >= high)) {
+                i += LANES;
+                continue;
+            }
+        }
+        const b = bytes[i];
+        if (b == 0) return false;
+        if (b < 0x80) {
+            i += 1;
+            continue;
+        }
+        const len = std.unicode.utf8ByteSequenceLength(b) catch return false;
+        if (i + len > bytes.len) return false;
+        _ = std.unicode.utf8Decode(bytes[i..][0..len]) catch return false;
+        i += len;
+    }
+    return true;
+}
+
+// ── Tests ──────────────────────────────────────────────────
+
+test "isText accepts ASCII and UTF-8 source" {
+    try std.testing.expect(isText(""));
+    try std.testing.expect(isText("const x = 1;\n"));
+    try std.testing.expect(isText("const greeting = \"héllo wörld — ✓ 𝔘\"; // long enough to cross a vector boundary"));
+}
+
+test "isText rejects NUL bytes and malformed UTF-8" {
+    try std.testing.expect(!isText("const x = 1;\x00 // a NUL after the first vector of bytes"));
+    try std.testing.expect(!isText("abc\xff"));
+    try std.testing.expect(!isText("truncated \xe2\x9c"));
+    try std.testing.expect(!isText("overlong \xc0\xaf"));
+    try std.testing.expect(!isText("surrogate \xed\xa0\x80"));
+}
@@ -3,7 +3,8 @@
  * Run after `bun run build`. Imports from dist/, not src/.
  */
 import { describe, it, expect } from "bun:test";
-import { existsSync } from "node:fs";
+import { existsSync, readFileSync } from "node:fs";
+import { createHash } from "node:crypto";
 import { join } from "node:path";
 
 const dist = join(import.meta.dir, "..", "dist");
@@ -21,6 +22,8 @@ describe("dist artifacts", () => {
     "encoder.js",
     "encoder.d.ts",
     "ts/index.d.ts",
+    "javascript.js",
+    "engine-javascript.wasm",
   ];
 
   for (const file of required) {
@@ -144,6 +147,29 @@ describe("dist/encoder.js (codesift/encoder)", async () => {
   });
 });
 
+// ── Subpath: codesift/javascript ─────────────────────────
+
+describe("dist/javascript.js (codesift/javascript)", () => {
+  /** Hash scripts/embed-wasm.mjs writes next to a build's base64. */
+  const buildHash = (wasm: string) =>
+    createHash("sha256").update(readFileSync(join(dist, wasm))).digest("hex").slice(0, 16);
+
+  /** Text of `file` and every chunk it imports, transitively. */
+  function bundled(file: string, seen = new Set<string>()): string {
+    if (seen.has(file)) return "";
+    seen.add(file);
+    let text = readFileSync(join(dist, file), "utf-8");
+    for (const [, dep] of text.matchAll(/(?:from|import)\s*"\.\/([^"]+\.js)"/g)) text += bundled(dep, seen);
+    return text;
+  }
+
+  it("embeds the JavaScript-only engine, not the full one", () => {
+    const text = bundled("javascript.js");
+    expect(text).toContain(buildHash("engine-javascript.wasm"));
+    expect(text).not.toContain(buildHash("engine.wasm"));
+  });
+});
+
 // ── Subpath: codesift/types ──────────────────────────────
 
 describe("dist/types.js (codesift/types)", async () => {
@@ -0,0 +1,114 @@
+import { describe, it, expect } from "bun:test";
+import { createScanner, loadRules } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+const rules: RuleDefinition[] = [
+  { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } },
+  { id: "no-settimeout", language: "javascript", severity: "warning", message: "setTimeout", rule: { pattern: "setTimeout($FN, $MS)" } },
+  { id: "calls", language: "javascript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+  { id: "in-try", language: "javascript", severity: "info", message: "eval in try", rule: { all: [{ pattern: "eval($X)" }, { inside: { kind: "try_statement" }, stopBy: "end" }] } },
+];
+
+const source = "eval(a);\ntry { eval(b); } catch (e) {}\nsetTimeout(f, 10);\nfoo(bar(1));\n";
+
+describe("applyAsync", () => {
+  it("matches apply() with the default fuel", async () => {
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      expect(await ruleset.applyAsync(scanner)).toEqual(ruleset.apply(scanner));
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("yields between steps when fuel is small", async () => {
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      let yields = 0;
+      const findings = await ruleset.applyAsync(scanner, { fuel: 1, yield: async () => { yields++; } });
+      // Fuel 1 visits one node per step, so the walks are split too.
+      expect(yields).toBeGreaterThan(rules.length);
+      expect(findings).toEqual(ruleset.apply(scanner));
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("splits one rule's walk across steps", async () => {
+    const ruleset = loadRules(encodeRules([rules[0]]));
+    // 1000 statements of five named nodes each, then the one match.
+    const scanner = createScanner("f(x);\n".repeat(1000) + "eval(y);", "javascript");
+    try {
+      let yields = 0;
+      const findings = await ruleset.applyAsync(scanner, { fuel: 100, yield: async () => { yields++; } });
+      expect(yields).toBeGreaterThanOrEqual(40);
+      expect(findings).toEqual(ruleset.apply(scanner));
+      expect(findings[0].matches.map(m => m.bindings.X)).toEqual(["y"]);
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("is deterministic for a given fuel", async () => {
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      const count = async () => {
+        let n = 0;
+        await ruleset.applyAsync(scanner, { fuel: 30, yield: async () => { n++; } });
+        return n;
+      };
+      expect(await count()).toBe(await count());
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("stops when aborted", async () => {
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    const controller = new AbortController();
+    try {
+      const run = ruleset.applyAsync(scanner, {
+        fuel: 1,
+        signal: controller.signal,
+        yield: async () => controller.abort(),
+      });
+      await expect(run).rejects.toBeDefined();
+      // An abandoned evaluation does not disturb the next one, which starts
+      // over and takes as many steps as it would on a fresh scanner.
+      let yields = 0;
+      const findings = await ruleset.applyAsync(scanner, { fuel: 30, yield: async () => { yields++; } });
+      expect(findings).toEqual(ruleset.apply(scanner));
+      const fresh = createScanner(source, "javascript");
+      try {
+        let freshYields = 0;
+        await ruleset.applyAsync(fresh, { fuel: 30, yield: async () => { freshYields++; } });
+        expect(yields).toBe(freshYields);
+      } finally {
+        fresh.free();
+      }
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("returns no findings once the scanner is freed mid-run", async () => {
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      const findings = await ruleset.applyAsync(scanner, { fuel: 1, yield: async () => scanner.free() });
+      expect(findings).toEqual([]);
+    } finally {
+      ruleset.free();
+    }
+  });
+});
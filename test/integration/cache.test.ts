@@ -0,0 +1,123 @@
+import { describe, it, expect, beforeEach, afterEach } from "bun:test";
+import * as fs from "node:fs";
+import * as os from "node:os";
+import * as path from "node:path";
+import { loadRules } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import { openScanCache } from "../../src/js/cache.js";
+import { scanStream } from "../../src/js/pipeline.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+const noEval: RuleDefinition = { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } };
+const noAlert: RuleDefinition = { id: "no-alert", language: "javascript", severity: "error", message: "alert", rule: { pattern: "alert($X)" } };
+
+let dir: string;
+let cacheDir: string;
+let files: string[];
+
+beforeEach(() => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), "codesift-cache-"));
+  cacheDir = path.join(dir, ".cache");
+  const old = Date.now() / 1000 - 60;
+  files = ["a.js", "b.js", "c.js", "same-as-a.js"].map((name, i) => {
+    const file = path.join(dir, name);
+    fs.writeFileSync(file, i === 1 ? "alert(1);" : i === 2 ? "const c = 1;" : "eval(x);");
+    // Older than the racy window, so their stats are recorded.
+    fs.utimesSync(file, old, old);
+    return file;
+  });
+});
+
+afterEach(() => {
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+/** Scan `files` through a cache under cacheDir, returning each file's findings and whether it was scanned. */
+async function scan(rules: RuleDefinition[]) {
+  const bytecode = encodeRules(rules);
+  const cache = await openScanCache(cacheDir, bytecode);
+  const ruleset = loadRules(bytecode);
+  const out: Array<{ file: string; ruleIds: string[]; scanned: boolean }> = [];
+  try {
+    for await (const { file, findings, bytes } of scanStream(files, ruleset, { batch: 2, cache })) {
+      out.push({ file: path.basename(file), ruleIds: findings.map(f => f.ruleId), scanned: bytes !== undefined });
+    }
+  } finally {
+    ruleset.free();
+  }
+  await cache.save();
+  return out;
+}
+
+describe("scan cache", () => {
+  it("returns the same findings warm, without scanning", async () => {
+    const cold = await scan([noEval]);
+    expect(cold.map(f => f.ruleIds)).toEqual([["no-eval"], [], [], ["no-eval"]]);
+    expect(cold.every(f => f.scanned)).toBe(true);
+
+    const warm = await scan([noEval]);
+    expect(warm.map(f => f.ruleIds)).toEqual(cold.map(f => f.ruleIds));
+    expect(warm.every(f => !f.scanned)).toBe(true);
+  });
+
+  it("shares one entry between files with the same content", async () => {
+    await scan([noEval]);
+    const copy = path.join(dir, "copy.js");
+    fs.copyFileSync(files[0], copy);
+    files.push(copy);
+    const warm = await scan([noEval]);
+    expect(warm[4]).toEqual({ file: "copy.js", ruleIds: ["no-eval"], scanned: false });
+  });
+
+  it("rescans a changed file and keys findings by ruleset", async () => {
+    await scan([noEval]);
+    fs.writeFileSync(files[2], "eval(c);");
+
+    const changed = await scan([noEval]);
+    expect(changed[2]).toEqual({ file: "c.js", ruleIds: ["no-eval"], scanned: true });
+    expect(changed.filter(f => f.scanned)).toHaveLength(1);
+
+    const other = await scan([noEval, noAlert]);
+    expect(other.map(f => f.ruleIds)).toEqual([["no-eval"], ["no-alert"], ["no-eval"], ["no-eval"]]);
+    expect(other[0].scanned).toBe(true);
+  });
+
+  it("keys findings by language as well as content", async () => {
+    // A type assertion in .ts; in .tsx the same bytes open a JSX element.
+    const assertion: RuleDefinition = { id: "assertion", language: "typescript", severity: "info", message: "assertion", rule: { kind: "type_assertion" } };
+    files = ["v.ts", "v.tsx"].map(name => {
+      const file = path.join(dir, name);
+      fs.writeFileSync(file, "const v = <any>x;\n");
+      return file;
+    });
+    const cold = await scan([assertion]);
+    expect(cold).toEqual([
+      { file: "v.ts", ruleIds: ["assertion"], scanned: true },
+      { file: "v.tsx", ruleIds: [], scanned: true },
+    ]);
+    const warm = await scan([assertion]);
+    expect(warm.map(f => f.ruleIds)).toEqual([["assertion"], []]);
+    expect(warm.every(f => !f.scanned)).toBe(true);
+  });
+
+  it("keeps tree snapshots across rulesets", async () => {
+    await scan([noEval]);
+    // a.js and same-as-a.js share one tree; the others were never parsed.
+    expect(fs.readdirSync(path.join(cacheDir, "trees")).filter(f => f.endsWith(".javascript"))).toHaveLength(1);
+
+    const other = await scan([noEval, noAlert]);
+    expect(other.map(f => f.ruleIds)).toEqual([["no-eval"], ["no-alert"], [], ["no-eval"]]);
+    expect(fs.readdirSync(path.join(cacheDir, "trees")).filter(f => f.endsWith(".javascript"))).toHaveLength(2);
+  });
+
+  it("does not trust the stats of a file modified just now", async () => {
+    const bytecode = encodeRules([noEval]);
+    const now = Date.now() / 1000;
+    fs.utimesSync(files[0], now, now);
+    const cache = await openScanCache(cacheDir, bytecode);
+    await cache.lookup(files[0]);
+    await cache.save();
+    const stats = JSON.parse(fs.readFileSync(path.join(cacheDir, "files.json"), "utf-8"));
+    expect(stats[files[0]]).toBeUndefined();
+  });
+});
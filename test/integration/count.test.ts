@@ -0,0 +1,97 @@
+import { describe, it, expect } from "bun:test";
+import { createScanner, loadRules, structCount } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+// 100 calls: more than the 64 matches a match() call returns.
+const calls = Array.from({ length: 100 }, (_, i) => `log(${i % 3 === 0 ? "a" : "b"});`).join("\n");
+const source = `${calls}\nwarn(a);\nconst x = log(c);\n`;
+
+describe("count and groupBy", () => {
+  it("counts every match without the match cap", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      expect(scanner.match("log($X)").length).toBeLessThanOrEqual(64);
+      expect(scanner.count("log($X)")).toBe(101);
+      expect(scanner.count("warn($X)")).toBe(1);
+      expect(scanner.count("nothing($X)")).toBe(0);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("groups matches by the text bound to a metavariable", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      const counts = scanner.groupBy("$FN($X)", "$X");
+      expect(counts.total).toBe(102);
+      expect(counts.ungrouped).toBe(0);
+      expect(counts.other).toBe(0);
+      expect(counts.groups).toEqual([
+        { text: "b", count: 66 },
+        { text: "a", count: 35 },
+        { text: "c", count: 1 },
+      ]);
+      expect(scanner.groupBy("$FN($X)", "FN").groups).toEqual([
+        { text: "log", count: 101 },
+        { text: "warn", count: 1 },
+      ]);
+      expect(scanner.groupBy("log($X)", "$MISSING").ungrouped).toBe(101);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("one-shot structCount agrees with the scanner", () => {
+    const counts = structCount("log($X)", source, "javascript", { groupBy: "X" });
+    expect(counts.total).toBe(101);
+    expect(counts.groups.map(g => g.text)).toEqual(["b", "a", "c"]);
+    expect(structCount("eval($X)", source, "javascript").total).toBe(0);
+  });
+
+  it("counts matches per rule", () => {
+    const rules: RuleDefinition[] = [
+      { id: "log", language: "javascript", severity: "info", message: "log", rule: { pattern: "log($X)" } },
+      { id: "eval", language: "javascript", severity: "info", message: "eval", rule: { pattern: "eval($X)" } },
+      { id: "calls", language: "javascript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+      { id: "decl-log", language: "javascript", severity: "info", message: "log in a declaration", rule: { all: [{ pattern: "log(c)" }, { inside: { kind: "lexical_declaration" } }] } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      expect(ruleset.count(scanner)).toEqual([
+        { ruleId: "log", count: 101, capped: false },
+        { ruleId: "eval", count: 0, capped: false },
+        { ruleId: "calls", count: 102, capped: false },
+        { ruleId: "decl-log", count: 1, capped: false },
+      ]);
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("counts each statement's expression once on both counting paths", () => {
+    const rules: RuleDefinition[] = [
+      // Tallied: a single pattern node.
+      { id: "eval", language: "javascript", severity: "info", message: "eval", rule: { pattern: "eval($X)" } },
+      // Evaluated as in apply: composite rules.
+      { id: "eval-or-warn", language: "javascript", severity: "info", message: "either", rule: { any: [{ pattern: "eval($X)" }, { pattern: "warn($X)" }] } },
+      { id: "eval-a", language: "javascript", severity: "info", message: "eval of a", rule: { all: [{ pattern: "eval($X)" }, { has: { pattern: "a" } }] } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner("eval(a);\neval(b);\nwarn(a);\nx = eval(a);\n", "javascript");
+    try {
+      const applied = new Map(ruleset.apply(scanner).map(f => [f.ruleId, f.matches.length]));
+      expect(ruleset.count(scanner)).toEqual([
+        { ruleId: "eval", count: 3, capped: false },
+        { ruleId: "eval-or-warn", count: 4, capped: false },
+        { ruleId: "eval-a", count: 2, capped: false },
+      ]);
+      for (const { ruleId, count } of ruleset.count(scanner)) expect(count).toBe(applied.get(ruleId) ?? 0);
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+});
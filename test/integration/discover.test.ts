@@ -0,0 +1,137 @@
+import { describe, it, expect, beforeEach, afterEach } from "bun:test";
+import * as fs from "node:fs";
+import * as os from "node:os";
+import * as path from "node:path";
+import { discoverFiles, parseGitIndex } from "../../src/js/discover.js";
+
+let dir: string;
+
+function write(file: string, body = ""): void {
+  const full = path.join(dir, file);
+  fs.mkdirSync(path.dirname(full), { recursive: true });
+  fs.writeFileSync(full, body);
+}
+
+async function discover(root: string, opts?: Parameters<typeof discoverFiles>[1]): Promise<string[]> {
+  const found: string[] = [];
+  for await (const file of discoverFiles([root], opts)) found.push(path.relative(dir, file).split(path.sep).join("/"));
+  return found;
+}
+
+/** A minimal git index: version 2 pads each entry, version 4 prefix-compresses paths. */
+function gitIndex(version: 2 | 4, entries: { path: string; mode?: number }[]): Buffer {
+  const parts: Buffer[] = [];
+  const header = Buffer.alloc(12);
+  header.write("DIRC", 0, "latin1");
+  header.writeUInt32BE(version, 4);
+  header.writeUInt32BE(entries.length, 8);
+  parts.push(header);
+
+  let prev = Buffer.alloc(0);
+  for (const entry of entries) {
+    const name = Buffer.from(entry.path);
+    const fixed = Buffer.alloc(62);
+    fixed.writeUInt32BE(entry.mode ?? 0o100644, 24);
+    fixed.writeUInt16BE(Math.min(name.length, 0xfff), 60);
+    parts.push(fixed);
+    if (version === 4) {
+      let common = 0;
+      while (common < prev.length && common < name.length && prev[common] === name[common]) common++;
+      // Offsets here stay below 128: a single varint byte.
+      parts.push(Buffer.from([prev.length - common]), name.subarray(common), Buffer.alloc(1));
+    } else {
+      const len = 62 + name.length;
+      parts.push(name, Buffer.alloc(8 - (len % 8)));
+    }
+    prev = name;
+  }
+  return Buffer.concat(parts);
+}
+
+beforeEach(() => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), "codesift-discover-"));
+});
+
+afterEach(() => {
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+describe("discoverFiles", () => {
+  it("yields source files in sorted order and skips .git and node_modules", async () => {
+    write("b.ts");
+    write("a.js");
+    write("notes.txt");
+    write("lib/c.mjs");
+    write("node_modules/pkg/index.js");
+    write(".git/hooks/x.js");
+    expect(await discover(dir)).toEqual(["a.js", "b.ts", "lib/c.mjs"]);
+  });
+
+  it("scans a node_modules directory named explicitly", async () => {
+    write("node_modules/pkg/index.js");
+    expect(await discover(path.join(dir, "node_modules"))).toEqual(["node_modules/pkg/index.js"]);
+  });
+
+  it("honors .gitignore files, negation and nesting", async () => {
+    write(".gitignore", "dist/\n# comment\n*.test.js\n/top.js\n");
+    write("top.js");
+    write("keep.js");
+    write("dist/out.js");
+    write("src/top.js");
+    write("src/a.test.js");
+    write("src/.gitignore", "gen/*\n!gen/keep.js\n");
+    write("src/gen/skip.js");
+    write("src/gen/keep.js");
+    expect(await discover(dir)).toEqual(["keep.js", "src/top.js", "src/gen/keep.js"]);
+    expect(await discover(dir, { gitignore: false })).toContain("dist/out.js");
+  });
+
+  it("applies ignore files above the given path and .git/info/exclude", async () => {
+    fs.mkdirSync(path.join(dir, ".git", "info"), { recursive: true });
+    write(".git/info/exclude", "*.gen.ts\n");
+    write(".gitignore", "fixtures/\n");
+    write("src/a.ts");
+    write("src/a.gen.ts");
+    write("src/fixtures/f.js");
+    expect(await discover(path.join(dir, "src"))).toEqual(["src/a.ts"]);
+  });
+
+  it("leaves out --exclude globs relative to the given path", async () => {
+    write("a.js");
+    write("a.min.js");
+    write("vendor/v.js");
+    write("src/deep/x.js");
+    write("src/y.js");
+    expect(await discover(dir, { exclude: ["*.min.js", "vendor", "src/**/x.js"] })).toEqual(["a.js", "src/y.js"]);
+  });
+
+  it("lists tracked files from the git index", async () => {
+    write("a.js");
+    write("untracked.js");
+    write("src/b.ts");
+    write("src/c.js");
+    write("README.md");
+    const entries = [
+      { path: "README.md" },
+      { path: "a.js" },
+      { path: "deleted.js" },
+      { path: "src/b.ts" },
+      { path: "src/c.js" },
+      { path: "sub", mode: 0o160000 },
+    ];
+    for (const version of [2, 4] as const) {
+      expect(parseGitIndex(gitIndex(version, entries))).toEqual(["README.md", "a.js", "deleted.js", "src/b.ts", "src/c.js"]);
+
+      write(".git/index");
+      fs.writeFileSync(path.join(dir, ".git", "index"), gitIndex(version, entries));
+      expect(await discover(dir, { gitIndex: true })).toEqual(["a.js", "src/b.ts", "src/c.js"]);
+      expect(await discover(path.join(dir, "src"), { gitIndex: true, exclude: ["c.js"] })).toEqual(["src/b.ts"]);
+    }
+  });
+
+  it("falls back to walking when there is no usable index", async () => {
+    write(".git/index", "not an index");
+    write("a.js");
+    expect(await discover(dir, { gitIndex: true })).toEqual(["a.js"]);
+  });
+});
@@ -0,0 +1,82 @@
+import { describe, it, expect } from "bun:test";
+import { mkdtempSync, rmSync, readdirSync, writeFileSync, statSync, utimesSync } from "node:fs";
+import { spawnSync } from "node:child_process";
+import { tmpdir } from "node:os";
+import { join } from "node:path";
+import { fileURLToPath } from "node:url";
+import { init, structMatch, hasLanguage } from "../../src/js/index.js";
+import { openModuleCache } from "../../src/js/ts/module-cache.js";
+
+describe("engine instantiation", () => {
+  it("init() is idempotent and the engine works afterwards", async () => {
+    await init();
+    await init();
+    expect(structMatch("eval($X)", "eval(a)", "javascript").length).toBe(1);
+  });
+
+  it("init({ cache }) fills the cache on a cold start and reads it on the next", () => {
+    // This process's engine is already up, so each start runs in its own process.
+    const dir = mkdtempSync(join(tmpdir(), "codesift-init-test-"));
+    try {
+      const cacheDir = join(dir, "cache");
+      const script = join(dir, "start.ts");
+      const entry = fileURLToPath(new URL("../../src/js/index.js", import.meta.url));
+      writeFileSync(script, [
+        `import { init, structMatch } from ${JSON.stringify(entry)};`,
+        `await init({ cache: ${JSON.stringify(cacheDir)} });`,
+        `console.log(structMatch("eval($X)", "eval(a)", "javascript").length);`,
+      ].join("\n"));
+      const start = () => {
+        const run = spawnSync(process.execPath, [script], { encoding: "utf-8" });
+        expect(run.stderr).toBe("");
+        return run.stdout.trim();
+      };
+
+      expect(start()).toBe("1");
+      const [file] = readdirSync(cacheDir);
+      expect(file).toMatch(/^engine-.+\.wasm$/);
+
+      // A hit compiles the cached bytes and leaves the file alone.
+      const old = Date.now() / 1000 - 60;
+      utimesSync(join(cacheDir, file), old, old);
+      const mtime = statSync(join(cacheDir, file)).mtimeMs;
+      expect(start()).toBe("1");
+      expect(readdirSync(cacheDir)).toEqual([file]);
+      expect(statSync(join(cacheDir, file)).mtimeMs).toBe(mtime);
+    } finally {
+      rmSync(dir, { recursive: true, force: true });
+    }
+  });
+
+  it("module cache round-trips bytes per engine build", async () => {
+    const dir = mkdtempSync(join(tmpdir(), "codesift-cache-test-"));
+    try {
+      const cache = await openModuleCache(dir, "build-a");
+      expect(cache).not.toBeNull();
+      expect(await cache!.get()).toBeNull();
+
+      const bytes = new Uint8Array([0x00, 0x61, 0x73, 0x6d, 1, 0, 0, 0]);
+      await cache!.put(bytes);
+      expect(Array.from((await cache!.get())!)).toEqual(Array.from(bytes));
+      expect(readdirSync(dir)).toEqual(["engine-build-a.wasm"]);
+
+      // A different build never sees another build's bytes.
+      const other = await openModuleCache(dir, "build-b");
+      expect(await other!.get()).toBeNull();
+    } finally {
+      rmSync(dir, { recursive: true, force: true });
+    }
+  });
+
+  it("an unwritable cache location degrades to a miss", async () => {
+    const cache = await openModuleCache("/dev/null/not-a-dir", "x");
+    await cache!.put(new Uint8Array([1, 2, 3]));
+    expect(await cache!.get()).toBeNull();
+  });
+
+  it("the embedded engine links every WASM grammar", () => {
+    expect(hasLanguage("javascript")).toBe(true);
+    expect(hasLanguage("typescript")).toBe(true);
+    expect(hasLanguage("tsx")).toBe(true);
+  });
+});
@@ -0,0 +1,119 @@
+import { describe, it, expect } from "bun:test";
+import { createScanner, loadRules } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import type { RuleDefinition, Finding } from "../../src/js/types.js";
+
+const rules: RuleDefinition[] = [
+  {
+    id: "no-eval",
+    language: "javascript",
+    severity: "error",
+    message: "eval is dangerous",
+    rule: { pattern: "eval($X)" },
+  },
+  {
+    id: "call-in-function",
+    language: "javascript",
+    severity: "warning",
+    message: "call inside a function",
+    rule: { all: [{ kind: "call_expression" }, { inside: { kind: "function_declaration" }, stopBy: "end" }] },
+  },
+  {
+    id: "todo",
+    language: "javascript",
+    severity: "info",
+    message: "TODO comment",
+    rule: { regex: "TODO" },
+  },
+];
+
+function summarize(findings: Finding[]): string[] {
+  return findings
+    .flatMap(f => f.matches.map(m => `${f.ruleId}@${m.start_byte}-${m.end_byte}:${m.start_row}:${m.start_col}`))
+    .sort();
+}
+
+function fullApply(source: string): string[] {
+  const ruleset = loadRules(encodeRules(rules));
+  const scanner = createScanner(source, "javascript");
+  try {
+    return summarize(ruleset.apply(scanner));
+  } finally {
+    scanner.free();
+    ruleset.free();
+  }
+}
+
+describe("incremental re-evaluation", () => {
+  it("first applyIncremental matches a full apply", () => {
+    const source = "eval(a);\nfunction f() { log(1); }\n";
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      expect(summarize(ruleset.applyIncremental(scanner))).toEqual(fullApply(source));
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("tracks findings across a sequence of edits", () => {
+    const versions = [
+      "eval(a);\nfunction f() { log(1); }\nconst x = 1;\n",
+      "eval(a);\nfunction f() { log(1); eval(b); }\nconst x = 1;\n",
+      "eval(a);\nfunction f() { log(1); eval(b); }\n// TODO remove\nconst x = 1;\n",
+      "function f() { log(1); eval(b); }\n// TODO remove\nconst x = 1;\n",
+      "function f() { log(1); eval(b); }\n// TODO remove\nconst x = eval(2);\n",
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(versions[0], "javascript");
+    try {
+      expect(summarize(ruleset.applyIncremental(scanner))).toEqual(fullApply(versions[0]));
+      for (const next of versions.slice(1)) {
+        expect(scanner.edit(next)).toBe(true);
+        expect(scanner.source).toBe(next);
+        expect(summarize(ruleset.applyIncremental(scanner))).toEqual(fullApply(next));
+      }
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("accepts an explicit edit range", () => {
+    const before = "const a = 1;\nconst b = 2;\n";
+    const after = "const a = 1;\neval(b);\nconst b = 2;\n";
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(before, "javascript");
+    try {
+      ruleset.applyIncremental(scanner);
+      expect(scanner.edit(after, { startByte: 13, oldEndByte: 13, newEndByte: 22 })).toBe(true);
+      expect(summarize(ruleset.applyIncremental(scanner))).toEqual(fullApply(after));
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("rejects an inconsistent edit and keeps the old source", () => {
+    const scanner = createScanner("eval(a);", "javascript");
+    try {
+      expect(scanner.edit("eval(ab);", { startByte: 5, oldEndByte: 6, newEndByte: 6 })).toBe(false);
+      expect(scanner.source).toBe("eval(a);");
+      expect(scanner.match("eval($X)").length).toBe(1);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("tree navigation reflects the edited source", () => {
+    const scanner = createScanner("foo(1);", "javascript");
+    try {
+      expect(scanner.edit("foo(1);\nbar(2);")).toBe(true);
+      expect(scanner.root().namedChildCount()).toBe(2);
+      expect(scanner.match("bar($X)").length).toBe(1);
+    } finally {
+      scanner.free();
+    }
+  });
+});
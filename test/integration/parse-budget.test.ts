@@ -0,0 +1,55 @@
+import { describe, it, expect } from "bun:test";
+import {
+  createScanner,
+  structMatch,
+  compilePattern,
+  matchPattern,
+  freePattern,
+  ParseBudgetExceededError,
+} from "../../src/js/index.js";
+
+// Unbalanced brackets and stray tokens keep tree-sitter in error recovery.
+const garbage = "({[<(".repeat(20000) + "=> ?? ... ,,;".repeat(5000);
+
+describe("parse budgets", () => {
+  it("generous budget parses normally", () => {
+    const matches = structMatch("eval($X)", "eval(a)", "javascript", { budgetUs: 10_000_000 });
+    expect(matches.length).toBe(1);
+
+    const scanner = createScanner("eval(a); eval(b)", "javascript", { budgetUs: 10_000_000 });
+    try {
+      expect(scanner.match("eval($X)").length).toBe(2);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("structMatch throws once the budget is spent", () => {
+    expect(() => structMatch("eval($X)", garbage, "javascript", { budgetUs: 1 }))
+      .toThrow(ParseBudgetExceededError);
+  });
+
+  it("createScanner throws once the budget is spent", () => {
+    expect(() => createScanner(garbage, "typescript", { budgetUs: 1 })).toThrow(ParseBudgetExceededError);
+  });
+
+  it("matchPattern throws once the budget is spent", () => {
+    const handle = compilePattern("eval($X)", "javascript");
+    try {
+      expect(() => matchPattern(handle, garbage, { budgetUs: 1 })).toThrow(ParseBudgetExceededError);
+      // A cancelled parse must not leak into the next call.
+      expect(matchPattern(handle, "eval(x)").length).toBe(1);
+    } finally {
+      freePattern(handle);
+    }
+  });
+
+  it("no budget means no limit", () => {
+    const scanner = createScanner(garbage.slice(0, 2000), "javascript");
+    try {
+      expect(scanner._srcHandle).toBeGreaterThan(0);
+    } finally {
+      scanner.free();
+    }
+  });
+});
@@ -0,0 +1,107 @@
+import { describe, it, expect, beforeAll, afterAll } from "bun:test";
+import * as fs from "node:fs";
+import * as os from "node:os";
+import * as path from "node:path";
+import { Writable } from "node:stream";
+import { loadRules } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import { readAhead, batches, write, scanStream } from "../../src/js/pipeline.js";
+
+let dir: string;
+let files: string[];
+
+beforeAll(() => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), "codesift-pipeline-"));
+  files = Array.from({ length: 20 }, (_, i) => {
+    const file = path.join(dir, `f${i}.js`);
+    fs.writeFileSync(file, i % 4 === 0 ? `eval(v${i});` : `const v${i} = ${i};`);
+    return file;
+  });
+});
+
+afterAll(() => {
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+async function* stream<T>(items: T[], pulled?: { count: number }): AsyncGenerator<T> {
+  for (const item of items) {
+    if (pulled) pulled.count++;
+    yield item;
+  }
+}
+
+describe("scan pipeline", () => {
+  it("readAhead yields every file in order, with read errors in place", async () => {
+    const missing = path.join(dir, "missing.js");
+    const seen: string[] = [];
+    for await (const { file, bytes, error } of readAhead(stream([...files.slice(0, 5), missing, ...files.slice(5)]), 4)) {
+      seen.push(file);
+      if (file === missing) {
+        expect(error).toBeDefined();
+        expect(bytes).toBeUndefined();
+      } else {
+        expect(new TextDecoder().decode(bytes)).toBe(fs.readFileSync(file, "utf-8"));
+      }
+    }
+    expect(seen).toEqual([...files.slice(0, 5), missing, ...files.slice(5)]);
+  });
+
+  it("readAhead starts at most depth reads ahead of the consumer", async () => {
+    const pulled = { count: 0 };
+    let taken = 0;
+    for await (const _ of readAhead(stream(files, pulled), 3)) {
+      taken++;
+      expect(pulled.count - taken).toBeLessThanOrEqual(2);
+    }
+    expect(taken).toBe(files.length);
+  });
+
+  it("batches groups a stream and flushes the remainder", async () => {
+    const out: number[][] = [];
+    for await (const batch of batches(stream([1, 2, 3, 4, 5, 6, 7]), 3)) out.push(batch);
+    expect(out).toEqual([[1, 2, 3], [4, 5, 6], [7]]);
+  });
+
+  it("write waits for a full stream to drain", async () => {
+    const chunks: string[] = [];
+    const sink = new Writable({
+      highWaterMark: 4,
+      write(chunk, _enc, done) {
+        chunks.push(String(chunk));
+        setTimeout(done, 1);
+      },
+    });
+    for (const text of ["aaaa", "bbbb", "cccc"]) {
+      await write(sink, text);
+      expect(sink.writableLength).toBeLessThan(4);
+    }
+    await new Promise(resolve => sink.end(resolve));
+    expect(chunks).toEqual(["aaaa", "bbbb", "cccc"]);
+  });
+
+  it("scanStream yields every file in order with applySource's findings", async () => {
+    const ruleset = loadRules(encodeRules([
+      { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } },
+    ]));
+    try {
+      const missing = path.join(dir, "missing.js");
+      const input = [...files, missing];
+      for (const readAheadDepth of [0, 5]) {
+        const seen: string[] = [];
+        for await (const { file, findings, bytes, error } of scanStream(input, ruleset, { batch: 3, readAhead: readAheadDepth })) {
+          seen.push(file);
+          if (file === missing) {
+            expect(error).toBeDefined();
+            continue;
+          }
+          const source = fs.readFileSync(file, "utf-8");
+          expect(findings).toEqual(ruleset.applySource(source, "javascript"));
+          if (readAheadDepth > 0) expect(new TextDecoder().decode(bytes)).toBe(source);
+        }
+        expect(seen).toEqual(input);
+      }
+    } finally {
+      ruleset.free();
+    }
+  });
+});
@@ -0,0 +1,99 @@
+import { describe, it, expect, beforeAll, afterAll } from "bun:test";
+import * as fs from "node:fs";
+import * as os from "node:os";
+import * as path from "node:path";
+import { loadRules, structMatch, hashBytes } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import { createPool } from "../../src/js/pool.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+const rules: RuleDefinition[] = [
+  { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } },
+  { id: "inner-html", language: "javascript", severity: "warning", message: "innerHTML", rule: { pattern: "$EL.innerHTML = $V" } },
+];
+
+let dir: string;
+let files: string[];
+
+beforeAll(() => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), "codesift-pool-"));
+  files = Array.from({ length: 40 }, (_, i) => {
+    const file = path.join(dir, `f${i}.js`);
+    const body = i % 3 === 0 ? `eval(a${i});\nel.innerHTML = x;` : i % 3 === 1 ? `const v${i} = 1;` : `eval(b${i});`;
+    fs.writeFileSync(file, body);
+    return file;
+  });
+});
+
+afterAll(() => {
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+describe("worker pool", () => {
+  it("scans files in order with the same findings as applySource", async () => {
+    const bytecode = encodeRules(rules);
+    const ruleset = loadRules(bytecode);
+    const pool = createPool({ size: 3, rules: bytecode });
+    try {
+      const seen: string[] = [];
+      for await (const { file, findings, error } of pool.scan(files)) {
+        expect(error).toBeUndefined();
+        seen.push(file);
+        expect(findings).toEqual(ruleset.applySource(fs.readFileSync(file, "utf-8"), "javascript"));
+      }
+      expect(seen).toEqual(files);
+    } finally {
+      await pool.close();
+      ruleset.free();
+    }
+  });
+
+  it("hashes the bytes it scans when asked", async () => {
+    const bytecode = encodeRules(rules);
+    const ruleset = loadRules(bytecode);
+    const pool = createPool({ size: 2, rules: bytecode });
+    try {
+      for await (const { file, findings, hash } of pool.scan(files.slice(0, 6), { hash: true })) {
+        const bytes = fs.readFileSync(file);
+        expect(hash).toBe(hashBytes(bytes));
+        expect(findings).toEqual(ruleset.applySource(bytes.toString("utf-8"), "javascript"));
+      }
+      for await (const { hash } of pool.scan(files.slice(0, 1))) expect(hash).toBeUndefined();
+    } finally {
+      await pool.close();
+      ruleset.free();
+    }
+  });
+
+  it("runs patterns and reports unreadable files", async () => {
+    const pool = createPool({ size: 2 });
+    try {
+      const missing = path.join(dir, "missing.js");
+      const results = [];
+      for await (const r of pool.run("eval($X)", [...files, missing], { limit: 1 })) results.push(r);
+      expect(results).toHaveLength(files.length + 1);
+      files.forEach((file, i) => {
+        expect(results[i].matches).toEqual(structMatch("eval($X)", fs.readFileSync(file, "utf-8"), "javascript", { limit: 1 }));
+      });
+      expect(results[files.length].error).toBeDefined();
+    } finally {
+      await pool.close();
+    }
+  });
+
+  it("stops handing out files when iteration ends early", async () => {
+    const pool = createPool({ size: 2 });
+    try {
+      for await (const r of pool.run("eval($X)", files)) {
+        expect(r.file).toBe(files[0]);
+        break;
+      }
+      // The pool stays usable for the next job.
+      let count = 0;
+      for await (const _ of pool.run("eval($X)", files.slice(0, 5))) count++;
+      expect(count).toBe(5);
+    } finally {
+      await pool.close();
+    }
+  });
+});
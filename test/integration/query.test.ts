@@ -0,0 +1,114 @@
+import { describe, it, expect } from "bun:test";
+import { createScanner, loadRules, patternToQuery, QueryError } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import type { Match, RuleDefinition } from "../../src/js/types.js";
+
+const source = `eval(input);
+const el = document.getElementById("out");
+el.innerHTML = render(input);
+setTimeout(() => eval(code), 10);
+foo(bar(1), 2);
+// TODO: drop eval
+`;
+
+const ranges = (ms: Match[]) => ms.map(m => [m.start_byte, m.end_byte]);
+
+describe("tree-sitter queries", () => {
+  it("runs raw queries with captures and predicates", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      const evals = scanner.query(`((call_expression function: (identifier) @_f arguments: (arguments (_) @ARG)) @match (#eq? @_f "eval"))`);
+      expect(evals.map(m => m.bindings.ARG)).toEqual(["input", "code"]);
+      const structural = ranges(scanner.match("eval($X)"));
+      for (const r of ranges(evals)) expect(structural).toContainEqual(r);
+
+      const matched = scanner.query(`((identifier) @id (#match? @id "^set"))`);
+      expect(matched.map(m => m.bindings.id)).toEqual(["setTimeout"]);
+
+      expect(scanner.query("(call_expression) @match", 2)).toHaveLength(2);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("reports query compile errors", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      expect(() => scanner.query("(call_expression")).toThrow(QueryError);
+      let error: unknown;
+      try {
+        scanner.query("(no_such_kind) @match");
+      } catch (e) {
+        error = e;
+      }
+      expect(error).toBeInstanceOf(QueryError);
+      expect((error as QueryError).kind).toBe("node type");
+      expect((error as QueryError).offset).toBeLessThan("(no_such_kind)".length);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("translates patterns with a fixed root kind", () => {
+    expect(patternToQuery("eval($X)", "javascript")).toBe(
+      `((call_expression . (_) @_l0 . (arguments . (_) .) .) @_root (#eq? @_l0 "eval"))`,
+    );
+    expect(patternToQuery("$X", "javascript")).toBeNull();
+  });
+
+  it("rule findings from the query pass equal the structural search", () => {
+    const patterns = ["eval($X)", "$OBJ.innerHTML = $V", "foo($A, $B)", "setTimeout($F, $T)", "$FN($$$ARGS)"];
+    const rules: RuleDefinition[] = [
+      ...patterns.map((pattern, i) => ({ id: `p${i}`, language: "javascript" as const, severity: "warning" as const, message: pattern, rule: { pattern } })),
+      { id: "calls", language: "javascript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+      { id: "comments", language: "javascript", severity: "info", message: "comment", rule: { kind: "comment" } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    const scanner = createScanner(source, "javascript");
+    try {
+      const findings = new Map(ruleset.apply(scanner).map(f => [f.ruleId, ranges(f.matches)]));
+      patterns.forEach((pattern, i) => {
+        expect(findings.get(`p${i}`) ?? []).toEqual(ranges(scanner.match(pattern)));
+      });
+      expect(findings.get("calls")).toEqual(ranges(scanner.matchKind("call_expression")));
+      expect(findings.get("comments")).toHaveLength(1);
+    } finally {
+      scanner.free();
+      ruleset.free();
+    }
+  });
+
+  it("query pass findings equal the walk's across grammars and depths", async () => {
+    // The query is compiled for the first rule's language (javascript).
+    const rules: RuleDefinition[] = [
+      { id: "eval", language: "javascript", severity: "warning", message: "eval", rule: { pattern: "eval($X)" } },
+      { id: "calls", language: "typescript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+      { id: "ids", language: "javascript", severity: "info", message: "identifier", rule: { kind: "identifier" } },
+      { id: "exprs", language: "javascript", severity: "info", message: "supertype", rule: { kind: "expression" } },
+    ];
+    const sources: [string, "javascript" | "typescript"][] = [
+      [source, "javascript"],
+      ["function f(x: number): void { eval(x); g<string>(x as any); }\n", "typescript"],
+      ["[".repeat(250) + "eval(deep)" + "]".repeat(250) + ";\neval(shallow);\n", "javascript"],
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    try {
+      for (const [text, language] of sources) {
+        const scanner = createScanner(text, language);
+        try {
+          const byRule = (fs: { ruleId: string; matches: Match[] }[]) =>
+            Object.fromEntries(rules.map(r => [r.id, ranges(fs.find(f => f.ruleId === r.id)?.matches ?? [])]));
+          const queried = byRule(ruleset.apply(scanner));
+          // applyAsync always walks the tree.
+          expect(queried).toEqual(byRule(await ruleset.applyAsync(scanner)));
+          expect(queried.eval.length).toBeGreaterThan(0);
+          expect(queried.exprs).toEqual([]);
+        } finally {
+          scanner.free();
+        }
+      }
+    } finally {
+      ruleset.free();
+    }
+  });
+});
@@ -0,0 +1,71 @@
+import { describe, it, expect } from "bun:test";
+import { Writable } from "node:stream";
+import { createFindingWriter, type ReportFormat } from "../../src/js/report.js";
+import type { Finding, RuleDefinition } from "../../src/js/types.js";
+
+const rules: RuleDefinition[] = [
+  { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } },
+];
+
+function finding(row: number): Finding {
+  return {
+    ruleId: "no-eval",
+    severity: "error",
+    message: "eval",
+    matches: [{ start_byte: 0, end_byte: 7, start_row: row, start_col: 0, end_row: row, end_col: 7, bindings: { X: "x" } }],
+  };
+}
+
+async function render(format: ReportFormat, files: Array<{ file: string; findings: Finding[] }>): Promise<string> {
+  let text = "";
+  const out = new Writable({
+    write(chunk, _enc, done) {
+      text += String(chunk);
+      done();
+    },
+  });
+  const writer = createFindingWriter(format, out, rules);
+  for (const { file, findings } of files) await writer.file(file, findings, () => "eval(x)\neval(x)");
+  await writer.end(files.length);
+  return text;
+}
+
+const scanned = [
+  { file: "a.js", findings: [finding(0), finding(1)] },
+  { file: "b.js", findings: [] },
+  { file: "c.js", findings: [finding(0)] },
+];
+
+describe("finding writers", () => {
+  it("streams the same json document JSON.stringify gives", async () => {
+    const withFindings = scanned.filter(f => f.findings.length > 0);
+    expect(await render("json", scanned)).toBe(JSON.stringify(withFindings, null, 2) + "\n");
+    expect(await render("json", [])).toBe("[]\n");
+  });
+
+  it("streams sarif results into a valid document", async () => {
+    const doc = JSON.parse(await render("sarif", scanned));
+    expect(doc.version).toBe("2.1.0");
+    expect(doc.runs[0].tool.driver.rules.map((r: { id: string }) => r.id)).toEqual(["no-eval"]);
+    const results = doc.runs[0].results;
+    expect(results).toHaveLength(3);
+    expect(results.map((r: any) => r.locations[0].physicalLocation.artifactLocation.uri)).toEqual(["a.js", "a.js", "c.js"]);
+    expect(results[1].locations[0].physicalLocation.region.startLine).toBe(2);
+    expect(await render("sarif", scanned)).toBe(JSON.stringify(doc, null, 2) + "\n");
+
+    expect(JSON.parse(await render("sarif", [])).runs[0].results).toEqual([]);
+  });
+
+  it("writes one ndjson line per finding", async () => {
+    const lines = (await render("ndjson", scanned)).trimEnd().split("\n").map(l => JSON.parse(l));
+    expect(lines).toHaveLength(3);
+    expect(lines.map(l => l.file)).toEqual(["a.js", "a.js", "c.js"]);
+    expect(lines[2]).toEqual({ file: "c.js", ...finding(0) });
+  });
+
+  it("prints text snippets and a summary", async () => {
+    const text = await render("text", scanned);
+    expect(text).toContain("a.js:2:1: error [no-eval] eval");
+    expect(text.trimEnd().endsWith("3 finding(s) in 3 file(s)")).toBe(true);
+  });
+});
@@ -174,4 +174,128 @@ describe("rule engine end-to-end", () => {
       }
     }
   });
+
+  it("applySource skips rules whose literals are absent", () => {
+    const rules: RuleDefinition[] = [
+      { id: "no-eval", language: "javascript", message: "eval", rule: { pattern: "eval($X)" } },
+      { id: "no-inner-html", language: "javascript", message: "innerHTML", rule: { pattern: "$EL.innerHTML = $V" } },
+      {
+        id: "either",
+        language: "javascript",
+        message: "either",
+        rule: { any: [{ pattern: "eval($X)" }, { pattern: "setTimeout($X)" }] },
+      },
+      { id: "calls", language: "javascript", message: "any call", rule: { kind: "call_expression" } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    try {
+      for (const source of ["eval(x); el.innerHTML = y;", "setTimeout(f);", "const evaluation = 1;", "let x = 1;"]) {
+        const scanner = createScanner(source, "javascript");
+        try {
+          expect(ruleset.applySource(source, "javascript")).toEqual(ruleset.apply(scanner));
+        } finally {
+          scanner.free();
+        }
+      }
+      const ids = ruleset.applySource("eval(x)", "javascript").map(f => f.ruleId);
+      expect(ids).toContain("no-eval");
+      expect(ids).not.toContain("no-inner-html");
+    } finally {
+      ruleset.free();
+    }
+  });
+
+  it("applyMany returns applySource's findings for every source", () => {
+    const rules: RuleDefinition[] = [
+      { id: "no-eval", language: "javascript", message: "eval", rule: { pattern: "eval($X)" } },
+      { id: "calls", language: "javascript", message: "any call", rule: { kind: "call_expression" } },
+      { id: "typed", language: "typescript", message: "annotation", rule: { kind: "type_annotation" } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    try {
+      const sources = [
+        { source: "eval(x); f();", lang: "javascript" as const },
+        { source: "let x = 1;", lang: "javascript" as const },
+        { source: "const s = \"é\"; eval(s);", lang: "javascript" as const },
+        { source: "let n: number = g();", lang: "typescript" as const },
+        { source: "", lang: "javascript" as const },
+      ];
+      const batched = ruleset.applyMany(sources);
+      expect(batched).toHaveLength(sources.length);
+      sources.forEach(({ source, lang }, i) => {
+        expect(batched[i]).toEqual(ruleset.applySource(source, lang));
+      });
+      expect(batched[0].map(f => f.ruleId)).toContain("no-eval");
+      expect(batched[1]).toEqual([]);
+      expect(batched[2][0].matches[0].bindings.X).toBe("s");
+      expect(ruleset.applyMany([])).toEqual([]);
+    } finally {
+      ruleset.free();
+    }
+  });
+
+  it("applyMany takes bytes and readers, and skips binary or malformed sources", () => {
+    const rules: RuleDefinition[] = [
+      { id: "no-eval", language: "javascript", message: "eval", rule: { pattern: "eval($X)" } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    try {
+      const text = "const s = \"é\"; eval(s);";
+      const bytes = new TextEncoder().encode(text);
+      const reader = {
+        size: bytes.length + 8,
+        read(dest: Uint8Array): number {
+          dest.set(bytes);
+          return bytes.length;
+        },
+        lang: "javascript" as const,
+      };
+      const results = ruleset.applyMany([
+        { source: bytes, lang: "javascript" },
+        reader,
+        { source: "eval(a);\0", lang: "javascript" },
+        { source: new Uint8Array([...new TextEncoder().encode("eval(b);"), 0xff]), lang: "javascript" },
+      ]);
+      const expected = ruleset.applySource(text, "javascript");
+      expect(expected).toHaveLength(1);
+      expect(results[0]).toEqual(expected);
+      expect(results[1]).toEqual(expected);
+      expect(results[2]).toEqual([]);
+      expect(results[3]).toEqual([]);
+    } finally {
+      ruleset.free();
+    }
+  });
+
+  it("applyMany applies saved tree snapshots like the parsed source", () => {
+    const rules: RuleDefinition[] = [
+      { id: "no-eval", language: "javascript", message: "eval", rule: { pattern: "eval($X)" } },
+      { id: "calls", language: "javascript", message: "any call", rule: { kind: "call_expression" } },
+      { id: "follows", language: "javascript", message: "after let", rule: { all: [{ kind: "expression_statement" }, { follows: { kind: "lexical_declaration" } }] } },
+    ];
+    const ruleset = loadRules(encodeRules(rules));
+    try {
+      const sources = [
+        { source: "let s = \"é\";\neval(s);\n  f(g(1));", lang: "javascript" as const },
+        { source: "function f() { return eval(a) }", lang: "javascript" as const },
+        { source: "eval(((", lang: "javascript" as const },
+      ];
+      const saved: Uint8Array[] = [];
+      const parsed = ruleset.applyMany(sources, { onSnapshot: (i, snapshot) => { saved[i] = snapshot; } });
+      expect(saved.filter(Boolean)).toHaveLength(sources.length);
+
+      const flat = ruleset.applyMany(sources.map((s, i) => ({ ...s, snapshot: saved[i] })));
+      expect(flat).toEqual(parsed);
+      expect(new Set(flat[0].map(f => f.ruleId))).toEqual(new Set(["no-eval", "calls", "follows"]));
+
+      // A snapshot of other content, or one that is not a snapshot at all, is parsed over.
+      const stale = ruleset.applyMany([
+        { ...sources[1], snapshot: saved[0] },
+        { ...sources[0], snapshot: new Uint8Array(64).fill(7) },
+      ]);
+      expect(stale).toEqual([parsed[1], parsed[0]]);
+    } finally {
+      ruleset.free();
+    }
+  });
 });
@@ -0,0 +1,69 @@
+import { describe, it, expect } from "bun:test";
+import { createScanner, loadRules, type SgNode } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+const source = `// entry point
+function run(a) { foo(a); bar(1, 2); }
+const x = foo(b);
+foo(c);
+if (x) { foo(d); } // TODO tidy
+`;
+
+const rules: RuleDefinition[] = [
+  { id: "foo", language: "javascript", severity: "warning", message: "foo", rule: { pattern: "foo($A)" } },
+  { id: "calls", language: "javascript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+  { id: "todo", language: "javascript", severity: "info", message: "todo", rule: { regex: "TODO" } },
+  { id: "second", language: "javascript", severity: "info", message: "2nd", rule: { nthChild: 1 } },
+  {
+    id: "foo-in-fn",
+    language: "javascript",
+    severity: "error",
+    message: "foo inside function",
+    rule: { all: [{ pattern: "foo($A)" }, { inside: { kind: "function_declaration" }, stopBy: "end" }] },
+  },
+];
+
+/** Every node reachable from `node`, depth-first, as kind@range plus neighbours. */
+function walk(node: SgNode, out: string[] = []): string[] {
+  const r = node.range();
+  out.push(`${node.kind()}@${r.startByte}-${r.endByte} p=${node.parent()?.kind() ?? "-"} n=${node.next()?.kind() ?? "-"} v=${node.prev()?.kind() ?? "-"}`);
+  for (const child of node.children()) walk(child, out);
+  return out;
+}
+
+function observe(snapshot: boolean, text = source) {
+  const ruleset = loadRules(encodeRules(rules));
+  const scanner = createScanner(text, "javascript", { snapshot });
+  try {
+    return {
+      match: scanner.match("foo($A)"),
+      kinds: scanner.matchKind("call_expression"),
+      findings: ruleset.apply(scanner),
+      tree: walk(scanner.root()),
+    };
+  } finally {
+    scanner.free();
+    ruleset.free();
+  }
+}
+
+describe("tree snapshots", () => {
+  it("matching, rules and navigation agree with the tree walk", () => {
+    const walked = observe(false);
+    expect(walked.match.length).toBeGreaterThanOrEqual(4);
+    expect(observe(true)).toEqual(walked);
+  });
+
+  it("stays in step with edits", () => {
+    const edited = source.replace("foo(c);", "foo(c); foo(e);");
+    const scanner = createScanner(source, "javascript", { snapshot: true });
+    try {
+      expect(scanner.edit(edited)).toBe(true);
+      expect(scanner.match("foo($A)")).toEqual(observe(false, edited).match);
+      expect(walk(scanner.root())).toEqual(observe(false, edited).tree);
+    } finally {
+      scanner.free();
+    }
+  });
+});
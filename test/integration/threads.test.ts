@@ -0,0 +1,60 @@
+import { describe, it, expect } from "bun:test";
+import * as fs from "node:fs";
+import { loadRules } from "../../src/js/index.js";
+import { encodeRules } from "../../src/js/encoder.js";
+import { createThreadedRuleset } from "../../src/js/threads.js";
+import type { RuleDefinition } from "../../src/js/types.js";
+
+// The threaded engine is a separate build output (zig build).
+const wasmUrl = new URL("../../dist/engine-threads.wasm", import.meta.url);
+const built = fs.existsSync(wasmUrl);
+
+const rules: RuleDefinition[] = [
+  { id: "no-eval", language: "javascript", severity: "error", message: "eval", rule: { pattern: "eval($X)" } },
+  { id: "inner-html", language: "javascript", severity: "warning", message: "innerHTML", rule: { pattern: "$EL.innerHTML = $V" } },
+  { id: "timeout", language: "javascript", severity: "info", message: "setTimeout", rule: { pattern: "setTimeout($F, $T)" } },
+  { id: "calls", language: "javascript", severity: "info", message: "call", rule: { kind: "call_expression" } },
+  { id: "decl-eval", language: "javascript", severity: "error", message: "eval in a declaration", rule: { all: [{ pattern: "eval($X)" }, { inside: { kind: "lexical_declaration" } }] } },
+];
+
+const source = Array.from({ length: 30 }, (_, i) =>
+  i % 3 === 0 ? `eval(a${i});\nel.innerHTML = x${i};` : i % 3 === 1 ? `const v${i} = eval(b${i});` : `setTimeout(f${i}, ${i});`,
+).join("\n");
+
+describe.skipIf(!built)("threaded engine", () => {
+  it("splits rules across threads with the same findings as applySource", async () => {
+    const bytecode = encodeRules(rules);
+    const ruleset = loadRules(bytecode);
+    const expected = ruleset.applySource(source, "javascript");
+    ruleset.free();
+
+    for (const threads of [1, 2, 3, 8]) {
+      const threaded = await createThreadedRuleset({ rules: bytecode, threads, wasmUrl });
+      try {
+        expect(threaded.threads).toBe(threads);
+        expect(await threaded.apply(source, "javascript")).toEqual(expected);
+        // The source handle is freed after each apply, so applies can repeat.
+        expect(await threaded.apply(source, "javascript")).toEqual(expected);
+      } finally {
+        await threaded.close();
+      }
+    }
+  });
+
+  it("runs overlapping applies one at a time", async () => {
+    const threaded = await createThreadedRuleset({ rules: encodeRules(rules), threads: 4, wasmUrl });
+    try {
+      const [a, b, none] = await Promise.all([
+        threaded.apply("eval(x);", "javascript"),
+        threaded.apply("setTimeout(f, 1);", "javascript"),
+        threaded.apply("let y = 1;", "javascript"),
+      ]);
+      expect(a.map(f => f.ruleId)).toEqual(["no-eval", "calls"]);
+      expect(b.map(f => f.ruleId)).toEqual(["timeout", "calls"]);
+      expect(none).toEqual([]);
+    } finally {
+      await threaded.close();
+    }
+    await expect(threaded.apply("eval(x);", "javascript")).rejects.toThrow();
+  });
+});
@@ -1,5 +1,5 @@
 import { describe, it, expect } from "bun:test";
-import { createScanner, SgNode } from "../../src/js/ts/index.js";
+import { createScanner, SgNode } from "../../src/js/index.js";
 
 describe("tree traversal (SgNode)", () => {
   const source = `const x = eval(input);
@@ -189,6 +189,21 @@ const y = "hello";`;
     }
   });
 
+  it("matches() with exact tests only the node itself", () => {
+    const scanner = createScanner("eval(input);", "javascript");
+    try {
+      const root = scanner.root();
+      // The statement below spans the whole program, so the subtree test passes.
+      expect(root.matches("eval($X)")).toBe(true);
+      expect(root.matches("eval($X)", { exact: true })).toBe(false);
+      const call = root.find("eval($X)")!;
+      expect(call.matches("eval($X)", { exact: true })).toBe(true);
+      expect(call.matches("console.log($X)", { exact: true })).toBe(false);
+    } finally {
+      scanner.free();
+    }
+  });
+
   it("text() returns correct source for deep nodes", () => {
     const scanner = createScanner("const x = 42;", "javascript");
     try {
@@ -266,4 +281,83 @@ const y = "hello";`;
       scanner.free();
     }
   });
+
+  it("nodes carry stable ids that navigation round-trips", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      const root = scanner.root();
+      expect(root.id()).toBe(0);
+      const kids = root.children();
+      kids.forEach((kid, i) => {
+        expect(root.child(i)!.id()).toBe(kid.id());
+        expect(kid.parent()!.id()).toBe(root.id());
+      });
+      const [first, second] = root.namedChildren();
+      expect(first.next()!.id()).toBe(second.id());
+      expect(second.prev()!.id()).toBe(first.id());
+      expect(first.prev()).toBeNull();
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("resolves kinds for anonymous tokens and ERROR nodes", () => {
+    const scanner = createScanner("foo(;", "javascript");
+    try {
+      const kinds: string[] = [];
+      const visit = (n: SgNode) => { kinds.push(n.kind()); n.children().forEach(visit); };
+      visit(scanner.root());
+      expect(kinds).toContain("(");
+      expect(kinds).toContain("ERROR");
+      expect(kinds.every(k => k.length > 0)).toBe(true);
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("dumpTree flattens a subtree in preorder", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      const expected: SgNode[] = [];
+      const visit = (n: SgNode, depth: number) => {
+        if (depth > 2) return;
+        expected.push(n);
+        n.namedChildren().forEach(c => visit(c, depth + 1));
+      };
+      visit(scanner.root(), 0);
+
+      const dump = scanner.dumpTree(undefined, { namedOnly: true, maxDepth: 2 });
+      expect(dump.length).toBe(expected.length);
+      expected.forEach((n, i) => {
+        expect(dump.id[i]).toBe(n.id());
+        expect(dump.kindName(dump.kind[i])).toBe(n.kind());
+        expect(dump.named[i]).toBe(1);
+        expect(dump.startByte[i]).toBe(n.range().startByte);
+        expect(dump.endByte[i]).toBe(n.range().endByte);
+        const p = dump.parent[i];
+        expect(p === -1 ? null : dump.id[p]).toBe(i === 0 ? null : n.parent()!.id());
+      });
+      // Sibling links enumerate the root's children.
+      const rows: number[] = [];
+      for (let c = dump.firstChild[0]; c !== -1; c = dump.nextSibling[c]) rows.push(c);
+      expect(rows.map(r => dump.id[r])).toEqual(scanner.root().namedChildren().map(n => n.id()));
+    } finally {
+      scanner.free();
+    }
+  });
+
+  it("dumpTree starts at a given node", () => {
+    const scanner = createScanner(source, "javascript");
+    try {
+      const fn = scanner.root().namedChildren().find(n => n.kind() === "function_declaration")!;
+      const dump = scanner.dumpTree(fn);
+      expect(dump.id[0]).toBe(fn.id());
+      expect(dump.parent[0]).toBe(-1);
+      expect(dump.kindName(dump.kind[0])).toBe("function_declaration");
+      expect(Array.from(dump.startByte).every(b => b >= fn.range().startByte)).toBe(true);
+      expect(Array.from(dump.named)).toContain(0);
+    } finally {
+      scanner.free();
+    }
+  });
 });
@@ -0,0 +1,105 @@
+import { describe, it, expect, beforeEach, afterEach } from "bun:test";
+import * as fs from "node:fs";
+import * as os from "node:os";
+import * as path from "node:path";
+import { patternLiterals } from "../../src/js/index.js";
+import { updateTrigramIndex, openTrigramIndex, indexedCandidates, trigramsOf } from "../../src/js/trigrams.js";
+
+let dir: string;
+let indexDir: string;
+let files: string[];
+
+const sources: Record<string, string> = {
+  "a.js": "el.innerHTML = html;",
+  "b.js": "eval(input);",
+  "c.js": "const evaluation = 1; el.textContent = x;",
+  "d.ts": "function f(): void { eval(code) }",
+};
+
+beforeEach(() => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), "codesift-trigrams-"));
+  indexDir = path.join(dir, ".index");
+  const old = Date.now() / 1000 - 60;
+  files = Object.entries(sources).map(([name, text]) => {
+    const file = path.join(dir, name);
+    fs.writeFileSync(file, text);
+    // Older than the racy window, so their stats are trusted.
+    fs.utimesSync(file, old, old);
+    return file;
+  });
+});
+
+afterEach(() => {
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+async function candidates(literals: string[]): Promise<string[] | null> {
+  const index = await openTrigramIndex(indexDir);
+  expect(index).not.toBeNull();
+  try {
+    const found = await index!.candidates(literals);
+    return found && [...found].map(f => path.basename(f)).sort();
+  } finally {
+    await index!.close();
+  }
+}
+
+async function collect(items: AsyncIterable<string>): Promise<string[]> {
+  const out: string[] = [];
+  for await (const item of items) out.push(path.basename(item));
+  return out;
+}
+
+describe("trigram index", () => {
+  it("extracts each distinct trigram once", () => {
+    const trigrams = trigramsOf(new TextEncoder().encode("abcabcab"));
+    expect([...trigrams].sort()).toEqual([0x616263, 0x626361, 0x636162]);
+    expect(trigramsOf(new TextEncoder().encode("ab"))).toHaveLength(0);
+  });
+
+  it("reports patternLiterals for a pattern", () => {
+    expect(patternLiterals("$EL.innerHTML = $V", "javascript")).toEqual(["innerHTML"]);
+    expect(patternLiterals("$X", "javascript")).toEqual([]);
+  });
+
+  it("narrows a query to files holding every literal", async () => {
+    expect(await updateTrigramIndex(indexDir, files)).toEqual({ files: 4, indexed: 4 });
+    expect(await candidates(["eval"])).toEqual(["b.js", "c.js", "d.ts"]);
+    expect(await candidates(["eval", "input"])).toEqual(["b.js"]);
+    expect(await candidates(["innerHTML"])).toEqual(["a.js"]);
+    expect(await candidates(["missing"])).toEqual([]);
+    // Literals too short for a trigram rule nothing out.
+    expect(await candidates(["el"])).toBeNull();
+  });
+
+  it("reindexes only changed files and drops removed ones", async () => {
+    await updateTrigramIndex(indexDir, files);
+    fs.writeFileSync(files[0], "el.outerHTML = html;");
+    fs.utimesSync(files[1], Date.now() / 1000 - 30, Date.now() / 1000 - 30);
+    expect(await updateTrigramIndex(indexDir, files.slice(0, 3))).toEqual({ files: 3, indexed: 1 });
+    expect(await candidates(["innerHTML"])).toEqual([]);
+    expect(await candidates(["outerHTML"])).toEqual(["a.js"]);
+    expect(await candidates(["eval"])).toEqual(["b.js", "c.js"]);
+  });
+
+  it("passes through files the index does not cover", async () => {
+    await updateTrigramIndex(indexDir, files.slice(0, 3));
+    const extra = path.join(dir, "e.js");
+    fs.writeFileSync(extra, "const x = 1;");
+    fs.appendFileSync(files[0], " eval(y);");
+
+    const index = (await openTrigramIndex(indexDir))!;
+    try {
+      const kept = await collect(indexedCandidates([...files, extra], index, () => ["eval"]));
+      // a.js changed since indexing and d.ts, e.js were never indexed.
+      expect(kept).toEqual(["a.js", "b.js", "c.js", "d.ts", "e.js"]);
+      expect(await collect(indexedCandidates(files.slice(1, 3), index, () => ["input"]))).toEqual(["b.js"]);
+    } finally {
+      await index.close();
+    }
+  });
+
+  it("has no index until one is built", async () => {
+    expect(await openTrigramIndex(indexDir)).toBeNull();
+  });
+});
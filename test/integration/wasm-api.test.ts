@@ -1,5 +1,5 @@
 import { describe, it, expect } from "bun:test";
-import { structMatch, compilePattern, matchPattern, freePattern, createScanner, type Match, type RichMatch } from "../../src/js/index.js";
+import { structMatch, compilePattern, matchPattern, freePattern, createScanner, loadRules, encodeRules, patternCacheStats, type Match, type RichMatch } from "../../src/js/index.js";
 
 describe("structMatch()", () => {
   it("finds eval($X) pattern in source", () => {
@@ -24,6 +24,16 @@ describe("structMatch()", () => {
     expect(matches.some((m) => m.bindings.X === "dangerous")).toBe(true);
   });
 
+  it("stops at the match limit", () => {
+    const source = "eval(a); eval(b); eval(c);";
+    expect(structMatch("eval($X)", source, "javascript")).toHaveLength(3);
+    const first = structMatch("eval($X)", source, "javascript", { limit: 1 });
+    expect(first).toHaveLength(1);
+    expect(first[0].bindings.X).toBe("a");
+    const two = structMatch("eval($X)", source, "javascript", { limit: 2 });
+    expect(two.map(m => m.bindings.X)).toEqual(["a", "b"]);
+  });
+
   it("returns no matches for non-matching pattern", () => {
     const matches = structMatch(
       "eval($X)",
@@ -145,6 +155,41 @@ describe("compilePattern / matchPattern / freePattern", () => {
     freePattern(999);
   });
 
+  it("shares one parse of a pattern across every entry point", () => {
+    const pattern = "cacheProbe($X, 1)";
+    const before = patternCacheStats().parses;
+    for (let i = 0; i < 50; i++) structMatch(pattern, `cacheProbe(a${i}, 1)`, "javascript");
+
+    const h1 = compilePattern(pattern, "javascript");
+    const h2 = compilePattern(pattern, "javascript");
+    expect(h1).toBe(h2);
+    const scanner = createScanner("cacheProbe(b, 1)", "javascript");
+    const ruleset = loadRules(encodeRules([
+      { id: "a", language: "javascript", severity: "info", message: "a", rule: { pattern } },
+      { id: "b", language: "javascript", severity: "info", message: "b", rule: { pattern } },
+    ]));
+    try {
+      expect(scanner.match(pattern).length).toBeGreaterThan(0);
+      expect(scanner.root().findAll(pattern).length).toBeGreaterThan(0);
+      expect(ruleset.apply(scanner)).toHaveLength(2);
+      expect(patternCacheStats().parses).toBe(before + 1);
+    } finally {
+      ruleset.free();
+      scanner.free();
+      freePattern(h1);
+      freePattern(h2);
+    }
+  });
+
+  it("evicts unreferenced patterns when the cache is full", () => {
+    for (let i = 0; i < 100; i++) {
+      const h = compilePattern(`evictProbe${i}($X)`, "javascript");
+      expect(h).toBeGreaterThan(0);
+      freePattern(h);
+    }
+    expect(patternCacheStats().cached).toBeLessThanOrEqual(64);
+  });
+
   it("can compile multiple patterns simultaneously", () => {
     const h1 = compilePattern("eval($X)", "javascript");
     const h2 = compilePattern("$OBJ.$METHOD($ARG)", "javascript");
@@ -206,6 +251,15 @@ describe("createScanner()", () => {
     s.free();
   });
 
+  it("limits matches and answers exists()", () => {
+    const s = createScanner("eval(a); eval(b); eval(c);", "javascript");
+    expect(s.match("eval($X)", 2).map(m => m.bindings.X)).toEqual(["a", "b"]);
+    expect(s.match("eval($X)")).toHaveLength(3);
+    expect(s.exists("eval($X)")).toBe(true);
+    expect(s.exists("fetch($X)")).toBe(false);
+    s.free();
+  });
+
   it("exposes source and language properties", () => {
     const s = createScanner("eval(x)", "javascript");
     expect(s.source).toBe("eval(x)");
@@ -331,3 +385,26 @@ describe("scanner.scanAll()", () => {
     s.free();
   });
 });
+
+describe("source ingestion", () => {
+  it("round-trips non-ASCII source text through WASM memory", () => {
+    const src = 'const s = "héllo 🌍 \ud800"; eval(s);\nlog("日本語");';
+    const s = createScanner(src, "javascript");
+    try {
+      // Lone surrogates are written as U+FFFD, exactly like TextEncoder.
+      expect(s.root().text()).toBe(new TextDecoder().decode(new TextEncoder().encode(src)));
+      const hits = s.scanAll(["log($X)"]);
+      expect(hits.length).toBe(1);
+      expect(hits[0].text).toBe('log("日本語")');
+      expect(hits[0].bindings.X).toBe('"日本語"');
+    } finally {
+      s.free();
+    }
+  });
+
+  it("matches non-ASCII sources without a scanner", () => {
+    const matches = structMatch("eval($X)", "/* ünïcode */ eval(ß)", "javascript");
+    expect(matches.length).toBe(1);
+    expect(matches[0].bindings.X).toBe("ß");
+  });
+});